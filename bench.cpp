@@ -0,0 +1,1468 @@
+///
+/// \file bench.cpp
+/// \brief Command line benchmarks
+///
+
+#include "bench.h"
+#include "bilateral.h"
+#include "blur.h"
+#include "color_matrix.h"
+#include "components.h"
+#include "convolve.h"
+#include "fill.h"
+#include "gradient.h"
+#include "histogram.h"
+#include "integral.h"
+#include "layers.h"
+#include "lut3d.h"
+#include "mask.h"
+#include "median.h"
+#include "morphology.h"
+#include "palette.h"
+#include "ppm.h"
+#include "numa.h"
+#include "resample.h"
+#include "srgb.h"
+#include "thread_pool.h"
+#include "tiled.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+///This will return the seconds elapsed since start
+///
+/// \param start the time the measurement began
+/// \return the elapsed time in seconds
+///
+static double seconds_since(const std::chrono::steady_clock::time_point &start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+///This will run a 3-tap horizontal mean over every channel of src into dst
+///with parallel_for, split into row bands the way the image kernels are.
+///Under first touch placement each band runs on the pinned worker that
+///first touched its rows.
+///
+/// \param src the input image
+/// \param dst the output image, same size as src
+///
+static void band_filter(const ppm<> &src, ppm<> &dst) {
+	for (unsigned int c = 0; c < 3; ++c) {
+		parallel_for(0, src.height, 16, [&](unsigned int y0, unsigned int y1) {
+			for (unsigned int y = y0; y < y1; ++y) {
+				const unsigned char *in = src.view(c).row(y);
+				unsigned char *out = dst.view(c).row(y);
+				const unsigned int w = src.width;
+				out[0] = in[0];
+				for (unsigned int x = 1; x + 1 < w; ++x)
+					out[x] = (unsigned char)((in[x - 1] + in[x] + in[x + 1] + 1) / 3);
+				out[w - 1] = in[w - 1];
+			}
+		});
+	}
+}
+
+///This will compare page placement strategies for large rasters: the time
+///to create (fault in and clear) a source and destination image and the
+///time of a full-image filter pass over them.
+///
+/// \param argc the number of options
+/// \param args the options: [width] [height]
+/// \return 0
+///
+static int bench_alloc(int argc, char **args) {
+	const unsigned int width = argc > 0 ? (unsigned int)std::atoi(args[0]) : 8192;
+	const unsigned int height = argc > 1 ? (unsigned int)std::atoi(args[1]) : 8192;
+	struct config {
+		const char *name;
+		bool huge_pages;
+		numa_placement placement;
+	};
+	const config configs[] = {
+		{ "4K pages", false, placement_default },
+		{ "huge pages", true, placement_default },
+		{ "huge + interleave", true, placement_interleave },
+		{ "huge + first touch", true, placement_first_touch },
+	};
+	std::cout << width << "x" << height << " RGB, " << thread_pool::global().size() << " threads, "
+		<< numa_node_count() << " NUMA node(s)" << std::endl;
+	std::cout << std::left << std::setw(22) << "placement" << std::setw(14) << "create (ms)"
+		<< std::setw(14) << "filter (ms)" << "GB/s" << std::endl;
+	buffer_pool &pool = buffer_pool::instance();
+	for (unsigned int i = 0; i < sizeof(configs) / sizeof(configs[0]); ++i) {
+		pool.set_huge_pages(configs[i].huge_pages);
+		pool.set_placement(configs[i].placement);
+		double create;
+		double filter = 1e30;
+		{
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			ppm<> src(width, height);
+			ppm<> dst(width, height);
+			create = seconds_since(start);
+			for (int run = 0; run < 3; ++run) {
+				start = std::chrono::steady_clock::now();
+				band_filter(src, dst);
+				filter = std::min(filter, seconds_since(start));
+			}
+		}
+		//the images went back to the pool; drop them so the next config maps fresh pages
+		pool.trim();
+		const double bytes = 2.0 * 3.0 * width * height;
+		std::cout << std::left << std::setw(22) << configs[i].name << std::setw(14) << std::fixed
+			<< std::setprecision(1) << create * 1000.0 << std::setw(14) << filter * 1000.0
+			<< std::setprecision(2) << bytes / filter / 1e9 << std::endl;
+	}
+	pool.set_huge_pages(false);
+	pool.set_placement(placement_default);
+	return 0;
+}
+
+///This will enlarge an image by an integer factor, repeating pixels
+///
+/// \param src the image
+/// \param factor the scale factor
+/// \return the enlarged image
+///
+static ppm<> upscale_nearest(const ppm<> &src, unsigned int factor) {
+	ppm<> dst(src.width * factor, src.height * factor, uninitialized);
+	parallel_for(0, dst.height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			for (unsigned int y = y0; y < y1; ++y) {
+				const unsigned char *in = src.view(c).row(y / factor);
+				unsigned char *out = dst.view(c).row(y);
+				for (unsigned int x = 0; x < dst.width; ++x)
+					out[x] = in[x / factor];
+			}
+		}
+	});
+	return dst;
+}
+
+///This will time the thread pool on the stages every image goes through:
+///deinterleaving a raw PPM raster, converting to float, transposing, and
+///staging packed RGB for display, on an image upscaled from a data file,
+///for every thread count from 1 to the number of hardware threads.
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [factor]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_scaling(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const unsigned int factor = argc > 1 ? (unsigned int)std::atoi(args[1]) : 8;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	ppm<> img = upscale_nearest(small, factor > 0 ? factor : 1);
+	pixel_buffer<unsigned char> raw((size_t)img.size * 3, uninitialized);
+	interleave(rgb_view<const unsigned char>(img.view()), raw.data(), (size_t)3 * img.width);
+	ppm<> loaded(img.width, img.height, uninitialized);
+	ppm<> transposed(img.height, img.width, uninitialized);
+	ppm<float> linear;
+
+	std::cout << fileName << " x" << factor << " = " << img.width << "x" << img.height << std::endl;
+	std::cout << std::left << std::setw(10) << "threads" << std::setw(16) << "deinterleave" << std::setw(16)
+		<< "to float" << std::setw(16) << "transpose" << std::setw(16) << "stage RGB24" << "speedup" << std::endl;
+	thread_pool &pool = thread_pool::global();
+	const unsigned int max_threads = pool.size();
+	double base = 0.0;
+	for (unsigned int n = 1; n <= max_threads; ++n) {
+		pool.resize(n);
+		double t[4] = { 1e30, 1e30, 1e30, 1e30 };
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			deinterleave<1>(raw.data(), loaded, loaded.size, 0);
+			t[0] = std::min(t[0], seconds_since(start));
+			start = std::chrono::steady_clock::now();
+			linear = to_float(loaded);
+			t[1] = std::min(t[1], seconds_since(start));
+			start = std::chrono::steady_clock::now();
+			for (unsigned int c = 0; c < 3; ++c)
+				transpose_blocked<unsigned char, 64>(loaded.view(c), transposed.view(c));
+			t[2] = std::min(t[2], seconds_since(start));
+			start = std::chrono::steady_clock::now();
+			interleave(rgb_view<const unsigned char>(loaded.view()), raw.data(), (size_t)3 * loaded.width);
+			t[3] = std::min(t[3], seconds_since(start));
+		}
+		const double total = t[0] + t[1] + t[2] + t[3];
+		if (n == 1)
+			base = total;
+		std::cout << std::left << std::setw(10) << n << std::fixed << std::setprecision(1);
+		for (int i = 0; i < 4; ++i)
+			std::cout << std::setw(16) << t[i] * 1000.0;
+		std::cout << std::setprecision(2) << base / total << "x" << std::endl;
+	}
+	pool.resize(max_threads);
+	return 0;
+}
+
+///This will blur the top rows of a plane with a full 2D Gaussian kernel,
+///the way a non-separable filter would, as the baseline for bench_blur
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, not src
+/// \param sigma the standard deviation in pixels
+/// \param rows the number of rows to compute
+///
+static void blur_naive(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst, float sigma,
+	unsigned int rows) {
+	const std::vector<float> w = gaussian_kernel(sigma);
+	const int r = (int)w.size() - 1;
+	const int width = (int)src.width;
+	const int height = (int)src.height;
+	parallel_for(0, rows, 4, [&](unsigned int y0, unsigned int y1) {
+		for (int y = (int)y0; y < (int)y1; ++y) {
+			for (int x = 0; x < width; ++x) {
+				float acc = 0.0f;
+				for (int j = -r; j <= r; ++j) {
+					const int yy = std::min(std::max(y + j, 0), height - 1);
+					const unsigned char *in = src.row(yy);
+					const float wy = w[j < 0 ? -j : j];
+					for (int i = -r; i <= r; ++i) {
+						const int xx = std::min(std::max(x + i, 0), width - 1);
+						acc += wy * w[i < 0 ? -i : i] * in[xx];
+					}
+				}
+				dst(x, y) = (unsigned char)std::min(acc + 0.5f, 255.0f);
+			}
+		}
+	});
+}
+
+///This will time the Gaussian blur methods against a naive 2D convolution
+///on every channel of an image upscaled from a data file; how close they
+///come to each other is checked by the blur tests
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [sigma]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_blur(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const float sigma = argc > 1 ? (float)std::atof(args[1]) : 3.0f;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	ppm<> out(img.width, img.height, uninitialized);
+	const rgb_view<const unsigned char> src(img.view());
+	const unsigned int naive_rows = std::min(img.height, 256u);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", sigma " << sigma
+		<< ", " << thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(14) << "method" << std::setw(14) << "time (ms)" << "MPixel/s" << std::endl;
+	struct method {
+		const char *name;
+		blur_method value;
+	};
+	const method methods[] = {
+		{ "separable", blur_direct },
+		{ "naive 2D", blur_auto },
+		{ "box x3", blur_box },
+		{ "recursive", blur_iir },
+	};
+	for (unsigned int i = 0; i < sizeof(methods) / sizeof(methods[0]); ++i) {
+		//the naive convolution is slow; it runs once on the top rows and its time is scaled up
+		const int runs = i == 1 ? 1 : 3;
+		double t = 1e30;
+		for (int run = 0; run < runs; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (i == 1) {
+				for (unsigned int c = 0; c < 3; ++c)
+					blur_naive(src[c], out.view(c), sigma, naive_rows);
+			}
+			else
+				gaussian_blur(src, rgb_view<unsigned char>(out.view()), sigma, methods[i].value);
+			t = std::min(t, seconds_since(start));
+		}
+		if (i == 1)
+			t = t * img.height / naive_rows;
+		std::cout << std::left << std::setw(14) << methods[i].name << std::setw(14) << std::fixed
+			<< std::setprecision(1) << t * 1000.0 << img.size / t / 1e6 << std::endl;
+	}
+	return 0;
+}
+
+///This will time the direct and FFT convolution paths on box kernels of
+///several sizes next to a plain copy of the image, which bounds what
+///memory bandwidth allows, and show which path convolve_auto picks and
+///where the cost model puts the crossover
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [size]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_convolve(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const unsigned int size = argc > 1 ? (unsigned int)std::atoi(args[1]) : 63;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	ppm<> out(img.width, img.height, uninitialized);
+	const rgb_view<const unsigned char> src(img.view());
+
+	double t = 1e30;
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned int c = 0; c < 3; ++c)
+			copy(src[c], out.view(c));
+		t = std::min(t, seconds_since(start));
+	}
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", "
+		<< thread_pool::global().size() << " threads, copy " << std::fixed << std::setprecision(1)
+		<< t * 1000.0 << " ms (" << std::setprecision(2) << 2.0 * 3.0 * img.size / t / 1e9 << " GB/s)" << std::endl;
+	std::cout << std::left << std::setw(10) << "kernel" << std::setw(14) << "direct (ms)"
+		<< std::setw(14) << "fft (ms)" << "auto" << std::endl;
+	const unsigned int sizes[] = { 3, 5, 9, 15, 31, size };
+	for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+		const unsigned int n = sizes[i];
+		const kernel2d k = kernel2d(n, n, std::vector<float>((size_t)n * n, 1.0f).data()).normalized();
+		double times[2] = { 1e30, 1e30 };
+		const convolve_method methods[2] = { convolve_direct, convolve_fft };
+		for (int m = 0; m < 2; ++m) {
+			for (int run = 0; run < 2; ++run) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				convolve(src, rgb_view<unsigned char>(out.view()), k, 0.0f, methods[m]);
+				times[m] = std::min(times[m], seconds_since(start));
+			}
+		}
+		const std::string name = std::to_string(n) + "x" + std::to_string(n);
+		std::cout << std::left << std::setw(10) << name << std::setw(14) << std::fixed << std::setprecision(1)
+			<< times[0] * 1000.0 << std::setw(14) << times[1] * 1000.0
+			<< (convolve_prefers_fft(img.width, img.height, k) ? "fft" : "direct") << std::endl;
+	}
+	//the smallest square kernel the cost model sends to the FFT, to hold against the measured crossover
+	unsigned int crossover = 1;
+	while (crossover < 1024 && !convolve_prefers_fft(img.width, img.height, kernel2d(crossover, crossover)))
+		crossover += 2;
+	std::cout << "cost model switches to fft at " << crossover << "x" << crossover << std::endl;
+	return 0;
+}
+
+///This will time each resampling filter shrinking an upscaled image by a
+///factor and enlarging the result back.  Rates count the large image's
+///pixels both ways: the ones read by the shrink, written by the enlargement.
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [factor]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_resample(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const float factor = argc > 1 ? (float)std::atof(args[1]) : 3.0f;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const unsigned int w = std::max((unsigned int)(img.width / std::max(factor, 1.0f)), 1u);
+	const unsigned int h = std::max((unsigned int)(img.height / std::max(factor, 1.0f)), 1u);
+	ppm<> shrunk(w, h, uninitialized);
+	ppm<> enlarged(img.width, img.height, uninitialized);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << " <-> " << w << "x" << h << ", "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(12) << "filter" << std::setw(14) << "down (ms)" << std::setw(16)
+		<< "down MPixel/s" << std::setw(12) << "up (ms)" << "up MPixel/s" << std::endl;
+	const char *names[] = { "box", "bilinear", "bicubic", "lanczos3" };
+	const resample_filter filters[] = { resample_box, resample_bilinear, resample_bicubic, resample_lanczos3 };
+	for (unsigned int i = 0; i < 4; ++i) {
+		double t[2] = { 1e30, 1e30 };
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			resample(rgb_view<const unsigned char>(img.view()), rgb_view<unsigned char>(shrunk.view()), filters[i]);
+			t[0] = std::min(t[0], seconds_since(start));
+			start = std::chrono::steady_clock::now();
+			resample(rgb_view<const unsigned char>(shrunk.view()), rgb_view<unsigned char>(enlarged.view()), filters[i]);
+			t[1] = std::min(t[1], seconds_since(start));
+		}
+		std::cout << std::left << std::setw(12) << names[i] << std::fixed << std::setprecision(1)
+			<< std::setw(14) << t[0] * 1000.0 << std::setw(16) << img.size / t[0] / 1e6
+			<< std::setw(12) << t[1] * 1000.0 << enlarged.size / t[1] / 1e6 << std::endl;
+	}
+	return 0;
+}
+
+///This will time decoding an image from sRGB to linear light and encoding
+///it back, once with pow() per sample and once with the tables, and time a
+///resize done in linear light against one on the sRGB samples directly
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_srgb(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	ppm<float> linear(img.width, img.height, uninitialized);
+	ppm<> out(img.width, img.height, uninitialized);
+	const rgb_view<const unsigned char> src(img.view());
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(20) << "step" << std::setw(14) << "time (ms)" << "MSample/s" << std::endl;
+	const char *names[] = { "decode pow()", "decode table", "encode pow()", "encode table" };
+	for (int i = 0; i < 4; ++i) {
+		double t = 1e30;
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (i == 0 || i == 2) {
+				parallel_for(0, img.height, 16, [&](unsigned int y0, unsigned int y1) {
+					for (unsigned int c = 0; c < 3; ++c) {
+						for (unsigned int y = y0; y < y1; ++y) {
+							const unsigned char *in = img.view(c).row(y);
+							float *lin = linear.view(c).row(y);
+							unsigned char *o = out.view(c).row(y);
+							for (unsigned int x = 0; x < img.width; ++x) {
+								if (i == 0) {
+									const float v = in[x] / 255.0f;
+									lin[x] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+								}
+								else {
+									const float v = std::min(std::max(lin[x], 0.0f), 1.0f);
+									const float e = v <= 0.0031308f ? 12.92f * v : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+									o[x] = (unsigned char)(e * 255.0f + 0.5f);
+								}
+							}
+						}
+					}
+				});
+			}
+			else if (i == 1)
+				srgb_to_linear(src, linear.view());
+			else
+				linear_to_srgb(rgb_view<const float>(linear.view()), rgb_view<unsigned char>(out.view()));
+			t = std::min(t, seconds_since(start));
+		}
+		std::cout << std::left << std::setw(20) << names[i] << std::setw(14) << std::fixed << std::setprecision(1)
+			<< t * 1000.0 << 3.0 * img.size / t / 1e6 << std::endl;
+	}
+
+	//halving the size averages 2x2 blocks; in linear light the average keeps the block's brightness
+	ppm<float> half_linear(img.width / 2, img.height / 2, uninitialized);
+	ppm<> half(img.width / 2, img.height / 2, uninitialized);
+	double t[2] = { 1e30, 1e30 };
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		resample(src, rgb_view<unsigned char>(half.view()), resample_box);
+		t[0] = std::min(t[0], seconds_since(start));
+		start = std::chrono::steady_clock::now();
+		srgb_to_linear(src, linear.view());
+		resample(rgb_view<const float>(linear.view()), half_linear.view(), resample_box);
+		linear_to_srgb(rgb_view<const float>(half_linear.view()), rgb_view<unsigned char>(half.view()));
+		t[1] = std::min(t[1], seconds_since(start));
+	}
+	std::cout << "halve in sRGB " << std::setprecision(1) << t[0] * 1000.0 << " ms, in linear light "
+		<< t[1] * 1000.0 << " ms" << std::endl;
+	return 0;
+}
+
+///This will time applying color matrices to an 8-bit and a float image,
+///next to a plain copy of the image, which bounds what memory bandwidth
+///allows
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_color(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const ppm<float> img_float = to_float(img);
+	ppm<> out(img.width, img.height, uninitialized);
+	ppm<float> out_float(img.width, img.height, uninitialized);
+
+	double t = 1e30;
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned int c = 0; c < 3; ++c)
+			copy(img.view(c), out.view(c));
+		t = std::min(t, seconds_since(start));
+	}
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", "
+		<< thread_pool::global().size() << " threads, copy " << std::fixed << std::setprecision(1)
+		<< t * 1000.0 << " ms (" << std::setprecision(2) << 2.0 * 3.0 * img.size / t / 1e9 << " GB/s)" << std::endl;
+	std::cout << std::left << std::setw(20) << "matrix" << std::setw(12) << "8-bit (ms)" << std::setw(16)
+		<< "8-bit MPixel/s" << std::setw(12) << "float (ms)" << "float MPixel/s" << std::endl;
+	const char *names[] = { "white balance", "saturation 1.5", "swap red/blue", "grayscale", "all four" };
+	const color_matrix matrices[] = {
+		color_matrix::white_balance(1.1f, 1.0f, 0.85f),
+		color_matrix::saturation(1.5f),
+		color_matrix::channel_swap(2, 1, 0),
+		color_matrix::grayscale(),
+		color_matrix::grayscale() * color_matrix::channel_swap(2, 1, 0) * color_matrix::saturation(1.5f)
+			* color_matrix::white_balance(1.1f, 1.0f, 0.85f),
+	};
+	for (unsigned int i = 0; i < sizeof(matrices) / sizeof(matrices[0]); ++i) {
+		double times[2] = { 1e30, 1e30 };
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			apply_color_matrix(rgb_view<const unsigned char>(img.view()), out.view(), matrices[i]);
+			times[0] = std::min(times[0], seconds_since(start));
+			start = std::chrono::steady_clock::now();
+			apply_color_matrix(rgb_view<const float>(img_float.view()), out_float.view(), matrices[i]);
+			times[1] = std::min(times[1], seconds_since(start));
+		}
+		std::cout << std::left << std::setw(20) << names[i] << std::fixed << std::setprecision(1)
+			<< std::setw(12) << times[0] * 1000.0 << std::setw(16) << img.size / times[0] / 1e6
+			<< std::setw(12) << times[1] * 1000.0 << img.size / times[1] / 1e6 << std::endl;
+	}
+	return 0;
+}
+
+///This will time grading an 8-bit and a float image with a 3D LUT, the
+///work the viewer redoes on the whole frame when the grade changes.
+///Without a .cube file a 33-point S-curve with warmed highlights is used.
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [grade.cube]
+/// \return 0 on success, 1 if the image or the LUT could not be loaded
+///
+static int bench_lut(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	lut3d grade;
+	if (argc > 1) {
+		if (!grade.read(args[1]))
+			return 1;
+	}
+	else {
+		grade.size = 33;
+		grade.table.resize(33 * 33 * 33 * 3);
+		float *t = grade.table.data();
+		for (unsigned int b = 0; b < 33; ++b) {
+			for (unsigned int g = 0; g < 33; ++g) {
+				for (unsigned int r = 0; r < 33; ++r) {
+					const float v[3] = { r / 32.0f, g / 32.0f, b / 32.0f };
+					const float warm[3] = { 1.05f, 1.0f, 0.9f };
+					for (unsigned int c = 0; c < 3; ++c)
+						*t++ = std::min(v[c] * v[c] * (3.0f - 2.0f * v[c]) * warm[c], 1.0f);
+				}
+			}
+		}
+	}
+	const ppm<> img = upscale_nearest(small, 4);
+	const ppm<float> img_float = to_float(img);
+	ppm<> out(img.width, img.height, uninitialized);
+	ppm<float> out_float(img.width, img.height, uninitialized);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", " << grade.size << "^3 LUT, "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(20) << "image" << std::setw(14) << "time (ms)" << "MPixel/s" << std::endl;
+	double t[2] = { 1e30, 1e30 };
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		apply_lut3d(rgb_view<const unsigned char>(img.view()), out.view(), grade);
+		t[0] = std::min(t[0], seconds_since(start));
+		start = std::chrono::steady_clock::now();
+		apply_lut3d(rgb_view<const float>(img_float.view()), out_float.view(), grade);
+		t[1] = std::min(t[1], seconds_since(start));
+	}
+	const char *names[] = { "8-bit", "float" };
+	for (int i = 0; i < 2; ++i)
+		std::cout << std::left << std::setw(20) << names[i] << std::setw(14) << std::fixed << std::setprecision(1)
+			<< t[i] * 1000.0 << img.size / t[i] / 1e6 << std::endl;
+	return 0;
+}
+
+///This will count the samples of an image into one histogram per channel
+///on the calling thread, the baseline for bench_histogram
+///
+/// \param src the image
+/// \return the histograms
+///
+static histogram histogram_naive(const rgb_view<const unsigned char> &src) {
+	histogram h;
+	h.samples = src.width() * src.height();
+	for (unsigned int c = 0; c < 3; ++c) {
+		const unsigned int width = src.width();
+		for (unsigned int y = 0; y < src.height(); ++y) {
+			const unsigned char *p = src[c].row(y);
+			for (unsigned int x = 0; x < width; ++x)
+				++h.counts[c][p[x]];
+		}
+	}
+	return h;
+}
+
+///This will time counting histograms with a single set of counters and
+///with the per-band, interleaved counters, on the image and on a flat image
+///of one color where every sample hits the same counter, and then time
+///auto-levels and equalization
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_histogram(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	ppm<> flat(img.width, img.height, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c)
+		fill(flat.view(c), (unsigned char)128);
+	ppm<> out(img.width, img.height, uninitialized);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(20) << "method" << std::setw(14) << "image (ms)" << "flat (ms)" << std::endl;
+	const char *names[] = { "single counters", "per-band x4" };
+	for (int i = 0; i < 2; ++i) {
+		double t[2] = { 1e30, 1e30 };
+		for (int k = 0; k < 2; ++k) {
+			const rgb_view<const unsigned char> src = k == 0 ? img.view() : rgb_view<const unsigned char>(flat.view());
+			for (int run = 0; run < 3; ++run) {
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				const histogram h = i == 0 ? histogram_naive(src) : compute_histogram(src);
+				t[k] = std::min(t[k], seconds_since(start));
+				if (h.samples != img.size)
+					return 1;
+			}
+		}
+		std::cout << std::left << std::setw(20) << names[i] << std::setw(14) << std::fixed << std::setprecision(2)
+			<< t[0] * 1000.0 << t[1] * 1000.0 << std::endl;
+	}
+
+	double t[2] = { 1e30, 1e30 };
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		auto_levels(rgb_view<const unsigned char>(img.view()), out.view());
+		t[0] = std::min(t[0], seconds_since(start));
+		start = std::chrono::steady_clock::now();
+		equalize(rgb_view<const unsigned char>(img.view()), out.view());
+		t[1] = std::min(t[1], seconds_since(start));
+	}
+	std::cout << "auto-levels " << std::setprecision(1) << t[0] * 1000.0 << " ms, equalize " << t[1] * 1000.0
+		<< " ms" << std::endl;
+
+	//a stroke of painted pixels, kept current in the histogram one pixel at a time
+	const unsigned int stroke = std::min(img.width, img.height);
+	histogram h = compute_histogram(rgb_view<const unsigned char>(out.view()));
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < stroke; ++i) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			unsigned char &sample = out.view(c)(i, i);
+			const unsigned char before = sample;
+			sample = c == 0 ? 255 : 0;
+			h.replace(c, before, sample);
+		}
+	}
+	const double incremental = seconds_since(start);
+	start = std::chrono::steady_clock::now();
+	compute_histogram(rgb_view<const unsigned char>(out.view()));
+	const double recount = seconds_since(start);
+	std::cout << "painting " << stroke << " pixels: updated in " << std::setprecision(3) << incremental * 1000.0
+		<< " ms, one recount takes " << recount * 1000.0 << " ms" << std::endl;
+	return 0;
+}
+
+///This will median filter the top rows of a plane by sorting each window,
+///the baseline for bench_median
+///
+/// \param src the plane to filter
+/// \param dst the filtered plane, not src
+/// \param radius the radius of the window
+/// \param rows the number of rows to compute
+///
+static void median_naive(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int radius, unsigned int rows) {
+	const int r = (int)radius;
+	const int width = (int)src.width;
+	const int height = (int)src.height;
+	parallel_for(0, rows, 4, [&](unsigned int y0, unsigned int y1) {
+		std::vector<unsigned char> window((size_t)(2 * r + 1) * (2 * r + 1));
+		for (int y = (int)y0; y < (int)y1; ++y) {
+			for (int x = 0; x < width; ++x) {
+				size_t n = 0;
+				for (int j = -r; j <= r; ++j) {
+					const unsigned char *in = src.row((unsigned int)std::min(std::max(y + j, 0), height - 1));
+					for (int i = -r; i <= r; ++i)
+						window[n++] = in[std::min(std::max(x + i, 0), width - 1)];
+				}
+				std::nth_element(window.begin(), window.begin() + n / 2, window.end());
+				dst(x, y) = window[n / 2];
+			}
+		}
+	});
+}
+
+///This will time the constant-time median filter over growing radii next
+///to sorting every window, on the green channel of an image upscaled from
+///a data file
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [radius]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_median(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const unsigned int max_radius = argc > 1 ? (unsigned int)std::atoi(args[1]) : 64;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const image_view<const unsigned char> src = img.view(1);
+	ppm<> out(img.width, img.height, uninitialized);
+	ppm<> reference(img.width, img.height, uninitialized);
+	const unsigned int naive_rows = std::min(img.height, 16u);
+	const double pixels = (double)img.width * img.height;
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", green channel, "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(10) << "radius" << std::setw(14) << "sort (ms)" << std::setw(14)
+		<< "median (ms)" << "MPixel/s" << std::endl;
+	for (unsigned int r = 1; r <= max_radius; r *= 2) {
+		double t = 1e30;
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			median_filter(src, out.view(1), r);
+			t = std::min(t, seconds_since(start));
+		}
+		std::cout << std::left << std::setw(10) << r << std::fixed << std::setprecision(1);
+		//sorting is only timed on the top rows while it still finishes quickly, and scaled up
+		if (r <= 8) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			median_naive(src, reference.view(1), r, naive_rows);
+			const double naive = seconds_since(start) * img.height / naive_rows;
+			std::cout << std::setw(14) << naive * 1000.0;
+		}
+		else
+			std::cout << std::setw(14) << "-";
+		std::cout << std::setw(14) << t * 1000.0 << pixels / t / 1e6 << std::endl;
+	}
+	return 0;
+}
+
+///This will run a bilateral filter directly on the top rows of an image,
+///summing a window of 2 sigma_space around each pixel, as the baseline for
+///bench_bilateral
+///
+/// \param src the image to filter
+/// \param dst the filtered image, not src
+/// \param sigma_space the spatial standard deviation in pixels
+/// \param sigma_range the luma standard deviation in levels
+/// \param rows the number of rows to compute
+///
+static void bilateral_naive(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	float sigma_space, float sigma_range, unsigned int rows) {
+	const int r = (int)std::ceil(2.0f * sigma_space);
+	const int width = (int)src.width();
+	const int height = (int)src.height();
+	std::vector<float> spatial(r + 1), range(256);
+	for (int k = 0; k <= r; ++k)
+		spatial[k] = std::exp(-(float)(k * k) / (2.0f * sigma_space * sigma_space));
+	for (int k = 0; k < 256; ++k)
+		range[k] = std::exp(-(float)(k * k) / (2.0f * sigma_range * sigma_range));
+	parallel_for(0, rows, 1, [&](unsigned int y0, unsigned int y1) {
+		for (int y = (int)y0; y < (int)y1; ++y) {
+			for (int x = 0; x < width; ++x) {
+				const int luma = (54 * src[0](x, y) + 183 * src[1](x, y) + 19 * src[2](x, y) + 128) >> 8;
+				float sum[3] = { 0.0f, 0.0f, 0.0f }, weight = 0.0f;
+				for (int j = std::max(y - r, 0); j <= std::min(y + r, height - 1); ++j) {
+					for (int i = std::max(x - r, 0); i <= std::min(x + r, width - 1); ++i) {
+						const int l = (54 * src[0](i, j) + 183 * src[1](i, j) + 19 * src[2](i, j) + 128) >> 8;
+						const float w = spatial[std::abs(i - x)] * spatial[std::abs(j - y)] * range[std::abs(l - luma)];
+						for (unsigned int c = 0; c < 3; ++c)
+							sum[c] += w * src[c](i, j);
+						weight += w;
+					}
+				}
+				for (unsigned int c = 0; c < 3; ++c)
+					dst[c](x, y) = (unsigned char)std::min(sum[c] / weight + 0.5f, 255.0f);
+			}
+		}
+	});
+}
+
+///This will time the bilateral grid over growing spatial sigmas next to
+///the direct filter on an image upscaled from a data file
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [sigma_range]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_bilateral(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const float sigma_range = argc > 1 ? (float)std::atof(args[1]) : 20.0f;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const rgb_view<const unsigned char> src(img.view());
+	ppm<> out(img.width, img.height, uninitialized);
+	ppm<> reference(img.width, img.height, uninitialized);
+	const unsigned int naive_rows = std::min(img.height, 4u);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", sigma_range " << sigma_range << ", "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(14) << "sigma_space" << std::setw(14) << "direct (ms)" << std::setw(14)
+		<< "grid (ms)" << "MPixel/s" << std::endl;
+	for (float sigma_space = 4.0f; sigma_space <= 64.0f; sigma_space *= 2.0f) {
+		double t = 1e30;
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bilateral_filter(src, out.view(), sigma_space, sigma_range);
+			t = std::min(t, seconds_since(start));
+		}
+		std::cout << std::left << std::fixed << std::setprecision(0) << std::setw(14) << sigma_space << std::setprecision(1);
+		//the direct filter is only timed on the top rows while it still finishes quickly, and scaled up
+		if (sigma_space <= 16.0f) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bilateral_naive(src, reference.view(), sigma_space, sigma_range, naive_rows);
+			const double naive = seconds_since(start) * img.height / naive_rows;
+			std::cout << std::setw(14) << naive * 1000.0;
+		}
+		else
+			std::cout << std::setw(14) << "-";
+		std::cout << std::setw(14) << t * 1000.0 << img.size / t / 1e6 << std::endl;
+	}
+	return 0;
+}
+
+///This will erode the top rows of a plane by taking the minimum over each
+///window directly, the baseline for bench_morphology
+///
+/// \param src the plane to erode
+/// \param dst the eroded plane, not src
+/// \param radius the radius of the square
+/// \param rows the number of rows to compute
+///
+static void erode_naive(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int radius, unsigned int rows) {
+	const int r = (int)radius;
+	const int width = (int)src.width;
+	const int height = (int)src.height;
+	parallel_for(0, rows, 4, [&](unsigned int y0, unsigned int y1) {
+		for (int y = (int)y0; y < (int)y1; ++y) {
+			for (int x = 0; x < width; ++x) {
+				unsigned char v = 255;
+				for (int j = std::max(y - r, 0); j <= std::min(y + r, height - 1); ++j) {
+					const unsigned char *in = src.row(j);
+					for (int i = std::max(x - r, 0); i <= std::min(x + r, width - 1); ++i)
+						v = std::min(v, in[i]);
+				}
+				dst(x, y) = v;
+			}
+		}
+	});
+}
+
+///This will time the van Herk/Gil-Werman erosion over growing squares next
+///to the direct minimum on the green channel of an image upscaled from a
+///data file, then close a mask thresholded from it
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [radius]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_morphology(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const unsigned int max_radius = argc > 1 ? (unsigned int)std::atoi(args[1]) : 64;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const image_view<const unsigned char> src = img.view(1);
+	ppm<> out(img.width, img.height, uninitialized);
+	ppm<> reference(img.width, img.height, uninitialized);
+	const unsigned int naive_rows = std::min(img.height, 64u);
+	const double pixels = (double)img.width * img.height;
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", green channel, "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(10) << "radius" << std::setw(14) << "direct (ms)" << std::setw(14)
+		<< "erode (ms)" << "MPixel/s" << std::endl;
+	for (unsigned int r = 1; r <= max_radius; r *= 2) {
+		double t = 1e30;
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			morphology(src, out.view(1), morph_erode, r, r);
+			t = std::min(t, seconds_since(start));
+		}
+		std::cout << std::left << std::setw(10) << r << std::fixed << std::setprecision(1);
+		//the direct minimum is only timed on the top rows while it still finishes quickly, and scaled up
+		if (r <= 16) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			erode_naive(src, reference.view(1), r, naive_rows);
+			const double naive = seconds_since(start) * img.height / naive_rows;
+			std::cout << std::setw(14) << naive * 1000.0;
+		}
+		else
+			std::cout << std::setw(14) << "-";
+		std::cout << std::setw(14) << t * 1000.0 << pixels / t / 1e6 << std::endl;
+	}
+
+	//the pixels a bitmap would set, closed to fill gaps narrower than the square
+	mask m(img.width, img.height);
+	for (unsigned int y = 0; y < img.height; ++y)
+		for (unsigned int x = 0; x < img.width; ++x)
+			m.samples[(size_t)y * img.width + x] = src(x, y) >= 128 ? 255 : 0;
+	double t = 1e30;
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		morphology(m.view(), m.view(), morph_close, 16, 16);
+		t = std::min(t, seconds_since(start));
+	}
+	std::cout << "closing a mask, radius 16: " << std::setprecision(1) << t * 1000.0 << " ms" << std::endl;
+	return 0;
+}
+
+///This will compute the Sobel gradient the way separate passes would: the
+///two derivatives into full-size planes, then the magnitude and the
+///orientation from them, as the baseline for bench_gradient
+///
+/// \param src the plane
+/// \param gx the x derivative
+/// \param gy the y derivative
+/// \param magnitude the magnitude in levels per pixel
+/// \param orientation the direction in radians
+///
+static void gradient_passes(const image_view<const unsigned char> &src, const image_view<float> &gx,
+	const image_view<float> &gy, const image_view<float> &magnitude, const image_view<float> &orientation) {
+	const int width = (int)src.width;
+	const int height = (int)src.height;
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (int y = (int)y0; y < (int)y1; ++y) {
+			const unsigned char *a = src.row(std::max(y - 1, 0)), *b = src.row(y), *c = src.row(std::min(y + 1, height - 1));
+			for (int x = 0; x < width; ++x) {
+				const int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+				gx(x, y) = (a[r] + 2 * b[r] + c[r] - a[l] - 2 * b[l] - c[l]) / 8.0f;
+			}
+		}
+	});
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (int y = (int)y0; y < (int)y1; ++y) {
+			const unsigned char *a = src.row(std::max(y - 1, 0)), *c = src.row(std::min(y + 1, height - 1));
+			for (int x = 0; x < width; ++x) {
+				const int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+				gy(x, y) = (c[l] + 2 * c[x] + c[r] - a[l] - 2 * a[x] - a[r]) / 8.0f;
+			}
+		}
+	});
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			for (unsigned int x = 0; x < src.width; ++x) {
+				magnitude(x, y) = std::sqrt(gx(x, y) * gx(x, y) + gy(x, y) * gy(x, y));
+				orientation(x, y) = std::atan2(gy(x, y), gx(x, y));
+			}
+		}
+	});
+}
+
+///This will time the fused gradient kernels on the green channel of an
+///image upscaled from a data file, next to computing the derivatives,
+///magnitude and orientation in separate passes over full-size planes
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_gradient(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const image_view<const unsigned char> src = img.view(1);
+	const unsigned int width = img.width, height = img.height;
+	const size_t pixels = (size_t)width * height;
+	pixel_buffer<float> planes(4 * pixels, uninitialized);
+	const image_view<float> gx(planes.data(), width, height, width);
+	const image_view<float> gy(planes.data() + pixels, width, height, width);
+	const image_view<float> magnitude(planes.data() + 2 * pixels, width, height, width);
+	const image_view<float> orientation(planes.data() + 3 * pixels, width, height, width);
+	ppm<> edges(width, height, uninitialized);
+
+	std::cout << fileName << " x4 = " << width << "x" << height << ", green channel, "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(34) << "method" << std::setw(14) << "time (ms)" << "MPixel/s" << std::endl;
+	const char *names[] = { "separate passes", "Sobel magnitude + orientation", "Sobel magnitude", "Sobel 8-bit",
+		"Scharr 8-bit" };
+	for (int i = 0; i < 5; ++i) {
+		double t = 1e30;
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (i == 0)
+				gradient_passes(src, gx, gy, magnitude, orientation);
+			else if (i == 1)
+				gradient(src, magnitude, orientation, gradient_sobel);
+			else if (i == 2)
+				gradient(src, magnitude, image_view<float>(), gradient_sobel);
+			else
+				gradient(src, edges.view(1), i == 3 ? gradient_sobel : gradient_scharr);
+			t = std::min(t, seconds_since(start));
+		}
+		std::cout << std::left << std::setw(34) << names[i] << std::setw(14) << std::fixed << std::setprecision(1)
+			<< t * 1000.0 << pixels / t / 1e6 << std::endl;
+	}
+	return 0;
+}
+
+///This will time building summed-area tables for the channels of an image
+///upscaled from a data file, querying the mean and variance of random
+///rectangles, and box means of growing radius next to box_blur
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_integral(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	ppm<> out(img.width, img.height, uninitialized);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	summed_area_table tables[3];
+	double t = 1e30;
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned int c = 0; c < 3; ++c)
+			tables[c].build(img.view(c));
+		t = std::min(t, seconds_since(start));
+	}
+	std::cout << "build 3 tables: " << std::fixed << std::setprecision(1) << t * 1000.0 << " ms, "
+		<< img.size / t / 1e6 << " MPixel/s" << std::endl;
+
+	//random rectangles, drawn up front so only the queries are timed
+	const unsigned int queries = 1 << 20;
+	std::vector<unsigned int> rects(4 * queries);
+	std::srand(1);
+	for (unsigned int i = 0; i < queries; ++i) {
+		rects[4 * i] = (unsigned int)std::rand() % img.width;
+		rects[4 * i + 1] = (unsigned int)std::rand() % img.height;
+		rects[4 * i + 2] = 1 + (unsigned int)std::rand() % (img.width - rects[4 * i]);
+		rects[4 * i + 3] = 1 + (unsigned int)std::rand() % (img.height - rects[4 * i + 1]);
+	}
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double total = 0.0;
+	for (unsigned int i = 0; i < queries; ++i) {
+		const unsigned int *r = &rects[4 * i];
+		total += tables[i % 3].mean(r[0], r[1], r[2], r[3]) + tables[i % 3].variance(r[0], r[1], r[2], r[3]);
+	}
+	t = seconds_since(start);
+	std::cout << queries << " rectangle means and variances: " << t * 1000.0 << " ms, "
+		<< std::setprecision(0) << t / queries * 1e9 << " ns each (checksum " << total << ")" << std::endl;
+
+	std::cout << std::left << std::setw(10) << "radius" << std::setw(16) << "box_blur (ms)" << "box_mean (ms)" << std::endl;
+	for (unsigned int radius = 1; radius <= 64; radius *= 4) {
+		double times[2] = { 1e30, 1e30 };
+		for (int run = 0; run < 3; ++run) {
+			start = std::chrono::steady_clock::now();
+			for (unsigned int c = 0; c < 3; ++c)
+				box_blur(img.view(c), out.view(c), radius);
+			times[0] = std::min(times[0], seconds_since(start));
+			start = std::chrono::steady_clock::now();
+			for (unsigned int c = 0; c < 3; ++c)
+				box_mean(tables[c], out.view(c), radius);
+			times[1] = std::min(times[1], seconds_since(start));
+		}
+		std::cout << std::left << std::setw(10) << radius << std::setprecision(1) << std::setw(16) << times[0] * 1000.0
+			<< times[1] * 1000.0 << std::endl;
+	}
+	return 0;
+}
+
+///This will map every pixel of an image to its nearest palette entry by
+///testing all of them, the search the palette's lookup grid replaces
+///
+/// \param src the image
+/// \param indices the entry of each pixel
+/// \param p the palette
+///
+static void quantize_linear(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices,
+	const palette &p) {
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			for (unsigned int x = 0; x < src.width(); ++x) {
+				const int r = src[0](x, y), g = src[1](x, y), b = src[2](x, y);
+				unsigned int best = 0, best_distance = 0xffffffffu;
+				for (unsigned int k = 0; k < p.size(); ++k) {
+					const int dr = r - p.colors[3 * k], dg = g - p.colors[3 * k + 1], db = b - p.colors[3 * k + 2];
+					const unsigned int d = (unsigned int)(dr * dr + dg * dg + db * db);
+					if (d < best_distance) {
+						best_distance = d;
+						best = k;
+					}
+				}
+				indices(x, y) = (unsigned char)best;
+			}
+		}
+	});
+}
+
+///This will time building palettes for an image upscaled from a data file
+///and mapping it to one with each dithering method, next to a nearest color
+///search over every entry, printing the error of each result
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [colors]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_palette(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const unsigned int colors = argc > 1 ? (unsigned int)std::atoi(args[1]) : 256;
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const rgb_view<const unsigned char> src(img.view());
+	const unsigned int width = img.width, height = img.height;
+	const size_t pixels = (size_t)width * height;
+	pixel_buffer<unsigned char> indices(pixels, uninitialized);
+	const image_view<unsigned char> index_view(indices.data(), width, height, width);
+	ppm<> out(width, height, uninitialized);
+
+	std::cout << fileName << " x4 = " << width << "x" << height << ", " << colors << " colors, "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << std::left << std::setw(28) << "method" << std::setw(14) << "time (ms)" << std::setw(12) << "MPixel/s"
+		<< "rms error" << std::endl;
+	palette p;
+	const char *names[] = { "median cut palette", "k-means palette", "nearest, every entry", "nearest, lookup grid",
+		"ordered dither", "Floyd-Steinberg" };
+	for (int i = 0; i < 6; ++i) {
+		double t = 1e30;
+		for (int run = 0; run < 3; ++run) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			if (i < 2)
+				p = build_palette(src, colors, i == 0 ? palette_median_cut : palette_kmeans);
+			else if (i == 2)
+				quantize_linear(src, index_view, p);
+			else
+				quantize(src, index_view, p, i == 3 ? dither_none : i == 4 ? dither_ordered : dither_floyd_steinberg);
+			t = std::min(t, seconds_since(start));
+		}
+		std::cout << std::left << std::setw(28) << names[i] << std::setw(14) << std::fixed << std::setprecision(1)
+			<< t * 1000.0 << std::setw(12) << pixels / t / 1e6;
+		if (i < 2)
+			quantize(src, index_view, p, dither_none);
+		expand_indices(index_view, p, out.view());
+		double error = 0.0;
+		for (unsigned int c = 0; c < 3; ++c) {
+			for (unsigned int y = 0; y < height; ++y) {
+				for (unsigned int x = 0; x < width; ++x) {
+					const double d = (double)src[c](x, y) - out.view(c)(x, y);
+					error += d * d;
+				}
+			}
+		}
+		std::cout << std::setprecision(2) << std::sqrt(error / (3.0 * pixels)) << std::endl;
+	}
+	return 0;
+}
+
+///This will time flattening a stack of layers over an image upscaled from a
+///data file: the whole stack, the tile under a one-pixel edit, and a stroke
+///of such edits next to flattening the whole stack after every edit
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_layers(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const unsigned int width = img.width, height = img.height;
+
+	//the image, then four layers of its channels rotated under diagonal alpha ramps
+	layer_stack stack(width, height);
+	stack.add(layer(img));
+	const blend_op ops[] = { blend_over, blend_atop, blend_plus, blend_xor };
+	for (unsigned int k = 0; k < 4; ++k) {
+		ppm<> rotated(width, height, uninitialized);
+		for (unsigned int c = 0; c < 3; ++c)
+			copy(img.view((c + k + 1) % 3), rotated.view(c));
+		mask ramp(width, height);
+		for (unsigned int y = 0; y < height; ++y) {
+			for (unsigned int x = 0; x < width; ++x)
+				ramp.view()(x, y) = (unsigned char)((x + (k + 1) * y) / 8);
+		}
+		stack.add(layer(rotated, ramp, ops[k], 0.5f + 0.125f * k));
+	}
+
+	std::cout << fileName << " x4 = " << width << "x" << height << ", " << stack.layers.size() << " layers, "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	double full = 1e30;
+	for (int run = 0; run < 3; ++run) {
+		stack.touch_all();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		stack.flatten();
+		full = std::min(full, seconds_since(start));
+	}
+
+	//a diagonal stroke on the top layer, flattened after every pixel: first only the tiles under each
+	//pixel, then the whole stack
+	const unsigned int edits = 200;
+	layer &top = stack.layers.back();
+	double stroke[2];
+	for (int whole = 0; whole < 2; ++whole) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (unsigned int i = 0; i < edits; ++i) {
+			const unsigned int x = width / 4 + i, y = height / 4 + i;
+			for (unsigned int c = 0; c < 3; ++c)
+				top.image.view(c)(x, y) = (unsigned char)(255 - 255 * whole);
+			top.alpha.view()(x, y) = 255;
+			if (whole)
+				stack.touch_all();
+			else
+				stack.touch(x, y, 1, 1);
+			stack.flatten();
+		}
+		stroke[whole] = seconds_since(start);
+	}
+
+	std::cout << std::left << std::setw(34) << "method" << "time (ms)" << std::endl;
+	std::cout << std::left << std::setw(34) << "flatten whole stack" << std::fixed << std::setprecision(2)
+		<< full * 1000.0 << std::endl;
+	std::cout << std::left << std::setw(34) << "flatten after one edit" << stroke[0] / edits * 1000.0 << std::endl;
+	std::cout << std::left << std::setw(34) << "stroke, touched tiles" << stroke[0] * 1000.0 << std::endl;
+	std::cout << std::left << std::setw(34) << "stroke, whole stack" << stroke[1] * 1000.0 << std::endl;
+	return 0;
+}
+
+///This will label the set pixels of a mask by flooding each component in
+///turn from its first pixel, on one thread: the baseline labeling
+///
+/// \param src the mask
+/// \param labels the labels, numbered like label_components does
+/// \return the number of components
+///
+static unsigned int label_flood(const image_view<const unsigned char> &src, uint32_t *labels) {
+	const unsigned int width = src.width, height = src.height;
+	std::fill(labels, labels + (size_t)width * height, 0u);
+	std::vector<size_t> stack;
+	unsigned int count = 0;
+	for (unsigned int y = 0; y < height; ++y) {
+		for (unsigned int x = 0; x < width; ++x) {
+			if (!src(x, y) || labels[(size_t)y * width + x])
+				continue;
+			labels[(size_t)y * width + x] = ++count;
+			stack.push_back((size_t)y * width + x);
+			while (!stack.empty()) {
+				const size_t p = stack.back();
+				stack.pop_back();
+				const unsigned int px = (unsigned int)(p % width), py = (unsigned int)(p / width);
+				for (unsigned int ny = py > 0 ? py - 1 : 0; ny <= std::min(py + 1, height - 1); ++ny) {
+					for (unsigned int nx = px > 0 ? px - 1 : 0; nx <= std::min(px + 1, width - 1); ++nx) {
+						const size_t q = (size_t)ny * width + nx;
+						if (src(nx, ny) && !labels[q]) {
+							labels[q] = count;
+							stack.push_back(q);
+						}
+					}
+				}
+			}
+		}
+	}
+	return count;
+}
+
+///This will time labeling the components of a mask thresholded from an
+///image upscaled from a data file, and of a random mask of the same size,
+///next to flooding each component in turn
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm] [level]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_components(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	const unsigned char level = (unsigned char)(argc > 1 ? std::atoi(args[1]) : 128);
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const unsigned int width = img.width, height = img.height;
+	const double pixels = (double)width * height;
+
+	double t = 1e30;
+	mask thresholded;
+	for (int run = 0; run < 3; ++run) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		thresholded = threshold(img.view(1), level);
+		t = std::min(t, seconds_since(start));
+	}
+	//a random mask with 40% of its pixels set: many small components, the hard case for merging
+	mask noise(width, height);
+	std::srand(1);
+	for (size_t i = 0; i < noise.samples.size(); ++i)
+		noise.samples[i] = std::rand() % 5 < 2 ? 255 : 0;
+
+	std::cout << fileName << " x4 = " << width << "x" << height << ", green channel at least " << (int)level << ", "
+		<< thread_pool::global().size() << " threads" << std::endl;
+	std::cout << "threshold: " << std::fixed << std::setprecision(1) << t * 1000.0 << " ms" << std::endl;
+	std::cout << std::left << std::setw(22) << "mask" << std::setw(14) << "flood (ms)" << std::setw(18) << "4-connected (ms)"
+		<< std::setw(18) << "8-connected (ms)" << std::setw(12) << "MPixel/s" << "components" << std::endl;
+	pixel_buffer<uint32_t> flooded((size_t)width * height, uninitialized);
+	const char *names[] = { "thresholded", "random 40%" };
+	for (int m = 0; m < 2; ++m) {
+		const image_view<const unsigned char> src = m == 0 ? thresholded.view() : noise.view();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		label_flood(src, flooded.data());
+		const double flood = seconds_since(start);
+		double times[2] = { 1e30, 1e30 };
+		connected_components components;
+		for (int c = 0; c < 2; ++c) {
+			for (int run = 0; run < 3; ++run) {
+				start = std::chrono::steady_clock::now();
+				components = label_components(src, c == 0 ? connect_4 : connect_8);
+				times[c] = std::min(times[c], seconds_since(start));
+			}
+		}
+		std::cout << std::left << std::setw(22) << names[m] << std::setw(14) << flood * 1000.0 << std::setw(18)
+			<< times[0] * 1000.0 << std::setw(18) << times[1] * 1000.0 << std::setw(12) << pixels / times[1] / 1e6
+			<< components.count() << std::endl;
+	}
+	return 0;
+}
+
+///This will fill the region of similar color around a pixel one pixel at a
+///time, pushing every neighbor that matches: the baseline fill
+///
+/// \param src the image
+/// \param x the column of the pixel
+/// \param y the row of the pixel
+/// \param tolerance the most any channel may differ from the pixel's
+/// \param region the pixels filled, zero to start with
+/// \return the number of pixels filled
+///
+static uint64_t fill_pixels(const rgb_view<const unsigned char> &src, unsigned int x, unsigned int y,
+	unsigned int tolerance, const image_view<unsigned char> &region) {
+	const unsigned int width = src.width(), height = src.height();
+	const int color[3] = { src[0](x, y), src[1](x, y), src[2](x, y) };
+	std::vector<size_t> stack(1, (size_t)y * width + x);
+	region(x, y) = 255;
+	uint64_t filled = 0;
+	while (!stack.empty()) {
+		const size_t p = stack.back();
+		stack.pop_back();
+		++filled;
+		const unsigned int px = (unsigned int)(p % width), py = (unsigned int)(p / width);
+		const unsigned int nx[4] = { px - 1, px + 1, px, px }, ny[4] = { py, py, py - 1, py + 1 };
+		for (unsigned int k = 0; k < 4; ++k) {
+			//a step off the edge wraps around to a huge coordinate
+			if (nx[k] >= width || ny[k] >= height || region(nx[k], ny[k]))
+				continue;
+			bool match = true;
+			for (unsigned int c = 0; c < 3 && match; ++c)
+				match = std::abs((int)src[c](nx[k], ny[k]) - color[c]) <= (int)tolerance;
+			if (match) {
+				region(nx[k], ny[k]) = 255;
+				stack.push_back((size_t)ny[k] * width + nx[k]);
+			}
+		}
+	}
+	return filled;
+}
+
+///This will time the scanline flood fill from the middle of an image
+///upscaled from a data file for growing tolerances, next to filling one
+///pixel at a time
+///
+/// \param argc the number of options
+/// \param args the options: [file.ppm]
+/// \return 0 on success, 1 if the image could not be loaded
+///
+static int bench_fill(int argc, char **args) {
+	const std::string fileName = argc > 0 ? args[0] : "data/bunny.ppm";
+	ppm<> small(fileName);
+	if (small.size == 0)
+		return 1;
+	const ppm<> img = upscale_nearest(small, 4);
+	const rgb_view<const unsigned char> src(img.view());
+	const unsigned int x = img.width / 2, y = img.height / 2;
+	mask region(img.width, img.height), naive_region(img.width, img.height);
+
+	std::cout << fileName << " x4 = " << img.width << "x" << img.height << ", filling from " << x << "," << y << std::endl;
+	std::cout << std::left << std::setw(12) << "tolerance" << std::setw(12) << "pixels" << std::setw(16) << "per pixel (ms)"
+		<< std::setw(16) << "scanline (ms)" << std::setw(12) << "MPixel/s" << "bounds" << std::endl;
+	for (unsigned int tolerance = 8; tolerance <= 128; tolerance *= 2) {
+		double t = 1e30;
+		uint64_t filled = 0;
+		fill_bounds bounds;
+		for (int run = 0; run < 3; ++run) {
+			region.samples.zero();
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			filled = flood_fill(src, x, y, tolerance, region.view(), bounds);
+			t = std::min(t, seconds_since(start));
+		}
+		naive_region.samples.zero();
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		fill_pixels(src, x, y, tolerance, naive_region.view());
+		const double naive = seconds_since(start);
+		std::cout << std::left << std::setw(12) << tolerance << std::setw(12) << filled << std::fixed << std::setprecision(1)
+			<< std::setw(16) << naive * 1000.0 << std::setw(16) << t * 1000.0 << std::setw(12) << filled / t / 1e6
+			<< bounds.w << "x" << bounds.h << " at " << bounds.x << "," << bounds.y << std::endl;
+	}
+	return 0;
+}
+
+///This will run the benchmark named by args[0]
+///
+/// \param argc the number of arguments
+/// \param args the benchmark name followed by its options
+/// \return 0 on success, 1 for an unknown benchmark
+///
+int run_benchmark(int argc, char **args) {
+	const std::string name = argc > 0 ? args[0] : "";
+	if (name == "alloc")
+		return bench_alloc(argc - 1, args + 1);
+	if (name == "scaling")
+		return bench_scaling(argc - 1, args + 1);
+	if (name == "blur")
+		return bench_blur(argc - 1, args + 1);
+	if (name == "convolve")
+		return bench_convolve(argc - 1, args + 1);
+	if (name == "resample")
+		return bench_resample(argc - 1, args + 1);
+	if (name == "srgb")
+		return bench_srgb(argc - 1, args + 1);
+	if (name == "color")
+		return bench_color(argc - 1, args + 1);
+	if (name == "lut")
+		return bench_lut(argc - 1, args + 1);
+	if (name == "histogram")
+		return bench_histogram(argc - 1, args + 1);
+	if (name == "median")
+		return bench_median(argc - 1, args + 1);
+	if (name == "bilateral")
+		return bench_bilateral(argc - 1, args + 1);
+	if (name == "morphology")
+		return bench_morphology(argc - 1, args + 1);
+	if (name == "gradient")
+		return bench_gradient(argc - 1, args + 1);
+	if (name == "integral")
+		return bench_integral(argc - 1, args + 1);
+	if (name == "palette")
+		return bench_palette(argc - 1, args + 1);
+	if (name == "layers")
+		return bench_layers(argc - 1, args + 1);
+	if (name == "components")
+		return bench_components(argc - 1, args + 1);
+	if (name == "fill")
+		return bench_fill(argc - 1, args + 1);
+	std::cout << "Error. Unknown benchmark \"" << name << "\". Available: alloc, scaling, blur, convolve, resample, srgb, color, lut, histogram, median, bilateral, morphology, gradient, integral, palette, layers, components, fill" << std::endl;
+	return 1;
+}
@@ -0,0 +1,15 @@
+///
+/// \file bench.h
+/// \brief Command line benchmarks
+///
+/// Run as "prog01 --bench <name> [options]".  Each benchmark prints a small
+/// table of timings to stdout.
+///
+
+#ifndef BENCH_H
+#define BENCH_H
+
+//run the benchmark named by args[0] with the remaining args as options
+int run_benchmark(int argc, char **args);
+
+#endif
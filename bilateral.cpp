@@ -0,0 +1,266 @@
+///
+/// \file bilateral.cpp
+/// \brief Edge-preserving smoothing with a bilateral grid
+///
+
+#include "bilateral.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+//floats per cell: the weighted sums of r, g and b, then the weight
+static const unsigned int CELL = 4;
+
+//Rec. 709 luma weights in 1/256ths, the guide the grid sorts pixels by
+static const unsigned int LUMA_R = 54;
+static const unsigned int LUMA_G = 183;
+static const unsigned int LUMA_B = 19;
+
+///A bilateral grid: cells along luma vary fastest, then x, then y, so the
+///two cells a pixel touches along luma are 8 consecutive floats
+struct bilateral_grid {
+	unsigned int nx, ny, nz;
+	pixel_buffer<float> cells;
+
+	bilateral_grid(unsigned int _nx, unsigned int _ny, unsigned int _nz) :
+		nx(_nx), ny(_ny), nz(_nz), cells((size_t)_nx * _ny * _nz * CELL) {}
+
+	float *cell(unsigned int x, unsigned int y, unsigned int z) {
+		return cells.data() + (((size_t)y * nx + x) * nz + z) * CELL;
+	}
+};
+
+///A position along one grid axis: the cell below and the fraction of the
+///way to the next one
+struct grid_position {
+	unsigned int cell;
+	float fraction;
+};
+
+///This will return the grid position of every sample value 0 to n - 1
+///
+/// \param n the number of values
+/// \param scale grid cells per value
+/// \return the positions
+///
+static std::vector<grid_position> grid_positions(unsigned int n, float scale) {
+	std::vector<grid_position> out(n);
+	for (unsigned int i = 0; i < n; ++i) {
+		const float f = i * scale;
+		out[i].cell = (unsigned int)f;
+		out[i].fraction = f - out[i].cell;
+	}
+	return out;
+}
+
+///This will return the luma of a pixel
+static inline unsigned int pixel_luma(unsigned int r, unsigned int g, unsigned int b) {
+	return (LUMA_R * r + LUMA_G * g + LUMA_B * b + 128) >> 8;
+}
+
+///This will add a pixel, weighted, to the two cells along luma at p
+///
+/// \param p the lower of the two cells
+/// \param v the pixel's r, g, b, 1 scaled by the lower cell's luma weight, then the same for the upper cell
+/// \param w the weight of the x, y corner
+///
+static inline void splat_cells(float *p, const float *v, float w) {
+#if defined(__AVX2__) && defined(__FMA__)
+	_mm256_storeu_ps(p, _mm256_fmadd_ps(_mm256_loadu_ps(v), _mm256_set1_ps(w), _mm256_loadu_ps(p)));
+#else
+	for (unsigned int i = 0; i < 2 * CELL; ++i)
+		p[i] += v[i] * w;
+#endif
+}
+
+///This will splat the pixels into the grid rows y0 to y1.  Each pixel adds
+///to the 8 cells around its position, so the rows are split between bands
+///by the cells written, not by the pixels read.
+///
+/// \param src the image
+/// \param grid the grid, zeroed
+/// \param px the grid position of every column
+/// \param py the grid position of every row
+/// \param pz the grid position of every luma
+/// \param y0 the first grid row to fill
+/// \param y1 one past the last grid row to fill
+///
+static void splat_rows(const rgb_view<const unsigned char> &src, bilateral_grid &grid,
+	const std::vector<grid_position> &px, const std::vector<grid_position> &py, const std::vector<grid_position> &pz,
+	unsigned int y0, unsigned int y1) {
+	const unsigned int width = src.width();
+	const size_t rs = src[0].step, gs = src[1].step, bs = src[2].step;
+	for (unsigned int y = 0; y < src.height(); ++y) {
+		//rows splat into their cell row and the next
+		if (py[y].cell + 1 < y0)
+			continue;
+		if (py[y].cell >= y1)
+			break;
+		const unsigned char *r = src[0].row(y), *g = src[1].row(y), *b = src[2].row(y);
+		const float wy[2] = { 1.0f - py[y].fraction, py[y].fraction };
+		for (unsigned int x = 0; x < width; ++x) {
+			const unsigned int cr = r[(size_t)x * rs], cg = g[(size_t)x * gs], cb = b[(size_t)x * bs];
+			const grid_position z = pz[pixel_luma(cr, cg, cb)];
+			const float lo = 1.0f - z.fraction, hi = z.fraction;
+			const float v[2 * CELL] = { cr * lo, cg * lo, cb * lo, lo, cr * hi, cg * hi, cb * hi, hi };
+			const float wx[2] = { 1.0f - px[x].fraction, px[x].fraction };
+			for (unsigned int j = 0; j < 2; ++j) {
+				const unsigned int cy = py[y].cell + j;
+				if (cy < y0 || cy >= y1)
+					continue;
+				float *p = grid.cell(px[x].cell, cy, z.cell);
+				splat_cells(p, v, wx[0] * wy[j]);
+				splat_cells(p + grid.nz * CELL, v, wx[1] * wy[j]);
+			}
+		}
+	}
+}
+
+///This will blur the cells along one line of the grid with the binomial
+///kernel 1 4 6 4 1, a Gaussian of one cell, treating cells past the ends
+///as empty
+///
+/// \param p the first cell of the line
+/// \param n the number of cells
+/// \param stride the floats from one cell of the line to the next
+/// \param line room for n + 4 cells
+///
+static void blur_line(float *p, unsigned int n, size_t stride, float *line) {
+	std::fill(line, line + 2 * CELL, 0.0f);
+	std::fill(line + (n + 2) * CELL, line + (n + 4) * CELL, 0.0f);
+	for (unsigned int k = 0; k < n; ++k) {
+		for (unsigned int i = 0; i < CELL; ++i)
+			line[(k + 2) * CELL + i] = p[k * stride + i];
+	}
+	for (unsigned int k = 0; k < n; ++k) {
+		const float *t = line + k * CELL;
+		for (unsigned int i = 0; i < CELL; ++i)
+			p[k * stride + i] = (t[i] + 4.0f * (t[CELL + i] + t[3 * CELL + i]) + 6.0f * t[2 * CELL + i] + t[4 * CELL + i])
+				* (1.0f / 16.0f);
+	}
+}
+
+///This will blur the grid along luma, x and y, on the thread pool
+///
+/// \param grid the grid
+///
+static void blur_grid(bilateral_grid &grid) {
+	const unsigned int nx = grid.nx, ny = grid.ny, nz = grid.nz;
+	const unsigned int longest = std::max(std::max(nx, ny), nz);
+	parallel_for(0, ny, 4, [&](unsigned int y0, unsigned int y1) {
+		std::vector<float> line((longest + 4) * CELL);
+		for (unsigned int y = y0; y < y1; ++y) {
+			for (unsigned int x = 0; x < nx; ++x)
+				blur_line(grid.cell(x, y, 0), nz, CELL, line.data());
+			for (unsigned int z = 0; z < nz; ++z)
+				blur_line(grid.cell(0, y, z), nx, (size_t)nz * CELL, line.data());
+		}
+	});
+	parallel_for(0, nx, 4, [&](unsigned int x0, unsigned int x1) {
+		std::vector<float> line((longest + 4) * CELL);
+		for (unsigned int x = x0; x < x1; ++x) {
+			for (unsigned int z = 0; z < nz; ++z)
+				blur_line(grid.cell(x, 0, z), ny, (size_t)nx * nz * CELL, line.data());
+		}
+	});
+}
+
+///This will interpolate the grid at every pixel of a band of rows and
+///divide the sums by the weight
+///
+/// \param src the image
+/// \param dst the filtered image; may be src
+/// \param grid the blurred grid
+/// \param px the grid position of every column
+/// \param py the grid position of every row
+/// \param pz the grid position of every luma
+/// \param y0 the first row
+/// \param y1 one past the last row
+///
+static void slice_rows(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	bilateral_grid &grid, const std::vector<grid_position> &px, const std::vector<grid_position> &py,
+	const std::vector<grid_position> &pz, unsigned int y0, unsigned int y1) {
+	const unsigned int width = src.width();
+	const size_t rs = src[0].step, gs = src[1].step, bs = src[2].step;
+	const size_t ro = dst[0].step, go = dst[1].step, bo = dst[2].step;
+	const size_t next_x = (size_t)grid.nz * CELL, next_y = (size_t)grid.nx * grid.nz * CELL;
+	for (unsigned int y = y0; y < y1; ++y) {
+		const unsigned char *r = src[0].row(y), *g = src[1].row(y), *b = src[2].row(y);
+		unsigned char *outr = dst[0].row(y), *outg = dst[1].row(y), *outb = dst[2].row(y);
+		const float fy = py[y].fraction;
+		for (unsigned int x = 0; x < width; ++x) {
+			const unsigned int cr = r[(size_t)x * rs], cg = g[(size_t)x * gs], cb = b[(size_t)x * bs];
+			const grid_position z = pz[pixel_luma(cr, cg, cb)];
+			const float *p = grid.cell(px[x].cell, py[y].cell, z.cell);
+			const float fx = px[x].fraction;
+			const float w00 = (1.0f - fx) * (1.0f - fy), w10 = fx * (1.0f - fy), w01 = (1.0f - fx) * fy, w11 = fx * fy;
+			float sum[CELL];
+#if defined(__AVX2__) && defined(__FMA__)
+			__m256 acc = _mm256_mul_ps(_mm256_loadu_ps(p), _mm256_set1_ps(w00));
+			acc = _mm256_fmadd_ps(_mm256_loadu_ps(p + next_x), _mm256_set1_ps(w10), acc);
+			acc = _mm256_fmadd_ps(_mm256_loadu_ps(p + next_y), _mm256_set1_ps(w01), acc);
+			acc = _mm256_fmadd_ps(_mm256_loadu_ps(p + next_y + next_x), _mm256_set1_ps(w11), acc);
+			//the lower luma cell in the low half, the upper in the high half
+			const __m128 lo = _mm256_castps256_ps128(acc), hi = _mm256_extractf128_ps(acc, 1);
+			_mm_storeu_ps(sum, _mm_fmadd_ps(_mm_sub_ps(hi, lo), _mm_set1_ps(z.fraction), lo));
+#else
+			for (unsigned int i = 0; i < 2 * CELL; i += CELL) {
+				for (unsigned int k = 0; k < CELL; ++k) {
+					const float v = w00 * p[i + k] + w10 * p[next_x + i + k] + w01 * p[next_y + i + k]
+						+ w11 * p[next_y + next_x + i + k];
+					sum[k] = i == 0 ? v : sum[k] + (v - sum[k]) * z.fraction;
+				}
+			}
+#endif
+			//every pixel splatted weight around its own position, so sum[3] > 0 but for rounding
+			if (sum[3] > 1e-6f) {
+				const float scale = 1.0f / sum[3];
+				outr[(size_t)x * ro] = (unsigned char)std::min(sum[0] * scale + 0.5f, 255.0f);
+				outg[(size_t)x * go] = (unsigned char)std::min(sum[1] * scale + 0.5f, 255.0f);
+				outb[(size_t)x * bo] = (unsigned char)std::min(sum[2] * scale + 0.5f, 255.0f);
+			}
+			else {
+				outr[(size_t)x * ro] = (unsigned char)cr;
+				outg[(size_t)x * go] = (unsigned char)cg;
+				outb[(size_t)x * bo] = (unsigned char)cb;
+			}
+		}
+	}
+}
+
+///This will smooth an image while keeping its edges: splat it into a
+///bilateral grid, blur the grid, and slice the result back out
+///
+/// \param src the image to filter
+/// \param dst the filtered image, same size as src; may be src
+/// \param sigma_space the spatial standard deviation in pixels
+/// \param sigma_range the luma standard deviation, in 8-bit levels
+///
+void bilateral_filter(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	float sigma_space, float sigma_range) {
+	const unsigned int width = src.width(), height = src.height();
+	if (width == 0 || height == 0)
+		return;
+	const float ss = std::max(sigma_space, BILATERAL_MIN_SIGMA_SPACE);
+	const float sr = std::max(sigma_range, BILATERAL_MIN_SIGMA_RANGE);
+	const std::vector<grid_position> px = grid_positions(width, 1.0f / ss);
+	const std::vector<grid_position> py = grid_positions(height, 1.0f / ss);
+	const std::vector<grid_position> pz = grid_positions(256, 1.0f / sr);
+	//one more cell than the last position along each axis, for its upper neighbour
+	bilateral_grid grid(px[width - 1].cell + 2, py[height - 1].cell + 2, pz[255].cell + 2);
+
+	parallel_for(0, grid.ny, 2, [&](unsigned int y0, unsigned int y1) {
+		splat_rows(src, grid, px, py, pz, y0, y1);
+	});
+	blur_grid(grid);
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		slice_rows(src, dst, grid, px, py, pz, y0, y1);
+	});
+}
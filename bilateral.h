@@ -0,0 +1,33 @@
+///
+/// \file bilateral.h
+/// \brief Edge-preserving smoothing with a bilateral grid
+///
+/// A bilateral filter averages each pixel with its neighbours, weighted
+/// down both by distance and by how different their brightness is, so
+/// smooth areas are flattened while edges stay sharp.  Computed directly
+/// it costs a full window of neighbours per pixel.  The bilateral grid
+/// (Chen, Paris and Durand) instead samples the image into a coarse 3D grid
+/// over x, y and luma, one cell per sigma in each direction: every pixel is
+/// splatted into the 8 cells around it, the grid is blurred with a small
+/// separable kernel, and every pixel is sliced back out of it by trilinear
+/// interpolation at its own position and luma.  The cost is two small,
+/// fixed amounts of work per pixel plus a grid that shrinks as the sigmas
+/// grow.  Each cell holds the weighted sum of r, g and b and the weight, so
+/// with AVX2 the two cells along the luma axis are one 8-float vector.
+///
+
+#ifndef BILATERAL_H
+#define BILATERAL_H
+
+#include "image_view.h"
+
+//smallest sigmas the grid is used with; smaller ones are raised to these, as the grid would grow past the image
+const float BILATERAL_MIN_SIGMA_SPACE = 4.0f;
+const float BILATERAL_MIN_SIGMA_RANGE = 8.0f;
+
+//dst = src averaged over about sigma_space pixels, with weights falling off over luma differences of about
+//sigma_range levels (0 to 255); dst may be src
+void bilateral_filter(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	float sigma_space, float sigma_range);
+
+#endif
@@ -0,0 +1,633 @@
+///
+/// \file blur.cpp
+/// \brief Separable Gaussian, box and recursive (IIR) blurs on image planes
+///
+
+#include "blur.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//columns per strip of the vertical passes; (2r + 1) rows of a strip stay in cache
+static const unsigned int STRIP = 256;
+//columns per strip of the recursive vertical pass, small so there are many strips to share out
+static const unsigned int IIR_STRIP = 64;
+//rows the recursive and box row passes run side by side, one vector lane each
+static const unsigned int LANES = 8;
+
+///This will return the normalized taps of a sampled Gaussian.  The kernel
+///is symmetric, so only w[0] (the center) to w[r] are returned.
+///
+/// \param sigma the standard deviation in pixels
+/// \return the taps, w.size() - 1 is the radius
+///
+std::vector<float> gaussian_kernel(float sigma) {
+	if (!(sigma > 0.0f))
+		return std::vector<float>(1, 1.0f);
+	const unsigned int r = std::max(1u, (unsigned int)std::ceil(3.0f * sigma));
+	std::vector<float> w(r + 1);
+	double sum = 0.0;
+	for (unsigned int k = 0; k <= r; ++k) {
+		w[k] = (float)std::exp(-(double)k * k / (2.0 * sigma * sigma));
+		sum += k == 0 ? w[k] : 2.0 * w[k];
+	}
+	for (unsigned int k = 0; k <= r; ++k)
+		w[k] = (float)(w[k] / sum);
+	return w;
+}
+
+///This will convert a float back to a sample, rounding and clamping 8-bit
+///samples
+static inline void store_sample(float v, unsigned char &out) {
+	v = v + 0.5f;
+	out = (unsigned char)(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v));
+}
+static inline void store_sample(float v, float &out) {
+	out = v;
+}
+
+///This will copy a row segment of a view into floats
+///
+/// \param src the view
+/// \param x0 the first column
+/// \param y the row
+/// \param n the number of samples
+/// \param out the floats
+///
+template <typename S>
+static void load_row(const image_view<const S> &src, unsigned int x0, unsigned int y, unsigned int n, float *out) {
+	const S *in = &src(x0, y);
+	if (src.dense()) {
+		for (unsigned int x = 0; x < n; ++x)
+			out[x] = (float)in[x];
+	}
+	else {
+		for (unsigned int x = 0; x < n; ++x)
+			out[x] = (float)in[(size_t)x * src.step];
+	}
+}
+
+///This will store a row segment of floats into a view
+///
+/// \param in the floats
+/// \param dst the view
+/// \param x0 the first column
+/// \param y the row
+/// \param n the number of samples
+///
+template <typename T>
+static void store_row(const float *in, const image_view<T> &dst, unsigned int x0, unsigned int y, unsigned int n) {
+	T *out = &dst(x0, y);
+	for (unsigned int x = 0; x < n; ++x)
+		store_sample(in[x], out[(size_t)x * dst.step]);
+}
+
+///This will interleave LANES rows of a float plane so sample x of row
+///y0 + j lands at block[x * LANES + j].  Lanes past the last row repeat it.
+///
+/// \param plane the plane
+/// \param width the number of columns
+/// \param y0 the first row
+/// \param n the number of rows left from y0, at least 1
+/// \param block the interleaved rows, width * LANES floats
+///
+static void gather_rows(const float *plane, unsigned int width, unsigned int y0, unsigned int n, float *block) {
+	const float *rows[LANES];
+	for (unsigned int j = 0; j < LANES; ++j)
+		rows[j] = plane + (size_t)(y0 + std::min(j, n - 1)) * width;
+	for (unsigned int x = 0; x < width; ++x)
+		for (unsigned int j = 0; j < LANES; ++j)
+			block[(size_t)x * LANES + j] = rows[j][x];
+}
+
+///This will write interleaved rows back to a float plane
+///
+/// \param block the interleaved rows
+/// \param plane the plane
+/// \param width the number of columns
+/// \param y0 the first row
+/// \param n the number of rows to write, at most LANES
+///
+static void scatter_rows(const float *block, float *plane, unsigned int width, unsigned int y0, unsigned int n) {
+	for (unsigned int j = 0; j < n; ++j) {
+		float *row = plane + (size_t)(y0 + j) * width;
+		for (unsigned int x = 0; x < width; ++x)
+			row[x] = block[(size_t)x * LANES + j];
+	}
+}
+
+///This will load a row into a buffer padded with r copies of the edge
+///samples on each side
+///
+/// \param src the view
+/// \param y the row
+/// \param r the padding
+/// \param padded the buffer, src.width + 2 r floats
+///
+template <typename S>
+static void load_padded_row(const image_view<const S> &src, unsigned int y, unsigned int r, float *padded) {
+	const unsigned int w = src.width;
+	load_row(src, 0, y, w, padded + r);
+	for (unsigned int k = 0; k < r; ++k) {
+		padded[k] = padded[r];
+		padded[r + w + k] = padded[r + w - 1];
+	}
+}
+
+///This will convolve a padded row with a symmetric kernel
+///
+/// \param p the row, padded by r samples on each side
+/// \param w the taps w[0..r]
+/// \param r the radius
+/// \param out the n output samples
+/// \param n the number of output samples
+///
+static void convolve_row_symmetric(const float *p, const float *w, unsigned int r, float *out, unsigned int n) {
+	const float *c = p + r;
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	for (; x + 8 <= n; x += 8) {
+		__m256 acc = _mm256_mul_ps(_mm256_set1_ps(w[0]), _mm256_loadu_ps(c + x));
+		for (unsigned int k = 1; k <= r; ++k) {
+			__m256 pair = _mm256_add_ps(_mm256_loadu_ps(c + x - k), _mm256_loadu_ps(c + x + k));
+#if defined(__FMA__)
+			acc = _mm256_fmadd_ps(_mm256_set1_ps(w[k]), pair, acc);
+#else
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]), pair));
+#endif
+		}
+		_mm256_storeu_ps(out + x, acc);
+	}
+#endif
+	for (; x < n; ++x) {
+		const float *q = c + x;
+		float acc = w[0] * q[0];
+		for (unsigned int k = 1; k <= r; ++k)
+			acc += w[k] * (*(q - k) + q[k]);
+		out[x] = acc;
+	}
+}
+
+///This will convolve the columns of 2r + 1 row segments with a symmetric
+///kernel, producing the output row of the middle segment
+///
+/// \param rows the row segments, rows[r] is the center row
+/// \param w the taps w[0..r]
+/// \param r the radius
+/// \param out the n output samples
+/// \param n the number of columns
+///
+static void convolve_columns_symmetric(const float *const *rows, const float *w, unsigned int r, float *out, unsigned int n) {
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	for (; x + 8 <= n; x += 8) {
+		__m256 acc = _mm256_mul_ps(_mm256_set1_ps(w[0]), _mm256_loadu_ps(rows[r] + x));
+		for (unsigned int k = 1; k <= r; ++k) {
+			__m256 pair = _mm256_add_ps(_mm256_loadu_ps(rows[r - k] + x), _mm256_loadu_ps(rows[r + k] + x));
+#if defined(__FMA__)
+			acc = _mm256_fmadd_ps(_mm256_set1_ps(w[k]), pair, acc);
+#else
+			acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(w[k]), pair));
+#endif
+		}
+		_mm256_storeu_ps(out + x, acc);
+	}
+#endif
+	for (; x < n; ++x) {
+		float acc = w[0] * rows[r][x];
+		for (unsigned int k = 1; k <= r; ++k)
+			acc += w[k] * (rows[r - k][x] + rows[r + k][x]);
+		out[x] = acc;
+	}
+}
+
+///This will blur a plane by separable convolution with a Gaussian.  The
+///horizontal pass fills a float copy of the plane; the vertical pass walks
+///each band of rows one column strip at a time.
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, may be src
+/// \param sigma the standard deviation in pixels
+///
+template <typename S, typename T>
+static void blur_direct_plane(const image_view<const S> &src, const image_view<T> &dst, float sigma) {
+	const std::vector<float> w = gaussian_kernel(sigma);
+	const unsigned int r = (unsigned int)w.size() - 1;
+	const unsigned int width = src.width;
+	const unsigned int height = src.height;
+	pixel_buffer<float> tmp((size_t)width * height, uninitialized);
+
+	parallel_for(0, height, 8, [&](unsigned int y0, unsigned int y1) {
+		pixel_buffer<float> padded(width + 2 * r, uninitialized);
+		for (unsigned int y = y0; y < y1; ++y) {
+			load_padded_row(src, y, r, padded.data());
+			convolve_row_symmetric(padded.data(), w.data(), r, tmp.data() + (size_t)y * width, width);
+		}
+	});
+
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		std::vector<const float *> rows(2 * r + 1);
+		pixel_buffer<float> out(STRIP, uninitialized);
+		for (unsigned int x0 = 0; x0 < width; x0 += STRIP) {
+			const unsigned int n = std::min(STRIP, width - x0);
+			for (unsigned int y = y0; y < y1; ++y) {
+				for (unsigned int k = 0; k <= 2 * r; ++k) {
+					int yy = (int)y + (int)k - (int)r;
+					yy = yy < 0 ? 0 : (yy >= (int)height ? (int)height - 1 : yy);
+					rows[k] = tmp.data() + (size_t)yy * width + x0;
+				}
+				convolve_columns_symmetric(rows.data(), w.data(), r, out.data(), n);
+				store_row(out.data(), dst, x0, y, n);
+			}
+		}
+	});
+}
+
+///Coefficients of the Young and van Vliet recursive Gaussian, normalized
+///so w[n] = B x[n] + a1 w[n-1] + a2 w[n-2] + a3 w[n-3]
+struct iir_coefficients {
+	float B;
+	float a1;
+	float a2;
+	float a3;
+	//Triggs and Sdika's matrix mapping the last forward outputs to the
+	//state that starts the backward pass as if the edge sample went on forever
+	float M[3][3];
+
+	///This will compute the coefficients for a sigma
+	///
+	/// \param sigma the standard deviation in pixels
+	///
+	iir_coefficients(float sigma) {
+		const double s = sigma;
+		const double q = s >= 2.5 ? 0.98711 * s - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * s);
+		const double q2 = q * q;
+		const double q3 = q2 * q;
+		const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+		const double b1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+		const double b2 = -(1.4281 * q2 + 1.26661 * q3);
+		const double b3 = 0.422205 * q3;
+		const double c1 = b1 / b0;
+		const double c2 = b2 / b0;
+		const double c3 = b3 / b0;
+		a1 = (float)c1;
+		a2 = (float)c2;
+		a3 = (float)c3;
+		B = (float)(1.0 - (c1 + c2 + c3));
+		//the boundary matrix, scaled by B so it applies to the normalized outputs
+		const double scale = B / ((1.0 + c1 - c2 + c3) * (1.0 - c1 - c2 - c3) * (1.0 + c2 + (c1 - c3) * c3));
+		M[0][0] = (float)(scale * (-c3 * c1 + 1.0 - c3 * c3 - c2));
+		M[0][1] = (float)(scale * (c3 + c1) * (c2 + c3 * c1));
+		M[0][2] = (float)(scale * c3 * (c1 + c3 * c2));
+		M[1][0] = (float)(scale * (c1 + c3 * c2));
+		M[1][1] = (float)(-scale * (c2 - 1.0) * (c2 + c3 * c1));
+		M[1][2] = (float)(-scale * c3 * (c3 * c1 + c3 * c3 + c2 - 1.0));
+		M[2][0] = (float)(scale * (c3 * c1 + c2 + c1 * c1 - c2 * c2));
+		M[2][1] = (float)(scale * (c1 * c2 + c3 * c2 * c2 - c1 * c3 * c3 - c3 * c3 * c3 - c3 * c2 + c3));
+		M[2][2] = (float)(scale * c3 * (c1 + c3 * c2));
+	}
+};
+
+///This will advance the recursive Gaussian one step on n lanes side by
+///side: v = B x + a1 w1 + a2 w2 + a3 w3, then the state shifts to v
+///
+/// \param in the input sample of each lane
+/// \param out the output sample of each lane, may be in
+/// \param w1 the previous outputs, updated
+/// \param w2 the outputs before those, updated
+/// \param w3 the outputs before those, updated
+/// \param n the number of lanes
+/// \param k the coefficients
+///
+static inline void iir_step(const float *in, float *out, float *w1, float *w2, float *w3, unsigned int n,
+	const iir_coefficients &k) {
+	unsigned int j = 0;
+#if defined(__AVX2__)
+	const __m256 B = _mm256_set1_ps(k.B);
+	const __m256 a1 = _mm256_set1_ps(k.a1);
+	const __m256 a2 = _mm256_set1_ps(k.a2);
+	const __m256 a3 = _mm256_set1_ps(k.a3);
+	for (; j + 8 <= n; j += 8) {
+		const __m256 v1 = _mm256_loadu_ps(w1 + j);
+		const __m256 v2 = _mm256_loadu_ps(w2 + j);
+		const __m256 v3 = _mm256_loadu_ps(w3 + j);
+#if defined(__FMA__)
+		__m256 v = _mm256_fmadd_ps(a3, v3, _mm256_mul_ps(B, _mm256_loadu_ps(in + j)));
+		v = _mm256_fmadd_ps(a2, v2, v);
+		v = _mm256_fmadd_ps(a1, v1, v);
+#else
+		__m256 v = _mm256_add_ps(_mm256_mul_ps(a3, v3), _mm256_mul_ps(B, _mm256_loadu_ps(in + j)));
+		v = _mm256_add_ps(_mm256_mul_ps(a2, v2), v);
+		v = _mm256_add_ps(_mm256_mul_ps(a1, v1), v);
+#endif
+		_mm256_storeu_ps(w3 + j, v2);
+		_mm256_storeu_ps(w2 + j, v1);
+		_mm256_storeu_ps(w1 + j, v);
+		_mm256_storeu_ps(out + j, v);
+	}
+#endif
+	for (; j < n; ++j) {
+		const float v = k.B * in[j] + k.a1 * w1[j] + k.a2 * w2[j] + k.a3 * w3[j];
+		w3[j] = w2[j];
+		w2[j] = w1[j];
+		w1[j] = v;
+		out[j] = v;
+	}
+}
+
+///This will run the recursive Gaussian forward and backward along n
+///lanes in place.  The forward pass starts from the steady state of the
+///first sample and the backward pass from Triggs and Sdika's state for
+///the last, so both edges behave as if the edge sample were repeated.
+///
+/// \param p the samples, step i of lane j at p[i * pitch + j]
+/// \param steps the number of samples per lane
+/// \param pitch the number of floats between two steps
+/// \param n the number of lanes, at most IIR_STRIP
+/// \param k the coefficients
+///
+static void iir_lanes(float *p, unsigned int steps, size_t pitch, unsigned int n, const iir_coefficients &k) {
+	float w1[IIR_STRIP], w2[IIR_STRIP], w3[IIR_STRIP], edge[IIR_STRIP];
+	float *last = p + (steps - 1) * pitch;
+	for (unsigned int j = 0; j < n; ++j) {
+		w1[j] = w2[j] = w3[j] = p[j];
+		edge[j] = last[j];
+	}
+	for (unsigned int i = 0; i < steps; ++i)
+		iir_step(p + i * pitch, p + i * pitch, w1, w2, w3, n, k);
+	//w1, w2 and w3 now hold the last three forward outputs
+	for (unsigned int j = 0; j < n; ++j) {
+		const float d0 = w1[j] - edge[j], d1 = w2[j] - edge[j], d2 = w3[j] - edge[j];
+		w1[j] = edge[j] + k.M[0][0] * d0 + k.M[0][1] * d1 + k.M[0][2] * d2;
+		w2[j] = edge[j] + k.M[1][0] * d0 + k.M[1][1] * d1 + k.M[1][2] * d2;
+		w3[j] = edge[j] + k.M[2][0] * d0 + k.M[2][1] * d1 + k.M[2][2] * d2;
+		last[j] = w1[j];
+	}
+	for (unsigned int i = steps - 1; i-- > 0;)
+		iir_step(p + i * pitch, p + i * pitch, w1, w2, w3, n, k);
+}
+
+///This will blur a plane with the recursive Gaussian.  The recursion is
+///serial along a row, so rows are filtered in interleaved groups of LANES;
+///columns are filtered a strip at a time with one lane per column.  Both
+///run a vector of lanes per step and keep the filter state in cache.
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, may be src
+/// \param sigma the standard deviation in pixels
+///
+template <typename S, typename T>
+static void blur_iir_plane(const image_view<const S> &src, const image_view<T> &dst, float sigma) {
+	const iir_coefficients k(sigma);
+	const unsigned int width = src.width;
+	const unsigned int height = src.height;
+	pixel_buffer<float> tmp((size_t)width * height, uninitialized);
+
+	const unsigned int groups = (height + LANES - 1) / LANES;
+	parallel_for(0, groups, 1, [&](unsigned int g0, unsigned int g1) {
+		pixel_buffer<float> block((size_t)width * LANES, uninitialized);
+		for (unsigned int g = g0; g < g1; ++g) {
+			const unsigned int y0 = g * LANES;
+			const unsigned int n = std::min(LANES, height - y0);
+			for (unsigned int y = y0; y < y0 + n; ++y)
+				load_row(src, 0, y, width, tmp.data() + (size_t)y * width);
+			gather_rows(tmp.data(), width, y0, n, block.data());
+			iir_lanes(block.data(), width, LANES, LANES, k);
+			scatter_rows(block.data(), tmp.data(), width, y0, n);
+		}
+	});
+
+	const unsigned int strips = (width + IIR_STRIP - 1) / IIR_STRIP;
+	parallel_for(0, strips, 1, [&](unsigned int s0, unsigned int s1) {
+		for (unsigned int s = s0; s < s1; ++s) {
+			const unsigned int x0 = s * IIR_STRIP;
+			const unsigned int n = std::min(IIR_STRIP, width - x0);
+			iir_lanes(tmp.data() + x0, height, width, n, k);
+			for (unsigned int y = 0; y < height; ++y)
+				store_row(tmp.data() + (size_t)y * width + x0, dst, x0, y, n);
+		}
+	});
+}
+
+///This will advance n running box sums one step: each output is its sum
+///times scale, then the sum takes in one sample and drops another
+///
+/// \param sum the running sums, updated
+/// \param add the samples entering the box
+/// \param sub the samples leaving the box
+/// \param out the outputs
+/// \param scale one over the box size
+/// \param n the number of lanes
+///
+static inline void box_step(float *sum, const float *add, const float *sub, float *out, float scale, unsigned int n) {
+	unsigned int j = 0;
+#if defined(__AVX2__)
+	const __m256 s = _mm256_set1_ps(scale);
+	for (; j + 8 <= n; j += 8) {
+		const __m256 v = _mm256_loadu_ps(sum + j);
+		_mm256_storeu_ps(out + j, _mm256_mul_ps(v, s));
+		_mm256_storeu_ps(sum + j, _mm256_add_ps(v, _mm256_sub_ps(_mm256_loadu_ps(add + j), _mm256_loadu_ps(sub + j))));
+	}
+#endif
+	for (; j < n; ++j) {
+		out[j] = sum[j] * scale;
+		sum[j] += add[j] - sub[j];
+	}
+}
+
+///This will run a box filter along n lanes
+///
+/// \param in the input, step i of lane j at in[i * pitch + j]
+/// \param out the output, same layout as in
+/// \param steps the number of samples per lane
+/// \param pitch the number of floats between two steps
+/// \param n the number of lanes, at most IIR_STRIP
+/// \param r the box radius
+///
+static void box_lanes(const float *in, float *out, unsigned int steps, size_t pitch, unsigned int n, unsigned int r) {
+	const float scale = 1.0f / (2 * r + 1);
+	float sum[IIR_STRIP];
+	for (unsigned int j = 0; j < n; ++j)
+		sum[j] = 0.0f;
+	for (int i = -(int)r; i <= (int)r; ++i) {
+		const float *p = in + std::min(std::max(i, 0), (int)steps - 1) * pitch;
+		for (unsigned int j = 0; j < n; ++j)
+			sum[j] += p[j];
+	}
+	for (unsigned int i = 0; i < steps; ++i) {
+		const float *add = in + std::min((int)(i + r + 1), (int)steps - 1) * pitch;
+		const float *sub = in + std::max((int)i - (int)r, 0) * pitch;
+		box_step(sum, add, sub, out + i * pitch, scale, n);
+	}
+}
+
+///This will run one horizontal box pass over a float plane, LANES
+///interleaved rows at a time
+///
+/// \param in the input plane
+/// \param out the output plane
+/// \param width the number of columns
+/// \param height the number of rows
+/// \param r the box radius
+///
+static void box_pass_rows(const float *in, float *out, unsigned int width, unsigned int height, unsigned int r) {
+	const unsigned int groups = (height + LANES - 1) / LANES;
+	parallel_for(0, groups, 1, [&](unsigned int g0, unsigned int g1) {
+		pixel_buffer<float> block((size_t)width * LANES, uninitialized);
+		pixel_buffer<float> boxed((size_t)width * LANES, uninitialized);
+		for (unsigned int g = g0; g < g1; ++g) {
+			const unsigned int y0 = g * LANES;
+			const unsigned int n = std::min(LANES, height - y0);
+			gather_rows(in, width, y0, n, block.data());
+			box_lanes(block.data(), boxed.data(), width, LANES, LANES, r);
+			scatter_rows(boxed.data(), out, width, y0, n);
+		}
+	});
+}
+
+///This will run one vertical box pass over a float plane, one column strip
+///at a time with a running sum per column
+///
+/// \param in the input plane
+/// \param out the output plane
+/// \param width the number of columns
+/// \param height the number of rows
+/// \param r the box radius
+///
+static void box_pass_columns(const float *in, float *out, unsigned int width, unsigned int height, unsigned int r) {
+	const unsigned int strips = (width + IIR_STRIP - 1) / IIR_STRIP;
+	parallel_for(0, strips, 1, [&](unsigned int s0, unsigned int s1) {
+		for (unsigned int s = s0; s < s1; ++s) {
+			const unsigned int x0 = s * IIR_STRIP;
+			box_lanes(in + x0, out + x0, height, width, std::min(IIR_STRIP, width - x0), r);
+		}
+	});
+}
+
+///This will blur a plane with a cascade of box passes
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, may be src
+/// \param radii the radius of each pass
+///
+template <typename S, typename T>
+static void box_cascade(const image_view<const S> &src, const image_view<T> &dst, const std::vector<unsigned int> &radii) {
+	const unsigned int width = src.width;
+	const unsigned int height = src.height;
+	pixel_buffer<float> a((size_t)width * height, uninitialized);
+	pixel_buffer<float> b((size_t)width * height, uninitialized);
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y)
+			load_row(src, 0, y, width, a.data() + (size_t)y * width);
+	});
+	for (size_t i = 0; i < radii.size(); ++i) {
+		box_pass_rows(a.data(), b.data(), width, height, radii[i]);
+		box_pass_columns(b.data(), a.data(), width, height, radii[i]);
+	}
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y)
+			store_row(a.data() + (size_t)y * width, dst, 0, y, width);
+	});
+}
+
+///This will return the radii of three box passes whose combined variance
+///is as close as possible to sigma^2
+///
+/// \param sigma the standard deviation in pixels
+/// \return the three radii
+///
+static std::vector<unsigned int> box_radii(float sigma) {
+	const int n = 3;
+	const double ideal = std::sqrt(12.0 * sigma * sigma / n + 1.0);
+	int wl = (int)std::floor(ideal);
+	if (wl % 2 == 0)
+		wl--;
+	wl = std::max(wl, 1);
+	const int wu = wl + 2;
+	const double m_ideal = (12.0 * sigma * sigma - n * wl * wl - 4.0 * n * wl - 3.0 * n) / (-4.0 * wl - 4.0);
+	const int m = (int)std::floor(m_ideal + 0.5);
+	std::vector<unsigned int> radii;
+	for (int i = 0; i < n; ++i)
+		radii.push_back((unsigned int)((i < m ? wl : wu) - 1) / 2);
+	return radii;
+}
+
+///This will dispatch a Gaussian blur to the chosen method
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane
+/// \param sigma the standard deviation in pixels
+/// \param method how the blur is computed
+///
+template <typename S, typename T>
+static void blur_plane(const image_view<const S> &src, const image_view<T> &dst, float sigma, blur_method method) {
+	if (src.empty())
+		return;
+	if (!(sigma > 0.0f)) {
+		copy(src, dst);
+		return;
+	}
+	if (method == blur_auto)
+		method = sigma <= BLUR_DIRECT_MAX_SIGMA ? blur_direct : blur_iir;
+	//the recursive filter's coefficients are only valid from sigma 0.5 up
+	if (method == blur_iir && sigma < 0.5f)
+		method = blur_direct;
+	if (method == blur_direct)
+		blur_direct_plane(src, dst, sigma);
+	else if (method == blur_box)
+		box_cascade(src, dst, box_radii(sigma));
+	else
+		blur_iir_plane(src, dst, sigma);
+}
+
+///This will blur an 8-bit plane with a Gaussian
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, same size as src, may be src
+/// \param sigma the standard deviation in pixels
+/// \param method how the blur is computed
+///
+void gaussian_blur(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	float sigma, blur_method method) {
+	blur_plane(src, dst, sigma, method);
+}
+
+///This will blur a float plane with a Gaussian
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, same size as src, may be src
+/// \param sigma the standard deviation in pixels
+/// \param method how the blur is computed
+///
+void gaussian_blur(const image_view<const float> &src, const image_view<float> &dst,
+	float sigma, blur_method method) {
+	blur_plane(src, dst, sigma, method);
+}
+
+///This will average an 8-bit plane over a square box
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, same size as src, may be src
+/// \param radius the box spans 2 radius + 1 pixels each way
+///
+void box_blur(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst, unsigned int radius) {
+	if (!src.empty())
+		box_cascade(src, dst, std::vector<unsigned int>(1, radius));
+}
+
+///This will average a float plane over a square box
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, same size as src, may be src
+/// \param radius the box spans 2 radius + 1 pixels each way
+///
+void box_blur(const image_view<const float> &src, const image_view<float> &dst, unsigned int radius) {
+	if (!src.empty())
+		box_cascade(src, dst, std::vector<unsigned int>(1, radius));
+}
@@ -0,0 +1,61 @@
+///
+/// \file blur.h
+/// \brief Separable Gaussian, box and recursive (IIR) blurs on image planes
+///
+/// Blurs run separably on one plane at a time: a horizontal pass into a
+/// float buffer, then a vertical pass walked in column strips so the rows
+/// the kernel spans stay in cache.  Both passes are vectorized (AVX2/FMA
+/// when the build enables them) and split over the thread pool.  For large
+/// sigmas a box cascade or a recursive filter costs the same per pixel
+/// whatever the sigma.
+///
+
+#ifndef BLUR_H
+#define BLUR_H
+
+#include <vector>
+
+#include "image_view.h"
+
+//how a Gaussian blur is computed
+enum blur_method {
+	//direct convolution for small sigma, recursive filter for large sigma
+	blur_auto,
+	//separable convolution with the sampled Gaussian
+	blur_direct,
+	//three box passes whose combined variance matches the Gaussian
+	blur_box,
+	//third order recursive filter (Young and van Vliet)
+	blur_iir
+};
+
+//largest sigma blur_auto uses direct convolution for
+const float BLUR_DIRECT_MAX_SIGMA = 4.0f;
+
+//the normalized taps w[0..r] of a sampled Gaussian, w[k] applying at offsets -k and +k
+std::vector<float> gaussian_kernel(float sigma);
+
+//blur one plane; src and dst may be the same view
+void gaussian_blur(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	float sigma, blur_method method = blur_auto);
+void gaussian_blur(const image_view<const float> &src, const image_view<float> &dst,
+	float sigma, blur_method method = blur_auto);
+
+//average over a (2 radius + 1) square; src and dst may be the same view
+void box_blur(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst, unsigned int radius);
+void box_blur(const image_view<const float> &src, const image_view<float> &dst, unsigned int radius);
+
+///This will blur all three channels of an image
+///
+/// \param src the image to blur
+/// \param dst the blurred image, same size as src
+/// \param sigma the standard deviation of the Gaussian in pixels
+/// \param method how the blur is computed
+///
+template <typename T>
+void gaussian_blur(const rgb_view<const T> &src, const rgb_view<T> &dst, float sigma, blur_method method = blur_auto) {
+	for (unsigned int c = 0; c < 3; ++c)
+		gaussian_blur(src[c], dst[c], sigma, method);
+}
+
+#endif
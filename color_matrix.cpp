@@ -0,0 +1,251 @@
+///
+/// \file color_matrix.cpp
+/// \brief 3x3 color matrices applied to the three planes in one pass
+///
+
+#include "color_matrix.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//fractional bits of the fixed-point coefficients of 8-bit planes
+static const int COLOR_BITS = 12;
+//the offset rides in a multiply-add with a constant sample of this value, which keeps it
+//inside 16 bits: offset << COLOR_BITS == (offset << (COLOR_BITS - 6)) * 64
+static const int OFFSET_SAMPLE = 64;
+
+//Rec. 709 luma weights; exact on linear light, the usual approximation on sRGB samples
+static const float LUMA_R = 0.2126f;
+static const float LUMA_G = 0.7152f;
+static const float LUMA_B = 0.0722f;
+
+///This will return a matrix scaling each channel by a gain
+///
+/// \param r the red gain
+/// \param g the green gain
+/// \param b the blue gain
+/// \return the matrix
+///
+color_matrix color_matrix::white_balance(float r, float g, float b) {
+	color_matrix out;
+	out.m[0][0] = r;
+	out.m[1][1] = g;
+	out.m[2][2] = b;
+	return out;
+}
+
+///This will return a matrix scaling each color's distance from its luma
+///
+/// \param s the scale: 0 gives grayscale, 1 the identity
+/// \return the matrix
+///
+color_matrix color_matrix::saturation(float s) {
+	const float luma[3] = { LUMA_R, LUMA_G, LUMA_B };
+	color_matrix out;
+	for (unsigned int i = 0; i < 3; ++i) {
+		for (unsigned int j = 0; j < 3; ++j)
+			out.m[i][j] = (1.0f - s) * luma[j] + (i == j ? s : 0.0f);
+	}
+	return out;
+}
+
+///This will return a matrix reordering the channels
+///
+/// \param r_from the input channel the red output takes
+/// \param g_from the input channel the green output takes
+/// \param b_from the input channel the blue output takes
+/// \return the matrix
+///
+color_matrix color_matrix::channel_swap(unsigned int r_from, unsigned int g_from, unsigned int b_from) {
+	const unsigned int from[3] = { r_from, g_from, b_from };
+	color_matrix out;
+	for (unsigned int i = 0; i < 3; ++i) {
+		for (unsigned int j = 0; j < 3; ++j)
+			out.m[i][j] = from[i] == j ? 1.0f : 0.0f;
+	}
+	return out;
+}
+
+///This will return a matrix setting every channel to the luma
+///
+/// \return the matrix
+///
+color_matrix color_matrix::grayscale() {
+	return saturation(0.0f);
+}
+
+///The coefficients of a matrix for 8-bit planes, stored as the 16-bit pairs
+///the multiply-add consumes: (m0, m1) times (r, g) plus (m2, offset) times
+///(b, OFFSET_SAMPLE), one row per output channel.
+struct fixed_matrix {
+	int16_t rg[3][2];
+	int16_t b1[3][2];
+	//false if a coefficient or offset does not fit in 16 bits
+	bool valid;
+
+	explicit fixed_matrix(const color_matrix &m) : valid(true) {
+		for (unsigned int i = 0; i < 3; ++i) {
+			const float values[4] = { m.m[i][0] * (1 << COLOR_BITS), m.m[i][1] * (1 << COLOR_BITS),
+				m.m[i][2] * (1 << COLOR_BITS),
+				//the rounding of the final shift is folded into the offset
+				(m.offset[i] * (1 << COLOR_BITS) + (1 << (COLOR_BITS - 1))) / OFFSET_SAMPLE };
+			int16_t *targets[4] = { &rg[i][0], &rg[i][1], &b1[i][0], &b1[i][1] };
+			for (unsigned int k = 0; k < 4; ++k) {
+				const float v = std::floor(values[k] + 0.5f);
+				if (!(v >= -32768.0f && v <= 32767.0f))
+					valid = false;
+				*targets[k] = valid ? (int16_t)v : 0;
+			}
+		}
+	}
+
+	///This will apply the matrix to one pixel
+	///
+	/// \param r the red input
+	/// \param g the green input
+	/// \param b the blue input
+	/// \param i the output channel
+	/// \return the output sample
+	///
+	unsigned char apply(int r, int g, int b, unsigned int i) const {
+		const int sum = (r * rg[i][0] + g * rg[i][1] + b * b1[i][0] + OFFSET_SAMPLE * b1[i][1]) >> COLOR_BITS;
+		return (unsigned char)(sum < 0 ? 0 : (sum > 255 ? 255 : sum));
+	}
+};
+
+///This will apply a matrix to one pixel of float planes
+///
+/// \param m the matrix
+/// \param r the red input
+/// \param g the green input
+/// \param b the blue input
+/// \param i the output channel
+/// \return the output sample
+///
+static inline float apply(const color_matrix &m, float r, float g, float b, unsigned int i) {
+	return m.m[i][0] * r + m.m[i][1] * g + m.m[i][2] * b + m.offset[i];
+}
+
+///This will apply a matrix to every pixel of an 8-bit image
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may share planes with src
+/// \param m the matrix
+///
+void apply_color_matrix(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	const color_matrix &m) {
+	const fixed_matrix f(m);
+#if defined(__AVX2__)
+	const bool dense = src[0].dense() && src[1].dense() && src[2].dense() && dst[0].dense() && dst[1].dense()
+		&& dst[2].dense();
+#endif
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *in[3] = { src[0].row(y), src[1].row(y), src[2].row(y) };
+			unsigned char *out[3] = { dst[0].row(y), dst[1].row(y), dst[2].row(y) };
+			const unsigned int width = src.width();
+			unsigned int x = 0;
+			if (!f.valid) {
+				//coefficients past the fixed-point range: round each float result instead
+				for (; x < width; ++x) {
+					const float r = in[0][(size_t)x * src[0].step];
+					const float g = in[1][(size_t)x * src[1].step];
+					const float b = in[2][(size_t)x * src[2].step];
+					for (unsigned int i = 0; i < 3; ++i) {
+						const float v = std::floor(apply(m, r, g, b, i) + 0.5f);
+						out[i][(size_t)x * dst[i].step] = (unsigned char)(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v));
+					}
+				}
+				continue;
+			}
+#if defined(__AVX2__)
+			if (dense) {
+				__m256i rg_weights[3], b1_weights[3];
+				for (unsigned int i = 0; i < 3; ++i) {
+					rg_weights[i] = _mm256_set1_epi32((int)(((uint32_t)(uint16_t)f.rg[i][1] << 16) | (uint16_t)f.rg[i][0]));
+					b1_weights[i] = _mm256_set1_epi32((int)(((uint32_t)(uint16_t)f.b1[i][1] << 16) | (uint16_t)f.b1[i][0]));
+				}
+				const __m256i constant = _mm256_set1_epi16(OFFSET_SAMPLE);
+				for (; x + 16 <= width; x += 16) {
+					const __m256i r = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(in[0] + x)));
+					const __m256i g = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(in[1] + x)));
+					const __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(in[2] + x)));
+					//(r, g) and (b, constant) pairs; the unpacks and packs both work within 128-bit
+					//lanes, so the samples come back in order
+					const __m256i rg_lo = _mm256_unpacklo_epi16(r, g), rg_hi = _mm256_unpackhi_epi16(r, g);
+					const __m256i b1_lo = _mm256_unpacklo_epi16(b, constant), b1_hi = _mm256_unpackhi_epi16(b, constant);
+					__m128i results[3];
+					for (unsigned int i = 0; i < 3; ++i) {
+						const __m256i lo = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg_lo, rg_weights[i]),
+							_mm256_madd_epi16(b1_lo, b1_weights[i])), COLOR_BITS);
+						const __m256i hi = _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg_hi, rg_weights[i]),
+							_mm256_madd_epi16(b1_hi, b1_weights[i])), COLOR_BITS);
+						const __m256i words = _mm256_packs_epi32(lo, hi);
+						results[i] = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8));
+					}
+					//all inputs are loaded before any output is stored, so dst may share planes with src
+					for (unsigned int i = 0; i < 3; ++i)
+						_mm_storeu_si128((__m128i *)(out[i] + x), results[i]);
+				}
+			}
+#endif
+			for (; x < width; ++x) {
+				const int r = in[0][(size_t)x * src[0].step];
+				const int g = in[1][(size_t)x * src[1].step];
+				const int b = in[2][(size_t)x * src[2].step];
+				for (unsigned int i = 0; i < 3; ++i)
+					out[i][(size_t)x * dst[i].step] = f.apply(r, g, b, i);
+			}
+		}
+	});
+}
+
+///This will apply a matrix to every pixel of a float image
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may share planes with src
+/// \param m the matrix
+///
+void apply_color_matrix(const rgb_view<const float> &src, const rgb_view<float> &dst, const color_matrix &m) {
+#if defined(__AVX2__) && defined(__FMA__)
+	const bool dense = src[0].dense() && src[1].dense() && src[2].dense() && dst[0].dense() && dst[1].dense()
+		&& dst[2].dense();
+#endif
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const float *in[3] = { src[0].row(y), src[1].row(y), src[2].row(y) };
+			float *out[3] = { dst[0].row(y), dst[1].row(y), dst[2].row(y) };
+			const unsigned int width = src.width();
+			unsigned int x = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+			if (dense) {
+				for (; x + 8 <= width; x += 8) {
+					const __m256 r = _mm256_loadu_ps(in[0] + x);
+					const __m256 g = _mm256_loadu_ps(in[1] + x);
+					const __m256 b = _mm256_loadu_ps(in[2] + x);
+					__m256 results[3];
+					for (unsigned int i = 0; i < 3; ++i) {
+						__m256 v = _mm256_fmadd_ps(_mm256_set1_ps(m.m[i][0]), r, _mm256_set1_ps(m.offset[i]));
+						v = _mm256_fmadd_ps(_mm256_set1_ps(m.m[i][1]), g, v);
+						results[i] = _mm256_fmadd_ps(_mm256_set1_ps(m.m[i][2]), b, v);
+					}
+					for (unsigned int i = 0; i < 3; ++i)
+						_mm256_storeu_ps(out[i] + x, results[i]);
+				}
+			}
+#endif
+			for (; x < width; ++x) {
+				const float r = in[0][(size_t)x * src[0].step];
+				const float g = in[1][(size_t)x * src[1].step];
+				const float b = in[2][(size_t)x * src[2].step];
+				for (unsigned int i = 0; i < 3; ++i)
+					out[i][(size_t)x * dst[i].step] = apply(m, r, g, b, i);
+			}
+		}
+	});
+}
@@ -0,0 +1,61 @@
+///
+/// \file color_matrix.h
+/// \brief 3x3 color matrices applied to the three planes in one pass
+///
+/// White balance, saturation, channel swaps, grayscale and their
+/// combinations are all a matrix times the (r, g, b) vector of each pixel,
+/// plus an offset.  The matrix is applied to all three planes at once, 16
+/// pixels at a time with AVX2, so each sample is read and written once
+/// however many adjustments the matrix combines.  8-bit planes use 12-bit
+/// fixed-point coefficients and 16-bit multiply-add; float planes use FMA.
+///
+
+#ifndef COLOR_MATRIX_H
+#define COLOR_MATRIX_H
+
+#include "image_view.h"
+
+struct color_matrix {
+	//out[i] = m[i][0] r + m[i][1] g + m[i][2] b + offset[i]
+	float m[3][3];
+	//in sample units: levels for 8-bit planes
+	float offset[3];
+
+	//the identity
+	color_matrix() : m{ { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } }, offset{ 0.0f, 0.0f, 0.0f } {}
+
+	///This will return the matrix applying this one after other
+	///
+	/// \param other the matrix applied first
+	/// \return the combined matrix
+	///
+	color_matrix operator*(const color_matrix &other) const {
+		color_matrix out;
+		for (unsigned int i = 0; i < 3; ++i) {
+			out.offset[i] = offset[i];
+			for (unsigned int j = 0; j < 3; ++j) {
+				out.m[i][j] = 0.0f;
+				for (unsigned int k = 0; k < 3; ++k)
+					out.m[i][j] += m[i][k] * other.m[k][j];
+				out.offset[i] += m[i][j] * other.offset[j];
+			}
+		}
+		return out;
+	}
+
+	//scales each channel by its gain
+	static color_matrix white_balance(float r, float g, float b);
+	//moves colors away from (s > 1) or towards (s < 1) their luma; 0 is grayscale
+	static color_matrix saturation(float s);
+	//output channel i takes input channel from[i], e.g. (2, 1, 0) swaps red and blue
+	static color_matrix channel_swap(unsigned int r_from, unsigned int g_from, unsigned int b_from);
+	//every channel set to the Rec. 709 luma
+	static color_matrix grayscale();
+};
+
+//dst = m applied to every pixel of src; dst may be src, or src's planes in another order
+void apply_color_matrix(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	const color_matrix &m);
+void apply_color_matrix(const rgb_view<const float> &src, const rgb_view<float> &dst, const color_matrix &m);
+
+#endif
@@ -0,0 +1,212 @@
+///
+/// \file components.cpp
+/// \brief Connected-component labeling of masks with per-component statistics
+///
+
+#include "components.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <iostream>
+
+//the fewest rows a band is given
+static const unsigned int COMPONENT_BAND_ROWS = 32;
+
+//the rows of a band and the labels it used
+struct label_band {
+	unsigned int y0;
+	unsigned int y1;
+	//the first label of the band and one past its last
+	uint32_t first;
+	uint32_t next;
+};
+
+///This will return the root of a label, halving the path to it on the way
+///
+/// \param parent the forest
+/// \param l the label
+/// \return the root
+///
+static inline uint32_t find_root(uint32_t *parent, uint32_t l) {
+	while (parent[l] != l) {
+		parent[l] = parent[parent[l]];
+		l = parent[l];
+	}
+	return l;
+}
+
+///This will join the sets of two labels, linking the larger root to the
+///smaller so a root is always the smallest label of its set
+///
+/// \param parent the forest
+/// \param a a label
+/// \param b another label
+/// \return the root of the joined set
+///
+static inline uint32_t join(uint32_t *parent, uint32_t a, uint32_t b) {
+	a = find_root(parent, a);
+	b = find_root(parent, b);
+	if (a < b)
+		parent[b] = a;
+	else
+		parent[a] = b;
+	return std::min(a, b);
+}
+
+///This will give every set pixel of a band a provisional label from the
+///band's own range, joining the labels of connected neighbors.  The row
+///above the band is left to the merge.
+///
+/// \param src the mask
+/// \param labels the labels
+/// \param parent the forest
+/// \param connected the connectivity
+/// \param band the band; its next label is updated
+///
+static void label_band_rows(const image_view<const unsigned char> &src, uint32_t *labels, uint32_t *parent,
+	connectivity connected, label_band &band) {
+	const unsigned int width = src.width;
+	uint32_t next = band.first;
+	for (unsigned int y = band.y0; y < band.y1; ++y) {
+		const unsigned char *in = src.row(y);
+		uint32_t *out = labels + (size_t)y * width;
+		const uint32_t *up = y > band.y0 ? out - width : 0;
+		for (unsigned int x = 0; x < width; ++x) {
+			if (!in[(size_t)x * src.step]) {
+				out[x] = 0;
+				continue;
+			}
+			const uint32_t left = x > 0 ? out[x - 1] : 0;
+			const uint32_t above = up ? up[x] : 0;
+			uint32_t l;
+			if (connected == connect_4) {
+				if (above && left)
+					l = left == above ? left : join(parent, left, above);
+				else
+					l = above ? above : left;
+			}
+			else {
+				//the pixel above touches the other three neighbors, so when it is set nothing new joins
+				const uint32_t above_left = up && x > 0 ? up[x - 1] : 0;
+				const uint32_t above_right = up && x + 1 < width ? up[x + 1] : 0;
+				if (above)
+					l = above;
+				else if (above_right)
+					l = above_left ? join(parent, above_right, above_left) :
+						left ? join(parent, above_right, left) : above_right;
+				else
+					l = above_left ? above_left : left;
+			}
+			if (!l) {
+				l = next++;
+				parent[l] = l;
+			}
+			out[x] = l;
+		}
+	}
+	band.next = next;
+}
+
+///This will label the components of a mask
+///
+/// \param src the mask; nonzero pixels are set
+/// \param connected the connectivity
+/// \return the labels and the statistics of each component; empty if the
+///mask has too many pixels to label in 32 bits
+///
+connected_components label_components(const image_view<const unsigned char> &src, connectivity connected) {
+	connected_components out;
+	const unsigned int width = src.width, height = src.height;
+	const size_t pixels = (size_t)width * height;
+	if (pixels == 0)
+		return out;
+	if (pixels >= 0xffffffffULL) {
+		std::cout << "Error. A mask of " << width << "x" << height << " has too many pixels to label." << std::endl;
+		return out;
+	}
+	out.width = width;
+	out.height = height;
+	out.labels.resize(pixels);
+	//parent[l] for every label l, which starts at 1 past the index of a pixel of its band
+	pixel_buffer<uint32_t> forest(pixels + 1, uninitialized);
+	uint32_t *labels = out.labels.data(), *parent = forest.data();
+
+	const unsigned int band_count = std::max(1u, std::min(height / COMPONENT_BAND_ROWS, 4 * thread_pool::global().size()));
+	std::vector<label_band> bands(band_count);
+	for (unsigned int b = 0; b < band_count; ++b) {
+		bands[b].y0 = (unsigned int)((unsigned long long)height * b / band_count);
+		bands[b].y1 = (unsigned int)((unsigned long long)height * (b + 1) / band_count);
+		bands[b].first = (uint32_t)((size_t)bands[b].y0 * width + 1);
+	}
+	parallel_for(0, band_count, 1, [&](unsigned int b0, unsigned int b1) {
+		for (unsigned int b = b0; b < b1; ++b)
+			label_band_rows(src, labels, parent, connected, bands[b]);
+	});
+
+	//join each band's first row to the last row of the band above
+	for (unsigned int b = 1; b < band_count; ++b) {
+		const uint32_t *row = labels + (size_t)bands[b].y0 * width, *up = row - width;
+		for (unsigned int x = 0; x < width; ++x) {
+			if (!row[x])
+				continue;
+			if (up[x])
+				join(parent, row[x], up[x]);
+			if (connected == connect_8) {
+				if (x > 0 && up[x - 1])
+					join(parent, row[x], up[x - 1]);
+				if (x + 1 < width && up[x + 1])
+					join(parent, row[x], up[x + 1]);
+			}
+		}
+	}
+
+	//number the roots in order; every other label points at a smaller one, already numbered
+	uint32_t count = 0;
+	for (unsigned int b = 0; b < band_count; ++b) {
+		for (uint32_t l = bands[b].first; l < bands[b].next; ++l)
+			parent[l] = parent[l] == l ? ++count : parent[parent[l]];
+	}
+
+	//write the final labels, summing the statistics of each provisional label of a band
+	std::vector<std::vector<component_stats> > partial(band_count);
+	parallel_for(0, band_count, 1, [&](unsigned int b0, unsigned int b1) {
+		for (unsigned int b = b0; b < b1; ++b) {
+			const label_band &band = bands[b];
+			std::vector<component_stats> &local = partial[b];
+			component_stats empty = { 0, width, height, 0, 0, 0, 0 };
+			local.assign(band.next - band.first, empty);
+			for (unsigned int y = band.y0; y < band.y1; ++y) {
+				uint32_t *row = labels + (size_t)y * width;
+				for (unsigned int x = 0; x < width; ++x) {
+					if (!row[x])
+						continue;
+					component_stats &s = local[row[x] - band.first];
+					s.area++;
+					s.left = std::min(s.left, x);
+					s.right = std::max(s.right, x);
+					s.top = std::min(s.top, y);
+					s.bottom = std::max(s.bottom, y);
+					s.sum_x += x;
+					s.sum_y += y;
+					row[x] = parent[row[x]];
+				}
+			}
+		}
+	});
+	component_stats empty = { 0, width, height, 0, 0, 0, 0 };
+	out.stats.assign(count, empty);
+	for (unsigned int b = 0; b < band_count; ++b) {
+		for (uint32_t l = bands[b].first; l < bands[b].next; ++l) {
+			const component_stats &s = partial[b][l - bands[b].first];
+			component_stats &total = out.stats[parent[l] - 1];
+			total.area += s.area;
+			total.left = std::min(total.left, s.left);
+			total.right = std::max(total.right, s.right);
+			total.top = std::min(total.top, s.top);
+			total.bottom = std::max(total.bottom, s.bottom);
+			total.sum_x += s.sum_x;
+			total.sum_y += s.sum_y;
+		}
+	}
+	return out;
+}
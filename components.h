@@ -0,0 +1,70 @@
+///
+/// \file components.h
+/// \brief Connected-component labeling of masks with per-component statistics
+///
+/// The mask is split into row bands labeled in parallel.  Each band scans
+/// its rows once, giving a pixel the label of a neighbor above or to its
+/// left and joining the labels it finds connected in a union-find forest.
+/// The labels of a band start at the index of its first pixel, so every
+/// band draws from its own range and all of them share one forest without
+/// locks.  The bands are then joined along the rows where they meet.
+///
+/// Each set is linked to its smallest label, which is the first pixel of
+/// the component in raster order, so numbering the roots in order gives
+/// final labels in the order components first appear, whatever the number
+/// of threads.  A last parallel pass writes the final labels and sums the
+/// statistics of each band's labels, which are then added per component.
+///
+
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "image_view.h"
+#include "pixel_buffer.h"
+
+//which neighbors of a pixel it is connected to
+enum connectivity {
+	//left, right, up and down
+	connect_4,
+	//the diagonals too
+	connect_8
+};
+
+struct component_stats {
+	//the number of pixels
+	uint64_t area;
+	//the bounding box, inclusive
+	unsigned int left;
+	unsigned int top;
+	unsigned int right;
+	unsigned int bottom;
+	//the sums of the pixels' coordinates
+	uint64_t sum_x;
+	uint64_t sum_y;
+
+	double centroid_x() const { return (double)sum_x / area; }
+	double centroid_y() const { return (double)sum_y / area; }
+};
+
+struct connected_components {
+	unsigned int width;
+	unsigned int height;
+	//width * height labels, row after row: 0 for the background, 1 to count() for the components
+	pixel_buffer<uint32_t> labels;
+	//stats[l - 1]: the statistics of component l
+	std::vector<component_stats> stats;
+
+	connected_components() : width(0), height(0) {}
+
+	unsigned int count() const { return (unsigned int)stats.size(); }
+	image_view<const uint32_t> view() const { return image_view<const uint32_t>(labels.data(), width, height, width); }
+};
+
+//the components of the nonzero pixels of a mask, numbered in the order their first pixels appear
+connected_components label_components(const image_view<const unsigned char> &src,
+	connectivity connected = connect_8);
+
+#endif
@@ -0,0 +1,532 @@
+///
+/// \file convolve.cpp
+/// \brief General 2D convolution of image planes
+///
+
+#include "convolve.h"
+#include "fft.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//output samples per tile; the input window adds the kernel size minus one each way
+static const unsigned int TILE_WIDTH = 256;
+static const unsigned int TILE_HEIGHT = 32;
+
+//columns of the spectrum the FFT path gathers and transforms together
+static const unsigned int FFT_COLUMN_BATCH = 8;
+//relative cost of one tap on one sample of the direct path and of one
+//point of the FFT path per log2 of the number of points.  Measured with
+//AVX2 on one thread on the 3200x3024 image of bench convolve: a 31x31 box
+//took 1660 ms direct and 1300 ms through the FFT, 0.18 ns per tap and
+//sample against 4.8 ns per point and log2, so the two break even near 27x27
+static const double DIRECT_COST_PER_TAP = 1.0;
+static const double FFT_COST_PER_POINT = 27.0;
+
+//filters one tile: buf holds the input window, out receives tw x th samples
+typedef void (*tile_filter)(const float *buf, size_t pitch, const kernel2d &k, float bias,
+	float *out, unsigned int tw, unsigned int th);
+
+///This will convert a float back to a sample, rounding and clamping 8-bit
+///samples
+static inline void store_sample(float v, unsigned char &out) {
+	v = v + 0.5f;
+	out = (unsigned char)(v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v));
+}
+static inline void store_sample(float v, float &out) {
+	out = v;
+}
+
+#if defined(__AVX2__)
+///This will return a * b + c, fused when the build enables FMA
+static inline __m256 multiply_add(__m256 a, __m256 b, __m256 c) {
+#if defined(__FMA__)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+#endif
+
+///This will return true if two views share any memory
+///
+/// \param a the first view
+/// \param b the second view
+/// \return true if the address ranges of a and b overlap
+///
+template <typename S, typename T>
+static bool overlaps(const image_view<S> &a, const image_view<T> &b) {
+	const char *a0 = (const char *)a.data;
+	const char *a1 = (const char *)&a(a.width - 1, a.height - 1) + sizeof(S);
+	const char *b0 = (const char *)b.data;
+	const char *b1 = (const char *)&b(b.width - 1, b.height - 1) + sizeof(T);
+	return a0 < b1 && b0 < a1;
+}
+
+///This will copy a window of a view into floats, repeating the edge samples
+///of the view for the parts of the window outside it
+///
+/// \param src the view
+/// \param x0 the first column of the window, may be negative
+/// \param y0 the first row of the window, may be negative
+/// \param bw the number of columns of the window
+/// \param bh the number of rows of the window
+/// \param buf the window, bh rows of bw floats
+///
+template <typename S>
+static void load_window(const image_view<const S> &src, int x0, int y0, unsigned int bw, unsigned int bh, float *buf) {
+	const int w = (int)src.width;
+	const int h = (int)src.height;
+	//the columns of the window that lie inside the view
+	const int in0 = std::min(std::max(-x0, 0), (int)bw);
+	const int in1 = std::max(std::min(w - x0, (int)bw), in0);
+	for (unsigned int j = 0; j < bh; ++j) {
+		const int y = std::min(std::max(y0 + (int)j, 0), h - 1);
+		const S *row = src.row((unsigned int)y);
+		float *out = buf + (size_t)j * bw;
+		const float first = (float)row[0];
+		const float last = (float)row[(size_t)(w - 1) * src.step];
+		for (int i = 0; i < in0; ++i)
+			out[i] = first;
+		if (src.dense()) {
+			const S *in = row + x0;
+			for (int i = in0; i < in1; ++i)
+				out[i] = (float)in[i];
+		}
+		else {
+			for (int i = in0; i < in1; ++i)
+				out[i] = (float)row[(size_t)(x0 + i) * src.step];
+		}
+		for (int i = in1; i < (int)bw; ++i)
+			out[i] = last;
+	}
+}
+
+///This will apply a kernel to one tile.  KW and KH fix the kernel size at
+///compile time so the tap loops unroll and the taps stay in registers; 0
+///takes the size from the kernel.
+///
+/// \param buf the input window, (th + kernel height - 1) rows
+/// \param pitch the number of floats in a row of buf
+/// \param k the kernel
+/// \param bias the value added to every output
+/// \param out the tw x th outputs
+/// \param tw the number of output columns
+/// \param th the number of output rows
+///
+template <unsigned int KW, unsigned int KH>
+static void filter_tile(const float *buf, size_t pitch, const kernel2d &k, float bias,
+	float *out, unsigned int tw, unsigned int th) {
+	const unsigned int kw = KW ? KW : k.width;
+	const unsigned int kh = KH ? KH : k.height;
+	const float *taps = k.taps.data();
+	for (unsigned int y = 0; y < th; ++y) {
+		const float *in = buf + (size_t)y * pitch;
+		float *o = out + (size_t)y * tw;
+		unsigned int x = 0;
+#if defined(__AVX2__)
+		//four independent sums per tap hide the latency of the multiply-adds
+		for (; x + 32 <= tw; x += 32) {
+			__m256 acc0 = _mm256_set1_ps(bias), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+			for (unsigned int j = 0; j < kh; ++j) {
+				const float *row = in + (size_t)j * pitch + x;
+				for (unsigned int i = 0; i < kw; ++i) {
+					const __m256 t = _mm256_set1_ps(taps[j * kw + i]);
+					acc0 = multiply_add(t, _mm256_loadu_ps(row + i), acc0);
+					acc1 = multiply_add(t, _mm256_loadu_ps(row + i + 8), acc1);
+					acc2 = multiply_add(t, _mm256_loadu_ps(row + i + 16), acc2);
+					acc3 = multiply_add(t, _mm256_loadu_ps(row + i + 24), acc3);
+				}
+			}
+			_mm256_storeu_ps(o + x, acc0);
+			_mm256_storeu_ps(o + x + 8, acc1);
+			_mm256_storeu_ps(o + x + 16, acc2);
+			_mm256_storeu_ps(o + x + 24, acc3);
+		}
+		for (; x + 8 <= tw; x += 8) {
+			__m256 acc = _mm256_set1_ps(bias);
+			for (unsigned int j = 0; j < kh; ++j) {
+				const float *row = in + (size_t)j * pitch + x;
+				for (unsigned int i = 0; i < kw; ++i)
+					acc = multiply_add(_mm256_set1_ps(taps[j * kw + i]), _mm256_loadu_ps(row + i), acc);
+			}
+			_mm256_storeu_ps(o + x, acc);
+		}
+#endif
+		for (; x < tw; ++x) {
+			float acc = bias;
+			for (unsigned int j = 0; j < kh; ++j) {
+				const float *row = in + (size_t)j * pitch + x;
+				for (unsigned int i = 0; i < kw; ++i)
+					acc += taps[j * kw + i] * row[i];
+			}
+			o[x] = acc;
+		}
+	}
+}
+
+///This will return the tile filter for a kernel, specialized when its size
+///is one of the common ones
+///
+/// \param k the kernel
+/// \return the filter
+///
+static tile_filter select_filter(const kernel2d &k) {
+	if (k.width == 3 && k.height == 3)
+		return filter_tile<3, 3>;
+	if (k.width == 5 && k.height == 5)
+		return filter_tile<5, 5>;
+	if (k.width == 1 && k.height == 3)
+		return filter_tile<1, 3>;
+	if (k.width == 3 && k.height == 1)
+		return filter_tile<3, 1>;
+	return filter_tile<0, 0>;
+}
+
+///This will apply a kernel to a plane directly, one tile per task
+///
+/// \param src the plane to filter
+/// \param dst the filtered plane, same size as src
+/// \param k the kernel
+/// \param bias the value added to every output sample
+///
+template <typename T>
+static void convolve_direct_plane(const image_view<const T> &src, const image_view<T> &dst, const kernel2d &k, float bias) {
+	if (src.empty() || k.taps.empty())
+		return;
+	const unsigned int width = src.width;
+	const unsigned int height = src.height;
+
+	//tiles read past their own borders, so filtering in place needs a copy of the input
+	image_view<const T> in = src;
+	pixel_buffer<T> copied;
+	if (overlaps(src, dst)) {
+		copied.resize((size_t)width * height);
+		copy(src, image_view<T>(copied.data(), width, height, width));
+		in = image_view<const T>(copied.data(), width, height, width);
+	}
+
+	const tile_filter filter = select_filter(k);
+	const unsigned int tiles_x = (width + TILE_WIDTH - 1) / TILE_WIDTH;
+	const unsigned int tiles_y = (height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	parallel_for(0, tiles_x * tiles_y, 1, [&](unsigned int t0, unsigned int t1) {
+		const size_t pitch = TILE_WIDTH + k.width - 1;
+		pixel_buffer<float> buf(pitch * (TILE_HEIGHT + k.height - 1), uninitialized);
+		pixel_buffer<float> out((size_t)TILE_WIDTH * TILE_HEIGHT, uninitialized);
+		for (unsigned int t = t0; t < t1; ++t) {
+			const unsigned int x0 = (t % tiles_x) * TILE_WIDTH;
+			const unsigned int y0 = (t / tiles_x) * TILE_HEIGHT;
+			const unsigned int tw = std::min(TILE_WIDTH, width - x0);
+			const unsigned int th = std::min(TILE_HEIGHT, height - y0);
+			const unsigned int bw = tw + k.width - 1;
+			load_window(in, (int)x0 - (int)k.center_x(), (int)y0 - (int)k.center_y(), bw, th + k.height - 1, buf.data());
+			filter(buf.data(), bw, k, bias, out.data(), tw, th);
+			for (unsigned int y = 0; y < th; ++y) {
+				const float *o = out.data() + (size_t)y * tw;
+				T *row = &dst(x0, y0 + y);
+				if (dst.dense()) {
+					for (unsigned int x = 0; x < tw; ++x)
+						store_sample(o[x], row[x]);
+				}
+				else {
+					for (unsigned int x = 0; x < tw; ++x)
+						store_sample(o[x], row[(size_t)x * dst.step]);
+				}
+			}
+		}
+	});
+}
+
+///Convolution of planes of one size with one kernel through the FFT.  The
+///plane is extended by the kernel's halo (edges repeated) and zero padded
+///to n x m; the flipped kernel is wrapped around the origin of an n x m
+///plane, so the circular convolution of the two equals the correlation
+///over the plane.  Two real rows are transformed at once as the real and
+///imaginary parts of one complex row, and only the n / 2 + 1 columns of
+///the spectrum that a real row does not mirror are kept.
+class fft_convolver {
+	unsigned int width;
+	unsigned int height;
+	//the plane plus the halo the kernel reaches around it
+	unsigned int ext_width;
+	unsigned int ext_height;
+	int cx;
+	int cy;
+	//the transform size
+	unsigned int n;
+	unsigned int m;
+	//the columns kept of a row spectrum, n / 2 + 1
+	unsigned int bins;
+	fft_plan row_plan;
+	fft_plan column_plan;
+	//the kernel's spectrum scaled by 1 / (n m), column by column
+	pixel_buffer<complex_float> kernel_spectrum;
+	//the spectrum being filtered, m rows of bins
+	pixel_buffer<complex_float> spectrum;
+
+	template <typename F>
+	void forward_rows(unsigned int rows, F load_row);
+	template <typename F>
+	void transform_columns(F filter_column);
+
+public:
+	fft_convolver(unsigned int _width, unsigned int _height, const kernel2d &k);
+
+	template <typename T>
+	void apply(const image_view<const T> &src, const image_view<T> &dst, float bias);
+};
+
+///This will transform the rows of a real n x m plane into spectrum, two
+///rows per complex FFT
+///
+/// \param rows the rows from 0 that can be nonzero; the others are zero
+/// \param load_row load_row(y, out) writes the n samples of row y to out
+///
+template <typename F>
+void fft_convolver::forward_rows(unsigned int rows, F load_row) {
+	parallel_for(0, (m + 1) / 2, 4, [&](unsigned int p0, unsigned int p1) {
+		std::vector<float> a(n), b(n);
+		std::vector<complex_float> z(n), spec(n);
+		for (unsigned int p = p0; p < p1; ++p) {
+			const unsigned int y = 2 * p;
+			complex_float *sa = spectrum.data() + (size_t)y * bins;
+			complex_float *sb = y + 1 < m ? sa + bins : 0;
+			if (y >= rows) {
+				std::fill(sa, sa + bins, complex_float());
+				if (sb)
+					std::fill(sb, sb + bins, complex_float());
+				continue;
+			}
+			load_row(y, a.data());
+			if (y + 1 < rows)
+				load_row(y + 1, b.data());
+			else
+				std::fill(b.begin(), b.end(), 0.0f);
+			for (unsigned int x = 0; x < n; ++x)
+				z[x] = complex_float(a[x], b[x]);
+			row_plan.forward(z.data(), spec.data());
+			//split Z = A + iB using A[k] = conj(A[n - k]) and B[k] = conj(B[n - k])
+			for (unsigned int k = 0; k < bins; ++k) {
+				const complex_float zk = spec[k];
+				const complex_float zc = std::conj(spec[(n - k) % n]);
+				sa[k] = complex_float(0.5f * (zk.real() + zc.real()), 0.5f * (zk.imag() + zc.imag()));
+				if (sb)
+					sb[k] = complex_float(0.5f * (zk.imag() - zc.imag()), -0.5f * (zk.real() - zc.real()));
+			}
+		}
+	});
+}
+
+///This will transform every column of spectrum, FFT_COLUMN_BATCH columns
+///per gather so the reads use whole cache lines
+///
+/// \param filter_column filter_column(k, column, scratch) is called with the
+///forward transform of column k and may write a result back into column
+///
+template <typename F>
+void fft_convolver::transform_columns(F filter_column) {
+	const unsigned int batches = (bins + FFT_COLUMN_BATCH - 1) / FFT_COLUMN_BATCH;
+	parallel_for(0, batches, 1, [&](unsigned int b0, unsigned int b1) {
+		std::vector<complex_float> columns((size_t)m * FFT_COLUMN_BATCH);
+		std::vector<complex_float> spec(m);
+		for (unsigned int b = b0; b < b1; ++b) {
+			const unsigned int k0 = b * FFT_COLUMN_BATCH;
+			const unsigned int count = std::min(FFT_COLUMN_BATCH, bins - k0);
+			for (unsigned int y = 0; y < m; ++y) {
+				const complex_float *row = spectrum.data() + (size_t)y * bins + k0;
+				for (unsigned int c = 0; c < count; ++c)
+					columns[(size_t)c * m + y] = row[c];
+			}
+			for (unsigned int c = 0; c < count; ++c) {
+				complex_float *column = &columns[(size_t)c * m];
+				column_plan.forward(column, spec.data());
+				filter_column(k0 + c, spec.data(), column);
+			}
+			for (unsigned int y = 0; y < m; ++y) {
+				complex_float *row = spectrum.data() + (size_t)y * bins + k0;
+				for (unsigned int c = 0; c < count; ++c)
+					row[c] = columns[(size_t)c * m + y];
+			}
+		}
+	});
+}
+
+///This will transform the kernel for planes of a size
+///
+/// \param _width the number of columns of the planes
+/// \param _height the number of rows of the planes
+/// \param k the kernel
+///
+fft_convolver::fft_convolver(unsigned int _width, unsigned int _height, const kernel2d &k)
+	: width(_width), height(_height), ext_width(_width + k.width - 1), ext_height(_height + k.height - 1),
+	cx((int)k.center_x()), cy((int)k.center_y()), n(fft_good_size(ext_width)), m(fft_good_size(ext_height)),
+	bins(n / 2 + 1), row_plan(n), column_plan(m),
+	kernel_spectrum((size_t)bins * m, uninitialized), spectrum((size_t)bins * m, uninitialized) {
+	//tap (i, j) goes to (-i, -j) mod (n, m), which turns the convolution into the correlation
+	forward_rows(m, [&](unsigned int y, float *out) {
+		std::fill(out, out + n, 0.0f);
+		const unsigned int j = (m - y) % m;
+		if (j < k.height) {
+			for (unsigned int i = 0; i < k.width; ++i)
+				out[(n - i) % n] = k(i, j);
+		}
+	});
+	const float scale = 1.0f / ((float)n * (float)m);
+	transform_columns([&](unsigned int c, const complex_float *spec, complex_float *) {
+		complex_float *out = kernel_spectrum.data() + (size_t)c * m;
+		for (unsigned int v = 0; v < m; ++v)
+			out[v] = spec[v] * scale;
+	});
+}
+
+///This will convolve a plane with the kernel
+///
+/// \param src the plane to filter, of the size the convolver was built for
+/// \param dst the filtered plane, may be src
+/// \param bias the value added to every output sample
+///
+template <typename T>
+void fft_convolver::apply(const image_view<const T> &src, const image_view<T> &dst, float bias) {
+	forward_rows(ext_height, [&](unsigned int y, float *out) {
+		load_window(src, -cx, (int)y - cy, ext_width, 1, out);
+		std::fill(out + ext_width, out + n, 0.0f);
+	});
+	transform_columns([&](unsigned int c, complex_float *spec, complex_float *column) {
+		const complex_float *ks = kernel_spectrum.data() + (size_t)c * m;
+		for (unsigned int v = 0; v < m; ++v) {
+			const complex_float a = spec[v], b = ks[v];
+			spec[v] = complex_float(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+		}
+		column_plan.inverse(spec, column);
+	});
+	//rebuild the full spectrum of each pair of rows and take both rows back at once
+	parallel_for(0, (height + 1) / 2, 4, [&](unsigned int p0, unsigned int p1) {
+		std::vector<complex_float> spec(n), z(n);
+		for (unsigned int p = p0; p < p1; ++p) {
+			const unsigned int y = 2 * p;
+			const complex_float *sa = spectrum.data() + (size_t)y * bins;
+			const complex_float *sb = y + 1 < m ? sa + bins : 0;
+			for (unsigned int k = 0; k < n; ++k) {
+				const bool mirrored = k >= bins;
+				const unsigned int kk = mirrored ? n - k : k;
+				complex_float a = sa[kk];
+				complex_float b = sb ? sb[kk] : complex_float();
+				if (mirrored) {
+					a = std::conj(a);
+					b = std::conj(b);
+				}
+				spec[k] = complex_float(a.real() - b.imag(), a.imag() + b.real());
+			}
+			row_plan.inverse(spec.data(), z.data());
+			T *ra = &dst(0, y);
+			for (unsigned int x = 0; x < width; ++x)
+				store_sample(z[x].real() + bias, ra[(size_t)x * dst.step]);
+			if (y + 1 < height) {
+				T *rb = &dst(0, y + 1);
+				for (unsigned int x = 0; x < width; ++x)
+					store_sample(z[x].imag() + bias, rb[(size_t)x * dst.step]);
+			}
+		}
+	});
+}
+
+///This will estimate whether the FFT path is faster than the direct path
+///for a kernel on a plane.  The direct path costs a multiply-add per tap
+///and sample; the FFT path costs O(N log N) in the padded size, plus a
+///third of a kernel transform as the three channels share one.
+///
+/// \param width the number of columns of the plane
+/// \param height the number of rows of the plane
+/// \param k the kernel
+/// \return true if the FFT path is expected to be faster
+///
+bool convolve_prefers_fft(unsigned int width, unsigned int height, const kernel2d &k) {
+	const double direct = DIRECT_COST_PER_TAP * width * height * k.width * k.height;
+	const double points = (double)fft_good_size(width + k.width - 1) * fft_good_size(height + k.height - 1);
+	const double fft = FFT_COST_PER_POINT * points * std::log2(points) * (1.0 + 0.5 / 3.0);
+	return fft < direct;
+}
+
+///This will apply a kernel to the planes of an image with the chosen method
+///
+/// \param src the planes to filter
+/// \param dst the filtered planes
+/// \param planes the number of planes
+/// \param k the kernel
+/// \param bias the value added to every output sample
+/// \param method how the convolution is computed
+///
+template <typename T>
+static void convolve_planes(const image_view<const T> *src, const image_view<T> *dst, unsigned int planes,
+	const kernel2d &k, float bias, convolve_method method) {
+	if (planes == 0 || src[0].empty() || k.taps.empty())
+		return;
+	if (method == convolve_auto)
+		method = convolve_prefers_fft(src[0].width, src[0].height, k) ? convolve_fft : convolve_direct;
+	if (method == convolve_direct) {
+		for (unsigned int c = 0; c < planes; ++c)
+			convolve_direct_plane(src[c], dst[c], k, bias);
+		return;
+	}
+	fft_convolver fft(src[0].width, src[0].height, k);
+	for (unsigned int c = 0; c < planes; ++c)
+		fft.apply(src[c], dst[c], bias);
+}
+
+///This will apply a kernel to an 8-bit plane
+///
+/// \param src the plane to filter
+/// \param dst the filtered plane, same size as src, may be src
+/// \param k the kernel
+/// \param bias the value added to every output sample
+/// \param method how the convolution is computed
+///
+void convolve(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	const kernel2d &k, float bias, convolve_method method) {
+	convolve_planes(&src, &dst, 1, k, bias, method);
+}
+
+///This will apply a kernel to a float plane
+///
+/// \param src the plane to filter
+/// \param dst the filtered plane, same size as src, may be src
+/// \param k the kernel
+/// \param bias the value added to every output sample
+/// \param method how the convolution is computed
+///
+void convolve(const image_view<const float> &src, const image_view<float> &dst,
+	const kernel2d &k, float bias, convolve_method method) {
+	convolve_planes(&src, &dst, 1, k, bias, method);
+}
+
+///This will apply a kernel to the three channels of an 8-bit image
+///
+/// \param src the image to filter
+/// \param dst the filtered image, same size as src, may be src
+/// \param k the kernel
+/// \param bias the value added to every output sample
+/// \param method how the convolution is computed
+///
+void convolve(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	const kernel2d &k, float bias, convolve_method method) {
+	convolve_planes(src.planes, dst.planes, 3, k, bias, method);
+}
+
+///This will apply a kernel to the three channels of a float image
+///
+/// \param src the image to filter
+/// \param dst the filtered image, same size as src, may be src
+/// \param k the kernel
+/// \param bias the value added to every output sample
+/// \param method how the convolution is computed
+///
+void convolve(const rgb_view<const float> &src, const rgb_view<float> &dst,
+	const kernel2d &k, float bias, convolve_method method) {
+	convolve_planes(src.planes, dst.planes, 3, k, bias, method);
+}
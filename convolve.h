@@ -0,0 +1,88 @@
+///
+/// \file convolve.h
+/// \brief General 2D convolution of image planes
+///
+/// A kernel of any size is applied one output tile at a time.  Each tile
+/// first copies its input window, with a halo of kernel radius around it
+/// and the image edges repeated, into a small float buffer; the taps then
+/// run over that buffer without any bounds checks.  3x3 and 5x5 kernels use
+/// loops specialized at compile time, and tiles are spread over the thread
+/// pool.
+///
+/// The cost of the direct path grows with the kernel area.  Past a size a
+/// cost model decides, large kernels instead go through a real 2D FFT of
+/// the image padded to a 2^a 3^b 5^c size, whose cost hardly depends on
+/// the kernel.
+///
+
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+
+#include <vector>
+
+#include "image_view.h"
+
+struct kernel2d {
+	unsigned int width;
+	unsigned int height;
+	//the taps, row by row
+	std::vector<float> taps;
+
+	kernel2d() : width(0), height(0) {}
+	//a width x height kernel of zeros
+	kernel2d(unsigned int _width, unsigned int _height) : width(_width), height(_height), taps((size_t)_width * _height, 0.0f) {}
+	//a width x height kernel with the given taps, row by row
+	kernel2d(unsigned int _width, unsigned int _height, const float *_taps)
+		: width(_width), height(_height), taps(_taps, _taps + (size_t)_width * _height) {}
+
+	float &operator()(unsigned int x, unsigned int y) { return taps[(size_t)y * width + x]; }
+	float operator()(unsigned int x, unsigned int y) const { return taps[(size_t)y * width + x]; }
+	//the tap over the output pixel
+	unsigned int center_x() const { return width / 2; }
+	unsigned int center_y() const { return height / 2; }
+
+	///This will return the kernel scaled so its taps sum to one.  A kernel
+	///whose taps sum to zero (an edge detector, say) is returned unchanged.
+	///
+	/// \return the normalized kernel
+	///
+	kernel2d normalized() const {
+		double sum = 0.0;
+		for (size_t i = 0; i < taps.size(); ++i)
+			sum += taps[i];
+		kernel2d k(*this);
+		if (sum != 0.0) {
+			for (size_t i = 0; i < k.taps.size(); ++i)
+				k.taps[i] = (float)(k.taps[i] / sum);
+		}
+		return k;
+	}
+};
+
+//how a convolution is computed
+enum convolve_method {
+	//whichever of the two the cost model expects to be faster
+	convolve_auto,
+	//tiled direct convolution
+	convolve_direct,
+	//multiplication of the spectra of the image and the kernel
+	convolve_fft
+};
+
+//dst(x, y) = bias + sum of k(i, j) src(x + i - cx, y + j - cy), with the edges of src repeated
+//(a correlation; flip the kernel for a true convolution).  src and dst may be the same view.
+void convolve(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	const kernel2d &k, float bias = 0.0f, convolve_method method = convolve_auto);
+void convolve(const image_view<const float> &src, const image_view<float> &dst,
+	const kernel2d &k, float bias = 0.0f, convolve_method method = convolve_auto);
+
+//the same for all three channels; the FFT path transforms the kernel once for all of them
+void convolve(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	const kernel2d &k, float bias = 0.0f, convolve_method method = convolve_auto);
+void convolve(const rgb_view<const float> &src, const rgb_view<float> &dst,
+	const kernel2d &k, float bias = 0.0f, convolve_method method = convolve_auto);
+
+//true if the cost model picks the FFT for a kernel on a width x height plane
+bool convolve_prefers_fft(unsigned int width, unsigned int height, const kernel2d &k);
+
+#endif
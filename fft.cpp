@@ -0,0 +1,267 @@
+///
+/// \file fft.cpp
+/// \brief Mixed-radix complex FFT
+///
+/// Stage s of radix p takes the DFTs of length L of the n / L subsequences
+/// x[k], x[k + n / L], x[k + 2 n / L], ... and merges each p of them that
+/// interleave into a DFT of length L p.  Sample j of the merged transform
+/// k, for j = j0 + L r, is the p point DFT over q of the inputs
+/// X[q](j0) e^(-2 pi i q j0 / (L p)), taken at r.  Transform k of length L
+/// is kept at k L, so after the last stage the whole DFT is in order.
+///
+
+#include "fft.h"
+
+#include <cmath>
+
+///This will multiply two complex numbers.  std::complex's operator* checks
+///for infinities and NaNs through a library call, which would dominate the
+///butterflies.
+static inline complex_float mul(const complex_float &a, const complex_float &b) {
+	return complex_float(a.real() * b.real() - a.imag() * b.imag(), a.real() * b.imag() + a.imag() * b.real());
+}
+
+///This will return z times i, or times -i
+///
+/// \param z the number
+/// \param sign +1.0f for i, -1.0f for -i
+/// \return z rotated a quarter turn
+///
+static inline complex_float quarter_turn(const complex_float &z, float sign) {
+	return complex_float(-sign * z.imag(), sign * z.real());
+}
+
+///The stages below merge, for every j < length, the inputs j of the p
+///transforms k, k + groups, ..., k + (p - 1) groups into outputs j,
+///j + length, ..., j + (p - 1) length of transform k of the next stage.
+///The twiddles of input q are tw[q j groups]; looping over k inside j
+///loads them once per j.
+
+///This will run a radix 2 stage
+static void radix2(const complex_float *x, complex_float *y, unsigned int length, unsigned int groups,
+	const complex_float *tw) {
+	const size_t across = (size_t)groups * length;
+	for (unsigned int j = 0; j < length; ++j) {
+		const complex_float w1 = tw[(size_t)j * groups];
+		for (unsigned int k = 0; k < groups; ++k) {
+			const complex_float *in = x + (size_t)k * length + j;
+			complex_float *out = y + (size_t)k * 2 * length + j;
+			const complex_float a0 = in[0], a1 = mul(in[across], w1);
+			out[0] = a0 + a1;
+			out[length] = a0 - a1;
+		}
+	}
+}
+
+///This will run a radix 4 stage, whose DFT only needs quarter turns
+static void radix4(const complex_float *x, complex_float *y, unsigned int length, unsigned int groups,
+	const complex_float *tw, float sign) {
+	const size_t across = (size_t)groups * length;
+	for (unsigned int j = 0; j < length; ++j) {
+		const size_t w = (size_t)j * groups;
+		const complex_float w1 = tw[w], w2 = tw[2 * w], w3 = tw[3 * w];
+		for (unsigned int k = 0; k < groups; ++k) {
+			const complex_float *in = x + (size_t)k * length + j;
+			complex_float *out = y + (size_t)k * 4 * length + j;
+			const complex_float a0 = in[0], a1 = mul(in[across], w1);
+			const complex_float a2 = mul(in[2 * across], w2), a3 = mul(in[3 * across], w3);
+			const complex_float even_sum = a0 + a2, even_diff = a0 - a2;
+			const complex_float odd_sum = a1 + a3, odd_diff = quarter_turn(a1 - a3, sign);
+			out[0] = even_sum + odd_sum;
+			out[length] = even_diff + odd_diff;
+			out[2 * length] = even_sum - odd_sum;
+			out[3 * length] = even_diff - odd_diff;
+		}
+	}
+}
+
+///This will run a radix 3 stage.  The roots are -1/2 -+ i sqrt(3)/2.
+static void radix3(const complex_float *x, complex_float *y, unsigned int length, unsigned int groups,
+	const complex_float *tw, float sign) {
+	const size_t across = (size_t)groups * length;
+	const float half_root3 = 0.86602540378443865f;
+	for (unsigned int j = 0; j < length; ++j) {
+		const size_t w = (size_t)j * groups;
+		const complex_float w1 = tw[w], w2 = tw[2 * w];
+		for (unsigned int k = 0; k < groups; ++k) {
+			const complex_float *in = x + (size_t)k * length + j;
+			complex_float *out = y + (size_t)k * 3 * length + j;
+			const complex_float a0 = in[0], a1 = mul(in[across], w1), a2 = mul(in[2 * across], w2);
+			const complex_float sum = a1 + a2;
+			const complex_float rest = a0 - 0.5f * sum;
+			const complex_float turn = half_root3 * quarter_turn(a1 - a2, sign);
+			out[0] = a0 + sum;
+			out[length] = rest + turn;
+			out[2 * length] = rest - turn;
+		}
+	}
+}
+
+///This will run a radix 5 stage.  Inputs 1 and 4, and 2 and 3, meet the
+///same cosines and opposite sines, so their sums and differences are
+///formed first.
+static void radix5(const complex_float *x, complex_float *y, unsigned int length, unsigned int groups,
+	const complex_float *tw, float sign) {
+	const size_t across = (size_t)groups * length;
+	const double pi = 3.14159265358979323846;
+	const float c1 = (float)std::cos(0.4 * pi), c2 = (float)std::cos(0.8 * pi);
+	const float s1 = (float)std::sin(0.4 * pi), s2 = (float)std::sin(0.8 * pi);
+	for (unsigned int j = 0; j < length; ++j) {
+		const size_t w = (size_t)j * groups;
+		const complex_float w1 = tw[w], w2 = tw[2 * w], w3 = tw[3 * w], w4 = tw[4 * w];
+		for (unsigned int k = 0; k < groups; ++k) {
+			const complex_float *in = x + (size_t)k * length + j;
+			complex_float *out = y + (size_t)k * 5 * length + j;
+			const complex_float a0 = in[0], a1 = mul(in[across], w1), a2 = mul(in[2 * across], w2);
+			const complex_float a3 = mul(in[3 * across], w3), a4 = mul(in[4 * across], w4);
+			const complex_float outer_sum = a1 + a4, outer_diff = a1 - a4;
+			const complex_float inner_sum = a2 + a3, inner_diff = a2 - a3;
+			const complex_float near_real = a0 + c1 * outer_sum + c2 * inner_sum;
+			const complex_float far_real = a0 + c2 * outer_sum + c1 * inner_sum;
+			const complex_float near_turn = quarter_turn(s1 * outer_diff + s2 * inner_diff, sign);
+			const complex_float far_turn = quarter_turn(s2 * outer_diff - s1 * inner_diff, sign);
+			out[0] = a0 + outer_sum + inner_sum;
+			out[length] = near_real + near_turn;
+			out[2 * length] = far_real + far_turn;
+			out[3 * length] = far_real - far_turn;
+			out[4 * length] = near_real - near_turn;
+		}
+	}
+}
+
+///This will run a stage of any other radix as a direct p point DFT; the
+///p-th roots of unity are every (n / p)-th twiddle
+static void radix_any(const complex_float *x, complex_float *y, unsigned int length, unsigned int groups,
+	const complex_float *tw, unsigned int p) {
+	const size_t across = (size_t)groups * length;
+	std::vector<complex_float> a(p);
+	for (unsigned int j = 0; j < length; ++j) {
+		for (unsigned int k = 0; k < groups; ++k) {
+			const complex_float *in = x + (size_t)k * length + j;
+			complex_float *out = y + (size_t)k * p * length + j;
+			for (unsigned int q = 0; q < p; ++q)
+				a[q] = mul(in[q * across], tw[(size_t)q * j * groups]);
+			for (unsigned int r = 0; r < p; ++r) {
+				complex_float sum = a[0];
+				for (unsigned int q = 1; q < p; ++q)
+					sum += mul(a[q], tw[(size_t)(q * r % p) * length * groups]);
+				out[r * length] = sum;
+			}
+		}
+	}
+}
+
+///This will create a plan for transforms of n points.  Fours are taken out
+///first since a radix 4 stage needs no multiplications inside its DFT.
+///
+/// \param _n the transform length, at least 1
+///
+fft_plan::fft_plan(unsigned int _n) : n(_n > 0 ? _n : 1) {
+	unsigned int m = n;
+	const unsigned int small[] = { 4, 2, 3, 5 };
+	for (unsigned int i = 0; i < 4; ++i) {
+		while (m % small[i] == 0) {
+			radices.push_back(small[i]);
+			m /= small[i];
+		}
+	}
+	for (unsigned int p = 7; m > 1; p += 2) {
+		if (p * p > m)
+			p = m;
+		while (m % p == 0) {
+			radices.push_back(p);
+			m /= p;
+		}
+	}
+	forward_twiddles.resize(n);
+	inverse_twiddles.resize(n);
+	const double pi = 3.14159265358979323846;
+	for (unsigned int k = 0; k < n; ++k) {
+		const double phase = -2.0 * pi * k / n;
+		forward_twiddles[k] = complex_float((float)std::cos(phase), (float)std::sin(phase));
+		inverse_twiddles[k] = std::conj(forward_twiddles[k]);
+	}
+}
+
+///This will run every stage of a transform
+///
+/// \param in the input
+/// \param out the output, not overlapping in
+/// \param inverse true for the unscaled inverse DFT
+///
+void fft_plan::transform(const complex_float *in, complex_float *out, bool inverse) const {
+	//the stages alternate between out and a scratch buffer, arranged so the last one writes out
+	static thread_local std::vector<complex_float> scratch;
+	if (radices.size() > 1 && scratch.size() < n)
+		scratch.resize(n);
+	const complex_float *tw = inverse ? inverse_twiddles.data() : forward_twiddles.data();
+	const float sign = inverse ? 1.0f : -1.0f;
+	complex_float *buffers[2] = { out, scratch.data() };
+	const complex_float *src = in;
+	unsigned int length = 1;
+	for (size_t s = 0; s < radices.size(); ++s) {
+		complex_float *dst = buffers[(radices.size() - 1 - s) % 2];
+		const unsigned int p = radices[s];
+		const unsigned int groups = n / (length * p);
+		if (p == 4)
+			radix4(src, dst, length, groups, tw, sign);
+		else if (p == 2)
+			radix2(src, dst, length, groups, tw);
+		else if (p == 3)
+			radix3(src, dst, length, groups, tw, sign);
+		else if (p == 5)
+			radix5(src, dst, length, groups, tw, sign);
+		else
+			radix_any(src, dst, length, groups, tw, p);
+		src = dst;
+		length *= p;
+	}
+}
+
+///This will compute the DFT of n points
+///
+/// \param in the input
+/// \param out the output, not overlapping in
+///
+void fft_plan::forward(const complex_float *in, complex_float *out) const {
+	if (n == 1) {
+		out[0] = in[0];
+		return;
+	}
+	transform(in, out, false);
+}
+
+///This will compute the unscaled inverse DFT of n points
+///
+/// \param in the input
+/// \param out the output, not overlapping in
+///
+void fft_plan::inverse(const complex_float *in, complex_float *out) const {
+	if (n == 1) {
+		out[0] = in[0];
+		return;
+	}
+	transform(in, out, true);
+}
+
+///This will return the smallest length of the form 2^a 3^b 5^c that is at
+///least n.  These lengths only use the fast radix stages.
+///
+/// \param n the minimum length
+/// \return the length
+///
+unsigned int fft_good_size(unsigned int n) {
+	if (n <= 1)
+		return 1;
+	for (unsigned int size = n;; ++size) {
+		unsigned int m = size;
+		while (m % 2 == 0)
+			m /= 2;
+		while (m % 3 == 0)
+			m /= 3;
+		while (m % 5 == 0)
+			m /= 5;
+		if (m == 1)
+			return size;
+	}
+}
@@ -0,0 +1,46 @@
+///
+/// \file fft.h
+/// \brief Mixed-radix complex FFT
+///
+/// A plan factors its length into radix 4, 2, 3 and 5 stages (any other
+/// prime factor falls back to a slower generic stage) and precomputes the
+/// twiddle factors once, so transforming many rows or columns of the same
+/// length costs no setup.  The stages pass the data back and forth
+/// between the output and a scratch buffer in self-sorting (Stockham)
+/// order, so no bit reversal pass is needed.  Plans
+/// are read only after construction and can be shared by threads.
+///
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <vector>
+
+typedef std::complex<float> complex_float;
+
+class fft_plan {
+	unsigned int n;
+	//the radix of each stage, in the order they run
+	std::vector<unsigned int> radices;
+	//e^(-+2 pi i k / n) for k = 0 to n - 1
+	std::vector<complex_float> forward_twiddles;
+	std::vector<complex_float> inverse_twiddles;
+
+	void transform(const complex_float *in, complex_float *out, bool inverse) const;
+
+public:
+	//a plan for transforms of n points
+	explicit fft_plan(unsigned int _n);
+
+	unsigned int size() const { return n; }
+	//out = DFT(in); in and out must not overlap
+	void forward(const complex_float *in, complex_float *out) const;
+	//out = n * inverse DFT(in), i.e. unscaled; in and out must not overlap
+	void inverse(const complex_float *in, complex_float *out) const;
+};
+
+//the smallest length of the form 2^a 3^b 5^c that is at least n
+unsigned int fft_good_size(unsigned int n);
+
+#endif
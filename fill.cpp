@@ -0,0 +1,189 @@
+///
+/// \file fill.cpp
+/// \brief Scanline flood fill of the region of similar color around a pixel
+///
+
+#include "fill.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//what a fill compares against
+struct fill_target {
+	rgb_view<const unsigned char> src;
+	image_view<unsigned char> region;
+	unsigned char color[3];
+	unsigned char tolerance;
+	//true when the planes and the region are dense, so 32 pixels can be loaded at once
+	bool dense;
+};
+
+//a pixel to grow a run from
+struct fill_seed {
+	unsigned int x;
+	unsigned int y;
+};
+
+///This will test n pixels of a row, at most 32, for a match
+///
+/// \param t the fill
+/// \param x the first pixel
+/// \param y the row
+/// \param n the number of pixels
+/// \return bit i set if pixel x + i matches
+///
+static inline uint32_t match_bits(const fill_target &t, unsigned int x, unsigned int y, unsigned int n) {
+#if defined(__AVX2__)
+	if (n == 32 && t.dense) {
+		const __m256i tolerance = _mm256_set1_epi8((char)t.tolerance);
+		__m256i match = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(t.region.row(y) + x)),
+			_mm256_setzero_si256());
+		for (unsigned int c = 0; c < 3; ++c) {
+			const __m256i v = _mm256_loadu_si256((const __m256i *)(t.src[c].row(y) + x));
+			const __m256i s = _mm256_set1_epi8((char)t.color[c]);
+			const __m256i d = _mm256_or_si256(_mm256_subs_epu8(v, s), _mm256_subs_epu8(s, v));
+			match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_min_epu8(d, tolerance), d));
+		}
+		return (uint32_t)_mm256_movemask_epi8(match);
+	}
+#endif
+	const unsigned char *region = t.region.row(y) + (size_t)x * t.region.step;
+	const unsigned char *r = t.src[0].row(y) + (size_t)x * t.src[0].step;
+	const unsigned char *g = t.src[1].row(y) + (size_t)x * t.src[1].step;
+	const unsigned char *b = t.src[2].row(y) + (size_t)x * t.src[2].step;
+	uint32_t bits = 0;
+	for (unsigned int i = 0; i < n; ++i) {
+		const int dr = r[(size_t)i * t.src[0].step] - t.color[0];
+		const int dg = g[(size_t)i * t.src[1].step] - t.color[1];
+		const int db = b[(size_t)i * t.src[2].step] - t.color[2];
+		const int d = std::max(std::max(std::abs(dr), std::abs(dg)), std::abs(db));
+		bits |= (uint32_t)(region[(size_t)i * t.region.step] == 0 && d <= t.tolerance) << i;
+	}
+	return bits;
+}
+
+///This will return how many of the low bits of a mask are set in a row
+///
+/// \param bits the mask
+/// \return the number of set bits below the lowest clear one
+///
+static inline unsigned int trailing_ones(uint32_t bits) {
+	unsigned int n = 0;
+	while (n < 32 && (bits >> n & 1))
+		++n;
+	return n;
+}
+
+///This will return how many of the high bits of a mask are set in a row
+///
+/// \param bits the mask
+/// \return the number of set bits above the highest clear one
+///
+static inline unsigned int leading_ones(uint32_t bits) {
+	unsigned int n = 0;
+	while (n < 32 && (bits >> (31 - n) & 1))
+		++n;
+	return n;
+}
+
+///This will push a seed for each run of matching pixels among columns x0
+///to x1 of a row
+///
+/// \param t the fill
+/// \param x0 the first column
+/// \param x1 one past the last column
+/// \param y the row
+/// \param stack the seeds
+///
+static void push_runs(const fill_target &t, unsigned int x0, unsigned int x1, unsigned int y,
+	std::vector<fill_seed> &stack) {
+	uint32_t before = 0;
+	for (unsigned int x = x0; x < x1; x += 32) {
+		const unsigned int n = std::min(32u, x1 - x);
+		const uint32_t bits = match_bits(t, x, y, n);
+		//the pixels that match when the one before them does not
+		uint32_t starts = bits & ~(bits << 1 | before);
+		for (unsigned int i = 0; starts; ++i, starts >>= 1) {
+			if (starts & 1) {
+				const fill_seed seed = { x + i, y };
+				stack.push_back(seed);
+			}
+		}
+		before = bits >> (n - 1) & 1;
+	}
+}
+
+///This will fill the region of similar color around a pixel
+///
+/// \param src the image
+/// \param x the column of the pixel
+/// \param y the row of the pixel
+/// \param tolerance the most any channel may differ from the pixel's, 0 to 255
+/// \param region the pixels filled, the size of src; pixels already set in it are not filled again
+/// \param bounds the bounding box of the pixels filled; empty if none were
+/// \return the number of pixels filled
+///
+uint64_t flood_fill(const rgb_view<const unsigned char> &src, unsigned int x, unsigned int y, unsigned int tolerance,
+	const image_view<unsigned char> &region, fill_bounds &bounds) {
+	bounds.x = bounds.y = bounds.w = bounds.h = 0;
+	const unsigned int width = src.width(), height = src.height();
+	if (x >= width || y >= height || region(x, y) != 0)
+		return 0;
+	fill_target t;
+	t.src = src;
+	t.region = region;
+	for (unsigned int c = 0; c < 3; ++c)
+		t.color[c] = src[c](x, y);
+	t.tolerance = (unsigned char)std::min(tolerance, 255u);
+	t.dense = src[0].dense() && src[1].dense() && src[2].dense() && region.dense();
+
+	unsigned int left = x, right = x, top = y, bottom = y;
+	uint64_t filled = 0;
+	std::vector<fill_seed> stack;
+	const fill_seed start = { x, y };
+	stack.push_back(start);
+	while (!stack.empty()) {
+		const fill_seed seed = stack.back();
+		stack.pop_back();
+		//a run filled since the seed was pushed may have taken it
+		if (region(seed.x, seed.y) != 0)
+			continue;
+		unsigned int x0 = seed.x, x1 = seed.x + 1;
+		while (x0 > 0) {
+			const unsigned int n = std::min(32u, x0);
+			const unsigned int run = leading_ones(match_bits(t, x0 - n, seed.y, n) << (32 - n));
+			x0 -= std::min(run, n);
+			if (run < n)
+				break;
+		}
+		while (x1 < width) {
+			const unsigned int n = std::min(32u, width - x1);
+			const unsigned int run = trailing_ones(match_bits(t, x1, seed.y, n));
+			x1 += std::min(run, n);
+			if (run < n)
+				break;
+		}
+		unsigned char *row = region.row(seed.y);
+		for (unsigned int i = x0; i < x1; ++i)
+			row[(size_t)i * region.step] = 255;
+		filled += x1 - x0;
+		left = std::min(left, x0);
+		right = std::max(right, x1 - 1);
+		top = std::min(top, seed.y);
+		bottom = std::max(bottom, seed.y);
+		if (seed.y > 0)
+			push_runs(t, x0, x1, seed.y - 1, stack);
+		if (seed.y + 1 < height)
+			push_runs(t, x0, x1, seed.y + 1, stack);
+	}
+	bounds.x = left;
+	bounds.y = top;
+	bounds.w = right - left + 1;
+	bounds.h = bottom - top + 1;
+	return filled;
+}
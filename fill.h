@@ -0,0 +1,35 @@
+///
+/// \file fill.h
+/// \brief Scanline flood fill of the region of similar color around a pixel
+///
+/// The fill works span by span with an explicit stack instead of recursion:
+/// a seed taken off the stack grows left and right into the longest run of
+/// matching pixels on its row, the run is marked, and one seed is pushed
+/// for each run of matching pixels on the rows above and below it.  A pixel
+/// matches when it is not marked yet and each of its channels is within the
+/// tolerance of the starting pixel's.  With AVX2 that test is made on 32
+/// pixels of a row at once and kept as a bit mask, so runs are found 32
+/// pixels at a time.
+///
+
+#ifndef FILL_H
+#define FILL_H
+
+#include <cstdint>
+
+#include "image_view.h"
+
+//a rectangle of pixels
+struct fill_bounds {
+	unsigned int x;
+	unsigned int y;
+	unsigned int w;
+	unsigned int h;
+};
+
+//set to 255 in region the pixels 4-connected to (x, y) through pixels within tolerance of its color on every channel,
+//region being zero over them to start with; return how many were set and their bounding box
+uint64_t flood_fill(const rgb_view<const unsigned char> &src, unsigned int x, unsigned int y, unsigned int tolerance,
+	const image_view<unsigned char> &region, fill_bounds &bounds);
+
+#endif
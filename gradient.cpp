@@ -0,0 +1,278 @@
+///
+/// \file gradient.cpp
+/// \brief Sobel and Scharr gradients: edge magnitude and orientation
+///
+
+#include "gradient.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+static const float PI = 3.14159265358979f;
+
+//coefficients of the odd minimax polynomial for atan on [0, 1], good to 1e-5 radians
+static const float ATAN_C[6] = { 0.99997726f, -0.33262347f, 0.19354346f, -0.11643287f, 0.05265332f, -0.01172120f };
+
+///The weights of one operator
+struct gradient_weights {
+	//the taps of the smoothing kernel next to and at the center
+	int side;
+	int center;
+	//turns a difference of smoothed samples into levels per pixel
+	float scale;
+};
+
+///This will return the weights of an operator
+///
+/// \param op the operator
+/// \return its weights
+///
+static gradient_weights weights_of(gradient_operator op) {
+	gradient_weights k;
+	k.side = op == gradient_scharr ? 3 : 1;
+	k.center = op == gradient_scharr ? 10 : 2;
+	//the difference spans two pixels and the smoothing taps sum to 2 side + center
+	k.scale = 1.0f / (2.0f * (2 * k.side + k.center));
+	return k;
+}
+
+///This will return the angle of a vector with the same polynomial the
+///vectorized kernel uses, so every pixel gets the same result
+///
+/// \param y the y component
+/// \param x the x component
+/// \return the angle in radians, -pi to pi
+///
+static inline float approx_atan2(float y, float x) {
+	const float ax = std::fabs(x), ay = std::fabs(y);
+	const float hi = std::max(ax, ay), lo = std::min(ax, ay);
+	if (hi == 0.0f)
+		return 0.0f;
+	const float z = lo / hi, z2 = z * z;
+	float r = ATAN_C[5];
+	for (int i = 4; i >= 0; --i)
+		r = r * z2 + ATAN_C[i];
+	r *= z;
+	if (ay > ax)
+		r = 0.5f * PI - r;
+	if (x < 0.0f)
+		r = PI - r;
+	return y < 0.0f ? -r : r;
+}
+
+///This will store a magnitude, rounding and clamping 8-bit samples
+static inline void store_magnitude(float v, float &out) {
+	out = v;
+}
+static inline void store_magnitude(float v, unsigned char &out) {
+	out = (unsigned char)std::min(v + 0.5f, 255.0f);
+}
+
+///This will compute one output row at the columns x0 to x1 without
+///vectors, reading the neighbours at the edges from the edge column
+///
+/// \param a the row above
+/// \param b the row
+/// \param c the row below
+/// \param width the width of the rows
+/// \param x0 the first column
+/// \param x1 one past the last column
+/// \param k the operator weights
+/// \param scale the factor from differences to magnitudes
+/// \param magnitude the magnitude row
+/// \param step the distance between magnitude samples
+/// \param orientation the orientation row, or null
+/// \param orientation_step the distance between orientation samples
+///
+template <typename M>
+static void gradient_span(const unsigned char *a, const unsigned char *b, const unsigned char *c, unsigned int width,
+	unsigned int x0, unsigned int x1, const gradient_weights &k, float scale, M *magnitude, size_t step,
+	float *orientation, size_t orientation_step) {
+	for (unsigned int x = x0; x < x1; ++x) {
+		const unsigned int l = x > 0 ? x - 1 : 0, r = std::min(x + 1, width - 1);
+		const int gx = k.side * (a[r] + c[r] - a[l] - c[l]) + k.center * (b[r] - b[l]);
+		const int gy = k.side * (c[l] - a[l] + c[r] - a[r]) + k.center * (c[x] - a[x]);
+		store_magnitude(std::sqrt((float)(gx * gx + gy * gy)) * scale, magnitude[(size_t)x * step]);
+		if (orientation)
+			orientation[(size_t)x * orientation_step] = approx_atan2((float)gy, (float)gx);
+	}
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+///This will return the angles of 8 vectors, as approx_atan2
+static inline __m256 approx_atan2(__m256 y, __m256 x) {
+	const __m256 sign = _mm256_set1_ps(-0.0f);
+	const __m256 ax = _mm256_andnot_ps(sign, x), ay = _mm256_andnot_ps(sign, y);
+	const __m256 hi = _mm256_max_ps(ax, ay), lo = _mm256_min_ps(ax, ay);
+	//0 / tiny is 0 for a zero vector, as in the scalar version
+	const __m256 z = _mm256_div_ps(lo, _mm256_max_ps(hi, _mm256_set1_ps(1e-30f)));
+	const __m256 z2 = _mm256_mul_ps(z, z);
+	__m256 r = _mm256_set1_ps(ATAN_C[5]);
+	for (int i = 4; i >= 0; --i)
+		r = _mm256_fmadd_ps(r, z2, _mm256_set1_ps(ATAN_C[i]));
+	r = _mm256_mul_ps(r, z);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(0.5f * PI), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(PI), r), x);
+	return _mm256_xor_ps(r, _mm256_and_ps(y, sign));
+}
+
+///This will store 16 magnitudes, packing 8-bit ones with saturation
+static inline void store_magnitudes(__m256 lo, __m256 hi, float *out) {
+	_mm256_storeu_ps(out, lo);
+	_mm256_storeu_ps(out + 8, hi);
+}
+static inline void store_magnitudes(__m256 lo, __m256 hi, unsigned char *out) {
+	//rounded half up like store_magnitude; the magnitudes are not negative
+	const __m256 half = _mm256_set1_ps(0.5f);
+	const __m256i words = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_cvttps_epi32(_mm256_add_ps(lo, half)),
+		_mm256_cvttps_epi32(_mm256_add_ps(hi, half))), 0xD8);
+	const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+	_mm_storeu_si128((__m128i *)out, _mm256_castsi256_si128(bytes));
+}
+
+///This will load 16 samples as 16-bit lanes
+static inline __m256i load16(const unsigned char *p) {
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+#endif
+
+///This will compute one row of the gradient from the rows around it
+///
+/// \param a the row above, dense
+/// \param b the row, dense
+/// \param c the row below, dense
+/// \param width the width of the rows
+/// \param k the operator weights
+/// \param scale the factor from differences to magnitudes
+/// \param magnitude the magnitude row
+/// \param step the distance between magnitude samples
+/// \param orientation the orientation row, or null
+/// \param orientation_step the distance between orientation samples
+///
+template <typename M>
+static void gradient_row(const unsigned char *a, const unsigned char *b, const unsigned char *c, unsigned int width,
+	const gradient_weights &k, float scale, M *magnitude, size_t step, float *orientation, size_t orientation_step) {
+	unsigned int x = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+	if (width > 17) {
+		gradient_span(a, b, c, width, 0, 1, k, scale, magnitude, step, orientation, orientation_step);
+		const __m256i side = _mm256_set1_epi16((short)k.side), center = _mm256_set1_epi16((short)k.center);
+		const __m256 vscale = _mm256_set1_ps(scale);
+		M block[16];
+		float angles[16];
+		for (x = 1; x + 17 <= width; x += 16) {
+			//the smoothed columns left and right, and the differences down the rows
+			const __m256i left = _mm256_add_epi16(_mm256_mullo_epi16(side, _mm256_add_epi16(load16(a + x - 1), load16(c + x - 1))),
+				_mm256_mullo_epi16(center, load16(b + x - 1)));
+			const __m256i right = _mm256_add_epi16(_mm256_mullo_epi16(side, _mm256_add_epi16(load16(a + x + 1), load16(c + x + 1))),
+				_mm256_mullo_epi16(center, load16(b + x + 1)));
+			const __m256i down = _mm256_add_epi16(
+				_mm256_mullo_epi16(side, _mm256_add_epi16(_mm256_sub_epi16(load16(c + x - 1), load16(a + x - 1)),
+					_mm256_sub_epi16(load16(c + x + 1), load16(a + x + 1)))),
+				_mm256_mullo_epi16(center, _mm256_sub_epi16(load16(c + x), load16(a + x))));
+			const __m256i gx = _mm256_sub_epi16(right, left);
+			const __m256 gx0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(gx)));
+			const __m256 gx1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(gx, 1)));
+			const __m256 gy0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(down)));
+			const __m256 gy1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(down, 1)));
+			const __m256 m0 = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_fmadd_ps(gx0, gx0, _mm256_mul_ps(gy0, gy0))), vscale);
+			const __m256 m1 = _mm256_mul_ps(_mm256_sqrt_ps(_mm256_fmadd_ps(gx1, gx1, _mm256_mul_ps(gy1, gy1))), vscale);
+			if (step == 1)
+				store_magnitudes(m0, m1, magnitude + x);
+			else {
+				store_magnitudes(m0, m1, block);
+				for (unsigned int i = 0; i < 16; ++i)
+					magnitude[(size_t)(x + i) * step] = block[i];
+			}
+			if (orientation) {
+				float *out = orientation_step == 1 ? orientation + x : angles;
+				_mm256_storeu_ps(out, approx_atan2(gy0, gx0));
+				_mm256_storeu_ps(out + 8, approx_atan2(gy1, gx1));
+				if (orientation_step != 1) {
+					for (unsigned int i = 0; i < 16; ++i)
+						orientation[(size_t)(x + i) * orientation_step] = angles[i];
+				}
+			}
+		}
+	}
+#endif
+	gradient_span(a, b, c, width, x, width, k, scale, magnitude, step, orientation, orientation_step);
+}
+
+///This will compute the gradient of a plane in row bands.  Each band slides
+///a window of three source rows down the plane; rows of a plane that is not
+///dense are copied into the window first.
+///
+/// \param src the plane
+/// \param magnitude the magnitude plane
+/// \param orientation the orientation plane, or an empty view
+/// \param k the operator weights
+/// \param scale the factor from differences to magnitudes
+///
+template <typename M>
+static void gradient_rows(const image_view<const unsigned char> &src, const image_view<M> &magnitude,
+	const image_view<float> &orientation, const gradient_weights &k, float scale) {
+	const unsigned int width = src.width, height = src.height;
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		pixel_buffer<unsigned char> window(src.dense() ? 0 : (size_t)3 * width, uninitialized);
+		int held[3] = { -1, -1, -1 };
+		//the row y of the plane, dense
+		auto source_row = [&](unsigned int y) -> const unsigned char * {
+			if (src.dense())
+				return src.row(y);
+			unsigned char *slot = window.data() + (size_t)(y % 3) * width;
+			if (held[y % 3] != (int)y) {
+				const unsigned char *in = src.row(y);
+				for (unsigned int x = 0; x < width; ++x)
+					slot[x] = in[(size_t)x * src.step];
+				held[y % 3] = (int)y;
+			}
+			return slot;
+		};
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *a = source_row(y > 0 ? y - 1 : 0);
+			const unsigned char *b = source_row(y);
+			const unsigned char *c = source_row(std::min(y + 1, height - 1));
+			gradient_row(a, b, c, width, k, scale, magnitude.row(y), magnitude.step,
+				orientation.empty() ? (float *)0 : orientation.row(y), orientation.step);
+		}
+	});
+}
+
+///This will compute the gradient magnitude of a plane and, unless the
+///orientation view is empty, the gradient direction.  Samples past the
+///edges repeat the edge samples.
+///
+/// \param src the plane
+/// \param magnitude the magnitude in levels per pixel, same size as src
+/// \param orientation the direction in radians, same size as src, or an empty view
+/// \param op the operator
+///
+void gradient(const image_view<const unsigned char> &src, const image_view<float> &magnitude,
+	const image_view<float> &orientation, gradient_operator op) {
+	if (src.width == 0 || src.height == 0)
+		return;
+	const gradient_weights k = weights_of(op);
+	gradient_rows(src, magnitude, orientation, k, k.scale);
+}
+
+///This will compute the gradient magnitude of a plane as 8-bit samples
+///for display: the difference across each 3 x 3 neighbourhood, clamped
+///
+/// \param src the plane
+/// \param magnitude the magnitude, same size as src
+/// \param op the operator
+///
+void gradient(const image_view<const unsigned char> &src, const image_view<unsigned char> &magnitude,
+	gradient_operator op) {
+	if (src.width == 0 || src.height == 0)
+		return;
+	const gradient_weights k = weights_of(op);
+	gradient_rows(src, magnitude, image_view<float>(), k, 2.0f * k.scale);
+}
@@ -0,0 +1,33 @@
+///
+/// \file gradient.h
+/// \brief Sobel and Scharr gradients: edge magnitude and orientation
+///
+/// Both operators smooth across the derivative direction with a 3-tap
+/// kernel (1 2 1 for Sobel, 3 10 3 for Scharr, which keeps the response
+/// closer to the same in every direction) and take a central difference
+/// along it.  Each output row is computed straight from the three source
+/// rows around it in one pass: the derivatives are formed in 16-bit lanes,
+/// 16 pixels per AVX2 step, and turned into the magnitude and orientation
+/// before anything is stored.  Row bands run on the thread pool.
+///
+
+#ifndef GRADIENT_H
+#define GRADIENT_H
+
+#include "image_view.h"
+
+//the 3 x 3 derivative kernels
+enum gradient_operator {
+	gradient_sobel,
+	gradient_scharr
+};
+
+//the gradient magnitude of a plane in levels per pixel and, unless orientation is an empty view, its direction in
+//radians from -pi to pi, 0 pointing along +x and pi / 2 along +y (down the image), to within 1e-5 radians
+void gradient(const image_view<const unsigned char> &src, const image_view<float> &magnitude,
+	const image_view<float> &orientation, gradient_operator op = gradient_sobel);
+//the magnitude of the difference across each 3 x 3 neighbourhood, twice the derivative, clamped to 255 for display
+void gradient(const image_view<const unsigned char> &src, const image_view<unsigned char> &magnitude,
+	gradient_operator op = gradient_sobel);
+
+#endif
@@ -0,0 +1,101 @@
+///
+/// \file half.h
+/// \brief 16-bit IEEE floating point sample type
+///
+/// A minimal binary16 type used as a ppm sample type.  Samples are stored
+/// as 16 bits and converted to float for arithmetic.
+///
+
+#ifndef HALF_H
+#define HALF_H
+
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+struct half {
+	uint16_t bits;
+
+	half() = default;
+	half(float f) : bits(from_float(f)) {}
+	operator float() const { return to_float(bits); }
+
+	///This will convert a float to binary16, rounding to nearest even
+	///
+	/// \param f the value to convert
+	/// \return the binary16 bit pattern
+	///
+	static uint16_t from_float(float f) {
+#if defined(__F16C__)
+		return (uint16_t)_cvtss_sh(f, 0);
+#else
+		uint32_t x;
+		std::memcpy(&x, &f, sizeof(x));
+		const uint32_t sign = (x >> 16) & 0x8000;
+		x &= 0x7fffffff;
+		//NaN and infinity
+		if (x >= 0x7f800000)
+			return (uint16_t)(sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0));
+		//too large, becomes infinity
+		if (x >= 0x477ff000)
+			return (uint16_t)(sign | 0x7c00);
+		//too small even for a subnormal, becomes zero
+		if (x < 0x33000001)
+			return (uint16_t)sign;
+		int e = (int)(x >> 23);
+		uint32_t m = (x & 0x7fffff) | 0x800000;
+		//subnormal results shift the mantissa further right
+		int shift = e < 113 ? 126 - e : 13;
+		uint32_t h = m >> shift;
+		uint32_t rest = m & ((1u << shift) - 1);
+		uint32_t halfway = 1u << (shift - 1);
+		if (rest > halfway || (rest == halfway && (h & 1)))
+			h++;
+		if (e >= 113)
+			h = (((uint32_t)(e - 112) << 10) + h - 0x400);
+		return (uint16_t)(sign | h);
+#endif
+	}
+
+	///This will convert a binary16 bit pattern to float
+	///
+	/// \param h the binary16 bit pattern
+	/// \return the value as a float
+	///
+	static float to_float(uint16_t h) {
+#if defined(__F16C__)
+		return _cvtsh_ss(h);
+#else
+		const uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		uint32_t e = (h >> 10) & 0x1f;
+		uint32_t m = h & 0x3ff;
+		uint32_t x;
+		if (e == 0x1f) {
+			x = sign | 0x7f800000 | (m << 13);
+		}
+		else if (e != 0) {
+			x = sign | ((e + 112) << 23) | (m << 13);
+		}
+		else if (m == 0) {
+			x = sign;
+		}
+		else {
+			//normalize the subnormal
+			e = 113;
+			while (!(m & 0x400)) {
+				m <<= 1;
+				e--;
+			}
+			x = sign | (e << 23) | ((m & 0x3ff) << 13);
+		}
+		float f;
+		std::memcpy(&f, &x, sizeof(f));
+		return f;
+#endif
+	}
+};
+
+#endif
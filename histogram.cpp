@@ -0,0 +1,297 @@
+///
+/// \file histogram.cpp
+/// \brief Per-channel histograms, auto-levels and histogram equalization
+///
+
+#include "histogram.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+
+//interleaved copies of each histogram a band counts into
+static const unsigned int HISTOGRAM_COPIES = 4;
+
+///This will create an empty histogram
+histogram::histogram() : samples(0) {
+	std::memset(counts, 0, sizeof(counts));
+	for (unsigned int c = 0; c < 3; ++c) {
+		sum[c] = 0;
+		lowest[c] = 0;
+		highest[c] = 0;
+	}
+}
+
+///This will return a percentile of one channel
+///
+/// \param c the channel
+/// \param fraction the fraction of samples, 0 to 1
+/// \return the smallest value with at least that fraction of samples at or
+///below it; 0 for an empty histogram
+///
+unsigned int histogram::percentile(unsigned int c, float fraction) const {
+	const double wanted = std::max(std::ceil((double)fraction * samples), 1.0);
+	double below = 0.0;
+	for (unsigned int v = 0; v < 256; ++v) {
+		below += counts[c][v];
+		if (below >= wanted)
+			return v;
+	}
+	return samples > 0 ? 255 : 0;
+}
+
+///This will return the largest count of one channel
+///
+/// \param c the channel
+/// \return the count
+///
+uint32_t histogram::peak(unsigned int c) const {
+	return *std::max_element(counts[c], counts[c] + 256);
+}
+
+///This will recompute the sum, minimum and maximum of each channel from
+///the counts
+void histogram::summarize() {
+	for (unsigned int c = 0; c < 3; ++c) {
+		sum[c] = 0;
+		lowest[c] = 0;
+		highest[c] = 0;
+		bool found = false;
+		for (unsigned int v = 0; v < 256; ++v) {
+			if (counts[c][v] == 0)
+				continue;
+			sum[c] += (uint64_t)v * counts[c][v];
+			if (!found)
+				lowest[c] = (unsigned char)v;
+			highest[c] = (unsigned char)v;
+			found = true;
+		}
+	}
+}
+
+///This will move one sample of a channel from one value to another.  The
+///minimum and maximum only need a scan of the counts when the last sample
+///at one of them leaves it.
+///
+/// \param c the channel
+/// \param old_value the value the sample had, which must have been counted
+/// \param new_value the value it has now
+///
+void histogram::replace(unsigned int c, unsigned char old_value, unsigned char new_value) {
+	if (old_value == new_value)
+		return;
+	--counts[c][old_value];
+	++counts[c][new_value];
+	sum[c] = sum[c] - old_value + new_value;
+	if (new_value < lowest[c])
+		lowest[c] = new_value;
+	if (new_value > highest[c])
+		highest[c] = new_value;
+	//the new value is counted, so both scans stop at it at the latest
+	while (counts[c][lowest[c]] == 0)
+		++lowest[c];
+	while (counts[c][highest[c]] == 0)
+		--highest[c];
+}
+
+///This will count the pixels of a region into the histogram
+///
+/// \param region the pixels to add
+///
+void histogram::add(const rgb_view<const unsigned char> &region) {
+	const histogram h = compute_histogram(region);
+	if (h.samples == 0)
+		return;
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int v = 0; v < 256; ++v)
+			counts[c][v] += h.counts[c][v];
+		sum[c] += h.sum[c];
+		lowest[c] = samples > 0 ? std::min(lowest[c], h.lowest[c]) : h.lowest[c];
+		highest[c] = samples > 0 ? std::max(highest[c], h.highest[c]) : h.highest[c];
+	}
+	samples += h.samples;
+}
+
+///This will take the pixels of a region, counted before, out of the
+///histogram
+///
+/// \param region the pixels to remove
+///
+void histogram::remove(const rgb_view<const unsigned char> &region) {
+	const histogram h = compute_histogram(region);
+	if (h.samples == 0)
+		return;
+	samples -= h.samples;
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int v = 0; v < 256; ++v)
+			counts[c][v] -= h.counts[c][v];
+		sum[c] -= h.sum[c];
+	}
+	if (samples == 0) {
+		summarize();
+		return;
+	}
+	for (unsigned int c = 0; c < 3; ++c) {
+		while (counts[c][lowest[c]] == 0)
+			++lowest[c];
+		while (counts[c][highest[c]] == 0)
+			--highest[c];
+	}
+}
+
+///This will count the samples of one plane over a band of rows
+///
+/// \param src the plane
+/// \param y0 the first row
+/// \param y1 one past the last row
+/// \param out the counts to add to
+///
+static void count_band(const image_view<const unsigned char> &src, unsigned int y0, unsigned int y1, uint32_t *out) {
+	uint32_t local[HISTOGRAM_COPIES][256];
+	std::memset(local, 0, sizeof(local));
+	const unsigned int width = src.width;
+	const size_t step = src.step;
+	for (unsigned int y = y0; y < y1; ++y) {
+		const unsigned char *p = src.row(y);
+		unsigned int x = 0;
+		for (; x + HISTOGRAM_COPIES <= width; x += HISTOGRAM_COPIES) {
+			++local[0][p[(size_t)x * step]];
+			++local[1][p[(size_t)(x + 1) * step]];
+			++local[2][p[(size_t)(x + 2) * step]];
+			++local[3][p[(size_t)(x + 3) * step]];
+		}
+		for (; x < width; ++x)
+			++local[0][p[(size_t)x * step]];
+	}
+	for (unsigned int v = 0; v < 256; ++v)
+		out[v] += local[0][v] + local[1][v] + local[2][v] + local[3][v];
+}
+
+///This will compute the histograms of the three channels of an image
+///
+/// \param src the image
+/// \return the histograms
+///
+histogram compute_histogram(const rgb_view<const unsigned char> &src) {
+	histogram h;
+	h.samples = src.width() * src.height();
+	std::mutex lock;
+	parallel_for(0, src.height(), 32, [&](unsigned int y0, unsigned int y1) {
+		uint32_t band[3][256];
+		std::memset(band, 0, sizeof(band));
+		for (unsigned int c = 0; c < 3; ++c)
+			count_band(src[c], y0, y1, band[c]);
+		std::lock_guard<std::mutex> hold(lock);
+		for (unsigned int c = 0; c < 3; ++c) {
+			for (unsigned int v = 0; v < 256; ++v)
+				h.counts[c][v] += band[c][v];
+		}
+	});
+	h.summarize();
+	return h;
+}
+
+///This will create curves mapping every value to itself
+channel_curves::channel_curves() {
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int v = 0; v < 256; ++v)
+			map[c][v] = (unsigned char)v;
+	}
+}
+
+///This will compute auto-levels curves: each channel is stretched linearly
+///so that its darkest and brightest clip fraction of samples saturate.
+///Stretching the channels separately also removes a uniform color cast.
+///
+/// \param h the histogram of the image
+/// \param clip the fraction of samples allowed to saturate at each end
+/// \return the curves; a channel holding a single value is left unchanged
+///
+channel_curves auto_levels_curves(const histogram &h, float clip) {
+	channel_curves curves;
+	for (unsigned int c = 0; c < 3; ++c) {
+		const unsigned int lo = h.percentile(c, clip);
+		const unsigned int hi = h.percentile(c, 1.0f - clip);
+		if (hi <= lo)
+			continue;
+		for (unsigned int v = 0; v < 256; ++v) {
+			const int s = (int)std::floor(((int)v - (int)lo) * 255.0f / (hi - lo) + 0.5f);
+			curves.map[c][v] = (unsigned char)std::min(std::max(s, 0), 255);
+		}
+	}
+	return curves;
+}
+
+///This will compute equalization curves: each value maps to its share of
+///samples at or below it, so every output level ends up about as common as
+///any other.  The channels are equalized separately.
+///
+/// \param h the histogram of the image
+/// \return the curves; a channel holding a single value is left unchanged
+///
+channel_curves equalize_curves(const histogram &h) {
+	channel_curves curves;
+	for (unsigned int c = 0; c < 3; ++c) {
+		double cumulative[256];
+		double sum = 0.0;
+		double first = 0.0;
+		for (unsigned int v = 0; v < 256; ++v) {
+			sum += h.counts[c][v];
+			cumulative[v] = sum;
+			if (first == 0.0)
+				first = sum;
+		}
+		//the darkest value present maps to 0
+		if (sum <= first)
+			continue;
+		for (unsigned int v = 0; v < 256; ++v) {
+			const double s = std::floor((cumulative[v] - first) * 255.0 / (sum - first) + 0.5);
+			curves.map[c][v] = (unsigned char)std::min(std::max(s, 0.0), 255.0);
+		}
+	}
+	return curves;
+}
+
+///This will apply one curve per channel to an image
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may be src
+/// \param curves the curves
+///
+void apply_curves(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	const channel_curves &curves) {
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		const unsigned int width = src.width();
+		for (unsigned int c = 0; c < 3; ++c) {
+			const unsigned char *map = curves.map[c];
+			const size_t in_step = src[c].step, out_step = dst[c].step;
+			for (unsigned int y = y0; y < y1; ++y) {
+				const unsigned char *in = src[c].row(y);
+				unsigned char *out = dst[c].row(y);
+				for (unsigned int x = 0; x < width; ++x)
+					out[(size_t)x * out_step] = map[in[(size_t)x * in_step]];
+			}
+		}
+	});
+}
+
+///This will stretch each channel of an image to the full range
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may be src
+/// \param clip the fraction of samples allowed to saturate at each end
+///
+void auto_levels(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst, float clip) {
+	apply_curves(src, dst, auto_levels_curves(compute_histogram(src), clip));
+}
+
+///This will equalize the histogram of each channel of an image
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may be src
+///
+void equalize(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst) {
+	apply_curves(src, dst, equalize_curves(compute_histogram(src)));
+}
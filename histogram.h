@@ -0,0 +1,79 @@
+///
+/// \file histogram.h
+/// \brief Per-channel histograms, auto-levels and histogram equalization
+///
+/// Each row band counts into its own histograms, which are summed once the
+/// band is done, so threads never write the same counters.  Inside a band
+/// neighbouring samples count into four interleaved copies of each
+/// histogram: runs of equal samples, common in flat image areas, would
+/// otherwise wait on the increment of the same counter one after another.
+///
+/// A histogram also keeps each channel's sum, minimum and maximum.  When a
+/// few pixels change, replacing their old values by their new ones keeps
+/// all of it current at a cost that depends on the pixels edited, not on
+/// the image size.
+///
+/// Auto-levels and equalization turn a histogram into one 256-entry curve
+/// per channel, applied to the image in a single pass.
+///
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <cstdint>
+
+#include "image_view.h"
+
+struct histogram {
+	//counts[c][v]: the number of samples of channel c equal to v
+	uint32_t counts[3][256];
+	//the number of pixels counted
+	uint32_t samples;
+	//the sum, smallest and largest sample of each channel; 0 when empty
+	uint64_t sum[3];
+	unsigned char lowest[3];
+	unsigned char highest[3];
+
+	//an empty histogram
+	histogram();
+
+	//the smallest value with at least fraction of channel c's samples at or below it
+	unsigned int percentile(unsigned int c, float fraction) const;
+	//the largest count of channel c
+	uint32_t peak(unsigned int c) const;
+	double mean(unsigned int c) const { return samples > 0 ? (double)sum[c] / samples : 0.0; }
+
+	//recompute the sums, minimums and maximums from the counts
+	void summarize();
+	//update the counts and statistics for one sample of channel c changing from old_value to new_value
+	void replace(unsigned int c, unsigned char old_value, unsigned char new_value);
+	//count the pixels of a region in or out, e.g. before and after it is redrawn
+	void add(const rgb_view<const unsigned char> &region);
+	void remove(const rgb_view<const unsigned char> &region);
+};
+
+//the histograms of the three channels of an image
+histogram compute_histogram(const rgb_view<const unsigned char> &src);
+
+//a map of every 8-bit value to a new value, one per channel
+struct channel_curves {
+	unsigned char map[3][256];
+
+	//the identity
+	channel_curves();
+};
+
+//curves stretching each channel so its clip and 1 - clip percentiles become 0 and 255
+channel_curves auto_levels_curves(const histogram &h, float clip = 0.005f);
+//curves spreading each channel's values evenly over 0 to 255 by their cumulative counts
+channel_curves equalize_curves(const histogram &h);
+
+//dst = the curves applied to src; dst may be src
+void apply_curves(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	const channel_curves &curves);
+
+//the two in one step, from the histogram of src
+void auto_levels(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst, float clip = 0.005f);
+void equalize(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst);
+
+#endif
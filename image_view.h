@@ -0,0 +1,166 @@
+///
+/// \file image_view.h
+/// \brief Non-owning strided views over image planes
+///
+/// An image_view points into samples owned by someone else (usually one
+/// channel of a ppm) and describes a width x height window of them.
+/// Sample (x, y) lives at data[y * stride + x * step], so a view works for
+/// planar and interleaved layouts alike and a crop, tile or region of
+/// interest is just a view with a moved data pointer; nothing is copied.
+///
+
+#ifndef IMAGE_VIEW_H
+#define IMAGE_VIEW_H
+
+#include <cstddef>
+
+#include "thread_pool.h"
+
+template <typename T>
+struct image_view {
+	//the first sample of the view (offset already applied)
+	T *data;
+	unsigned int width;
+	unsigned int height;
+	//number of samples between the starts of two rows
+	size_t stride;
+	//number of samples between two neighboring pixels of a row
+	unsigned int step;
+
+	image_view() : data(0), width(0), height(0), stride(0), step(1) {}
+	image_view(T *_data, unsigned int _width, unsigned int _height, size_t _stride, unsigned int _step = 1)
+		: data(_data), width(_width), height(_height), stride(_stride), step(_step) {}
+
+	//a view of mutable samples can be used wherever a read only view is expected
+	template <typename U>
+	image_view(const image_view<U> &other)
+		: data(other.data), width(other.width), height(other.height), stride(other.stride), step(other.step) {}
+
+	T *row(unsigned int y) const { return data + y * stride; }
+	T &operator()(unsigned int x, unsigned int y) const { return data[y * stride + (size_t)x * step]; }
+	//true when the samples of a row are next to each other
+	bool dense() const { return step == 1; }
+	bool empty() const { return width == 0 || height == 0; }
+
+	///This will return the view of a rectangle inside this view.  The
+	///rectangle is clipped to the view.
+	///
+	/// \param x the first column of the rectangle
+	/// \param y the first row of the rectangle
+	/// \param w the number of columns
+	/// \param h the number of rows
+	/// \return the sub-view sharing this view's samples
+	///
+	image_view crop(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+		x = x < width ? x : width;
+		y = y < height ? y : height;
+		w = w < width - x ? w : width - x;
+		h = h < height - y ? h : height - y;
+		return image_view(data + y * stride + (size_t)x * step, w, h, stride, step);
+	}
+};
+
+///The three channels of an RGB image seen through views of equal size.
+template <typename T>
+struct rgb_view {
+	image_view<T> planes[3];
+
+	rgb_view() {}
+	rgb_view(const image_view<T> &r, const image_view<T> &g, const image_view<T> &b) {
+		planes[0] = r;
+		planes[1] = g;
+		planes[2] = b;
+	}
+	template <typename U>
+	rgb_view(const rgb_view<U> &other) {
+		for (unsigned int c = 0; c < 3; ++c)
+			planes[c] = other.planes[c];
+	}
+
+	unsigned int width() const { return planes[0].width; }
+	unsigned int height() const { return planes[0].height; }
+	const image_view<T> &operator[](unsigned int c) const { return planes[c]; }
+
+	///This will return the view of a rectangle inside this view
+	///
+	/// \param x the first column of the rectangle
+	/// \param y the first row of the rectangle
+	/// \param w the number of columns
+	/// \param h the number of rows
+	/// \return the sub-view sharing this view's samples
+	///
+	rgb_view crop(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+		return rgb_view(planes[0].crop(x, y, w, h), planes[1].crop(x, y, w, h), planes[2].crop(x, y, w, h));
+	}
+};
+
+///This will copy the samples of one view into another view of the same size
+///
+/// \param src the view to copy from
+/// \param dst the view to copy to
+///
+template <typename S, typename T>
+void copy(const image_view<S> &src, const image_view<T> &dst) {
+	parallel_for(0, src.height, 16, [&](unsigned int y0, unsigned int y1) {
+		//a local width: stores through an 8-bit T may alias the view, which would reload it every sample
+		const unsigned int width = src.width;
+		for (unsigned int y = y0; y < y1; ++y) {
+			const S *in = src.row(y);
+			T *out = dst.row(y);
+			if (src.dense() && dst.dense()) {
+				for (unsigned int x = 0; x < width; ++x)
+					out[x] = (T)in[x];
+			}
+			else {
+				for (unsigned int x = 0; x < width; ++x)
+					out[(size_t)x * dst.step] = (T)in[(size_t)x * src.step];
+			}
+		}
+	});
+}
+
+///This will set every sample of a view to a value
+///
+/// \param dst the view to fill
+/// \param v the value
+///
+template <typename T>
+void fill(const image_view<T> &dst, T v) {
+	parallel_for(0, dst.height, 16, [&](unsigned int y0, unsigned int y1) {
+		const unsigned int width = dst.width;
+		const size_t step = dst.step;
+		for (unsigned int y = y0; y < y1; ++y) {
+			T *out = dst.row(y);
+			for (unsigned int x = 0; x < width; ++x)
+				out[(size_t)x * step] = v;
+		}
+	});
+}
+
+///This will interleave the three channels of a view into packed RGB
+///triples, e.g. to stage an image for an SDL_PIXELFORMAT_RGB24 texture
+///
+/// \param src the channels to interleave
+/// \param dst the packed output
+/// \param pitch the number of bytes between two rows of dst
+///
+template <typename T>
+void interleave(const rgb_view<const T> &src, T *dst, size_t pitch) {
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		const unsigned int rs = src.planes[0].step, gs = src.planes[1].step, bs = src.planes[2].step;
+		const unsigned int width = src.width();
+		for (unsigned int y = y0; y < y1; ++y) {
+			const T *r = src.planes[0].row(y);
+			const T *g = src.planes[1].row(y);
+			const T *b = src.planes[2].row(y);
+			T *out = (T *)((char *)dst + y * pitch);
+			for (unsigned int x = 0; x < width; ++x) {
+				out[3 * x + 0] = r[(size_t)x * rs];
+				out[3 * x + 1] = g[(size_t)x * gs];
+				out[3 * x + 2] = b[(size_t)x * bs];
+			}
+		}
+	});
+}
+
+#endif
@@ -0,0 +1,185 @@
+///
+/// \file integral.cpp
+/// \brief Summed-area tables for constant-time rectangle statistics
+///
+
+#include "integral.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//table entries per strip of the column pass
+static const unsigned int SAT_STRIP = 512;
+
+///This will write the running sums and sums of squares along rows y0 to
+///y1 of a plane into table rows y0 + 1 to y1 + 1, after a zero entry
+///
+/// \param src the plane
+/// \param sums the sum table
+/// \param squares the table of sums of squares
+/// \param y0 the first row
+/// \param y1 one past the last row
+///
+template <typename T>
+static void row_sums(const image_view<const unsigned char> &src, T *sums, uint64_t *squares,
+	unsigned int y0, unsigned int y1) {
+	const unsigned int width = src.width;
+	const size_t stride = (size_t)width + 1, step = src.step;
+	for (unsigned int y = y0; y < y1; ++y) {
+		const unsigned char *in = src.row(y);
+		T *s = sums + (y + 1) * stride;
+		uint64_t *q = squares + (y + 1) * stride;
+		T sum = 0;
+		uint64_t square = 0;
+		s[0] = 0;
+		q[0] = 0;
+		for (unsigned int x = 0; x < width; ++x) {
+			const unsigned int v = in[(size_t)x * step];
+			sum += v;
+			square += v * v;
+			s[x + 1] = sum;
+			q[x + 1] = square;
+		}
+	}
+}
+
+///This will add a row segment of a table to the one below it
+///
+/// \param row the row to add to
+/// \param above the row above it
+/// \param n the number of entries
+///
+static inline void add_row(uint32_t *row, const uint32_t *above, unsigned int n) {
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	for (; x + 8 <= n; x += 8) {
+		const __m256i v = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(row + x)),
+			_mm256_loadu_si256((const __m256i *)(above + x)));
+		_mm256_storeu_si256((__m256i *)(row + x), v);
+	}
+#endif
+	for (; x < n; ++x)
+		row[x] += above[x];
+}
+static inline void add_row(uint64_t *row, const uint64_t *above, unsigned int n) {
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	for (; x + 4 <= n; x += 4) {
+		const __m256i v = _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)(row + x)),
+			_mm256_loadu_si256((const __m256i *)(above + x)));
+		_mm256_storeu_si256((__m256i *)(row + x), v);
+	}
+#endif
+	for (; x < n; ++x)
+		row[x] += above[x];
+}
+
+///This will build both tables of a plane: the row pass over row bands,
+///then the column pass over column strips
+///
+/// \param src the plane
+/// \param sums the sum table, (width + 1) x (height + 1)
+/// \param squares the table of sums of squares, the same size
+///
+template <typename T>
+static void build_tables(const image_view<const unsigned char> &src, T *sums, uint64_t *squares) {
+	const unsigned int width = src.width, height = src.height;
+	const unsigned int stride = width + 1;
+	std::fill(sums, sums + stride, (T)0);
+	std::fill(squares, squares + stride, (uint64_t)0);
+	parallel_for(0, height, 16, [&](unsigned int y0, unsigned int y1) {
+		row_sums(src, sums, squares, y0, y1);
+	});
+	const unsigned int strips = (stride + SAT_STRIP - 1) / SAT_STRIP;
+	parallel_for(0, strips, 1, [&](unsigned int s0, unsigned int s1) {
+		const unsigned int x0 = s0 * SAT_STRIP, x1 = std::min(s1 * SAT_STRIP, stride);
+		for (unsigned int y = 2; y <= height; ++y) {
+			add_row(sums + (size_t)y * stride + x0, sums + (size_t)(y - 1) * stride + x0, x1 - x0);
+			add_row(squares + (size_t)y * stride + x0, squares + (size_t)(y - 1) * stride + x0, x1 - x0);
+		}
+	});
+}
+
+///This will build the summed-area tables of a plane
+///
+/// \param src the plane
+///
+void summed_area_table::build(const image_view<const unsigned char> &src) {
+	width = src.width;
+	height = src.height;
+	const size_t entries = ((size_t)width + 1) * ((size_t)height + 1);
+	squares.resize(entries);
+	if ((uint64_t)width * height <= SAT_MAX_NARROW_PIXELS) {
+		wide_sums.resize(0);
+		sums.resize(entries);
+		build_tables(src, sums.data(), squares.data());
+	}
+	else {
+		sums.resize(0);
+		wide_sums.resize(entries);
+		build_tables(src, wide_sums.data(), squares.data());
+	}
+}
+
+///This will return the population variance of a rectangle
+///
+/// \param x the first column
+/// \param y the first row
+/// \param w the number of columns
+/// \param h the number of rows
+/// \return the variance in squared levels
+///
+double summed_area_table::variance(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+	const double n = (double)w * h;
+	const double m = (double)sum(x, y, w, h) / n;
+	return std::max((double)sum_squares(x, y, w, h) / n - m * m, 0.0);
+}
+
+///This will write the box means of rows y0 to y1 of a plane
+///
+/// \param sums the sum table of the plane
+/// \param width the width of the plane
+/// \param height the height of the plane
+/// \param dst the result
+/// \param radius the radius of the square in pixels
+/// \param y0 the first row
+/// \param y1 one past the last row
+///
+template <typename T>
+static void box_mean_rows(const T *sums, unsigned int width, unsigned int height,
+	const image_view<unsigned char> &dst, unsigned int radius, unsigned int y0, unsigned int y1) {
+	const size_t stride = (size_t)width + 1;
+	for (unsigned int y = y0; y < y1; ++y) {
+		const unsigned int top = y > radius ? y - radius : 0;
+		const unsigned int bottom = std::min(y + radius + 1, height);
+		const T *above = sums + (size_t)top * stride, *below = sums + (size_t)bottom * stride;
+		const double rows = bottom - top;
+		unsigned char *out = dst.row(y);
+		for (unsigned int x = 0; x < width; ++x) {
+			const unsigned int left = x > radius ? x - radius : 0;
+			const unsigned int right = std::min(x + radius + 1, width);
+			const T sum = below[right] - below[left] - above[right] + above[left];
+			out[(size_t)x * dst.step] = (unsigned char)((double)sum / (rows * (right - left)) + 0.5);
+		}
+	}
+}
+
+///This will replace every sample by the mean of the square around it.
+///Near the edges only the part of the square inside the plane counts.
+///
+/// \param table the summed-area table of the plane
+/// \param dst the result, the size of the plane; may be the plane itself
+/// \param radius the radius of the square in pixels
+///
+void box_mean(const summed_area_table &table, const image_view<unsigned char> &dst, unsigned int radius) {
+	parallel_for(0, table.height, 16, [&](unsigned int y0, unsigned int y1) {
+		if (table.wide_sums.size() > 0)
+			box_mean_rows(table.wide_sums.data(), table.width, table.height, dst, radius, y0, y1);
+		else
+			box_mean_rows(table.sums.data(), table.width, table.height, dst, radius, y0, y1);
+	});
+}
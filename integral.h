@@ -0,0 +1,71 @@
+///
+/// \file integral.h
+/// \brief Summed-area tables for constant-time rectangle statistics
+///
+/// Entry (x, y) of a summed-area table holds the sum of every sample above
+/// and left of (x, y).  The sum over any rectangle is then four reads, so
+/// means and variances of regions, and box filters of any size, cost the
+/// same whatever the size.  The table has a zero first row and column so
+/// no query needs a bounds test.
+///
+/// The table is built in two passes: running sums along every row, split
+/// over row bands, then running sums down the columns, split over column
+/// strips so each step adds one row segment to the next with AVX2.
+///
+/// Sums are kept in 32 bits, which hold the sum of a whole image of up to
+/// SAT_MAX_NARROW_PIXELS (about 16.8 million) pixels; larger images take 64
+/// bits.  Sums of squares always take 64 bits.
+///
+
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+
+#include <cstdint>
+
+#include "image_view.h"
+#include "pixel_buffer.h"
+
+//the most pixels whose 8-bit sum fits 32 bits
+const uint64_t SAT_MAX_NARROW_PIXELS = 0xffffffffULL / 255;
+
+struct summed_area_table {
+	unsigned int width;
+	unsigned int height;
+	//(width + 1) x (height + 1) sums, in 32 bits unless the image is too large, then in 64
+	pixel_buffer<uint32_t> sums;
+	pixel_buffer<uint64_t> wide_sums;
+	//(width + 1) x (height + 1) sums of squares
+	pixel_buffer<uint64_t> squares;
+
+	//an empty table
+	summed_area_table() : width(0), height(0) {}
+	//the table of a plane
+	explicit summed_area_table(const image_view<const unsigned char> &src) : width(0), height(0) { build(src); }
+
+	void build(const image_view<const unsigned char> &src);
+	bool empty() const { return width == 0 || height == 0; }
+
+	//statistics of the w x h rectangle at (x, y), which must lie inside the plane and not be empty
+	uint64_t sum(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+		const size_t stride = (size_t)width + 1;
+		const size_t a = (size_t)y * stride + x, b = a + w, c = a + (size_t)h * stride, d = c + w;
+		if (wide_sums.size() > 0)
+			return wide_sums[d] - wide_sums[b] - wide_sums[c] + wide_sums[a];
+		return (uint32_t)(sums[d] - sums[b] - sums[c] + sums[a]);
+	}
+	uint64_t sum_squares(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+		const size_t stride = (size_t)width + 1;
+		const size_t a = (size_t)y * stride + x, b = a + w, c = a + (size_t)h * stride, d = c + w;
+		return squares[d] - squares[b] - squares[c] + squares[a];
+	}
+	double mean(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const {
+		return (double)sum(x, y, w, h) / ((double)w * h);
+	}
+	//the population variance
+	double variance(unsigned int x, unsigned int y, unsigned int w, unsigned int h) const;
+};
+
+//dst = the mean of the (2 radius + 1) square around each sample, over the part of it inside the plane
+void box_mean(const summed_area_table &table, const image_view<unsigned char> &dst, unsigned int radius);
+
+#endif
@@ -0,0 +1,275 @@
+///
+/// \file layers.cpp
+/// \brief Layered images with Porter-Duff compositing and a per-tile flattening cache
+///
+
+#include "layers.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//the factors of an operator in 1/255: Fa = fa_base + fa_sign * coverage below, Fb = fb_base + fb_sign * layer coverage
+struct blend_factors {
+	int fa_base;
+	int fa_sign;
+	int fb_base;
+	int fb_sign;
+};
+
+///This will return the factors of a Porter-Duff operator
+///
+/// \param op the operator
+/// \return its factors
+///
+static blend_factors factors_of(blend_op op) {
+	static const blend_factors table[] = {
+		{ 0, 0, 0, 0 },        //clear
+		{ 255, 0, 0, 0 },      //copy
+		{ 255, 0, 255, -1 },   //over
+		{ 255, -1, 255, 0 },   //dst_over
+		{ 0, 1, 0, 0 },        //in
+		{ 255, -1, 0, 0 },     //out
+		{ 0, 1, 255, -1 },     //atop
+		{ 255, -1, 255, -1 },  //xor
+		{ 255, 0, 255, 0 }     //plus
+	};
+	return table[op];
+}
+
+///This will divide a product of two 8-bit values by 255, rounded
+///
+/// \param x the product, at most 255 * 255
+/// \return x / 255
+///
+static inline unsigned int div255(unsigned int x) {
+	return ((x + 128) * 257) >> 16;
+}
+
+///This will composite one pixel
+///
+/// \param src the layer's color
+/// \param coverage the layer's coverage, opacity applied
+/// \param f the factors of the operator
+/// \param dst the premultiplied color below, replaced by the result
+/// \param dst_alpha the coverage below, replaced by the result
+///
+static inline void composite_pixel(const unsigned int src[3], unsigned int coverage, const blend_factors &f,
+	unsigned char *const dst[3], unsigned char &dst_alpha) {
+	const unsigned int fa = (unsigned int)(f.fa_base + f.fa_sign * (int)dst_alpha);
+	const unsigned int fb = (unsigned int)(f.fb_base + f.fb_sign * (int)coverage);
+	for (unsigned int c = 0; c < 3; ++c)
+		*dst[c] = (unsigned char)std::min(div255(fa * div255(src[c] * coverage)) + div255(fb * *dst[c]), 255u);
+	dst_alpha = (unsigned char)std::min(div255(fa * coverage) + div255(fb * dst_alpha), 255u);
+}
+
+#if defined(__AVX2__)
+static inline __m256i div255(__m256i x) {
+	return _mm256_mulhi_epu16(_mm256_add_epi16(x, _mm256_set1_epi16(128)), _mm256_set1_epi16(257));
+}
+static inline __m256i load16(const unsigned char *p) {
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+static inline void store16(unsigned char *p, __m256i v) {
+	_mm_storeu_si128((__m128i *)p, _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+}
+#endif
+
+///This will composite a run of dense pixels of a layer onto the run below
+///
+/// \param src the layer's red, green and blue samples
+/// \param alpha the layer's coverage, or 0 if it is opaque
+/// \param opacity the layer's opacity, 0 to 255
+/// \param f the factors of the operator
+/// \param dst the premultiplied red, green and blue samples below, replaced by the result
+/// \param dst_alpha the coverage below, replaced by the result
+/// \param n the number of pixels
+///
+static void composite_span(const unsigned char *const src[3], const unsigned char *alpha, unsigned int opacity,
+	const blend_factors &f, unsigned char *const dst[3], unsigned char *dst_alpha, unsigned int n) {
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	const __m256i opacity_v = _mm256_set1_epi16((short)opacity);
+	const __m256i fa_base = _mm256_set1_epi16((short)f.fa_base), fa_sign = _mm256_set1_epi16((short)f.fa_sign);
+	const __m256i fb_base = _mm256_set1_epi16((short)f.fb_base), fb_sign = _mm256_set1_epi16((short)f.fb_sign);
+	for (; x + 16 <= n; x += 16) {
+		const __m256i sa = alpha ? div255(_mm256_mullo_epi16(load16(alpha + x), opacity_v)) : opacity_v;
+		const __m256i da = load16(dst_alpha + x);
+		const __m256i fa = _mm256_add_epi16(fa_base, _mm256_sign_epi16(da, fa_sign));
+		const __m256i fb = _mm256_add_epi16(fb_base, _mm256_sign_epi16(sa, fb_sign));
+		for (unsigned int c = 0; c < 3; ++c) {
+			const __m256i cs = div255(_mm256_mullo_epi16(load16(src[c] + x), sa));
+			const __m256i cd = load16(dst[c] + x);
+			store16(dst[c] + x, _mm256_adds_epu16(div255(_mm256_mullo_epi16(fa, cs)), div255(_mm256_mullo_epi16(fb, cd))));
+		}
+		store16(dst_alpha + x, _mm256_adds_epu16(div255(_mm256_mullo_epi16(fa, sa)), div255(_mm256_mullo_epi16(fb, da))));
+	}
+#endif
+	for (; x < n; ++x) {
+		const unsigned int s[3] = { src[0][x], src[1][x], src[2][x] };
+		unsigned char *const d[3] = { dst[0] + x, dst[1] + x, dst[2] + x };
+		composite_pixel(s, alpha ? div255(alpha[x] * opacity) : opacity, f, d, dst_alpha[x]);
+	}
+}
+
+///This will composite an image onto another by a Porter-Duff operator
+///
+/// \param src the image to composite
+/// \param alpha its coverage, or an empty view if it is opaque
+/// \param opacity scales the coverage, 0 to 1
+/// \param op the operator
+/// \param dst the premultiplied image below, the size of src, replaced by the result
+/// \param dst_alpha the coverage below, replaced by the result
+///
+void composite(const rgb_view<const unsigned char> &src, const image_view<const unsigned char> &alpha, float opacity,
+	blend_op op, const rgb_view<unsigned char> &dst, const image_view<unsigned char> &dst_alpha) {
+	const unsigned int width = src.width();
+	const unsigned int opacity8 = (unsigned int)(std::min(std::max(opacity, 0.0f), 1.0f) * 255.0f + 0.5f);
+	const blend_factors f = factors_of(op);
+	bool dense = dst_alpha.dense() && (alpha.empty() || alpha.dense());
+	for (unsigned int c = 0; c < 3; ++c)
+		dense = dense && src[c].dense() && dst[c].dense();
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *a = alpha.empty() ? 0 : alpha.row(y);
+			if (dense) {
+				const unsigned char *const s[3] = { src[0].row(y), src[1].row(y), src[2].row(y) };
+				unsigned char *const d[3] = { dst[0].row(y), dst[1].row(y), dst[2].row(y) };
+				composite_span(s, a, opacity8, f, d, dst_alpha.row(y), width);
+				continue;
+			}
+			for (unsigned int x = 0; x < width; ++x) {
+				const unsigned int s[3] = { src[0](x, y), src[1](x, y), src[2](x, y) };
+				unsigned char *const d[3] = { &dst[0](x, y), &dst[1](x, y), &dst[2](x, y) };
+				composite_pixel(s, a ? div255(a[(size_t)x * alpha.step] * opacity8) : opacity8, f, d, dst_alpha(x, y));
+			}
+		}
+	});
+}
+
+///This will create an empty stack
+layer_stack::layer_stack() : width(0), height(0) {}
+
+///This will create a stack of no layers
+///
+/// \param _width the width in pixels
+/// \param _height the height in pixels
+///
+layer_stack::layer_stack(unsigned int _width, unsigned int _height) :
+	width(_width), height(_height), flat(_width, _height), coverage((size_t)_width * _height),
+	stale((size_t)tiles_across() * tiles_down(), 0) {}
+
+///This will add a layer on top of the stack and mark every tile
+///
+/// \param l the layer
+/// \return true if it was added, false if it is not the size of the stack
+///
+bool layer_stack::add(const layer &l) {
+	if (l.image.width != width || l.image.height != height) {
+		std::cout << "Error. A layer of " << l.image.width << "x" << l.image.height << " does not fit a stack of "
+			<< width << "x" << height << "." << std::endl;
+		return false;
+	}
+	if (!l.alpha.empty() && (l.alpha.width != width || l.alpha.height != height)) {
+		std::cout << "Error. A mask of " << l.alpha.width << "x" << l.alpha.height << " does not fit a layer of "
+			<< width << "x" << height << "." << std::endl;
+		return false;
+	}
+	layers.push_back(l);
+	touch_all();
+	return true;
+}
+
+///This will mark the tiles a rectangle overlaps
+///
+/// \param x the first column of the rectangle
+/// \param y the first row of the rectangle
+/// \param w the number of columns
+/// \param h the number of rows
+///
+void layer_stack::touch(unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
+	if (x >= width || y >= height || w == 0 || h == 0)
+		return;
+	const unsigned int across = tiles_across();
+	const unsigned int tx1 = (std::min(w, width - x) + x - 1) / LAYER_TILE;
+	const unsigned int ty1 = (std::min(h, height - y) + y - 1) / LAYER_TILE;
+	for (unsigned int ty = y / LAYER_TILE; ty <= ty1; ++ty) {
+		for (unsigned int tx = x / LAYER_TILE; tx <= tx1; ++tx)
+			stale[(size_t)ty * across + tx] = 1;
+	}
+}
+
+///This will mark every tile
+void layer_stack::touch_all() {
+	std::fill(stale.begin(), stale.end(), (unsigned char)1);
+}
+
+///This will return the pixels of a tile, clipped to the stack
+///
+/// \param tile the tile, counted row after row
+/// \param x the first column
+/// \param y the first row
+/// \param w the number of columns
+/// \param h the number of rows
+///
+void layer_stack::tile_bounds(unsigned int tile, unsigned int &x, unsigned int &y, unsigned int &w,
+	unsigned int &h) const {
+	x = tile % tiles_across() * LAYER_TILE;
+	y = tile / tiles_across() * LAYER_TILE;
+	w = std::min(LAYER_TILE, width - x);
+	h = std::min(LAYER_TILE, height - y);
+}
+
+///This will composite every marked tile again from transparent black,
+///layer by layer, one row of the tile at a time so the row stays in cache
+///while every layer is added to it, and clear the marks
+///
+/// \return the tiles composited, in order
+///
+std::vector<unsigned int> layer_stack::flatten() {
+	std::vector<unsigned int> tiles;
+	for (size_t i = 0; i < stale.size(); ++i) {
+		if (stale[i])
+			tiles.push_back((unsigned int)i);
+	}
+	//factors and 8-bit opacities of the visible layers
+	std::vector<const layer *> shown;
+	std::vector<blend_factors> f;
+	std::vector<unsigned int> opacity;
+	for (size_t i = 0; i < layers.size(); ++i) {
+		if (!layers[i].visible || layers[i].image.width != width || layers[i].image.height != height)
+			continue;
+		shown.push_back(&layers[i]);
+		f.push_back(factors_of(layers[i].op));
+		opacity.push_back((unsigned int)(std::min(std::max(layers[i].opacity, 0.0f), 1.0f) * 255.0f + 0.5f));
+	}
+
+	parallel_for(0, (unsigned int)tiles.size(), 1, [&](unsigned int t0, unsigned int t1) {
+		for (unsigned int t = t0; t < t1; ++t) {
+			unsigned int x, y, w, h;
+			tile_bounds(tiles[t], x, y, w, h);
+			for (unsigned int row = y; row < y + h; ++row) {
+				const size_t offset = (size_t)row * width + x;
+				unsigned char *const d[3] = { flat.view(0).row(row) + x, flat.view(1).row(row) + x,
+					flat.view(2).row(row) + x };
+				for (unsigned int c = 0; c < 3; ++c)
+					std::memset(d[c], 0, w);
+				std::memset(coverage.data() + offset, 0, w);
+				for (size_t i = 0; i < shown.size(); ++i) {
+					const layer &l = *shown[i];
+					const unsigned char *const s[3] = { l.image.view(0).row(row) + x, l.image.view(1).row(row) + x,
+						l.image.view(2).row(row) + x };
+					const unsigned char *a = l.alpha.empty() ? 0 : l.alpha.samples.data() + offset;
+					composite_span(s, a, opacity[i], f[i], d, coverage.data() + offset, w);
+				}
+			}
+		}
+	});
+	std::fill(stale.begin(), stale.end(), (unsigned char)0);
+	return tiles;
+}
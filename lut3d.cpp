@@ -0,0 +1,356 @@
+///
+/// \file lut3d.cpp
+/// \brief 3D color lookup tables (.cube) with tetrahedral interpolation
+///
+
+#include "lut3d.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//the largest grid accepted; 256^3 nodes already take 192 MB
+static const unsigned int LUT3D_MAX_SIZE = 256;
+
+///This will create an empty table
+lut3d::lut3d() : size(0), domain_min{ 0.0f, 0.0f, 0.0f }, domain_max{ 1.0f, 1.0f, 1.0f } {}
+
+///This will create a table from a .cube file
+///
+/// \param fileName the referenced .cube file
+///
+lut3d::lut3d(const std::string &fileName) : lut3d() {
+	read(fileName);
+}
+
+///This will read a .cube file: keyword lines (TITLE, LUT_3D_SIZE,
+///DOMAIN_MIN, DOMAIN_MAX, LUT_3D_INPUT_RANGE) followed by one "r g b" line
+///per grid point, red varying fastest.  Lines starting with # are comments.
+///
+/// \param fileName the referenced .cube file
+/// \return true on success; on failure the table is left empty
+///
+bool lut3d::read(const std::string &fileName) {
+	size = 0;
+	table.clear();
+	title.clear();
+	for (unsigned int c = 0; c < 3; ++c) {
+		domain_min[c] = 0.0f;
+		domain_max[c] = 1.0f;
+	}
+	std::ifstream input(fileName.c_str());
+	if (!input.is_open()) {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+		return false;
+	}
+
+	unsigned int n = 0;
+	std::vector<float> values;
+	std::string line;
+	unsigned int line_number = 0;
+	while (std::getline(input, line)) {
+		++line_number;
+		if (!line.empty() && line[line.size() - 1] == '\r')
+			line.erase(line.size() - 1);
+		const size_t first = line.find_first_not_of(" \t");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+		std::istringstream fields(line);
+		if (line[first] == '-' || line[first] == '.' || (line[first] >= '0' && line[first] <= '9')) {
+			float r, g, b;
+			if (!(fields >> r >> g >> b)) {
+				std::cout << "Error. " << fileName << ":" << line_number << " is not an r g b line." << std::endl;
+				return false;
+			}
+			values.push_back(r);
+			values.push_back(g);
+			values.push_back(b);
+			continue;
+		}
+		std::string keyword;
+		fields >> keyword;
+		bool ok = true;
+		if (keyword == "TITLE") {
+			const size_t open = line.find('"');
+			const size_t close = line.rfind('"');
+			if (open != std::string::npos && close > open)
+				title = line.substr(open + 1, close - open - 1);
+		}
+		else if (keyword == "LUT_3D_SIZE")
+			ok = (bool)(fields >> n) && n >= 2 && n <= LUT3D_MAX_SIZE;
+		else if (keyword == "DOMAIN_MIN")
+			ok = (bool)(fields >> domain_min[0] >> domain_min[1] >> domain_min[2]);
+		else if (keyword == "DOMAIN_MAX")
+			ok = (bool)(fields >> domain_max[0] >> domain_max[1] >> domain_max[2]);
+		else if (keyword == "LUT_3D_INPUT_RANGE") {
+			float lo, hi;
+			ok = (bool)(fields >> lo >> hi);
+			for (unsigned int c = 0; ok && c < 3; ++c) {
+				domain_min[c] = lo;
+				domain_max[c] = hi;
+			}
+		}
+		else if (keyword == "LUT_1D_SIZE") {
+			std::cout << "Error. " << fileName << " holds a 1D LUT, only 3D LUTs are supported." << std::endl;
+			return false;
+		}
+		//other keywords (LUT_1D_INPUT_RANGE, vendor extensions) do not affect a 3D table
+		if (!ok) {
+			std::cout << "Error. " << fileName << ":" << line_number << " has a bad " << keyword << " value." << std::endl;
+			return false;
+		}
+	}
+
+	if (n == 0) {
+		std::cout << "Error. " << fileName << " has no valid LUT_3D_SIZE." << std::endl;
+		return false;
+	}
+	if (values.size() != (size_t)n * n * n * 3) {
+		std::cout << "Error. " << fileName << " has " << values.size() / 3 << " grid points, expected "
+			<< (size_t)n * n * n << "." << std::endl;
+		return false;
+	}
+	for (unsigned int c = 0; c < 3; ++c) {
+		if (!(domain_max[c] > domain_min[c])) {
+			std::cout << "Error. " << fileName << " has an empty domain." << std::endl;
+			return false;
+		}
+	}
+	size = n;
+	table.swap(values);
+	return true;
+}
+
+///What a lookup needs, derived once per image: the mapping of a sample to
+///grid units and the distance in floats between neighbouring grid points.
+struct lut_params {
+	const float *table;
+	float last;
+	unsigned int last_cell;
+	float scale[3];
+	float bias[3];
+	unsigned int stride[3];
+
+	///This will derive the parameters of a table
+	///
+	/// \param lut the table, not empty
+	///
+	explicit lut_params(const lut3d &lut) : table(lut.table.data()), last((float)(lut.size - 1)),
+		last_cell(lut.size - 2) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			const float grid = last / (lut.domain_max[c] - lut.domain_min[c]);
+			scale[c] = grid;
+			bias[c] = -lut.domain_min[c] * grid;
+		}
+		stride[0] = 3;
+		stride[1] = 3 * lut.size;
+		stride[2] = 3 * lut.size * lut.size;
+	}
+
+	///This will interpolate the table at one color
+	///
+	/// \param v the color, in sample units
+	/// \param out the interpolated color
+	///
+	void lookup(const float v[3], float out[3]) const {
+		float f[3];
+		size_t base = 0;
+		for (unsigned int c = 0; c < 3; ++c) {
+			float x = v[c] * scale[c] + bias[c];
+			//written so a NaN clamps to the bottom
+			x = !(x > 0.0f) ? 0.0f : std::min(x, last);
+			const unsigned int i = std::min((unsigned int)x, last_cell);
+			f[c] = x - (float)i;
+			base += (size_t)i * stride[c];
+		}
+		//the tetrahedron runs from corner 000 along the axis of the largest fraction, then the
+		//middle one, to corner 111; the tie rules match the vector code
+		const unsigned int hi = f[0] >= f[1] && f[0] >= f[2] ? 0 : (f[1] >= f[2] ? 1 : 2);
+		const unsigned int lo = f[2] <= f[1] && f[2] <= f[0] ? 2 : (f[1] <= f[0] ? 1 : 0);
+		const unsigned int mid = 3 - hi - lo;
+		const unsigned int all = stride[0] + stride[1] + stride[2];
+		const float *c0 = table + base;
+		const float *c1 = c0 + stride[hi];
+		const float *c2 = c0 + all - stride[lo];
+		const float *c3 = c0 + all;
+		const float w0 = 1.0f - f[hi], w1 = f[hi] - f[mid], w2 = f[mid] - f[lo], w3 = f[lo];
+		for (unsigned int c = 0; c < 3; ++c)
+			out[c] = w0 * c0[c] + w1 * c1[c] + w2 * c2[c] + w3 * c3[c];
+	}
+
+#if defined(__AVX2__) && defined(__FMA__)
+	///This will interpolate the table at 8 colors
+	///
+	/// \param v the colors, in sample units
+	/// \param out the interpolated colors
+	///
+	void lookup8(const __m256 v[3], __m256 out[3]) const {
+		__m256 f[3];
+		__m256i base = _mm256_setzero_si256();
+		for (unsigned int c = 0; c < 3; ++c) {
+			__m256 x = _mm256_fmadd_ps(v[c], _mm256_set1_ps(scale[c]), _mm256_set1_ps(bias[c]));
+			//max returns its second operand for a NaN, clamping it to the bottom
+			x = _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(last));
+			const __m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(x), _mm256_set1_epi32((int)last_cell));
+			f[c] = _mm256_sub_ps(x, _mm256_cvtepi32_ps(i));
+			base = _mm256_add_epi32(base, _mm256_mullo_epi32(i, _mm256_set1_epi32((int)stride[c])));
+		}
+		const __m256i r_max = _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(f[0], f[1], _CMP_GE_OQ),
+			_mm256_cmp_ps(f[0], f[2], _CMP_GE_OQ)));
+		const __m256i g_max = _mm256_castps_si256(_mm256_cmp_ps(f[1], f[2], _CMP_GE_OQ));
+		const __m256i b_min = _mm256_castps_si256(_mm256_and_ps(_mm256_cmp_ps(f[2], f[1], _CMP_LE_OQ),
+			_mm256_cmp_ps(f[2], f[0], _CMP_LE_OQ)));
+		const __m256i g_min = _mm256_castps_si256(_mm256_cmp_ps(f[1], f[0], _CMP_LE_OQ));
+		const __m256i sr = _mm256_set1_epi32((int)stride[0]);
+		const __m256i sg = _mm256_set1_epi32((int)stride[1]);
+		const __m256i sb = _mm256_set1_epi32((int)stride[2]);
+		const __m256i all = _mm256_set1_epi32((int)(stride[0] + stride[1] + stride[2]));
+		const __m256i step_hi = _mm256_blendv_epi8(_mm256_blendv_epi8(sb, sg, g_max), sr, r_max);
+		const __m256i step_lo = _mm256_blendv_epi8(_mm256_blendv_epi8(sr, sg, g_min), sb, b_min);
+		const __m256i i1 = _mm256_add_epi32(base, step_hi);
+		const __m256i i2 = _mm256_add_epi32(base, _mm256_sub_epi32(all, step_lo));
+		const __m256i i3 = _mm256_add_epi32(base, all);
+
+		const __m256 f_hi = _mm256_max_ps(f[0], _mm256_max_ps(f[1], f[2]));
+		const __m256 f_lo = _mm256_min_ps(f[0], _mm256_min_ps(f[1], f[2]));
+		const __m256 f_mid = _mm256_sub_ps(_mm256_add_ps(f[0], _mm256_add_ps(f[1], f[2])), _mm256_add_ps(f_hi, f_lo));
+		const __m256 w0 = _mm256_sub_ps(_mm256_set1_ps(1.0f), f_hi);
+		const __m256 w1 = _mm256_sub_ps(f_hi, f_mid);
+		const __m256 w2 = _mm256_sub_ps(f_mid, f_lo);
+		for (unsigned int c = 0; c < 3; ++c) {
+			const float *t = table + c;
+			__m256 sum = _mm256_mul_ps(w0, _mm256_i32gather_ps(t, base, 4));
+			sum = _mm256_fmadd_ps(w1, _mm256_i32gather_ps(t, i1, 4), sum);
+			sum = _mm256_fmadd_ps(w2, _mm256_i32gather_ps(t, i2, 4), sum);
+			out[c] = _mm256_fmadd_ps(f_lo, _mm256_i32gather_ps(t, i3, 4), sum);
+		}
+	}
+#endif
+};
+
+#if defined(__AVX2__) && defined(__FMA__)
+///This will round 8 values in [0, 1] units to 8-bit samples, clamping them
+///
+/// \param v the values
+/// \param out the 8 samples
+///
+static inline void store8(__m256 v, unsigned char *out) {
+	v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(v, _mm256_set1_ps(255.0f)), _mm256_setzero_ps()),
+		_mm256_set1_ps(255.0f));
+	const __m256i s = _mm256_cvtps_epi32(v);
+	//the packs work within 128-bit lanes: samples 0-3 end up in the low lane, 4-7 in the high one
+	const __m256i words = _mm256_packus_epi32(s, s);
+	const __m256i bytes = _mm256_packus_epi16(words, words);
+	_mm_storel_epi64((__m128i *)out, _mm_unpacklo_epi32(_mm256_castsi256_si128(bytes), _mm256_extracti128_si256(bytes, 1)));
+}
+#endif
+
+///This will apply a table to every pixel of an 8-bit image
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may be src
+/// \param lut the table; an empty table copies src
+/// \param strength the amount of the change to apply, 1 for all of it
+///
+void apply_lut3d(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst, const lut3d &lut,
+	float strength) {
+	if (lut.empty()) {
+		for (unsigned int c = 0; c < 3; ++c)
+			copy(src[c], dst[c]);
+		return;
+	}
+	const lut_params p(lut);
+	const float unit = 1.0f / 255.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+	const bool dense = src[0].dense() && src[1].dense() && src[2].dense() && dst[0].dense() && dst[1].dense()
+		&& dst[2].dense();
+#endif
+	parallel_for(0, src.height(), 8, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *in[3] = { src[0].row(y), src[1].row(y), src[2].row(y) };
+			unsigned char *out[3] = { dst[0].row(y), dst[1].row(y), dst[2].row(y) };
+			const unsigned int width = src.width();
+			unsigned int x = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+			if (dense) {
+				const __m256 amount = _mm256_set1_ps(strength);
+				for (; x + 8 <= width; x += 8) {
+					__m256 v[3], graded[3];
+					for (unsigned int c = 0; c < 3; ++c) {
+						const __m256i s = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in[c] + x)));
+						v[c] = _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(unit));
+					}
+					p.lookup8(v, graded);
+					for (unsigned int c = 0; c < 3; ++c)
+						store8(_mm256_fmadd_ps(amount, _mm256_sub_ps(graded[c], v[c]), v[c]), out[c] + x);
+				}
+			}
+#endif
+			for (; x < width; ++x) {
+				float v[3], graded[3];
+				for (unsigned int c = 0; c < 3; ++c)
+					v[c] = in[c][(size_t)x * src[c].step] * unit;
+				p.lookup(v, graded);
+				for (unsigned int c = 0; c < 3; ++c) {
+					const float s = (v[c] + strength * (graded[c] - v[c])) * 255.0f;
+					out[c][(size_t)x * dst[c].step] = (unsigned char)(s <= 0.0f ? 0 : (s >= 255.0f ? 255 : (int)(s + 0.5f)));
+				}
+			}
+		}
+	});
+}
+
+///This will apply a table to every pixel of a float image
+///
+/// \param src the image
+/// \param dst the output image, the size of src; may be src
+/// \param lut the table; an empty table copies src
+/// \param strength the amount of the change to apply, 1 for all of it
+///
+void apply_lut3d(const rgb_view<const float> &src, const rgb_view<float> &dst, const lut3d &lut, float strength) {
+	if (lut.empty()) {
+		for (unsigned int c = 0; c < 3; ++c)
+			copy(src[c], dst[c]);
+		return;
+	}
+	const lut_params p(lut);
+#if defined(__AVX2__) && defined(__FMA__)
+	const bool dense = src[0].dense() && src[1].dense() && src[2].dense() && dst[0].dense() && dst[1].dense()
+		&& dst[2].dense();
+#endif
+	parallel_for(0, src.height(), 8, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const float *in[3] = { src[0].row(y), src[1].row(y), src[2].row(y) };
+			float *out[3] = { dst[0].row(y), dst[1].row(y), dst[2].row(y) };
+			const unsigned int width = src.width();
+			unsigned int x = 0;
+#if defined(__AVX2__) && defined(__FMA__)
+			if (dense) {
+				const __m256 amount = _mm256_set1_ps(strength);
+				for (; x + 8 <= width; x += 8) {
+					__m256 v[3], graded[3];
+					for (unsigned int c = 0; c < 3; ++c)
+						v[c] = _mm256_loadu_ps(in[c] + x);
+					p.lookup8(v, graded);
+					for (unsigned int c = 0; c < 3; ++c)
+						_mm256_storeu_ps(out[c] + x, _mm256_fmadd_ps(amount, _mm256_sub_ps(graded[c], v[c]), v[c]));
+				}
+			}
+#endif
+			for (; x < width; ++x) {
+				float v[3], graded[3];
+				for (unsigned int c = 0; c < 3; ++c)
+					v[c] = in[c][(size_t)x * src[c].step];
+				p.lookup(v, graded);
+				for (unsigned int c = 0; c < 3; ++c)
+					out[c][(size_t)x * dst[c].step] = v[c] + strength * (graded[c] - v[c]);
+			}
+		}
+	});
+}
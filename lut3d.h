@@ -0,0 +1,47 @@
+///
+/// \file lut3d.h
+/// \brief 3D color lookup tables (.cube) with tetrahedral interpolation
+///
+/// A 3D LUT samples a color transform on an n x n x n grid over the input
+/// cube.  A color between the grid points is interpolated inside one of the
+/// six tetrahedra each grid cell splits into along its diagonal, from the
+/// four corners of that tetrahedron: fewer reads than trilinear
+/// interpolation's eight, and neutral colors stay on the gray diagonal.
+/// With AVX2 the tetrahedron is picked without branches by sorting the
+/// three fractions, and 8 pixels are looked up at once with gathers.
+///
+
+#ifndef LUT3D_H
+#define LUT3D_H
+
+#include <string>
+#include <vector>
+
+#include "image_view.h"
+
+struct lut3d {
+	//grid points along each axis; 0 if no table is loaded
+	unsigned int size;
+	//the input values mapped to the first and the last grid point of each axis
+	float domain_min[3];
+	float domain_max[3];
+	//size^3 rgb triples, red varying fastest, then green, then blue
+	std::vector<float> table;
+	std::string title;
+
+	//an empty table
+	lut3d();
+	//a table loaded from a .cube file; empty if the file could not be read
+	explicit lut3d(const std::string &fileName);
+
+	bool read(const std::string &fileName);
+	bool empty() const { return size == 0; }
+};
+
+//dst = src + strength (lut(src) - src), with 8-bit samples taken as [0, 1]; dst may be src
+void apply_lut3d(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst, const lut3d &lut,
+	float strength = 1.0f);
+void apply_lut3d(const rgb_view<const float> &src, const rgb_view<float> &dst, const lut3d &lut,
+	float strength = 1.0f);
+
+#endif
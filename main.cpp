@@ -47,6 +47,7 @@
 #include <iostream>
 #include <cfloat>
 #include <cmath>
+#include <cstring>
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -54,149 +55,16 @@
 #include <sstream>
 #include <exception>
 
-using namespace std;
-
-class ppm {
-	void init();
-	//info about the PPM file (height and width)
-	unsigned int n_r;
-	unsigned int n_c;
-
-public:
-	//arrays for storing the Red (r), Green (g), and Blue (b) values
-	std::vector<unsigned char> r;
-	std::vector<unsigned char> g;
-	std::vector<unsigned char> b;
-
-	unsigned int height;
-	unsigned int width;
-	unsigned int max_color_val;
-
-	//total number of elements (in this case pixels)
-	unsigned int size;
-
-	ppm();
-	//create a PPM object and fill it with data stored in the PPM file referenced as fileName 
-	ppm(const std::string &fileName);
-	//create an "epmty" PPM image with a given width and height; the Red, Green, and Blue arrays are filled with zeros
-	ppm(const unsigned int _width, const unsigned int _height);
-	//read the PPM image from the PPM file referenced as fileName
-	void read(const std::string &fileName);
-	//This will be used in later projects
-	//write the PPM image in the PPM file referenced as fileName
-	void write(const std::string &fileName);
-};
-
-///This will initialize a PPM object to default values
-void ppm::init() {
-	width = 0;
-	height = 0;
-	max_color_val = 255;
-}
-
-///This will create a PPM object
-ppm::ppm() {
-	init();
-}
-
-///This will create a PPM object then fill it with data stored in the PPM file referenced as fileName 
-///
-/// \param fileName the referenced PPM file
-///
-ppm::ppm(const std::string &fileName) {
-	init();
-	read(fileName);
-}
-
-///This will create an "epmty" PPM image with a given width and height; 
-///the  Red, Green, and Blue arrays are filled with zeros
-///
-/// \param _width the number of rows
-/// \param _height the number of columns
-///
-ppm::ppm(const unsigned int _width, const unsigned int _height) {
-	init();
-	width = _width;
-	height = _height;
-	n_r = height;
-	n_c = width;
-	size = width * height;
-
-	// resize and fill r, g and b arrays with 0
-	r.resize(size);
-	g.resize(size);
-	b.resize(size);
-}
-
-///This will read the PPM image from the PPM file referenced as fileName
-///If there are any errors in the format of the file errors are reported or
-///exceptions are thrown.
-///
-/// \param fileName the referenced PPM file
-/// 
-void ppm::read(const std::string &fileName) {
-	std::ifstream input(fileName.c_str(), std::ios::in | std::ios::binary);
-	//Check to see if the file was opened, if it wasn't report an error.
-	if (input.is_open()) {
-		std::string line;
-		std::getline(input, line);
-		//If the first line doesn't contain "P6" report an error
-		if (line != "P6") {
-			std::cout << "Error. Unrecognized file format." << std::endl;
-			return;
-		}
-		std::getline(input, line);
-		while (line[0] == '#') {
-			std::getline(input, line);
-		}
-		std::stringstream dimensions(line);
-		//If the dimensions can't be obtained from the line catch the exception and report the error
-		try {
-			dimensions >> width;
-			dimensions >> height;
-			n_r = height;
-			n_c = width;
-		}
-		catch (std::exception &ex) {
-			std::cout << "Header file format error. " << ex.what() << std::endl;
-			return;
-		}
-		std::getline(input, line);
-		std::stringstream max_val(line);
-		//If the maximum color value can't be obtained from the line catch the exception and report the error
-		try {
-			max_val >> max_color_val;
-		}
-		catch (std::exception &ex) {
-			std::cout << "Header file format error. " << ex.what() << std::endl;
-			return;
-		}
-		size = width * height;
-		r.reserve(size); //resize the r vector
-		g.reserve(size); //resize the g vector
-		b.reserve(size); //resize the b vector
-		char channel;
-		//read and store color values from the input to the r, g, and b vectors arrays
-		for (unsigned int i = 0; i < size; ++i) {
-			input.read(&channel, 1);
-			r[i] = (unsigned char)channel;
-			input.read(&channel, 1);
-			g[i] = (unsigned char)channel;
-			input.read(&channel, 1);
-			b[i] = (unsigned char)channel;
-		}
-	}
-	else {
-		std::cout << "Error. Unable to open " << fileName << std::endl;
-	}
-	input.close();
-}
-
-///
-///void ppm::write(const std::string &fname) 
-///will be written eventually
-///
+#include "ppm.h"
+#include "bench.h"
+#include "bilateral.h"
+#include "fill.h"
+#include "histogram.h"
+#include "integral.h"
+#include "layers.h"
+#include "lut3d.h"
 
+using namespace std;
 
 /// 
 /// Log an SDL error with some error message to the output stream of our
@@ -231,12 +99,194 @@ void renderTexture(SDL_Texture *tex, SDL_Renderer *ren, int x, int y) {
 }
 
 
+/// 
+/// Grade a rectangle of the image with a 3D LUT and stage the result in
+/// the packed RGB24 array drawn to the screen
+///
+/// \param pixmap The image to grade
+/// \param grade The LUT; when empty the image is staged unchanged
+/// \param strength How much of the grade to apply, 0 to 1
+/// \param data The packed RGB24 array, one row of the image per 3 * width bytes
+/// \param x The first column of the rectangle
+/// \param y The first row of the rectangle
+/// \param w The number of columns
+/// \param h The number of rows
+///
+void gradePixels(const ppm<> &pixmap, const lut3d &grade, float strength, unsigned char *data,
+	unsigned int x, unsigned int y, unsigned int w, unsigned int h) {
+	const rgb_view<const unsigned char> src = rgb_view<const unsigned char>(pixmap.view()).crop(x, y, w, h);
+	unsigned char *out = data + 3 * ((size_t)y * pixmap.width + x);
+	if (grade.empty() || strength <= 0.0f) {
+		interleave(src, out, 3 * pixmap.width);
+		return;
+	}
+	ppm<> graded(w, h, uninitialized);
+	apply_lut3d(src, graded.view(), grade, strength);
+	interleave(rgb_view<const unsigned char>(graded.view()), out, 3 * pixmap.width);
+}
+
+
+/// 
+/// Grade the whole image and stage it, smoothed by an edge-preserving
+/// bilateral filter over about 8 pixels as a preview when a range is given
+///
+/// \param pixmap The image to stage
+/// \param grade The LUT; when empty the image is staged ungraded
+/// \param strength How much of the grade to apply, 0 to 1
+/// \param smoothing The luma differences the smoothing stops at, in 8-bit levels; 0 to stage the image sharp
+/// \param data The packed RGB24 array, one row of the image per 3 * width bytes
+///
+void stageImage(const ppm<> &pixmap, const lut3d &grade, float strength, float smoothing, unsigned char *data) {
+	const unsigned int w = pixmap.width, h = pixmap.height;
+	gradePixels(pixmap, grade, strength, data, 0, 0, w, h);
+	if (smoothing <= 0.0f)
+		return;
+	const rgb_view<unsigned char> staged(image_view<unsigned char>(data + 0, w, h, 3 * (size_t)w, 3),
+		image_view<unsigned char>(data + 1, w, h, 3 * (size_t)w, 3),
+		image_view<unsigned char>(data + 2, w, h, 3 * (size_t)w, 3));
+	bilateral_filter(rgb_view<const unsigned char>(staged), staged, 8.0f, smoothing);
+}
+
+
+/// 
+/// Grow a rectangle to cover another; an empty rectangle becomes the other
+///
+/// \param rect The rectangle to grow
+/// \param x The first column of the other rectangle
+/// \param y The first row of the other rectangle
+/// \param w The number of columns
+/// \param h The number of rows
+///
+void growRect(SDL_Rect &rect, int x, int y, int w, int h) {
+	if (rect.w > 0 && rect.h > 0) {
+		const int right = std::max(rect.x + rect.w, x + w), bottom = std::max(rect.y + rect.h, y + h);
+		x = std::min(rect.x, x);
+		y = std::min(rect.y, y);
+		w = right - x;
+		h = bottom - y;
+	}
+	rect.x = x;
+	rect.y = y;
+	rect.w = w;
+	rect.h = h;
+}
+
+
+/// 
+/// Flatten the tiles of the canvas under an edited rectangle and restage
+/// the rectangle.  The tiles are composited whole, but nothing changed in
+/// them outside the rectangle, so only it is regraded, moved from its old
+/// values to its new ones in the histogram pixel by pixel and added to the
+/// part of the texture to upload; the rest of the staged image, smoothing
+/// preview included, is left as it is.
+///
+/// \param canvas The layers, changed inside the rectangle
+/// \param grade The LUT; when empty the rectangle is staged ungraded
+/// \param strength How much of the grade to apply, 0 to 1
+/// \param data The packed RGB24 array, one row of the image per 3 * width bytes
+/// \param shown The histogram of the staged image, or NULL when it is to be recounted anyway
+/// \param edit The edited rectangle
+/// \param dirty The part of the texture to upload, grown to cover the rectangle
+///
+void restageEdit(layer_stack &canvas, const lut3d &grade, float strength, unsigned char *data, histogram *shown,
+	const SDL_Rect &edit, SDL_Rect &dirty) {
+	const size_t pitch = 3 * (size_t)canvas.width, row = 3 * (size_t)edit.w;
+	canvas.touch(edit.x, edit.y, edit.w, edit.h);
+	canvas.flatten();
+	std::vector<unsigned char> before;
+	if (shown) {
+		before.resize(row * edit.h);
+		for (int y = 0; y < edit.h; ++y)
+			std::memcpy(&before[y * row], data + (edit.y + y) * pitch + 3 * (size_t)edit.x, row);
+	}
+	gradePixels(canvas.flat, grade, strength, data, edit.x, edit.y, edit.w, edit.h);
+	if (shown) {
+		for (int y = 0; y < edit.h; ++y) {
+			const unsigned char *after = data + (edit.y + y) * pitch + 3 * (size_t)edit.x;
+			for (size_t i = 0; i < row; ++i) {
+				if (before[y * row + i] != after[i])
+					shown->replace((unsigned int)(i % 3), before[y * row + i], after[i]);
+			}
+		}
+	}
+	growRect(dirty, edit.x, edit.y, edit.w, edit.h);
+}
+
+
+
+
+
+/// 
+/// Print the mean and standard deviation of each channel over a rectangle
+/// of the image, four table reads per statistic whatever its size
+///
+/// \param os The output stream to write to
+/// \param tables The summed-area tables of the red, green and blue channels
+/// \param rect The rectangle, inside the image
+///
+void printSelection(std::ostream &os, const summed_area_table tables[3], const SDL_Rect &rect) {
+	os << "Selection " << rect.x << "," << rect.y << " " << rect.w << "x" << rect.h << ":";
+	for (unsigned int c = 0; c < 3; ++c) {
+		os << "  " << "RGB"[c] << " mean " << tables[c].mean(rect.x, rect.y, rect.w, rect.h)
+			<< " sd " << std::sqrt(tables[c].variance(rect.x, rect.y, rect.w, rect.h));
+	}
+	os << std::endl;
+}
+
+/// 
+/// Draw a histogram panel: a translucent box with a bar per value for each
+/// channel, added together so values common to all channels show white
+///
+/// \param ren The renderer we want to draw to
+/// \param h The histograms to draw
+/// \param x The x coordinate of the panel's top left corner
+/// \param y The y coordinate of the panel's top left corner
+/// \param height The height of the panel; it is 256 pixels wide
+///
+void renderHistogram(SDL_Renderer *ren, const histogram &h, int x, int y, int height) {
+	SDL_Rect box;
+	box.x = x;
+	box.y = y;
+	box.w = 256;
+	box.h = height;
+	SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(ren, 0, 0, 0, 160);
+	SDL_RenderFillRect(ren, &box);
+
+	//The bars share one scale so the channels can be compared
+	const double peak = std::max(std::max(h.peak(0), h.peak(1)), std::max<uint32_t>(h.peak(2), 1));
+	SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_ADD);
+	for (unsigned int c = 0; c < 3; ++c) {
+		SDL_SetRenderDrawColor(ren, c == 0 ? 255 : 0, c == 1 ? 255 : 0, c == 2 ? 255 : 0, 255);
+		for (int v = 0; v < 256; ++v) {
+			const int bar = (int)(h.counts[c][v] / peak * (height - 1) + 0.5);
+			if (bar > 0)
+				SDL_RenderDrawLine(ren, x + v, y + height - 1, x + v, y + height - bar);
+		}
+	}
+	SDL_SetRenderDrawBlendMode(ren, SDL_BLENDMODE_NONE);
+}
+
+
 
 
 
 /// 
 /// Main function.  Initializes an SDL window, renderer, and texture,
 /// and then goes into a loop to listen to events and draw the texture.
+/// A .cube file given after the image grades it: L toggles the grade and
+/// [ and ] lower and raise its strength.  Strokes painted with the left
+/// mouse button go on a layer of their own over the image, which V hides
+/// and shows; F swaps the brush for a bucket fill of the region of
+/// similar color under the mouse, and - and = lower and raise how much its
+/// colors may differ.  H shows the histogram of what is on screen, with each
+/// channel's range and mean in the title bar, kept up to date pixel by
+/// pixel over the edited rectangle while painting.  A auto-levels the image
+/// and E equalizes it.  S previews
+/// edge-preserving smoothing, and , and . lower and raise the luma
+/// differences it smooths over.  Dragging with the right mouse button
+/// selects a rectangle and prints its statistics.
+/// Run with --bench <name> to run a benchmark instead (see bench.h).
 ///
 /// \param argc Number of command line arguments
 /// \param argv Array of command line arguments
@@ -244,14 +294,49 @@ void renderTexture(SDL_Texture *tex, SDL_Renderer *ren, int x, int y) {
 ///
 
 int main(int argc, char** argv) {
+	if (argc < 2) {
+		std::cout << "Usage: " << argv[0] << " <file.ppm> [grade.cube] | --bench <name> [options]" << std::endl;
+		return 1;
+	}
+	if (std::string(argv[1]) == "--bench") {
+		return run_benchmark(argc - 2, argv + 2);
+	}
+
 	//Integers specifying the width (number of columns) and height (number
 	//of rows) of the image
 
 	const char* fileName = argv[1];
-	ppm pixmap(fileName);
+	//The image is the bottom layer of a stack and strokes go on a transparent layer above it, so
+	//a stroke only composites the tiles under it again; pixmap is what the stack flattens to
+	layer_stack canvas;
+	{
+		//16-bit files are read whole and scaled to 8 bits for display
+		const ppm<unsigned short> file(fileName);
+		if (file.size == 0) {
+			std::cout << "Error. " << fileName << " holds no image to show." << std::endl;
+			return 1;
+		}
+		ppm<> image;
+		convert(file, image);
+		canvas = layer_stack(image.width, image.height);
+		canvas.add(layer(image));
+		canvas.add(layer(ppm<>(image.width, image.height), mask(image.width, image.height)));
+	}
+	canvas.flatten();
+	const ppm<> &pixmap = canvas.flat;
 
 	int num_cols = pixmap.width;
 	int num_rows = pixmap.height;
+
+	//The optional color grade, applied at full strength to start with
+	lut3d grade;
+	if (argc > 2 && !grade.read(argv[2]))
+		return 1;
+	bool grading = !grade.empty();
+	float strength = 1.0f;
+	//The smoothing preview, off to start with
+	bool smoothing = false;
+	float smoothRange = 30.0f;
 	//Start up SDL and make sure it went ok
 	if (SDL_Init(SDL_INIT_VIDEO) != 0) {
 		logSDLError(std::cout, "SDL_Init");
@@ -278,15 +363,9 @@ int main(int argc, char** argv) {
 
 	//A raw data array of characters.  Each column is drawn using the r, g, and b
 	//arrays to produce an image from the file that was originally input.
-	unsigned char* data = new unsigned char[num_cols*num_rows * 3];
-	//r is row, c is column
-	for (int r = 0; r < num_rows; r++) {
-		for (int c = 0; c < num_cols; c++) {
-			data[3 * (r*num_cols + c) + 0] = pixmap.r[r*num_cols + c];
-			data[3 * (r*num_cols + c) + 1] = pixmap.g[r*num_cols + c];
-			data[3 * (r*num_cols + c) + 2] = pixmap.b[r*num_cols + c];
-		}
-	}
+	pixel_buffer<unsigned char> buffer(num_cols*num_rows * 3, uninitialized);
+	unsigned char* data = buffer.data();
+	stageImage(pixmap, grade, grading ? strength : 0.0f, smoothing ? smoothRange : 0.0f, data);
 
 	//Initialize the texture.  SDL_PIXELFORMAT_RGB24 specifies 3 bytes per
 	//pixel, one per color channel
@@ -318,6 +397,30 @@ int main(int argc, char** argv) {
 	float orig_x_angle;
 	float orig_y_angle;
 
+	//The bucket fill, used instead of the brush while on; filled marks what one fill covers and is cleared after it
+	bool bucket = false;
+	int tolerance = 32;
+	mask filled(num_cols, num_rows);
+	//The part of the texture out of date with the staged image, uploaded before the next frame is drawn
+	SDL_Rect dirty = { 0, 0, 0, 0 };
+
+	//The histogram panel; the histogram is only recounted after the staged image changes
+	bool showHistogram = false;
+	bool histogramDirty = true;
+	bool statisticsChanged = false;
+	histogram shown;
+	//The selection dragged with the right mouse button, and the tables its statistics come from,
+	//rebuilt when it is released after the staged image changed
+	bool selecting = false;
+	bool showSelection = false;
+	SDL_Rect selection;
+	int selectX = 0, selectY = 0;
+	summed_area_table tables[3];
+	bool tablesDirty = true;
+	const rgb_view<const unsigned char> staged(image_view<const unsigned char>(data + 0, num_cols, num_rows, 3 * num_cols, 3),
+		image_view<const unsigned char>(data + 1, num_cols, num_rows, 3 * num_cols, 3),
+		image_view<const unsigned char>(data + 2, num_cols, num_rows, 3 * num_cols, 3));
+
 	while (!quit) {
 		//Grab the time for frame rate computation
 		const Uint64 start = SDL_GetPerformanceCounter();
@@ -338,6 +441,71 @@ int main(int argc, char** argv) {
 				case SDLK_ESCAPE:
 					quit = true;
 					break;
+				//Toggle the grade, or change its strength, and regrade the whole image
+				case SDLK_l:
+				case SDLK_LEFTBRACKET:
+				case SDLK_RIGHTBRACKET:
+					if (grade.empty())
+						break;
+					if (event.key.keysym.sym == SDLK_l)
+						grading = !grading;
+					else
+						strength = std::min(std::max(strength + (event.key.keysym.sym == SDLK_LEFTBRACKET ? -0.1f : 0.1f), 0.0f), 1.0f);
+					stageImage(pixmap, grade, grading ? strength : 0.0f, smoothing ? smoothRange : 0.0f, data);
+					histogramDirty = true;
+					tablesDirty = true;
+					growRect(dirty, 0, 0, num_cols, num_rows);
+					std::cout << "Grade " << (grading ? "on" : "off") << ", strength " << std::lround(strength * 100.0f) << "%" << std::endl;
+					break;
+				//Toggle the smoothing preview, or change the luma differences it smooths over, and restage
+				case SDLK_s:
+				case SDLK_COMMA:
+				case SDLK_PERIOD:
+					if (event.key.keysym.sym == SDLK_s)
+						smoothing = !smoothing;
+					else if (smoothing)
+						smoothRange = std::min(std::max(smoothRange + (event.key.keysym.sym == SDLK_COMMA ? -10.0f : 10.0f), 10.0f), 100.0f);
+					else
+						break;
+					stageImage(pixmap, grade, grading ? strength : 0.0f, smoothing ? smoothRange : 0.0f, data);
+					histogramDirty = true;
+					tablesDirty = true;
+					growRect(dirty, 0, 0, num_cols, num_rows);
+					std::cout << "Smoothing " << (smoothing ? "on" : "off") << ", range " << smoothRange << std::endl;
+					break;
+				//Switch between the brush and the bucket fill, or change how much colors it fills over may differ
+				case SDLK_f:
+				case SDLK_MINUS:
+				case SDLK_EQUALS:
+					if (event.key.keysym.sym == SDLK_f)
+						bucket = !bucket;
+					else
+						tolerance = std::min(std::max(tolerance + (event.key.keysym.sym == SDLK_MINUS ? -8 : 8), 0), 255);
+					std::cout << (bucket ? "Bucket fill" : "Brush") << ", tolerance " << tolerance << std::endl;
+					break;
+				case SDLK_h:
+					showHistogram = !showHistogram;
+					statisticsChanged = true;
+					if (!showHistogram)
+						SDL_SetWindowTitle(window, "Basic SDL Test");
+					break;
+				//Stretch or equalize the image itself, or show or hide the strokes, then restage
+				case SDLK_a:
+				case SDLK_e:
+				case SDLK_v:
+					if (event.key.keysym.sym == SDLK_a)
+						auto_levels(rgb_view<const unsigned char>(canvas.layers[0].image.view()), canvas.layers[0].image.view());
+					else if (event.key.keysym.sym == SDLK_e)
+						equalize(rgb_view<const unsigned char>(canvas.layers[0].image.view()), canvas.layers[0].image.view());
+					else
+						canvas.layers[1].visible = !canvas.layers[1].visible;
+					canvas.touch_all();
+					canvas.flatten();
+					stageImage(pixmap, grade, grading ? strength : 0.0f, smoothing ? smoothRange : 0.0f, data);
+					histogramDirty = true;
+					tablesDirty = true;
+					growRect(dirty, 0, 0, num_cols, num_rows);
+					break;
 				default:
 					break;
 				}
@@ -345,30 +513,125 @@ int main(int argc, char** argv) {
 			else if (event.type == SDL_MOUSEBUTTONUP) {
 				if (event.button.button == SDL_BUTTON_LEFT)
 					leftMouseButtonDown = false;
-
+				//Report the statistics of the finished selection
+				else if (event.button.button == SDL_BUTTON_RIGHT && selecting) {
+					selecting = false;
+					if (tablesDirty) {
+						for (unsigned int c = 0; c < 3; ++c)
+							tables[c].build(staged[c]);
+						tablesDirty = false;
+					}
+					printSelection(std::cout, tables, selection);
+				}
 			}
 			else if (event.type == SDL_MOUSEBUTTONDOWN) {
-				if (event.button.button == SDL_BUTTON_LEFT) {
+				if (event.button.button == SDL_BUTTON_LEFT && bucket) {
+					//Fill the region of similar color under the mouse, as shown before grading, on the stroke layer,
+					//then restage only the fill's bounding box
+					const int mouseX = event.button.x, mouseY = event.button.y;
+					fill_bounds bounds;
+					if (mouseX >= 0 && mouseX < num_cols && mouseY >= 0 && mouseY < num_rows &&
+						flood_fill(rgb_view<const unsigned char>(pixmap.view()), mouseX, mouseY, tolerance, filled.view(), bounds) > 0) {
+						layer &strokes = canvas.layers[1];
+						for (unsigned int y = bounds.y; y < bounds.y + bounds.h; ++y) {
+							for (unsigned int x = bounds.x; x < bounds.x + bounds.w; ++x) {
+								if (!filled.view()(x, y))
+									continue;
+								strokes.image.view(0)(x, y) = 255;
+								strokes.image.view(1)(x, y) = 0;
+								strokes.image.view(2)(x, y) = 0;
+								strokes.alpha.view()(x, y) = 255;
+								filled.view()(x, y) = 0;
+							}
+						}
+						const SDL_Rect box = { (int)bounds.x, (int)bounds.y, (int)bounds.w, (int)bounds.h };
+						restageEdit(canvas, grade, grading ? strength : 0.0f, data, histogramDirty ? NULL : &shown, box, dirty);
+						if (!histogramDirty)
+							statisticsChanged = true;
+						tablesDirty = true;
+					}
+				}
+				else if (event.button.button == SDL_BUTTON_LEFT) {
 					leftMouseButtonDown = true;
 				}
+				//Start a selection at the pixel under the mouse
+				else if (event.button.button == SDL_BUTTON_RIGHT) {
+					selecting = true;
+					showSelection = true;
+					selectX = std::min(std::max(event.button.x, 0), num_cols - 1);
+					selectY = std::min(std::max(event.button.y, 0), num_rows - 1);
+					selection.x = selectX;
+					selection.y = selectY;
+					selection.w = 1;
+					selection.h = 1;
+				}
 			}
 			else if (event.type == SDL_MOUSEMOTION) {
+				//Stretch the selection from where it started to the pixel under the mouse
+				if (selecting) {
+					const int mouseX = std::min(std::max(event.motion.x, 0), num_cols - 1);
+					const int mouseY = std::min(std::max(event.motion.y, 0), num_rows - 1);
+					selection.x = std::min(selectX, mouseX);
+					selection.y = std::min(selectY, mouseY);
+					selection.w = std::abs(mouseX - selectX) + 1;
+					selection.h = std::abs(mouseY - selectY) + 1;
+				}
 				if (leftMouseButtonDown)
 				{
 					int mouseX = event.motion.x;
 					int mouseY = event.motion.y;
 
-					data[3 * (mouseY*num_cols + mouseX) + 0] = 255;
-					data[3 * (mouseY*num_cols + mouseX) + 1] = 0;
-					data[3 * (mouseY*num_cols + mouseX) + 2] = 0;
+					//Paint the stroke layer so the stroke survives regrading, then flatten the tile under the pixel
+					//and restage the pixel; the smoothing preview only catches up with the stroke when the image is
+					//next restaged
+					if (mouseX >= 0 && mouseX < num_cols && mouseY >= 0 && mouseY < num_rows) {
+						layer &strokes = canvas.layers[1];
+						strokes.image.view(0)(mouseX, mouseY) = 255;
+						strokes.image.view(1)(mouseX, mouseY) = 0;
+						strokes.image.view(2)(mouseX, mouseY) = 0;
+						strokes.alpha.view()(mouseX, mouseY) = 255;
+						const SDL_Rect dab = { mouseX, mouseY, 1, 1 };
+						restageEdit(canvas, grade, grading ? strength : 0.0f, data, histogramDirty ? NULL : &shown, dab, dirty);
+						if (!histogramDirty)
+							statisticsChanged = true;
+						tablesDirty = true;
+					}
 				}
 			}
 		}
 
-		//Update the texture, assuming data has changed.
-		SDL_UpdateTexture(background, NULL, data, 3 * num_cols);
+		//Upload only the part of the texture the staged image changed in
+		if (dirty.w > 0 && dirty.h > 0) {
+			SDL_UpdateTexture(background, &dirty, data + 3 * ((size_t)dirty.y * num_cols + dirty.x), 3 * num_cols);
+			dirty.w = 0;
+			dirty.h = 0;
+		}
 		//display the texture on the screen
 		renderTexture(background, renderer, 0, 0);
+		if (showSelection) {
+			SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+			SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
+			SDL_RenderDrawRect(renderer, &selection);
+		}
+		if (showHistogram) {
+			if (histogramDirty) {
+				shown = compute_histogram(staged);
+				histogramDirty = false;
+				statisticsChanged = true;
+			}
+			renderHistogram(renderer, shown, 10, std::max(num_rows - 110, 0), 100);
+			//Show each channel's range and mean in the title bar
+			if (statisticsChanged) {
+				std::ostringstream title;
+				title.setf(std::ios::fixed);
+				title.precision(1);
+				for (unsigned int c = 0; c < 3; ++c)
+					title << (c > 0 ? "  " : "") << "RGB"[c] << " " << (int)shown.lowest[c] << "-" << (int)shown.highest[c]
+						<< " mean " << shown.mean(c);
+				SDL_SetWindowTitle(window, title.str().c_str());
+				statisticsChanged = false;
+			}
+		}
 		//Update the screen
 		SDL_RenderPresent(renderer);
 
@@ -383,7 +646,7 @@ int main(int argc, char** argv) {
 
 	//After the loop finishes (when the window is closed, or escape is
 	//pressed, clean up the data that we allocated.
-	delete[] data;
+	buffer.release();
 	SDL_DestroyTexture(background);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
@@ -0,0 +1,184 @@
+///
+/// \file mask.cpp
+/// \brief Single channel masks read from and written to PBM and PGM files
+///
+
+#include "mask.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <utility>
+
+///This will create an empty mask
+mask::mask() : width(0), height(0) {}
+
+///This will create a mask of zeros
+///
+/// \param _width the width in pixels
+/// \param _height the height in pixels
+///
+mask::mask(unsigned int _width, unsigned int _height) :
+	width(_width), height(_height), samples((size_t)_width * _height) {}
+
+///This will create a mask from a .pbm or .pgm file
+///
+/// \param fileName the referenced file
+///
+mask::mask(const std::string &fileName) : mask() {
+	read(fileName);
+}
+
+///This will read the next number of a PNM header, skipping whitespace and
+///comments running from # to the end of the line
+///
+/// \param input the file
+/// \param value the number read
+/// \return true if a number was read
+///
+static bool read_header_number(std::istream &input, unsigned int &value) {
+	int ch = input.get();
+	while (ch == '#' || std::isspace(ch)) {
+		if (ch == '#') {
+			while (ch != '\n' && ch != EOF)
+				ch = input.get();
+		}
+		ch = input.get();
+	}
+	if (!std::isdigit(ch))
+		return false;
+	unsigned long v = 0;
+	while (std::isdigit(ch)) {
+		v = v * 10 + (unsigned long)(ch - '0');
+		if (v > 0xffffffffUL)
+			return false;
+		ch = input.get();
+	}
+	//exactly one whitespace character ends the number; after the last one the samples start
+	if (ch != EOF && !std::isspace(ch))
+		return false;
+	value = (unsigned int)v;
+	return true;
+}
+
+///This will read a binary PBM (P4) or PGM (P5) file
+///
+/// \param fileName the referenced file
+/// \return true on success; on failure the mask is left empty
+///
+bool mask::read(const std::string &fileName) {
+	width = 0;
+	height = 0;
+	samples.resize(0);
+	std::ifstream input(fileName.c_str(), std::ios::in | std::ios::binary);
+	if (!input.is_open()) {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+		return false;
+	}
+	char magic[2] = { 0, 0 };
+	input.read(magic, 2);
+	if (magic[0] != 'P' || (magic[1] != '4' && magic[1] != '5')) {
+		std::cout << "Error. " << fileName << " is not a binary PBM (P4) or PGM (P5) file." << std::endl;
+		return false;
+	}
+	const bool bitmap = magic[1] == '4';
+	unsigned int w = 0, h = 0, max_val = 1;
+	if (!read_header_number(input, w) || !read_header_number(input, h) ||
+		(!bitmap && !read_header_number(input, max_val))) {
+		std::cout << "Error. " << fileName << " has a bad header." << std::endl;
+		return false;
+	}
+	if (w == 0 || h == 0 || max_val == 0 || max_val > 65535) {
+		std::cout << "Error. " << fileName << " has an unsupported size or maximum value." << std::endl;
+		return false;
+	}
+
+	pixel_buffer<unsigned char> out((size_t)w * h, uninitialized);
+	//PBM rows are padded to whole bytes; PGM samples above 255 take two bytes, most significant first
+	const unsigned int bytes = max_val > 255 ? 2 : 1;
+	const size_t row_bytes = bitmap ? (w + 7) / 8 : (size_t)w * bytes;
+	pixel_buffer<unsigned char> raw(row_bytes, uninitialized);
+	for (unsigned int y = 0; y < h; ++y) {
+		input.read((char *)raw.data(), (std::streamsize)row_bytes);
+		unsigned char *row = out.data() + (size_t)y * w;
+		if (bitmap) {
+			for (unsigned int x = 0; x < w; ++x)
+				row[x] = (raw[x >> 3] >> (7 - (x & 7))) & 1 ? 255 : 0;
+		}
+		else if (bytes == 1 && max_val == 255) {
+			for (unsigned int x = 0; x < w; ++x)
+				row[x] = raw[x];
+		}
+		else {
+			for (unsigned int x = 0; x < w; ++x) {
+				const unsigned int v = bytes == 2 ? (raw[2 * x] << 8) | raw[2 * x + 1] : raw[x];
+				row[x] = (unsigned char)((std::min(v, max_val) * 255 + max_val / 2) / max_val);
+			}
+		}
+	}
+	if (!input) {
+		std::cout << "Error. " << fileName << " is truncated." << std::endl;
+		return false;
+	}
+	width = w;
+	height = h;
+	samples = std::move(out);
+	return true;
+}
+
+///This will write the mask as a binary PBM (P4) file, samples of 128 and up
+///set, or as a binary PGM (P5) file
+///
+/// \param fileName the referenced file
+/// \param bitmap true for PBM, false for PGM
+/// \return true on success
+///
+bool mask::write(const std::string &fileName, bool bitmap) const {
+	std::ofstream output(fileName.c_str(), std::ios::out | std::ios::binary);
+	if (!output.is_open()) {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+		return false;
+	}
+	output << (bitmap ? "P4\n" : "P5\n") << width << " " << height << "\n";
+	if (!bitmap)
+		output << "255\n";
+	const size_t row_bytes = bitmap ? (width + 7) / 8 : width;
+	pixel_buffer<unsigned char> raw(row_bytes);
+	for (unsigned int y = 0; y < height; ++y) {
+		const unsigned char *row = samples.data() + (size_t)y * width;
+		if (bitmap) {
+			raw.zero();
+			for (unsigned int x = 0; x < width; ++x)
+				raw[x >> 3] |= (unsigned char)((row[x] >= 128 ? 1 : 0) << (7 - (x & 7)));
+			output.write((const char *)raw.data(), (std::streamsize)row_bytes);
+		}
+		else
+			output.write((const char *)row, (std::streamsize)row_bytes);
+	}
+	if (!output) {
+		std::cout << "Error. Unable to write " << fileName << std::endl;
+		return false;
+	}
+	return true;
+}
+
+///This will threshold a plane into a mask, e.g. one channel of an image
+///
+/// \param src the plane
+/// \param level the smallest sample set in the mask
+/// \return the mask
+///
+mask threshold(const image_view<const unsigned char> &src, unsigned char level) {
+	mask out(src.width, src.height);
+	parallel_for(0, src.height, 64, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *in = src.row(y);
+			unsigned char *row = out.samples.data() + (size_t)y * src.width;
+			for (unsigned int x = 0; x < src.width; ++x)
+				row[x] = in[(size_t)x * src.step] >= level ? 255 : 0;
+		}
+	});
+	return out;
+}
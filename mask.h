@@ -0,0 +1,46 @@
+///
+/// \file mask.h
+/// \brief Single channel masks read from and written to PBM and PGM files
+///
+/// A mask is one 8-bit plane.  Binary PBM (P4) files store one bit per
+/// pixel with 1 for black; those pixels become 255 and the others 0, so
+/// what is drawn in the file is the foreground.  Binary PGM (P5) files
+/// store gray levels, which are scaled to 0 to 255.
+///
+
+#ifndef MASK_H
+#define MASK_H
+
+#include <string>
+
+#include "image_view.h"
+#include "pixel_buffer.h"
+
+struct mask {
+	unsigned int width;
+	unsigned int height;
+	//width * height samples, row after row
+	pixel_buffer<unsigned char> samples;
+
+	//an empty mask
+	mask();
+	//a mask of zeros
+	mask(unsigned int _width, unsigned int _height);
+	//a mask loaded from a .pbm or .pgm file; empty if the file could not be read
+	explicit mask(const std::string &fileName);
+
+	bool read(const std::string &fileName);
+	//write as a PBM, samples of 128 and up set, or as a PGM
+	bool write(const std::string &fileName, bool bitmap) const;
+	bool empty() const { return width == 0 || height == 0; }
+
+	image_view<unsigned char> view() { return image_view<unsigned char>(samples.data(), width, height, width); }
+	image_view<const unsigned char> view() const {
+		return image_view<const unsigned char>(samples.data(), width, height, width);
+	}
+};
+
+//a mask of 255 where a plane is at least level and 0 elsewhere, the size of the plane
+mask threshold(const image_view<const unsigned char> &src, unsigned char level);
+
+#endif
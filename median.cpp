@@ -0,0 +1,234 @@
+///
+/// \file median.cpp
+/// \brief Constant-time median filter on 8-bit image planes
+///
+
+#include "median.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//coarse bins of a histogram, one per value of the high 4 bits
+static const unsigned int COARSE = 16;
+//counts of one column histogram: the coarse bins, then 16 fine bins per coarse bin
+static const unsigned int HISTOGRAM_SIZE = COARSE + 256;
+//columns per strip, each strip keeping strip + 2r column histograms
+static const unsigned int MEDIAN_STRIP = 256;
+//largest radius whose (2r + 1)^2 window counts fit 16 bits
+static const unsigned int MEDIAN_MAX_RADIUS_16 = 127;
+
+///This will add one group of 16 counts to another
+///
+/// \param acc the counts to add to
+/// \param in the counts to add
+///
+static inline void add_counts(uint16_t *acc, const uint16_t *in) {
+#if defined(__AVX2__)
+	const __m256i a = _mm256_loadu_si256((const __m256i *)acc);
+	_mm256_storeu_si256((__m256i *)acc, _mm256_add_epi16(a, _mm256_loadu_si256((const __m256i *)in)));
+#else
+	for (unsigned int i = 0; i < 16; ++i)
+		acc[i] = (uint16_t)(acc[i] + in[i]);
+#endif
+}
+static inline void add_counts(uint32_t *acc, const uint32_t *in) {
+#if defined(__AVX2__)
+	for (unsigned int i = 0; i < 16; i += 8) {
+		const __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+		_mm256_storeu_si256((__m256i *)(acc + i), _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i *)(in + i))));
+	}
+#else
+	for (unsigned int i = 0; i < 16; ++i)
+		acc[i] += in[i];
+#endif
+}
+
+///This will add one group of 16 counts to another and subtract a third,
+///moving a window by one column
+///
+/// \param acc the counts to update
+/// \param in the counts of the column entering the window
+/// \param out the counts of the column leaving it
+///
+static inline void slide_counts(uint16_t *acc, const uint16_t *in, const uint16_t *out) {
+#if defined(__AVX2__)
+	const __m256i a = _mm256_add_epi16(_mm256_loadu_si256((const __m256i *)acc), _mm256_loadu_si256((const __m256i *)in));
+	_mm256_storeu_si256((__m256i *)acc, _mm256_sub_epi16(a, _mm256_loadu_si256((const __m256i *)out)));
+#else
+	for (unsigned int i = 0; i < 16; ++i)
+		acc[i] = (uint16_t)(acc[i] + in[i] - out[i]);
+#endif
+}
+static inline void slide_counts(uint32_t *acc, const uint32_t *in, const uint32_t *out) {
+#if defined(__AVX2__)
+	for (unsigned int i = 0; i < 16; i += 8) {
+		const __m256i a = _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(acc + i)),
+			_mm256_loadu_si256((const __m256i *)(in + i)));
+		_mm256_storeu_si256((__m256i *)(acc + i), _mm256_sub_epi32(a, _mm256_loadu_si256((const __m256i *)(out + i))));
+	}
+#else
+	for (unsigned int i = 0; i < 16; ++i)
+		acc[i] = acc[i] + in[i] - out[i];
+#endif
+}
+
+///This will count one sample into or out of a column histogram
+///
+/// \param h the column histogram
+/// \param v the sample
+/// \param delta 1 to count it in, -1 to count it out
+///
+template <typename C>
+static inline void count_sample(C *h, unsigned char v, int delta) {
+	h[v >> 4] = (C)(h[v >> 4] + delta);
+	h[COARSE + v] = (C)(h[COARSE + v] + delta);
+}
+
+///This will median filter the columns x0 to x1 of a plane.  Column
+///histogram j counts source column x0 - r + j, clamped to the plane.
+///
+/// \param src the plane
+/// \param dst the filtered plane, not src
+/// \param r the radius
+/// \param x0 the first column of the strip
+/// \param x1 one past the last column of the strip
+/// \param hist room for (x1 - x0 + 2r) column histograms
+///
+template <typename C>
+static void median_strip(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int r, unsigned int x0, unsigned int x1, pixel_buffer<C> &hist) {
+	const int width = (int)src.width;
+	const int height = (int)src.height;
+	const unsigned int window = 2 * r + 1;
+	const unsigned int n = x1 - x0;
+	const unsigned int columns = n + 2 * r;
+	//the source offset of each histogram's column, repeating the edge columns
+	std::vector<size_t> offset(columns);
+	for (unsigned int j = 0; j < columns; ++j) {
+		const int x = (int)x0 - (int)r + (int)j;
+		offset[j] = (size_t)std::min(std::max(x, 0), width - 1) * src.step;
+	}
+	hist.zero();
+	C *h = hist.data();
+	for (int y = -(int)r; y <= (int)r; ++y) {
+		const unsigned char *in = src.row((unsigned int)std::min(std::max(y, 0), height - 1));
+		for (unsigned int j = 0; j < columns; ++j)
+			count_sample(h + (size_t)j * HISTOGRAM_SIZE, in[offset[j]], 1);
+	}
+
+	//the median is the sample with rank more samples below it
+	const uint32_t rank = window * window / 2;
+	const size_t dst_step = dst.step;
+	C coarse[COARSE];
+	C fine[256];
+	//the column each coarse bin's fine counts are up to date for
+	int synced[COARSE];
+	for (int y = 0; y < height; ++y) {
+		//move the column histograms down a row: row y - r - 1 leaves, row y + r enters
+		if (y > 0) {
+			const unsigned char *out = src.row((unsigned int)std::max(y - (int)r - 1, 0));
+			const unsigned char *in = src.row((unsigned int)std::min(y + (int)r, height - 1));
+			if (out != in) {
+				for (unsigned int j = 0; j < columns; ++j) {
+					const unsigned char a = out[offset[j]], b = in[offset[j]];
+					if (a != b) {
+						C *col = h + (size_t)j * HISTOGRAM_SIZE;
+						count_sample(col, a, -1);
+						count_sample(col, b, 1);
+					}
+				}
+			}
+		}
+
+		std::fill(coarse, coarse + COARSE, (C)0);
+		for (unsigned int j = 0; j < window; ++j)
+			add_counts(coarse, h + (size_t)j * HISTOGRAM_SIZE);
+		std::fill(synced, synced + COARSE, -(int)window - 1);
+
+		unsigned char *out = dst.row((unsigned int)y) + (size_t)x0 * dst_step;
+		for (unsigned int i = 0; i < n; ++i) {
+			if (i > 0)
+				slide_counts(coarse, h + (size_t)(i + 2 * r) * HISTOGRAM_SIZE, h + (size_t)(i - 1) * HISTOGRAM_SIZE);
+			uint32_t below = 0;
+			unsigned int b = 0;
+			while (below + coarse[b] <= rank)
+				below += coarse[b++];
+
+			//bring the fine counts of that coarse bin to this column, by sliding
+			//them along if they are recent, otherwise by summing the window afresh
+			C *f = fine + b * 16;
+			const unsigned int bin = COARSE + b * 16;
+			if ((int)i - synced[b] <= (int)r) {
+				for (int k = synced[b] + 1; k <= (int)i; ++k)
+					slide_counts(f, h + (size_t)(k + 2 * r) * HISTOGRAM_SIZE + bin, h + (size_t)(k - 1) * HISTOGRAM_SIZE + bin);
+			}
+			else {
+				std::fill(f, f + 16, (C)0);
+				for (unsigned int j = i; j < i + window; ++j)
+					add_counts(f, h + (size_t)j * HISTOGRAM_SIZE + bin);
+			}
+			synced[b] = (int)i;
+
+			unsigned int v = 0;
+			while (below + f[v] <= rank)
+				below += f[v++];
+			out[(size_t)i * dst_step] = (unsigned char)(b * 16 + v);
+		}
+	}
+}
+
+///This will median filter a plane strip by strip on the thread pool
+///
+/// \param src the plane
+/// \param dst the filtered plane, not src
+/// \param r the radius, at least 1
+///
+template <typename C>
+static void median_strips(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int r) {
+	//strips at least as wide as the window, so the per-row setup stays a fraction of the work
+	const unsigned int strip = std::max(MEDIAN_STRIP, 2 * r + 1);
+	const unsigned int strips = (src.width + strip - 1) / strip;
+	parallel_for(0, strips, 1, [&](unsigned int s0, unsigned int s1) {
+		pixel_buffer<C> hist((size_t)(strip + 2 * r) * HISTOGRAM_SIZE, uninitialized);
+		for (unsigned int s = s0; s < s1; ++s)
+			median_strip(src, dst, r, s * strip, std::min((s + 1) * strip, src.width), hist);
+	});
+}
+
+///This will replace every sample of a plane by the median of the
+///(2 radius + 1) x (2 radius + 1) square around it, in time independent of
+///the radius.  Samples past the edges repeat the edge samples.
+///
+/// \param src the plane to filter
+/// \param dst the filtered plane, same size as src; may be src
+/// \param radius the radius of the window in pixels
+///
+void median_filter(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int radius) {
+	if (src.width == 0 || src.height == 0)
+		return;
+	if (radius == 0) {
+		copy(src, dst);
+		return;
+	}
+	//strips read the columns their neighbours write, so filter from a copy in place
+	if (src.data == dst.data) {
+		pixel_buffer<unsigned char> samples((size_t)src.width * src.height, uninitialized);
+		const image_view<unsigned char> tmp(samples.data(), src.width, src.height, src.width);
+		copy(src, tmp);
+		median_filter(image_view<const unsigned char>(tmp.data, tmp.width, tmp.height, tmp.stride), dst, radius);
+		return;
+	}
+	if (radius <= MEDIAN_MAX_RADIUS_16)
+		median_strips<uint16_t>(src, dst, radius);
+	else
+		median_strips<uint32_t>(src, dst, radius);
+}
@@ -0,0 +1,41 @@
+///
+/// \file median.h
+/// \brief Constant-time median filter on 8-bit image planes
+///
+/// The filter keeps one histogram per image column covering the 2r + 1
+/// rows around the current row (Perreault and Hébert).  Moving down a row
+/// updates each column histogram with one sample out and one in; moving
+/// right along a row adds the histogram of the column entering the window
+/// and subtracts the one leaving it.  Neither depends on the radius.
+///
+/// Each histogram has 16 coarse bins (the high 4 bits) over 256 fine bins.
+/// The window's coarse bins are updated at every pixel, sixteen counts in
+/// one vector operation with AVX2.  The fine bins of a coarse bin are only
+/// brought up to date when the median falls into it, which in most images
+/// is the same one or two bins along a row.  The image is split into
+/// vertical strips, each with its own column histograms, which run on the
+/// thread pool.
+///
+
+#ifndef MEDIAN_H
+#define MEDIAN_H
+
+#include "image_view.h"
+
+//the median over a (2 radius + 1) square, the edge rows and columns repeated; src and dst may be the same view
+void median_filter(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int radius);
+
+///This will median filter all three channels of an image
+///
+/// \param src the image to filter
+/// \param dst the filtered image, same size as src
+/// \param radius the radius of the square window in pixels
+///
+inline void median_filter(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	unsigned int radius) {
+	for (unsigned int c = 0; c < 3; ++c)
+		median_filter(src[c], dst[c], radius);
+}
+
+#endif
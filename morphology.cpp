@@ -0,0 +1,202 @@
+///
+/// \file morphology.cpp
+/// \brief Erosion, dilation, opening and closing with rectangular elements
+///
+
+#include "morphology.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+#include "tiled.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//columns per strip of the vertical pass; the backward minima of a strip stay in cache
+static const unsigned int MORPH_STRIP = 64;
+//block size of the transposes around the horizontal pass
+static const unsigned int MORPH_TILE = 32;
+
+///The minimum of two samples, for erosion
+struct min_op {
+	static const unsigned char identity = 255;
+	static inline unsigned char apply(unsigned char a, unsigned char b) { return std::min(a, b); }
+#if defined(__AVX2__)
+	static inline __m256i apply(__m256i a, __m256i b) { return _mm256_min_epu8(a, b); }
+#endif
+};
+
+///The maximum of two samples, for dilation
+struct max_op {
+	static const unsigned char identity = 0;
+	static inline unsigned char apply(unsigned char a, unsigned char b) { return std::max(a, b); }
+#if defined(__AVX2__)
+	static inline __m256i apply(__m256i a, __m256i b) { return _mm256_max_epu8(a, b); }
+#endif
+};
+
+///This will combine two row segments sample by sample
+///
+/// \param a the first segment
+/// \param b the second segment
+/// \param out the result; may be a or b
+/// \param n the number of samples
+///
+template <typename Op>
+static inline void combine(const unsigned char *a, const unsigned char *b, unsigned char *out, unsigned int n) {
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	for (; x + 32 <= n; x += 32) {
+		const __m256i va = _mm256_loadu_si256((const __m256i *)(a + x));
+		const __m256i vb = _mm256_loadu_si256((const __m256i *)(b + x));
+		_mm256_storeu_si256((__m256i *)(out + x), Op::apply(va, vb));
+	}
+#endif
+	for (; x < n; ++x)
+		out[x] = Op::apply(a[x], b[x]);
+}
+
+///This will return a row segment of a plane padded with r identity rows
+///at the top and at the bottom
+///
+/// \param src the plane
+/// \param p the padded row
+/// \param r the padding
+/// \param x0 the first column of the segment
+/// \param identity a segment of identity samples
+/// \return the segment
+///
+static inline const unsigned char *padded_row(const image_view<const unsigned char> &src, unsigned int p,
+	unsigned int r, unsigned int x0, const unsigned char *identity) {
+	return p < r || p >= src.height + r ? identity : src.row(p - r) + x0;
+}
+
+///This will run the van Herk/Gil-Werman recurrences down the columns x0 to
+///x1 of a dense plane.  The column is padded with r identity rows at both
+///ends and split into blocks of 2r + 1 rows; the window of output row y is
+///padded rows y to y + 2r, which ends the block it starts in or reaches
+///into the next one.  Output row y is written once input row y + r has
+///been read and rows below it are never read again, so dst may be src.
+///
+/// \param src the plane
+/// \param dst the result
+/// \param r the radius
+/// \param x0 the first column
+/// \param x1 one past the last column, at most MORPH_STRIP past x0
+/// \param suffix room for height + 2r rows of MORPH_STRIP samples
+///
+template <typename Op>
+static void vertical_strip(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int r, unsigned int x0, unsigned int x1, unsigned char *suffix) {
+	const unsigned int n = x1 - x0;
+	const unsigned int height = src.height;
+	const unsigned int block = 2 * r + 1;
+	const unsigned int rows = height + 2 * r;
+	unsigned char identity[MORPH_STRIP];
+	std::memset(identity, Op::identity, sizeof(identity));
+
+	//from each row to the end of its block, backwards
+	for (unsigned int p = rows; p-- > 0;) {
+		unsigned char *s = suffix + (size_t)p * MORPH_STRIP;
+		if (p + 1 == rows || (p + 1) % block == 0)
+			std::memcpy(s, padded_row(src, p, r, x0, identity), n);
+		else
+			combine<Op>(padded_row(src, p, r, x0, identity), s + MORPH_STRIP, s, n);
+	}
+	//from the start of each block to each row, forwards, finishing the window ending there
+	unsigned char prefix[MORPH_STRIP];
+	for (unsigned int p = 0; p < rows; ++p) {
+		if (p % block == 0)
+			std::memcpy(prefix, padded_row(src, p, r, x0, identity), n);
+		else
+			combine<Op>(prefix, padded_row(src, p, r, x0, identity), prefix, n);
+		if (p >= 2 * r)
+			combine<Op>(suffix + (size_t)(p - 2 * r) * MORPH_STRIP, prefix, dst.row(p - 2 * r) + x0, n);
+	}
+}
+
+///This will combine each sample with the 2r samples around it vertically,
+///strip by strip on the thread pool
+///
+/// \param src the plane, dense
+/// \param dst the result, dense; may be src
+/// \param r the radius
+///
+template <typename Op>
+static void vertical_pass(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int r) {
+	const unsigned int strips = (src.width + MORPH_STRIP - 1) / MORPH_STRIP;
+	parallel_for(0, strips, 1, [&](unsigned int s0, unsigned int s1) {
+		pixel_buffer<unsigned char> suffix((size_t)(src.height + 2 * r) * MORPH_STRIP, uninitialized);
+		for (unsigned int s = s0; s < s1; ++s)
+			vertical_strip<Op>(src, dst, r, s * MORPH_STRIP, std::min((s + 1) * MORPH_STRIP, src.width), suffix.data());
+	});
+}
+
+///This will combine each sample with the samples of the rectangle around
+///it: a vertical pass, then a horizontal pass run vertically on the
+///transposed plane
+///
+/// \param src the plane
+/// \param dst the result; may be src
+/// \param rx the horizontal radius
+/// \param ry the vertical radius
+///
+template <typename Op>
+static void rectangle_pass(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int rx, unsigned int ry) {
+	const unsigned int width = src.width, height = src.height;
+	pixel_buffer<unsigned char> rows((size_t)width * height, uninitialized);
+	const image_view<unsigned char> a(rows.data(), width, height, width);
+	if (ry > 0 && src.dense())
+		vertical_pass<Op>(src, a, ry);
+	else {
+		copy(src, a);
+		if (ry > 0)
+			vertical_pass<Op>(a, a, ry);
+	}
+	if (rx == 0) {
+		copy(a, dst);
+		return;
+	}
+	pixel_buffer<unsigned char> columns((size_t)width * height, uninitialized);
+	const image_view<unsigned char> b(columns.data(), height, width, height);
+	transpose_blocked<unsigned char, MORPH_TILE>(a, b);
+	vertical_pass<Op>(b, b, rx);
+	transpose_blocked<unsigned char, MORPH_TILE>(b, dst);
+}
+
+///This will erode, dilate, open or close a plane with a rectangle, at a
+///cost per sample that does not depend on the size of the rectangle.
+///Samples past the edges are ignored.
+///
+/// \param src the plane
+/// \param dst the result, same size as src; may be src
+/// \param op the operation
+/// \param rx the horizontal radius of the rectangle in pixels
+/// \param ry the vertical radius of the rectangle in pixels
+///
+void morphology(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	morphology_op op, unsigned int rx, unsigned int ry) {
+	if (src.width == 0 || src.height == 0)
+		return;
+	switch (op) {
+	case morph_erode:
+		rectangle_pass<min_op>(src, dst, rx, ry);
+		break;
+	case morph_dilate:
+		rectangle_pass<max_op>(src, dst, rx, ry);
+		break;
+	case morph_open:
+		rectangle_pass<min_op>(src, dst, rx, ry);
+		rectangle_pass<max_op>(dst, dst, rx, ry);
+		break;
+	case morph_close:
+		rectangle_pass<max_op>(src, dst, rx, ry);
+		rectangle_pass<min_op>(dst, dst, rx, ry);
+		break;
+	}
+}
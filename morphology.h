@@ -0,0 +1,55 @@
+///
+/// \file morphology.h
+/// \brief Erosion, dilation, opening and closing with rectangular elements
+///
+/// A rectangle is a horizontal line followed by a vertical line, and each
+/// line pass uses the van Herk/Gil-Werman algorithm: the samples are split
+/// into blocks as long as the line, a running minimum (or maximum) is
+/// taken forwards and backwards inside every block, and the result at each
+/// position combines one backward and one forward value.  That is three
+/// min/max operations per sample whatever the length of the line.
+///
+/// The recurrences run down columns, so a whole row segment is one AVX2
+/// min/max.  The horizontal pass transposes the plane, runs the vertical
+/// pass and transposes back.  Column strips run on the thread pool.
+///
+/// Masks read from PBM (P4) and PGM (P5) files are planes like any other;
+/// see mask.h.
+///
+
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include "image_view.h"
+
+//the operation of a morphology pass
+enum morphology_op {
+	//the smallest sample under the element
+	morph_erode,
+	//the largest sample under the element
+	morph_dilate,
+	//erosion, then dilation: removes bright details smaller than the element
+	morph_open,
+	//dilation, then erosion: fills dark details smaller than the element
+	morph_close
+};
+
+//apply op with a (2 rx + 1) x (2 ry + 1) rectangle, ignoring samples past the edges; src and dst may be the same view
+void morphology(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	morphology_op op, unsigned int rx, unsigned int ry);
+
+///This will apply a morphology operation to all three channels of an image
+///
+/// \param src the image
+/// \param dst the result, same size as src
+/// \param op the operation
+/// \param rx the horizontal radius of the rectangle in pixels
+/// \param ry the vertical radius of the rectangle in pixels
+///
+inline void morphology(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	morphology_op op, unsigned int rx, unsigned int ry) {
+	for (unsigned int c = 0; c < 3; ++c)
+		morphology(src[c], dst[c], op, rx, ry);
+}
+
+#endif
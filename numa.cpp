@@ -0,0 +1,185 @@
+///
+/// \file numa.cpp
+/// \brief Page placement helpers for large rasters
+///
+
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+///This will parse a kernel cpu/node list such as "0-3,8" and return the
+///highest entry plus one
+///
+/// \param list the list
+/// \return one more than the highest entry, 0 for an empty list
+///
+static unsigned int list_extent(const std::string &list) {
+	unsigned int extent = 0;
+	unsigned int value = 0;
+	bool digits = false;
+	for (size_t i = 0; i <= list.size(); ++i) {
+		if (i < list.size() && list[i] >= '0' && list[i] <= '9') {
+			value = 10 * value + (list[i] - '0');
+			digits = true;
+		}
+		else {
+			if (digits && value + 1 > extent)
+				extent = value + 1;
+			value = 0;
+			digits = false;
+		}
+	}
+	return extent;
+}
+
+///This will return the number of NUMA nodes that have memory
+///
+/// \return the node count, 1 when it cannot be determined
+///
+unsigned int numa_node_count() {
+	static unsigned int nodes = 0;
+	if (nodes == 0) {
+		std::ifstream input("/sys/devices/system/node/has_memory");
+		std::string line;
+		std::getline(input, line);
+		nodes = list_extent(line);
+		if (nodes == 0)
+			nodes = 1;
+	}
+	return nodes;
+}
+
+///This will return the number of hardware threads
+///
+/// \return the thread count, at least 1
+///
+unsigned int cpu_count() {
+	unsigned int n = std::thread::hardware_concurrency();
+	return n > 0 ? n : 1;
+}
+
+///This will map a block that starts within the first cache lines of a huge
+///page (so it is still PIXEL_ALIGNMENT aligned).  The pages are not
+///touched, so where they end up is decided by placement or by whichever
+///thread writes them first.
+///
+/// \param bytes the size of the block
+/// \param huge_pages true to ask for transparent huge pages
+/// \param placement how the pages are spread over NUMA nodes
+/// \return the block, NULL on failure
+///
+void *map_large_block(size_t bytes, bool huge_pages, numa_placement placement) {
+#if defined(__linux__)
+	//successive blocks start at different offsets into their first huge
+	//page; otherwise every plane would share the same low address bits and
+	//a kernel reading one plane while writing another suffers 4K aliasing
+	//and cache set conflicts
+	static unsigned int next_color = 0;
+	const size_t color = (size_t)(__sync_fetch_and_add(&next_color, 1) % 16) * (17 * 64);
+	//over-map by one huge page and trim so the block starts on a boundary
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	const size_t length = (color + bytes + page - 1) & ~(page - 1);
+	const size_t mapped = length + HUGE_PAGE_SIZE;
+	void *raw = mmap(0, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (raw == MAP_FAILED)
+		return 0;
+	char *start = (char *)raw;
+	char *block = (char *)(((size_t)start + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+	if (block > start)
+		munmap(start, block - start);
+	if (start + mapped > block + length)
+		munmap(block + length, start + mapped - (block + length));
+#if defined(MADV_HUGEPAGE)
+	if (huge_pages)
+		madvise(block, length, MADV_HUGEPAGE);
+#endif
+#if defined(SYS_mbind)
+	if (placement == placement_interleave && numa_node_count() > 1) {
+		//MPOL_INTERLEAVE over every node with memory
+		const int MPOL_INTERLEAVE_POLICY = 3;
+		const unsigned int nodes = numa_node_count();
+		std::vector<unsigned long> mask(nodes / (8 * sizeof(unsigned long)) + 1, 0);
+		for (unsigned int n = 0; n < nodes; ++n)
+			mask[n / (8 * sizeof(unsigned long))] |= 1ul << (n % (8 * sizeof(unsigned long)));
+		syscall(SYS_mbind, block, length, MPOL_INTERLEAVE_POLICY, mask.data(),
+			(unsigned long)(mask.size() * 8 * sizeof(unsigned long) + 1), 0u);
+	}
+#endif
+	(void)placement;
+	return block + color;
+#else
+	(void)bytes;
+	(void)huge_pages;
+	(void)placement;
+	return 0;
+#endif
+}
+
+///This will unmap a block returned by map_large_block
+///
+/// \param block the block
+/// \param bytes the size that was passed to map_large_block
+///
+void unmap_large_block(void *block, size_t bytes) {
+#if defined(__linux__)
+	//the mapping starts at the huge page boundary below the colored block
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	char *start = (char *)((size_t)block & ~(HUGE_PAGE_SIZE - 1));
+	munmap(start, ((char *)block - start + bytes + page - 1) & ~(page - 1));
+#else
+	(void)block;
+	(void)bytes;
+#endif
+}
+
+///This will pin the calling thread to the CPU that owns a band.  Bands are
+///spread evenly over the CPUs, so band i of n always lands on the same CPU
+///and pages it touched first stay local to it.
+///
+/// \param band the band
+/// \param bands the number of bands
+///
+void pin_thread_for_band(unsigned int band, unsigned int bands) {
+#if defined(__linux__)
+	const unsigned int cpus = cpu_count();
+	const unsigned int cpu = (unsigned int)((unsigned long long)band * cpus / (bands > 0 ? bands : 1));
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % cpus, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+	(void)band;
+	(void)bands;
+#endif
+}
+
+///This will zero fill a block in as many equal bands as parallel_for
+///splits the rows of a large image into.  parallel_for deals band i of
+///every call to the same worker queue, and the workers are pinned while
+///first touch placement is on, so unless a band is stolen its pages end up
+///on the node of the worker that later processes the same rows.
+///
+/// \param block the block
+/// \param bytes the size of the block
+///
+void first_touch(void *block, size_t bytes) {
+	const unsigned int bands = thread_pool::global().max_bands();
+	parallel_for(0, bands, 1, [=](unsigned int b0, unsigned int b1) {
+		const size_t begin = (size_t)((unsigned long long)bytes * b0 / bands);
+		const size_t end = (size_t)((unsigned long long)bytes * b1 / bands);
+		std::memset((char *)block + begin, 0, end - begin);
+	});
+}
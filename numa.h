@@ -0,0 +1,46 @@
+///
+/// \file numa.h
+/// \brief Page placement helpers for large rasters
+///
+/// On machines with several sockets, memory is placed on the node of the
+/// thread that first writes a page.  These helpers let the buffer pool
+/// back large blocks with transparent huge pages, spread them over all
+/// nodes, or have each row band first touched by the thread pool worker
+/// that will later process that band.  Everything here is a no-op outside Linux.
+///
+
+#ifndef NUMA_H
+#define NUMA_H
+
+#include <cstddef>
+
+//size of a transparent huge page; blocks at least this large are mapped directly
+const size_t HUGE_PAGE_SIZE = (size_t)2 << 20;
+
+//how the pages of large blocks are placed on NUMA nodes
+enum numa_placement {
+	//leave placement to the kernel (first touch by whoever writes first)
+	placement_default,
+	//spread pages round robin over all nodes
+	placement_interleave,
+	//zero fill each row band from the thread that owns the band
+	placement_first_touch
+};
+
+//number of NUMA nodes that have memory (1 when unknown)
+unsigned int numa_node_count();
+//number of hardware threads
+unsigned int cpu_count();
+
+//map a block of bytes starting near a HUGE_PAGE_SIZE boundary, NULL on failure
+void *map_large_block(size_t bytes, bool huge_pages, numa_placement placement);
+//unmap a block returned by map_large_block
+void unmap_large_block(void *block, size_t bytes);
+
+//pin the calling thread to the CPU that owns band out of bands
+void pin_thread_for_band(unsigned int band, unsigned int bands);
+//zero fill a block in the bands parallel_for splits a large image into, each band written by the pool thread
+//that takes the same band of a kernel
+void first_touch(void *block, size_t bytes);
+
+#endif
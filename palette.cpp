@@ -0,0 +1,503 @@
+///
+/// \file palette.cpp
+/// \brief Palette generation, nearest color search and dithering to indexed images
+///
+
+#include "palette.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+//cells of the color histogram and of the lookup grid, 32 along each axis
+static const unsigned int PALETTE_CELLS = 32 * 32 * 32;
+//pixels a Floyd-Steinberg row finishes between reports to the row below
+static const unsigned int DIFFUSION_CHUNK = 64;
+
+//the pixels of the image falling in one histogram cell
+struct color_cell {
+	uint64_t count;
+	uint64_t sum[3];
+};
+
+//an occupied cell: its coordinates on the grid, its pixel count and their mean color
+struct cell_color {
+	unsigned char coord[3];
+	uint64_t count;
+	float mean[3];
+};
+
+//a median cut box: a range of the occupied cells and their bounds on the grid
+struct color_box {
+	unsigned int begin;
+	unsigned int end;
+	uint64_t count;
+	unsigned char lo[3];
+	unsigned char hi[3];
+};
+
+///This will rebuild the grid listing, for each cell, the entries that can
+///be nearest to some color inside it.  Every color of the cell lies within
+///the bound, the smallest over the entries of their distance to the far
+///corner of the cell, of some entry, so an entry whose distance to the
+///near side of the cell is above the bound is never nearest.  The squared
+///distances add up over the axes, so each axis is tabulated once per cell
+///coordinate.
+void palette::build_lookup() {
+	const unsigned int n = size();
+	cell_start.assign(PALETTE_CELLS + 1, 0);
+	candidates.clear();
+	if (n == 0)
+		return;
+
+	//nearest[a][k * n + i] and farthest[a][k * n + i]: the squared distances along axis a from entry i to cell k
+	std::vector<unsigned int> nearest_axis[3], farthest_axis[3];
+	for (unsigned int a = 0; a < 3; ++a) {
+		nearest_axis[a].resize(32 * n);
+		farthest_axis[a].resize(32 * n);
+		for (unsigned int k = 0; k < 32; ++k) {
+			const int lo = (int)k * 8, hi = lo + 7;
+			for (unsigned int i = 0; i < n; ++i) {
+				const int v = colors[3 * i + a];
+				const int inside = v < lo ? lo - v : v > hi ? v - hi : 0;
+				const int outside = std::max(std::abs(v - lo), std::abs(v - hi));
+				nearest_axis[a][k * n + i] = (unsigned int)(inside * inside);
+				farthest_axis[a][k * n + i] = (unsigned int)(outside * outside);
+			}
+		}
+	}
+
+	//each red slice of the grid lists its candidates on its own, then the slices are joined in order
+	std::vector<std::vector<unsigned char> > slices(32);
+	parallel_for(0, 32, 1, [&](unsigned int r0, unsigned int r1) {
+		for (unsigned int r = r0; r < r1; ++r) {
+			for (unsigned int g = 0; g < 32; ++g) {
+				for (unsigned int b = 0; b < 32; ++b) {
+					const unsigned int *nr = &nearest_axis[0][r * n], *ng = &nearest_axis[1][g * n], *nb = &nearest_axis[2][b * n];
+					const unsigned int *fr = &farthest_axis[0][r * n], *fg = &farthest_axis[1][g * n], *fb = &farthest_axis[2][b * n];
+					unsigned int bound = 0xffffffffu;
+					for (unsigned int i = 0; i < n; ++i)
+						bound = std::min(bound, fr[i] + fg[i] + fb[i]);
+					const size_t before = slices[r].size();
+					for (unsigned int i = 0; i < n; ++i) {
+						if (nr[i] + ng[i] + nb[i] <= bound)
+							slices[r].push_back((unsigned char)i);
+					}
+					cell_start[((r << 10) | (g << 5) | b) + 1] = (uint32_t)(slices[r].size() - before);
+				}
+			}
+		}
+	});
+	for (unsigned int cell = 0; cell < PALETTE_CELLS; ++cell)
+		cell_start[cell + 1] += cell_start[cell];
+	candidates.reserve(cell_start[PALETTE_CELLS]);
+	for (unsigned int r = 0; r < 32; ++r)
+		candidates.insert(candidates.end(), slices[r].begin(), slices[r].end());
+}
+
+///This will count the pixels of an image into the 32^3 color cells and
+///list the occupied ones with their mean colors
+///
+/// \param src the image
+/// \return the occupied cells
+///
+static std::vector<cell_color> count_cells(const rgb_view<const unsigned char> &src) {
+	std::vector<color_cell> cells(PALETTE_CELLS);
+	std::mutex lock;
+	parallel_for(0, src.height(), 64, [&](unsigned int y0, unsigned int y1) {
+		std::vector<color_cell> band(PALETTE_CELLS);
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *r = src[0].row(y), *g = src[1].row(y), *b = src[2].row(y);
+			const size_t rs = src[0].step, gs = src[1].step, bs = src[2].step;
+			for (unsigned int x = 0; x < src.width(); ++x) {
+				const unsigned int vr = r[x * rs], vg = g[x * gs], vb = b[x * bs];
+				color_cell &cell = band[((vr >> 3) << 10) | ((vg >> 3) << 5) | (vb >> 3)];
+				cell.count++;
+				cell.sum[0] += vr;
+				cell.sum[1] += vg;
+				cell.sum[2] += vb;
+			}
+		}
+		std::lock_guard<std::mutex> hold(lock);
+		for (unsigned int i = 0; i < PALETTE_CELLS; ++i) {
+			cells[i].count += band[i].count;
+			for (unsigned int c = 0; c < 3; ++c)
+				cells[i].sum[c] += band[i].sum[c];
+		}
+	});
+
+	std::vector<cell_color> occupied;
+	for (unsigned int i = 0; i < PALETTE_CELLS; ++i) {
+		if (cells[i].count == 0)
+			continue;
+		cell_color cell;
+		cell.coord[0] = (unsigned char)(i >> 10);
+		cell.coord[1] = (unsigned char)((i >> 5) & 31);
+		cell.coord[2] = (unsigned char)(i & 31);
+		cell.count = cells[i].count;
+		for (unsigned int c = 0; c < 3; ++c)
+			cell.mean[c] = (float)((double)cells[i].sum[c] / cells[i].count);
+		occupied.push_back(cell);
+	}
+	return occupied;
+}
+
+///This will shrink a box to the cells it holds and total their pixels
+///
+/// \param box the box
+/// \param cells the occupied cells
+///
+static void fit_box(color_box &box, const std::vector<cell_color> &cells) {
+	box.count = 0;
+	for (unsigned int c = 0; c < 3; ++c) {
+		box.lo[c] = 31;
+		box.hi[c] = 0;
+	}
+	for (unsigned int i = box.begin; i < box.end; ++i) {
+		box.count += cells[i].count;
+		for (unsigned int c = 0; c < 3; ++c) {
+			box.lo[c] = std::min(box.lo[c], cells[i].coord[c]);
+			box.hi[c] = std::max(box.hi[c], cells[i].coord[c]);
+		}
+	}
+}
+
+///This will return the pixel weighted mean color of a range of cells
+///
+/// \param cells the occupied cells
+/// \param begin the first cell
+/// \param end one past the last cell
+/// \param color the mean, rounded
+///
+static void mean_color(const std::vector<cell_color> &cells, unsigned int begin, unsigned int end,
+	unsigned char *color) {
+	double sum[3] = { 0.0, 0.0, 0.0 }, count = 0.0;
+	for (unsigned int i = begin; i < end; ++i) {
+		for (unsigned int c = 0; c < 3; ++c)
+			sum[c] += (double)cells[i].mean[c] * cells[i].count;
+		count += (double)cells[i].count;
+	}
+	for (unsigned int c = 0; c < 3; ++c)
+		color[c] = (unsigned char)std::min(sum[c] / count + 0.5, 255.0);
+}
+
+///This will split the cells into boxes by median cut and return the mean
+///color of each box
+///
+/// \param cells the occupied cells, reordered box by box
+/// \param colors the most boxes
+/// \return the rgb triples of the boxes
+///
+static std::vector<unsigned char> median_cut(std::vector<cell_color> &cells, unsigned int colors) {
+	std::vector<color_box> boxes(1);
+	boxes[0].begin = 0;
+	boxes[0].end = (unsigned int)cells.size();
+	fit_box(boxes[0], cells);
+	while (boxes.size() < colors) {
+		//the box with the most pixels times its longest side; a box of one cell cannot be split
+		int pick = -1;
+		unsigned int axis = 0;
+		double best = 0.0;
+		for (size_t i = 0; i < boxes.size(); ++i) {
+			const color_box &box = boxes[i];
+			if (box.end - box.begin < 2)
+				continue;
+			unsigned int longest = 0;
+			for (unsigned int c = 1; c < 3; ++c) {
+				if (box.hi[c] - box.lo[c] > box.hi[longest] - box.lo[longest])
+					longest = c;
+			}
+			const double score = (double)box.count * (box.hi[longest] - box.lo[longest]);
+			if (score > best) {
+				best = score;
+				pick = (int)i;
+				axis = longest;
+			}
+		}
+		if (pick < 0)
+			break;
+
+		color_box &box = boxes[pick];
+		std::sort(cells.begin() + box.begin, cells.begin() + box.end, [axis](const cell_color &a, const cell_color &b) {
+			return a.coord[axis] < b.coord[axis];
+		});
+		//cut where half the pixels are below, keeping at least one cell on each side
+		uint64_t below = 0;
+		unsigned int cut = box.begin;
+		while (cut + 1 < box.end && 2 * (below + cells[cut].count) <= box.count)
+			below += cells[cut++].count;
+		cut = std::max(cut, box.begin + 1);
+		color_box upper = box;
+		upper.begin = cut;
+		box.end = cut;
+		fit_box(box, cells);
+		fit_box(upper, cells);
+		boxes.push_back(upper);
+	}
+
+	std::vector<unsigned char> out(3 * boxes.size());
+	for (size_t i = 0; i < boxes.size(); ++i)
+		mean_color(cells, boxes[i].begin, boxes[i].end, &out[3 * i]);
+	return out;
+}
+
+///This will move each entry of a palette to the mean of the cells nearest
+///to it, until no entry moves or the iterations run out.  An entry no
+///cell is nearest to stays where it is.
+///
+/// \param cells the occupied cells
+/// \param p the palette
+/// \param iterations the most passes
+///
+static void kmeans(const std::vector<cell_color> &cells, palette &p, unsigned int iterations) {
+	const unsigned int n = p.size();
+	for (unsigned int pass = 0; pass < iterations; ++pass) {
+		std::vector<double> sum(4 * n, 0.0);
+		for (size_t i = 0; i < cells.size(); ++i) {
+			const cell_color &cell = cells[i];
+			const unsigned int k = p.nearest((unsigned int)(cell.mean[0] + 0.5f), (unsigned int)(cell.mean[1] + 0.5f),
+				(unsigned int)(cell.mean[2] + 0.5f));
+			for (unsigned int c = 0; c < 3; ++c)
+				sum[4 * k + c] += (double)cell.mean[c] * cell.count;
+			sum[4 * k + 3] += (double)cell.count;
+		}
+		bool moved = false;
+		for (unsigned int k = 0; k < n; ++k) {
+			if (sum[4 * k + 3] == 0.0)
+				continue;
+			for (unsigned int c = 0; c < 3; ++c) {
+				const unsigned char v = (unsigned char)std::min(sum[4 * k + c] / sum[4 * k + 3] + 0.5, 255.0);
+				moved = moved || v != p.colors[3 * k + c];
+				p.colors[3 * k + c] = v;
+			}
+		}
+		if (!moved)
+			break;
+		p.build_lookup();
+	}
+}
+
+///This will build a palette for an image
+///
+/// \param src the image
+/// \param colors the most entries, 1 to PALETTE_MAX_COLORS
+/// \param method median cut alone or refined by k-means
+/// \param iterations the most k-means passes
+/// \return the palette; empty if the image or colors is
+///
+palette build_palette(const rgb_view<const unsigned char> &src, unsigned int colors, palette_method method,
+	unsigned int iterations) {
+	colors = std::min(colors, PALETTE_MAX_COLORS);
+	if (colors == 0 || src.width() == 0 || src.height() == 0)
+		return palette();
+	std::vector<cell_color> cells = count_cells(src);
+	palette p(median_cut(cells, colors));
+	if (method == palette_kmeans)
+		kmeans(cells, p, iterations);
+	return p;
+}
+
+///This will map every pixel of a band of rows to its nearest entry,
+///shifted first by a Bayer threshold pattern when spread is not zero
+///
+/// \param src the image
+/// \param indices the entry of each pixel
+/// \param p the palette
+/// \param spread the range of the threshold offsets in levels
+/// \param y0 the first row
+/// \param y1 one past the last row
+///
+static void map_rows(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices,
+	const palette &p, float spread, unsigned int y0, unsigned int y1) {
+	static const unsigned char bayer[8][8] = {
+		{ 0, 32, 8, 40, 2, 34, 10, 42 },
+		{ 48, 16, 56, 24, 50, 18, 58, 26 },
+		{ 12, 44, 4, 36, 14, 46, 6, 38 },
+		{ 60, 28, 52, 20, 62, 30, 54, 22 },
+		{ 3, 35, 11, 43, 1, 33, 9, 41 },
+		{ 51, 19, 59, 27, 49, 17, 57, 25 },
+		{ 15, 47, 7, 39, 13, 45, 5, 37 },
+		{ 63, 31, 55, 23, 61, 29, 53, 21 }
+	};
+	for (unsigned int y = y0; y < y1; ++y) {
+		const unsigned char *r = src[0].row(y), *g = src[1].row(y), *b = src[2].row(y);
+		const size_t rs = src[0].step, gs = src[1].step, bs = src[2].step;
+		unsigned char *out = indices.row(y);
+		int offsets[8];
+		for (unsigned int i = 0; i < 8; ++i)
+			offsets[i] = (int)std::floor(((bayer[y & 7][i] + 0.5f) / 64.0f - 0.5f) * spread + 0.5f);
+		for (unsigned int x = 0; x < src.width(); ++x) {
+			const int o = offsets[x & 7];
+			const unsigned int vr = (unsigned int)std::min(std::max((int)r[x * rs] + o, 0), 255);
+			const unsigned int vg = (unsigned int)std::min(std::max((int)g[x * gs] + o, 0), 255);
+			const unsigned int vb = (unsigned int)std::min(std::max((int)b[x * bs] + o, 0), 255);
+			out[(size_t)x * indices.step] = p.nearest(vr, vg, vb);
+		}
+	}
+}
+
+///This will return the mean distance from each entry of a palette to the
+///nearest other entry, the spacing ordered dithering spreads over
+///
+/// \param p the palette
+/// \return the spacing in levels; 0 for a single entry
+///
+static float palette_spacing(const palette &p) {
+	const unsigned int n = p.size();
+	if (n < 2)
+		return 0.0f;
+	double total = 0.0;
+	for (unsigned int i = 0; i < n; ++i) {
+		int best = 0x7fffffff;
+		for (unsigned int j = 0; j < n; ++j) {
+			if (j == i)
+				continue;
+			int d = 0;
+			for (unsigned int c = 0; c < 3; ++c) {
+				const int diff = (int)p.colors[3 * i + c] - p.colors[3 * j + c];
+				d += diff * diff;
+			}
+			best = std::min(best, d);
+		}
+		total += std::sqrt((double)best);
+	}
+	return (float)(total / n);
+}
+
+///This will quantize one row with Floyd-Steinberg error diffusion,
+///waiting on the row above before each chunk of pixels and reporting its
+///own progress after it.  The error carried to the next pixel stays in
+///registers; the error for the row below goes into below, whose pixel x is
+///at 3 (x + 1).
+///
+/// \param src the image
+/// \param indices the entry of each pixel
+/// \param p the palette
+/// \param y the row
+/// \param above the error diffused into this row
+/// \param below the error diffused into the next row
+/// \param ready the pixels the row above has finished, or 0 for the first row
+/// \param done the pixels this row has finished
+///
+static void diffuse_row(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices,
+	const palette &p, unsigned int y, const float *above, float *below,
+	const std::atomic<unsigned int> *ready, std::atomic<unsigned int> &done) {
+	const unsigned int width = src.width();
+	const unsigned char *in[3] = { src[0].row(y), src[1].row(y), src[2].row(y) };
+	const size_t steps[3] = { src[0].step, src[1].step, src[2].step };
+	unsigned char *out = indices.row(y);
+	float carry[3] = { 0.0f, 0.0f, 0.0f };
+	for (unsigned int x0 = 0; x0 < width; x0 += DIFFUSION_CHUNK) {
+		const unsigned int x1 = std::min(x0 + DIFFUSION_CHUNK, width);
+		//the chunk reads the error of pixels x0 to x1 - 1, which the row above finishes at pixel x1
+		if (ready) {
+			const unsigned int need = std::min(x1 + 1, width);
+			while (ready->load(std::memory_order_acquire) < need)
+				std::this_thread::yield();
+		}
+		//only now is the row two above, which read this buffer last, past its start
+		if (x0 == 0) {
+			for (unsigned int c = 0; c < 6; ++c)
+				below[c] = 0.0f;
+		}
+		for (unsigned int x = x0; x < x1; ++x) {
+			float want[3];
+			unsigned int v[3];
+			for (unsigned int c = 0; c < 3; ++c) {
+				want[c] = std::min(std::max((float)in[c][x * steps[c]] + carry[c] + (above ? above[3 * (x + 1) + c] : 0.0f),
+					0.0f), 255.0f);
+				v[c] = (unsigned int)(want[c] + 0.5f);
+			}
+			const unsigned char k = p.nearest(v[0], v[1], v[2]);
+			out[(size_t)x * indices.step] = k;
+			for (unsigned int c = 0; c < 3; ++c) {
+				const float e = want[c] - p.colors[3 * k + c];
+				carry[c] = e * (7.0f / 16.0f);
+				below[3 * x + c] += e * (3.0f / 16.0f);
+				below[3 * (x + 1) + c] += e * (5.0f / 16.0f);
+				below[3 * (x + 2) + c] = e * (1.0f / 16.0f);
+			}
+		}
+		done.store(x1, std::memory_order_release);
+	}
+}
+
+///This will quantize an image with Floyd-Steinberg error diffusion.  Each
+///thread takes the next row from a shared counter, so every row it waits
+///on has been taken by a thread already running.  The rows pass their
+///error through a ring of three buffers: a row cannot get to a pixel
+///before every row above it, up to the one reading the same buffer, is
+///past that pixel.
+///
+/// \param src the image
+/// \param indices the entry of each pixel
+/// \param p the palette
+///
+static void floyd_steinberg(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices,
+	const palette &p) {
+	const unsigned int width = src.width(), height = src.height();
+	const size_t row_floats = 3 * ((size_t)width + 2);
+	std::vector<float> errors(3 * row_floats);
+	std::unique_ptr<std::atomic<unsigned int>[]> progress(new std::atomic<unsigned int>[height]);
+	for (unsigned int y = 0; y < height; ++y)
+		progress[y].store(0, std::memory_order_relaxed);
+	std::atomic<unsigned int> next_row(0);
+	const unsigned int threads = std::min(thread_pool::global().size(), height);
+	parallel_for(0, threads, 1, [&](unsigned int, unsigned int) {
+		for (;;) {
+			const unsigned int y = next_row++;
+			if (y >= height)
+				return;
+			const float *above = y > 0 ? &errors[(y % 3) * row_floats] : 0;
+			float *below = &errors[((y + 1) % 3) * row_floats];
+			diffuse_row(src, indices, p, y, above, below, y > 0 ? &progress[y - 1] : 0, progress[y]);
+		}
+	});
+}
+
+///This will choose the palette entry of every pixel of an image
+///
+/// \param src the image
+/// \param indices the entry of each pixel, the size of the image
+/// \param p the palette, not empty
+/// \param method how the error of each choice is spread
+///
+void quantize(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices, const palette &p,
+	dither_method method) {
+	if (p.empty() || src.width() == 0 || src.height() == 0)
+		return;
+	if (method == dither_floyd_steinberg) {
+		floyd_steinberg(src, indices, p);
+		return;
+	}
+	const float spread = method == dither_ordered ? palette_spacing(p) : 0.0f;
+	parallel_for(0, src.height(), 16, [&](unsigned int y0, unsigned int y1) {
+		map_rows(src, indices, p, spread, y0, y1);
+	});
+}
+
+///This will replace every index by its palette color
+///
+/// \param indices the entry of each pixel
+/// \param p the palette
+/// \param dst the image, the size of indices
+///
+void expand_indices(const image_view<const unsigned char> &indices, const palette &p,
+	const rgb_view<unsigned char> &dst) {
+	parallel_for(0, indices.height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *in = indices.row(y);
+			for (unsigned int c = 0; c < 3; ++c) {
+				unsigned char *out = dst[c].row(y);
+				const size_t step = dst[c].step;
+				for (unsigned int x = 0; x < indices.width; ++x)
+					out[x * step] = p.colors[3 * (size_t)in[(size_t)x * indices.step] + c];
+			}
+		}
+	});
+}
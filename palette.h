@@ -0,0 +1,97 @@
+///
+/// \file palette.h
+/// \brief Palette generation, nearest color search and dithering to indexed images
+///
+/// A palette is built from a 32 x 32 x 32 histogram of the image, each cell
+/// keeping the count and the mean color of its pixels, so the work after
+/// one counting pass does not depend on the image size.  Median cut splits
+/// the box of occupied cells with the most pixels times the longest side at
+/// its median until there are as many boxes as colors; k-means then moves
+/// each color to the mean of the cells nearest to it.
+///
+/// Nearest color queries go through a grid over the same 32^3 cells: each
+/// cell lists only the palette entries that can be nearest to some color
+/// inside it: an entry farther from the cell than some other entry is from
+/// the far corner of the cell never is.  A query then tests a handful of
+/// entries instead of all of them.
+///
+/// Floyd-Steinberg diffusion runs a wavefront over the rows: each thread
+/// takes the next row and follows the row above it a few pixels behind,
+/// since a pixel only waits on the error of the three pixels above it.
+///
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "image_view.h"
+
+//the most entries a palette holds, so indices fit a byte
+const unsigned int PALETTE_MAX_COLORS = 256;
+
+struct palette {
+	//rgb triples of the entries
+	std::vector<unsigned char> colors;
+	//for each cell of the 32^3 grid, red slowest, the range of candidates holding the entries that can be nearest
+	std::vector<uint32_t> cell_start;
+	std::vector<unsigned char> candidates;
+
+	//an empty palette
+	palette() {}
+	//a palette of rgb triples, at most PALETTE_MAX_COLORS of them
+	explicit palette(const std::vector<unsigned char> &_colors) : colors(_colors) { build_lookup(); }
+
+	//rebuild the grid after the colors change
+	void build_lookup();
+	unsigned int size() const { return (unsigned int)colors.size() / 3; }
+	bool empty() const { return colors.empty(); }
+
+	//the index of the entry nearest a color, the lowest on ties; the palette must not be empty
+	unsigned char nearest(unsigned int r, unsigned int g, unsigned int b) const {
+		const size_t cell = ((size_t)(r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3);
+		const unsigned char *c = candidates.data() + cell_start[cell];
+		const unsigned char *end = candidates.data() + cell_start[cell + 1];
+		unsigned char best = *c;
+		unsigned int best_distance = 0xffffffffu;
+		for (; c < end; ++c) {
+			const unsigned char *color = colors.data() + 3 * (size_t)*c;
+			const int dr = (int)r - color[0], dg = (int)g - color[1], db = (int)b - color[2];
+			const unsigned int d = (unsigned int)(dr * dr + dg * dg + db * db);
+			if (d < best_distance) {
+				best_distance = d;
+				best = *c;
+			}
+		}
+		return best;
+	}
+};
+
+//how the colors are chosen
+enum palette_method {
+	palette_median_cut,
+	//median cut refined by k-means
+	palette_kmeans
+};
+
+//a palette of at most colors entries (1 to PALETTE_MAX_COLORS) for an image; fewer if it has fewer distinct colors
+palette build_palette(const rgb_view<const unsigned char> &src, unsigned int colors,
+	palette_method method = palette_kmeans, unsigned int iterations = 8);
+
+//how the error of mapping a pixel to its nearest entry is spread
+enum dither_method {
+	dither_none,
+	//an 8 x 8 Bayer threshold pattern, as large as the typical spacing of the palette colors
+	dither_ordered,
+	dither_floyd_steinberg
+};
+
+//indices = the palette entry chosen for each pixel of src
+void quantize(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices, const palette &p,
+	dither_method method = dither_floyd_steinberg);
+//dst = the palette color of each index
+void expand_indices(const image_view<const unsigned char> &indices, const palette &p,
+	const rgb_view<unsigned char> &dst);
+
+#endif
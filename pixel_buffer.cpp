@@ -0,0 +1,266 @@
+///
+/// \file pixel_buffer.cpp
+/// \brief Size-class pool behind pixel_buffer
+///
+
+#include "pixel_buffer.h"
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <cstdlib>
+#include <new>
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+///This will tell whether a block of this size is mapped directly instead of
+///coming from the C heap.  Mapped blocks start on a huge page boundary and
+///can be given a NUMA placement.
+///
+/// \param bytes the size of the block
+/// \return true for mapped blocks
+///
+static bool is_mapped(size_t bytes) {
+#if defined(__linux__)
+	return bytes >= HUGE_PAGE_SIZE;
+#else
+	(void)bytes;
+	return false;
+#endif
+}
+
+///This will allocate an aligned block straight from the system
+///
+/// \param bytes the size of the block
+/// \param huge_pages true to back large blocks with transparent huge pages
+/// \param placement the NUMA placement of large blocks
+/// \return the block, or NULL if the system is out of memory
+///
+static void *aligned_block(size_t bytes, bool huge_pages, numa_placement placement) {
+	if (is_mapped(bytes))
+		return map_large_block(bytes, huge_pages, placement);
+#if defined(_WIN32)
+	return _aligned_malloc(bytes, PIXEL_ALIGNMENT);
+#else
+	void *block = 0;
+	if (posix_memalign(&block, PIXEL_ALIGNMENT, bytes) != 0)
+		return 0;
+	return block;
+#endif
+}
+
+///This will return a block obtained from aligned_block to the system
+///
+/// \param block the block to free
+/// \param bytes the size of the block
+///
+static void free_block(void *block, size_t bytes) {
+	if (is_mapped(bytes)) {
+		unmap_large_block(block, bytes);
+		return;
+	}
+#if defined(_WIN32)
+	_aligned_free(block);
+#else
+	std::free(block);
+#endif
+}
+
+///This will create an empty pool that keeps up to 256 MB of released
+///blocks around
+buffer_pool::buffer_pool() : pooled_bytes(0), limit((size_t)256 << 20), huge_pages(false), placement(placement_default) {}
+
+///This will return the pool shared by all pixel buffers.  The pool is never
+///destroyed, so buffers in static storage can still release into it during
+///shutdown.
+///
+/// \return the pool
+///
+buffer_pool &buffer_pool::instance() {
+	static buffer_pool *pool = new buffer_pool();
+	return *pool;
+}
+
+///This will return the size class that serves a request of bytes bytes.
+///Class 0 holds 64 byte blocks, every later power of two is split into four
+///classes.
+///
+/// \param bytes the size of the request
+/// \return the size class
+///
+unsigned int buffer_pool::size_class(size_t bytes) {
+	if (bytes <= 64)
+		return 0;
+	unsigned int k = 0;
+	for (size_t v = bytes - 1; v > 1; v >>= 1)
+		k++;
+	const size_t base = (size_t)1 << k;
+	const size_t quarter = base >> 2;
+	const size_t sub = (bytes - base + quarter - 1) / quarter;
+	return 4 * (k - 6) + (unsigned int)sub;
+}
+
+///This will return the size of the blocks in a size class
+///
+/// \param c the size class
+/// \return the block size in bytes
+///
+size_t buffer_pool::class_bytes(unsigned int c) {
+	if (c == 0)
+		return 64;
+	const unsigned int k = 6 + (c - 1) / 4;
+	const size_t sub = (c - 1) % 4 + 1;
+	return ((size_t)1 << k) + sub * ((size_t)1 << (k - 2));
+}
+
+///This will return a block of at least bytes bytes.  A block released
+///earlier in the same size class is reused when there is one; a new large
+///block is first touched band by band under first touch placement.  New
+///large blocks are freshly mapped, so they come back all zeros.
+///
+/// \param bytes the size of the request
+/// \param zeroed if not NULL, set to true if the block is known to be all zeros
+/// \return the block
+///
+void *buffer_pool::acquire(size_t bytes, bool *zeroed) {
+	const unsigned int c = size_class(bytes);
+	if (zeroed)
+		*zeroed = false;
+	if (c < CLASSES) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (!free_blocks[c].empty()) {
+			void *block = free_blocks[c].back();
+			free_blocks[c].pop_back();
+			pooled_bytes -= class_bytes(c);
+			return block;
+		}
+	}
+	bool huge;
+	numa_placement where;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		huge = huge_pages;
+		where = placement;
+	}
+	void *block = aligned_block(class_bytes(c), huge, where);
+	if (!block)
+		throw std::bad_alloc();
+	//place a fresh block now, since the caller of an uninitialized buffer
+	//writes it from whatever thread it runs on, often a single one
+	if (is_mapped(class_bytes(c)) && where == placement_first_touch)
+		first_touch(block, class_bytes(c));
+	if (zeroed)
+		*zeroed = is_mapped(class_bytes(c));
+	return block;
+}
+
+///This will give a block back to the pool, or to the system if the pool is
+///already holding as much memory as it is allowed to
+///
+/// \param block the block
+/// \param bytes the size that was returned by class_bytes for the block
+///
+void buffer_pool::release(void *block, size_t bytes) {
+	const unsigned int c = size_class(bytes);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (c < CLASSES && pooled_bytes + bytes <= limit) {
+			free_blocks[c].push_back(block);
+			pooled_bytes += bytes;
+			return;
+		}
+	}
+	free_block(block, bytes);
+}
+
+///This will free every block held by the pool
+void buffer_pool::trim() {
+	std::lock_guard<std::mutex> guard(lock);
+	for (unsigned int c = 0; c < CLASSES; ++c) {
+		for (size_t i = 0; i < free_blocks[c].size(); ++i)
+			free_block(free_blocks[c][i], class_bytes(c));
+		free_blocks[c].clear();
+	}
+	pooled_bytes = 0;
+}
+
+///This will set how much released memory the pool keeps for reuse
+///
+/// \param bytes the limit, 0 disables pooling
+///
+void buffer_pool::set_limit(size_t bytes) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		limit = bytes;
+		if (pooled_bytes <= limit)
+			return;
+	}
+	trim();
+}
+
+///This will return how much released memory the pool keeps for reuse
+///
+/// \return the limit in bytes
+///
+size_t buffer_pool::get_limit() {
+	std::lock_guard<std::mutex> guard(lock);
+	return limit;
+}
+
+///This will return how much memory the pool is holding
+///
+/// \return the number of pooled bytes
+///
+size_t buffer_pool::bytes_pooled() {
+	std::lock_guard<std::mutex> guard(lock);
+	return pooled_bytes;
+}
+
+///This will turn transparent huge pages for large blocks on or off.  Pooled
+///blocks are freed so every later block gets the new setting.
+///
+/// \param enable true to madvise large blocks with MADV_HUGEPAGE
+///
+void buffer_pool::set_huge_pages(bool enable) {
+	trim();
+	std::lock_guard<std::mutex> guard(lock);
+	huge_pages = enable;
+}
+
+///This will choose how the pages of large blocks are placed on NUMA nodes.
+///Pooled blocks are freed so every later block gets the new placement.
+///First touch placement pins the workers of the global thread pool, so the
+///threads that place a band and the threads that process it are the same;
+///no parallel_for may be running.
+///
+/// \param where the placement
+///
+void buffer_pool::set_placement(numa_placement where) {
+	trim();
+	thread_pool::global().set_pinned(where == placement_first_touch);
+	std::lock_guard<std::mutex> guard(lock);
+	placement = where;
+}
+
+///This will return how the pages of large blocks are placed
+///
+/// \return the placement
+///
+numa_placement buffer_pool::get_placement() {
+	std::lock_guard<std::mutex> guard(lock);
+	return placement;
+}
+
+///This will zero fill a block.  Large blocks under first touch placement
+///are filled band by band by the pool workers that process those bands.
+///
+/// \param block the block
+/// \param bytes the number of bytes to clear
+///
+void buffer_pool::clear(void *block, size_t bytes) {
+	if (is_mapped(bytes) && get_placement() == placement_first_touch)
+		first_touch(block, bytes);
+	else
+		std::memset(block, 0, bytes);
+}
@@ -0,0 +1,192 @@
+///
+/// \file pixel_buffer.h
+/// \brief Aligned, pooled storage for pixel samples
+///
+/// pixel_buffer<T> replaces std::vector<T> for image planes.  Its memory is
+/// aligned to 64 bytes (one cache line, and wide enough for any SIMD load),
+/// resize() leaves new samples uninitialized because the caller is about
+/// to overwrite them anyway, and released memory goes back to a size-class
+/// pool so loading image after image reuses the same pages instead of
+/// faulting in fresh ones.  Blocks of HUGE_PAGE_SIZE and up are mapped
+/// directly, can be backed by transparent huge pages and can be placed
+/// across NUMA nodes (see numa.h).
+///
+
+#ifndef PIXEL_BUFFER_H
+#define PIXEL_BUFFER_H
+
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "numa.h"
+
+//alignment of every pixel buffer in bytes
+const size_t PIXEL_ALIGNMENT = 64;
+
+///A process wide pool of aligned memory blocks sorted into size classes.
+///Each power of two is split into four classes, so a recycled block wastes
+///at most a quarter of its size.
+class buffer_pool {
+	static const unsigned int CLASSES = 4 * 48;
+
+	std::mutex lock;
+	std::vector<void *> free_blocks[CLASSES];
+	size_t pooled_bytes;
+	size_t limit;
+	bool huge_pages;
+	numa_placement placement;
+
+	buffer_pool();
+	~buffer_pool();
+	buffer_pool(const buffer_pool &);
+	buffer_pool &operator=(const buffer_pool &);
+
+public:
+	//the pool shared by all pixel buffers
+	static buffer_pool &instance();
+
+	//the size class of a request and the block size of a class
+	static unsigned int size_class(size_t bytes);
+	static size_t class_bytes(unsigned int c);
+
+	//get a block of at least bytes bytes, aligned to PIXEL_ALIGNMENT; zeroed, if given, tells whether it is all zeros
+	void *acquire(size_t bytes, bool *zeroed = 0);
+	//give a block obtained from acquire back to the pool
+	void release(void *block, size_t bytes);
+	//free every block held by the pool
+	void trim();
+	//the most memory the pool keeps around before freeing released blocks
+	void set_limit(size_t bytes);
+	size_t get_limit();
+	size_t bytes_pooled();
+
+	//back large blocks with transparent huge pages
+	void set_huge_pages(bool enable);
+	//choose how the pages of large blocks are spread over NUMA nodes; first touch pins the thread pool's workers
+	void set_placement(numa_placement where);
+	numa_placement get_placement();
+	//zero fill a block, honoring first touch placement for large blocks
+	void clear(void *block, size_t bytes);
+};
+
+//tag used to ask for storage that is not zero filled
+struct uninitialized_t {};
+const uninitialized_t uninitialized = uninitialized_t();
+
+///A resizable array of trivially copyable samples backed by the buffer
+///pool.  Only the parts of the std::vector interface the image code uses
+///are provided.
+template <typename T>
+class pixel_buffer {
+	T *ptr;
+	size_t count;
+	size_t capacity_bytes;
+
+public:
+	typedef T value_type;
+
+	pixel_buffer() : ptr(0), count(0), capacity_bytes(0) {}
+	//a zero filled buffer of n samples
+	explicit pixel_buffer(size_t n) : ptr(0), count(0), capacity_bytes(0) { resize_zeroed(n); }
+	//a buffer of n samples with unspecified contents
+	pixel_buffer(size_t n, uninitialized_t) : ptr(0), count(0), capacity_bytes(0) { resize(n); }
+	pixel_buffer(const pixel_buffer &other) : ptr(0), count(0), capacity_bytes(0) {
+		resize(other.count);
+		if (count > 0)
+			std::memcpy(ptr, other.ptr, count * sizeof(T));
+	}
+	pixel_buffer(pixel_buffer &&other) : ptr(other.ptr), count(other.count), capacity_bytes(other.capacity_bytes) {
+		other.ptr = 0;
+		other.count = 0;
+		other.capacity_bytes = 0;
+	}
+	~pixel_buffer() { release(); }
+
+	pixel_buffer &operator=(const pixel_buffer &other) {
+		if (this != &other) {
+			resize(other.count);
+			if (count > 0)
+				std::memcpy(ptr, other.ptr, count * sizeof(T));
+		}
+		return *this;
+	}
+	pixel_buffer &operator=(pixel_buffer &&other) {
+		if (this != &other) {
+			release();
+			std::swap(ptr, other.ptr);
+			std::swap(count, other.count);
+			std::swap(capacity_bytes, other.capacity_bytes);
+		}
+		return *this;
+	}
+
+	///This will change the number of samples.  Samples that were already
+	///there keep their values, new samples are left uninitialized.
+	///
+	/// \param n the new number of samples
+	///
+	void resize(size_t n) {
+		const size_t bytes = n * sizeof(T);
+		if (bytes > capacity_bytes) {
+			const unsigned int c = buffer_pool::size_class(bytes);
+			T *grown = (T *)buffer_pool::instance().acquire(bytes);
+			if (count > 0)
+				std::memcpy(grown, ptr, count * sizeof(T));
+			release();
+			ptr = grown;
+			capacity_bytes = buffer_pool::class_bytes(c);
+		}
+		count = n;
+	}
+	///This will change the number of samples and set every sample to zero.
+	///A fresh block the pool hands back already zeroed is not cleared again.
+	///
+	/// \param n the new number of samples
+	///
+	void resize_zeroed(size_t n) {
+		const size_t bytes = n * sizeof(T);
+		if (bytes > capacity_bytes) {
+			//nothing is kept, so the old block goes back without a copy
+			const unsigned int c = buffer_pool::size_class(bytes);
+			bool zeroed = false;
+			T *grown = (T *)buffer_pool::instance().acquire(bytes, &zeroed);
+			release();
+			ptr = grown;
+			capacity_bytes = buffer_pool::class_bytes(c);
+			count = n;
+			if (zeroed)
+				return;
+		}
+		count = n;
+		zero();
+	}
+	//set every sample to zero
+	void zero() {
+		if (count > 0)
+			buffer_pool::instance().clear(ptr, count * sizeof(T));
+	}
+	//give the memory back to the pool
+	void release() {
+		if (ptr)
+			buffer_pool::instance().release(ptr, capacity_bytes);
+		ptr = 0;
+		count = 0;
+		capacity_bytes = 0;
+	}
+
+	T *data() { return ptr; }
+	const T *data() const { return ptr; }
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	T &operator[](size_t i) { return ptr[i]; }
+	const T &operator[](size_t i) const { return ptr[i]; }
+	T *begin() { return ptr; }
+	T *end() { return ptr + count; }
+	const T *begin() const { return ptr; }
+	const T *end() const { return ptr + count; }
+};
+
+#endif
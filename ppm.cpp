@@ -0,0 +1,197 @@
+///
+/// \file ppm.cpp
+/// \brief Floating point image writers (Radiance RGBE and PFM)
+///
+
+#include "ppm.h"
+
+///This will convert a floating point color to the shared exponent RGBE
+///representation used by Radiance files
+///
+/// \param red the red value
+/// \param green the green value
+/// \param blue the blue value
+/// \param rgbe the four output bytes
+///
+void float_to_rgbe(float red, float green, float blue, unsigned char rgbe[4]) {
+	float v = std::max(red, std::max(green, blue));
+	if (!(v > 1e-32f)) {
+		rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+		return;
+	}
+	int e;
+	v = std::frexp(v, &e) * 256.0f / v;
+	rgbe[0] = (unsigned char)(std::max(red, 0.0f) * v);
+	rgbe[1] = (unsigned char)(std::max(green, 0.0f) * v);
+	rgbe[2] = (unsigned char)(std::max(blue, 0.0f) * v);
+	rgbe[3] = (unsigned char)(e + 128);
+}
+
+///This will run length encode one component of an RGBE scanline.  Runs of
+///four or more equal bytes are stored as (128 + count, value), everything
+///else is stored as (count, literal bytes).
+///
+/// \param out the buffer the encoded bytes are appended to
+/// \param src one component of the scanline
+/// \param n the number of pixels in the scanline
+///
+void encode_rgbe_component(std::vector<unsigned char> &out, const unsigned char *src, unsigned int n) {
+	const unsigned int MIN_RUN = 4;
+	unsigned int cur = 0;
+	while (cur < n) {
+		//find the start of the next run that is long enough to encode
+		unsigned int beg_run = cur;
+		unsigned int run_count = 0;
+		unsigned int old_run_count = 0;
+		while (run_count < MIN_RUN && beg_run < n) {
+			beg_run += run_count;
+			old_run_count = run_count;
+			run_count = 1;
+			while (beg_run + run_count < n && run_count < 127 && src[beg_run] == src[beg_run + run_count])
+				run_count++;
+		}
+		//a short run right before the long one is cheaper as a run
+		if (old_run_count > 1 && old_run_count == beg_run - cur) {
+			out.push_back((unsigned char)(128 + old_run_count));
+			out.push_back(src[cur]);
+			cur = beg_run;
+		}
+		//literal bytes up to the start of the run
+		while (cur < beg_run) {
+			unsigned int count = std::min(beg_run - cur, 128u);
+			out.push_back((unsigned char)count);
+			out.insert(out.end(), src + cur, src + cur + count);
+			cur += count;
+		}
+		//the run itself
+		if (run_count >= MIN_RUN) {
+			out.push_back((unsigned char)(128 + run_count));
+			out.push_back(src[beg_run]);
+			cur += run_count;
+		}
+	}
+}
+
+///This will write a floating point image to a Radiance RGBE (.hdr) file.
+///Scanlines are run length encoded when the width allows it.
+///
+/// \param fileName the referenced HDR file
+/// \param src the channels to write
+///
+void write_rgbe(const std::string &fileName, const rgb_view<const float> &src) {
+	std::ofstream output(fileName.c_str(), std::ios::out | std::ios::binary);
+	//Check to see if the file was opened, if it wasn't report an error.
+	if (!output.is_open()) {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+		return;
+	}
+	const unsigned int width = src.width();
+	const unsigned int height = src.height();
+	output << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+	{
+		chunk_writer writer(output);
+		//the format can only run length encode widths between 8 and 32767
+		const bool rle = width >= 8 && width < 32768;
+		//scanlines are encoded in parallel a batch at a time, then written in order
+		const unsigned int BATCH = 64;
+		std::vector<std::vector<unsigned char> > encoded(std::min(BATCH, height));
+		for (unsigned int y0 = 0; y0 < height; y0 += BATCH) {
+			const unsigned int rows = std::min(BATCH, height - y0);
+			parallel_for(0, rows, 1, [&](unsigned int r0, unsigned int r1) {
+				std::vector<unsigned char> scanline(4 * width);
+				std::vector<unsigned char> component(width);
+				for (unsigned int r = r0; r < r1; ++r) {
+					const unsigned int y = y0 + r;
+					std::vector<unsigned char> &out = encoded[r];
+					out.clear();
+					for (unsigned int x = 0; x < width; ++x)
+						float_to_rgbe(src[0](x, y), src[1](x, y), src[2](x, y), &scanline[4 * x]);
+					if (!rle) {
+						out.swap(scanline);
+						scanline.resize(4 * width);
+						continue;
+					}
+					out.push_back(2);
+					out.push_back(2);
+					out.push_back((unsigned char)(width >> 8));
+					out.push_back((unsigned char)(width & 0xff));
+					for (unsigned int c = 0; c < 4; ++c) {
+						for (unsigned int x = 0; x < width; ++x)
+							component[x] = scanline[4 * x + c];
+						encode_rgbe_component(out, &component[0], width);
+					}
+				}
+			});
+			for (unsigned int r = 0; r < rows; ++r)
+				writer.put(encoded[r].data(), encoded[r].size());
+		}
+	}
+	if (!output) {
+		std::cout << "Error. Unable to write " << fileName << std::endl;
+	}
+	output.close();
+}
+
+///This will write a floating point image to a little endian PFM file.
+///PFM stores its rows bottom to top.
+///
+/// \param fileName the referenced PFM file
+/// \param src the channels to write
+///
+void write_pfm(const std::string &fileName, const rgb_view<const float> &src) {
+	std::ofstream output(fileName.c_str(), std::ios::out | std::ios::binary);
+	//Check to see if the file was opened, if it wasn't report an error.
+	if (!output.is_open()) {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+		return;
+	}
+	const unsigned int width = src.width();
+	const unsigned int height = src.height();
+	//the samples are written in host byte order, a negative scale marks
+	//them as little endian
+	const unsigned int one = 1;
+	const bool little_endian = *(const unsigned char *)&one == 1;
+	output << "PF\n" << width << " " << height << "\n" << (little_endian ? "-1.0" : "1.0") << "\n";
+	{
+		chunk_writer writer(output);
+		const size_t row_bytes = 3 * sizeof(float) * (size_t)width;
+		if (row_bytes <= WRITE_CHUNK_SIZE && row_bytes > 0) {
+			//whole rows per chunk, converted in parallel
+			const unsigned int rows_per_chunk = (unsigned int)(WRITE_CHUNK_SIZE / row_bytes);
+			for (unsigned int done = 0; done < height; done += rows_per_chunk) {
+				const unsigned int rows = std::min(rows_per_chunk, height - done);
+				float *dst = (float *)writer.claim(rows * row_bytes);
+				parallel_for(0, rows, 1, [&](unsigned int r0, unsigned int r1) {
+					for (unsigned int r = r0; r < r1; ++r) {
+						const unsigned int y = height - 1 - (done + r);
+						float *out = dst + (size_t)3 * width * r;
+						for (unsigned int x = 0; x < width; ++x) {
+							out[3 * x + 0] = src[0](x, y);
+							out[3 * x + 1] = src[1](x, y);
+							out[3 * x + 2] = src[2](x, y);
+						}
+					}
+				});
+			}
+		}
+		else {
+			for (unsigned int y = height; y-- > 0;) {
+				unsigned int x = 0;
+				while (x < width) {
+					unsigned int count = std::min(width - x, WRITE_CHUNK_SIZE / (3 * (unsigned int)sizeof(float)));
+					float *dst = (float *)writer.claim(3 * sizeof(float) * count);
+					for (unsigned int i = 0; i < count; ++i) {
+						dst[3 * i + 0] = src[0](x + i, y);
+						dst[3 * i + 1] = src[1](x + i, y);
+						dst[3 * i + 2] = src[2](x + i, y);
+					}
+					x += count;
+				}
+			}
+		}
+	}
+	if (!output) {
+		std::cout << "Error. Unable to write " << fileName << std::endl;
+	}
+	output.close();
+}
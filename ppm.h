@@ -0,0 +1,673 @@
+///
+/// \file ppm.h
+/// \brief PPM image storage templated over sample type and layout
+///
+/// ppm<T, Layout> stores an RGB image with samples of type T (unsigned char,
+/// unsigned short, half or float) in one of three layouts:
+///
+///   planar      - three separate r, g and b arrays (the default)
+///   interleaved - one array of r,g,b triples
+///   rgba_padded - one array of r,g,b,pad quads, one pixel per 4 samples
+///
+/// Every layout exposes plane(c) and a compile time Layout::step, so channel
+/// c of pixel i is plane(c)[i * Layout::step].  Kernels written against that
+/// pair are specialized for the layout by the compiler with no runtime
+/// branching.  Integer sample types hold the values of the file as is (up
+/// to max_color_val), floating point sample types hold values normalized
+/// to [0, 1].  view() and view(c) expose the channels as image_views, so a
+/// crop or tile of a ppm never needs a copy.  The arrays are pixel_buffers:
+/// 64-byte aligned, recycled through the buffer pool, and only zero filled
+/// when an image is created empty.
+///
+
+#ifndef PPM_H
+#define PPM_H
+
+#include <iostream>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <exception>
+
+#include "half.h"
+#include "image_view.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+//layouts
+struct planar {
+	static const unsigned int step = 1;
+};
+struct interleaved {
+	static const unsigned int step = 3;
+};
+struct rgba_padded {
+	static const unsigned int step = 4;
+};
+
+///Properties of the supported sample types
+template <typename T> struct sample_traits;
+template <> struct sample_traits<unsigned char> {
+	static const bool is_integer = true;
+	static unsigned int max() { return 255; }
+};
+template <> struct sample_traits<unsigned short> {
+	static const bool is_integer = true;
+	static unsigned int max() { return 65535; }
+};
+template <> struct sample_traits<half> {
+	static const bool is_integer = false;
+	static unsigned int max() { return 1; }
+};
+template <> struct sample_traits<float> {
+	static const bool is_integer = false;
+	static unsigned int max() { return 1; }
+};
+
+///The arrays behind a ppm.  The general case keeps every channel of a pixel
+///next to each other in one data array.
+template <typename T, typename Layout>
+struct ppm_storage {
+	pixel_buffer<T> data;
+
+	void allocate(unsigned int size) { data.resize((size_t)size * Layout::step); }
+	void allocate_zeroed(unsigned int size) { data.resize_zeroed((size_t)size * Layout::step); }
+	T *plane(unsigned int c) { return data.data() + c; }
+	const T *plane(unsigned int c) const { return data.data() + c; }
+};
+
+///The planar layout keeps one array per channel.
+template <typename T>
+struct ppm_storage<T, planar> {
+	//arrays for storing the Red (r), Green (g), and Blue (b) values
+	pixel_buffer<T> r;
+	pixel_buffer<T> g;
+	pixel_buffer<T> b;
+
+	void allocate(unsigned int size) {
+		r.resize(size);
+		g.resize(size);
+		b.resize(size);
+	}
+	void allocate_zeroed(unsigned int size) {
+		r.resize_zeroed(size);
+		g.resize_zeroed(size);
+		b.resize_zeroed(size);
+	}
+	T *plane(unsigned int c) { return c == 0 ? r.data() : (c == 1 ? g.data() : b.data()); }
+	const T *plane(unsigned int c) const { return c == 0 ? r.data() : (c == 1 ? g.data() : b.data()); }
+};
+
+template <typename T = unsigned char, typename Layout = planar>
+class ppm : public ppm_storage<T, Layout> {
+	void init();
+	//info about the PPM file (height and width)
+	unsigned int n_r;
+	unsigned int n_c;
+
+public:
+	typedef T sample_type;
+	typedef Layout layout_type;
+
+	unsigned int height;
+	unsigned int width;
+	unsigned int max_color_val;
+
+	//total number of elements (in this case pixels)
+	unsigned int size;
+
+	ppm();
+	//create a PPM object and fill it with data stored in the PPM file referenced as fileName
+	ppm(const std::string &fileName);
+	//create an "epmty" PPM image with a given width and height; the Red, Green, and Blue arrays are filled with zeros
+	ppm(const unsigned int _width, const unsigned int _height);
+	//create a PPM image with a given width and height whose arrays are left uninitialized
+	ppm(const unsigned int _width, const unsigned int _height, uninitialized_t);
+	//create a PPM image holding a copy of the pixels seen through a view
+	ppm(const rgb_view<const T> &src, unsigned int _max_color_val);
+	//read the PPM image from the PPM file referenced as fileName
+	void read(const std::string &fileName);
+	//write the PPM image in the PPM file referenced as fileName
+	void write(const std::string &fileName) const;
+	//write the image as floating point samples to a Radiance RGBE file
+	void write_rgbe(const std::string &fileName) const;
+	//write the image as floating point samples to a PFM file
+	void write_pfm(const std::string &fileName) const;
+
+	//the value of channel c of pixel i, scaled to [0, 1]
+	float normalized(unsigned int c, unsigned int i) const;
+	//set channel c of pixel i from a value in [0, 1]
+	void set_normalized(unsigned int c, unsigned int i, float v);
+
+	//views of one channel or of all three channels of the whole image
+	image_view<T> view(unsigned int c) { return image_view<T>(this->plane(c), width, height, (size_t)width * Layout::step, Layout::step); }
+	image_view<const T> view(unsigned int c) const { return image_view<const T>(this->plane(c), width, height, (size_t)width * Layout::step, Layout::step); }
+	rgb_view<T> view() { return rgb_view<T>(view(0), view(1), view(2)); }
+	rgb_view<const T> view() const { return rgb_view<const T>(view(0), view(1), view(2)); }
+};
+
+///This will convert a sample to a float in [0, 1]
+///
+/// \param v the sample
+/// \param max_color_val the largest value an integer sample can take
+/// \return the normalized value
+///
+template <typename T>
+inline float sample_to_float(T v, unsigned int max_color_val) {
+	if (sample_traits<T>::is_integer)
+		return (float)v / (float)max_color_val;
+	return (float)v;
+}
+
+///This will convert a float in [0, 1] to a sample, rounding and clamping
+///integer samples
+///
+/// \param v the normalized value
+/// \param max_color_val the largest value an integer sample can take
+/// \return the sample
+///
+template <typename T>
+inline T float_to_sample(float v, unsigned int max_color_val) {
+	if (sample_traits<T>::is_integer) {
+		float s = v * (float)max_color_val + 0.5f;
+		s = std::min(std::max(s, 0.0f), (float)max_color_val);
+		return (T)(unsigned int)s;
+	}
+	return (T)v;
+}
+
+///This will initialize a PPM object to default values
+template <typename T, typename Layout>
+void ppm<T, Layout>::init() {
+	width = 0;
+	height = 0;
+	size = 0;
+	n_r = 0;
+	n_c = 0;
+	max_color_val = sample_traits<T>::is_integer ? std::min(sample_traits<T>::max(), 255u) : 255;
+}
+
+///This will create a PPM object
+template <typename T, typename Layout>
+ppm<T, Layout>::ppm() {
+	init();
+}
+
+///This will create a PPM object then fill it with data stored in the PPM file referenced as fileName
+///
+/// \param fileName the referenced PPM file
+///
+template <typename T, typename Layout>
+ppm<T, Layout>::ppm(const std::string &fileName) {
+	init();
+	read(fileName);
+}
+
+///This will create an "epmty" PPM image with a given width and height;
+///the  Red, Green, and Blue arrays are filled with zeros
+///
+/// \param _width the number of rows
+/// \param _height the number of columns
+///
+template <typename T, typename Layout>
+ppm<T, Layout>::ppm(const unsigned int _width, const unsigned int _height) {
+	init();
+	width = _width;
+	height = _height;
+	n_r = height;
+	n_c = width;
+	size = width * height;
+
+	// resize and fill r, g and b arrays with 0
+	this->allocate_zeroed(size);
+}
+
+///This will create a PPM image with a given width and height without
+///clearing the arrays, for images that are about to be overwritten
+///
+/// \param _width the number of columns
+/// \param _height the number of rows
+///
+template <typename T, typename Layout>
+ppm<T, Layout>::ppm(const unsigned int _width, const unsigned int _height, uninitialized_t) {
+	init();
+	width = _width;
+	height = _height;
+	n_r = height;
+	n_c = width;
+	size = width * height;
+	this->allocate(size);
+}
+
+///This will create a PPM image holding a copy of the pixels seen through a
+///view.  Use this only when the pixels have to outlive the viewed image,
+///kernels take views directly.
+///
+/// \param src the pixels to copy
+/// \param _max_color_val the maximum color value of the samples
+///
+template <typename T, typename Layout>
+ppm<T, Layout>::ppm(const rgb_view<const T> &src, unsigned int _max_color_val) {
+	init();
+	width = src.width();
+	height = src.height();
+	n_r = height;
+	n_c = width;
+	size = width * height;
+	max_color_val = _max_color_val;
+	this->allocate(size);
+	for (unsigned int c = 0; c < 3; ++c)
+		copy(src[c], view(c));
+	if (Layout::step == 4)
+		fill(image_view<T>(this->plane(0) + 3, width, height, (size_t)width * 4, 4),
+			sample_traits<T>::is_integer ? (T)max_color_val : (T)1.0f);
+}
+
+///This will return raw PPM sample j as an integer.  Two byte samples are
+///stored most significant byte first.
+///
+/// \param src the raw samples
+/// \param j the index of the sample
+/// \return the sample value
+///
+template <unsigned int BYTES>
+inline unsigned int raw_sample(const unsigned char *src, size_t j) {
+	return BYTES == 1 ? src[j] : ((unsigned int)src[2 * j] << 8) | src[2 * j + 1];
+}
+
+///This will split raw PPM samples into the channels of the image, in
+///parallel bands.  The sample width and the layout step are compile time
+///constants, so each combination gets its own loop.
+///
+/// \param src the raw samples, three per pixel, BYTES bytes each
+/// \param dst the image
+/// \param count the number of pixels to copy
+/// \param offset the index of the first pixel
+///
+template <unsigned int BYTES, typename T, typename Layout>
+void deinterleave(const unsigned char *src, ppm<T, Layout> &dst, unsigned int count, unsigned int offset) {
+	const unsigned int step = Layout::step;
+	const float scale = 1.0f / (float)dst.max_color_val;
+	const T opaque = sample_traits<T>::is_integer ? (T)dst.max_color_val : (T)1.0f;
+	T *r = dst.plane(0) + (size_t)offset * step;
+	T *g = dst.plane(1) + (size_t)offset * step;
+	T *b = dst.plane(2) + (size_t)offset * step;
+	parallel_for(0, count, 16384, [&](unsigned int i0, unsigned int i1) {
+		for (unsigned int i = i0; i < i1; ++i) {
+			const unsigned int vr = raw_sample<BYTES>(src, 3 * (size_t)i + 0);
+			const unsigned int vg = raw_sample<BYTES>(src, 3 * (size_t)i + 1);
+			const unsigned int vb = raw_sample<BYTES>(src, 3 * (size_t)i + 2);
+			if (sample_traits<T>::is_integer) {
+				r[(size_t)i * step] = (T)vr;
+				g[(size_t)i * step] = (T)vg;
+				b[(size_t)i * step] = (T)vb;
+			}
+			else {
+				r[(size_t)i * step] = (T)(vr * scale);
+				g[(size_t)i * step] = (T)(vg * scale);
+				b[(size_t)i * step] = (T)(vb * scale);
+			}
+			//padded layouts get an opaque fourth sample
+			if (step == 4)
+				r[(size_t)i * step + 3] = opaque;
+		}
+	});
+}
+
+///This will read the PPM image from the PPM file referenced as fileName
+///If there are any errors in the format of the file errors are reported or
+///exceptions are thrown, and the image is left empty.
+///
+/// \param fileName the referenced PPM file
+///
+template <typename T, typename Layout>
+void ppm<T, Layout>::read(const std::string &fileName) {
+	//the header is only taken over once every check has passed
+	init();
+	std::ifstream input(fileName.c_str(), std::ios::in | std::ios::binary);
+	//Check to see if the file was opened, if it wasn't report an error.
+	if (input.is_open()) {
+		std::string line;
+		std::getline(input, line);
+		//If the first line doesn't contain "P6" report an error
+		if (line != "P6") {
+			std::cout << "Error. Unrecognized file format." << std::endl;
+			return;
+		}
+		std::getline(input, line);
+		while (!line.empty() && line[0] == '#') {
+			std::getline(input, line);
+		}
+		std::stringstream dimensions(line);
+		unsigned int file_width = 0, file_height = 0, file_max_color_val = 0;
+		//If the dimensions can't be obtained from the line catch the exception and report the error
+		try {
+			dimensions >> file_width;
+			dimensions >> file_height;
+		}
+		catch (std::exception &ex) {
+			std::cout << "Header file format error. " << ex.what() << std::endl;
+			return;
+		}
+		if (!dimensions || (unsigned long long)file_width * file_height > 0xffffffffull) {
+			std::cout << "Header file format error. Bad dimensions \"" << line << "\"" << std::endl;
+			return;
+		}
+		std::getline(input, line);
+		std::stringstream max_val(line);
+		//If the maximum color value can't be obtained from the line catch the exception and report the error
+		try {
+			max_val >> file_max_color_val;
+		}
+		catch (std::exception &ex) {
+			std::cout << "Header file format error. " << ex.what() << std::endl;
+			return;
+		}
+		//Integer samples have to be able to hold the maximum color value
+		if (!max_val || file_max_color_val == 0 || file_max_color_val > 65535 ||
+			(sample_traits<T>::is_integer && file_max_color_val > sample_traits<T>::max())) {
+			std::cout << "Error. Unsupported maximum color value " << file_max_color_val << std::endl;
+			return;
+		}
+		width = file_width;
+		height = file_height;
+		n_r = height;
+		n_c = width;
+		max_color_val = file_max_color_val;
+		size = width * height;
+		this->allocate(size);
+		//read and store color values from the input to the r, g, and b vectors arrays
+		//one chunk of rows at a time; values above 255 take two bytes, most
+		//significant byte first
+		const unsigned int bytes = max_color_val > 255 ? 2 : 1;
+		const unsigned int chunk_pixels = std::max(1u, (8u << 20) / (3 * bytes));
+		pixel_buffer<unsigned char> raw((size_t)std::min(size, chunk_pixels) * 3 * bytes, uninitialized);
+		for (unsigned int i = 0; i < size; i += chunk_pixels) {
+			unsigned int count = std::min(chunk_pixels, size - i);
+			input.read((char *)raw.data(), (std::streamsize)count * 3 * bytes);
+			if (bytes == 1)
+				deinterleave<1>(raw.data(), *this, count, i);
+			else
+				deinterleave<2>(raw.data(), *this, count, i);
+		}
+		if (!input) {
+			std::cout << "Error. " << fileName << " is truncated." << std::endl;
+			init();
+		}
+	}
+	else {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+	}
+	input.close();
+}
+
+///Size of the staging buffer used by the writers.  Pixels are converted
+///into this buffer and handed to the stream in large blocks, so writing is
+///bound by the disk rather than by per-byte stream calls.
+const unsigned int WRITE_CHUNK_SIZE = 1 << 20;
+
+///A small output helper that collects bytes in a fixed size chunk and
+///writes the chunk to the stream whenever it fills up.
+class chunk_writer {
+	std::ofstream &output;
+	pixel_buffer<char> chunk;
+	size_t used;
+
+public:
+	chunk_writer(std::ofstream &_output) : output(_output), chunk(WRITE_CHUNK_SIZE, uninitialized), used(0) {}
+	~chunk_writer() { flush(); }
+
+	//reserve n contiguous bytes in the chunk (n must not exceed WRITE_CHUNK_SIZE)
+	char *claim(size_t n) {
+		if (used + n > chunk.size())
+			flush();
+		char *dst = &chunk[used];
+		used += n;
+		return dst;
+	}
+	//append n bytes to the output
+	void put(const void *src, size_t n) {
+		const char *bytes = (const char *)src;
+		while (n > 0) {
+			if (used == chunk.size())
+				flush();
+			size_t count = std::min(n, chunk.size() - used);
+			std::copy(bytes, bytes + count, &chunk[used]);
+			used += count;
+			bytes += count;
+			n -= count;
+		}
+	}
+	//hand everything collected so far to the stream
+	void flush() {
+		if (used > 0)
+			output.write(&chunk[0], used);
+		used = 0;
+	}
+};
+
+//write floating point channels to a Radiance RGBE file
+void write_rgbe(const std::string &fileName, const rgb_view<const float> &src);
+//write floating point channels to a PFM file
+void write_pfm(const std::string &fileName, const rgb_view<const float> &src);
+
+///This will pack part of a row of a view into raw PPM samples
+///
+/// \param src the pixels
+/// \param x0 the first column
+/// \param y the row
+/// \param count the number of pixels
+/// \param max_color_val the maximum color value floating point samples are scaled to
+/// \param dst the raw output, three samples per pixel
+///
+template <unsigned int BYTES, typename T>
+void pack_row(const rgb_view<const T> &src, unsigned int x0, unsigned int y, unsigned int count,
+	unsigned int max_color_val, unsigned char *dst) {
+	for (unsigned int c = 0; c < 3; ++c) {
+		const T *in = &src[c](x0, y);
+		const unsigned int step = src[c].step;
+		for (unsigned int j = 0; j < count; ++j) {
+			T s = in[(size_t)j * step];
+			unsigned int v = sample_traits<T>::is_integer ? (unsigned int)s
+				: (unsigned int)float_to_sample<unsigned short>((float)s, max_color_val);
+			if (BYTES == 1) {
+				dst[3 * j + c] = (unsigned char)v;
+			}
+			else {
+				dst[2 * (3 * j + c) + 0] = (unsigned char)(v >> 8);
+				dst[2 * (3 * j + c) + 1] = (unsigned char)(v & 0xff);
+			}
+		}
+	}
+}
+
+///This will write the pixels seen through a view as raw PPM samples.  Whole
+///rows are packed into each chunk in parallel; rows too long for a chunk
+///are split.
+///
+/// \param writer the output
+/// \param src the pixels
+/// \param max_color_val the maximum color value
+///
+template <unsigned int BYTES, typename T>
+void write_ppm_samples(chunk_writer &writer, const rgb_view<const T> &src, unsigned int max_color_val) {
+	const unsigned int width = src.width();
+	const unsigned int height = src.height();
+	const size_t row_bytes = (size_t)3 * BYTES * width;
+	if (row_bytes == 0)
+		return;
+	if (row_bytes <= WRITE_CHUNK_SIZE) {
+		const unsigned int rows_per_chunk = (unsigned int)(WRITE_CHUNK_SIZE / row_bytes);
+		for (unsigned int y0 = 0; y0 < height; y0 += rows_per_chunk) {
+			const unsigned int rows = std::min(rows_per_chunk, height - y0);
+			unsigned char *dst = (unsigned char *)writer.claim(rows * row_bytes);
+			parallel_for(0, rows, std::max(1u, 16384 / width), [&](unsigned int r0, unsigned int r1) {
+				for (unsigned int r = r0; r < r1; ++r)
+					pack_row<BYTES>(src, 0, y0 + r, width, max_color_val, dst + r * row_bytes);
+			});
+		}
+		return;
+	}
+	const unsigned int pixels_per_chunk = WRITE_CHUNK_SIZE / (3 * BYTES);
+	for (unsigned int y = 0; y < height; ++y) {
+		for (unsigned int x0 = 0; x0 < width; x0 += pixels_per_chunk) {
+			const unsigned int count = std::min(pixels_per_chunk, width - x0);
+			unsigned char *dst = (unsigned char *)writer.claim((size_t)3 * BYTES * count);
+			parallel_for(0, count, 16384, [&](unsigned int j0, unsigned int j1) {
+				pack_row<BYTES>(src, x0 + j0, y, j1 - j0, max_color_val, dst + (size_t)3 * BYTES * j0);
+			});
+		}
+	}
+}
+
+///This will write the pixels seen through a view to the PPM file referenced
+///as fileName.  Floating point samples are quantized to max_color_val.
+///
+/// \param fileName the referenced PPM file
+/// \param src the pixels to write
+/// \param max_color_val the maximum color value written to the header
+///
+template <typename T>
+void write_ppm(const std::string &fileName, const rgb_view<const T> &src, unsigned int max_color_val) {
+	std::ofstream output(fileName.c_str(), std::ios::out | std::ios::binary);
+	//Check to see if the file was opened, if it wasn't report an error.
+	if (!output.is_open()) {
+		std::cout << "Error. Unable to open " << fileName << std::endl;
+		return;
+	}
+	output << "P6\n" << src.width() << " " << src.height() << "\n" << max_color_val << "\n";
+	{
+		chunk_writer writer(output);
+		if (max_color_val > 255)
+			write_ppm_samples<2>(writer, src, max_color_val);
+		else
+			write_ppm_samples<1>(writer, src, max_color_val);
+	}
+	if (!output) {
+		std::cout << "Error. Unable to write " << fileName << std::endl;
+	}
+	output.close();
+}
+
+///This will write the PPM image to the PPM file referenced as fileName.
+///
+/// \param fileName the referenced PPM file
+///
+template <typename T, typename Layout>
+void ppm<T, Layout>::write(const std::string &fileName) const {
+	write_ppm(fileName, view(), max_color_val);
+}
+
+///This will copy the image into a float planar image with values in [0, 1]
+///
+/// \param img the image
+/// \return the float copy
+///
+template <typename T, typename Layout>
+ppm<float> to_float(const ppm<T, Layout> &img) {
+	ppm<float> out(img.width, img.height, uninitialized);
+	parallel_for(0, img.size, 16384, [&](unsigned int i0, unsigned int i1) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			const T *src = img.plane(c);
+			float *dst = out.plane(c);
+			for (unsigned int i = i0; i < i1; ++i)
+				dst[i] = sample_to_float(src[(size_t)i * Layout::step], img.max_color_val);
+		}
+	});
+	return out;
+}
+
+///This will write the image to a Radiance RGBE (.hdr) file
+///
+/// \param fileName the referenced HDR file
+///
+template <typename T, typename Layout>
+void ppm<T, Layout>::write_rgbe(const std::string &fileName) const {
+	::write_rgbe(fileName, to_float(*this).view());
+}
+
+///This will write the image to a PFM file
+///
+/// \param fileName the referenced PFM file
+///
+template <typename T, typename Layout>
+void ppm<T, Layout>::write_pfm(const std::string &fileName) const {
+	::write_pfm(fileName, to_float(*this).view());
+}
+
+///Floating point planar images already hold float planes and are written
+///without a copy
+template <>
+inline void ppm<float, planar>::write_rgbe(const std::string &fileName) const {
+	::write_rgbe(fileName, view());
+}
+
+template <>
+inline void ppm<float, planar>::write_pfm(const std::string &fileName) const {
+	::write_pfm(fileName, view());
+}
+
+///This will return channel c of pixel i scaled to [0, 1]
+///
+/// \param c the channel (0 red, 1 green, 2 blue)
+/// \param i the pixel index
+/// \return the normalized value
+///
+template <typename T, typename Layout>
+float ppm<T, Layout>::normalized(unsigned int c, unsigned int i) const {
+	return sample_to_float(this->plane(c)[(size_t)i * Layout::step], max_color_val);
+}
+
+///This will set channel c of pixel i from a value in [0, 1]
+///
+/// \param c the channel (0 red, 1 green, 2 blue)
+/// \param i the pixel index
+/// \param v the normalized value
+///
+template <typename T, typename Layout>
+void ppm<T, Layout>::set_normalized(unsigned int c, unsigned int i, float v) {
+	this->plane(c)[(size_t)i * Layout::step] = float_to_sample<T>(v, max_color_val);
+}
+
+///This will convert an image to another sample type and/or layout.
+///Integer destinations keep the maximum color value of integer sources
+///when it fits.
+///
+/// \param src the image to convert
+/// \param dst the converted image
+///
+template <typename S, typename SL, typename T, typename TL>
+void convert(const ppm<S, SL> &src, ppm<T, TL> &dst) {
+	dst = ppm<T, TL>(src.width, src.height, uninitialized);
+	if (sample_traits<T>::is_integer) {
+		dst.max_color_val = sample_traits<S>::is_integer && src.max_color_val <= sample_traits<T>::max()
+			? src.max_color_val : std::min(sample_traits<T>::max(), 255u);
+	}
+	else {
+		dst.max_color_val = src.max_color_val;
+	}
+	const bool same_range = sample_traits<S>::is_integer == sample_traits<T>::is_integer
+		&& src.max_color_val == dst.max_color_val;
+	const T opaque = sample_traits<T>::is_integer ? (T)dst.max_color_val : (T)1.0f;
+	parallel_for(0, src.size, 16384, [&](unsigned int i0, unsigned int i1) {
+		for (unsigned int c = 0; c < 3; ++c) {
+			const S *in = src.plane(c);
+			T *out = dst.plane(c);
+			for (unsigned int i = i0; i < i1; ++i) {
+				if (same_range)
+					out[(size_t)i * TL::step] = (T)(float)in[(size_t)i * SL::step];
+				else
+					out[(size_t)i * TL::step] = float_to_sample<T>(sample_to_float(in[(size_t)i * SL::step], src.max_color_val), dst.max_color_val);
+			}
+		}
+		if (TL::step == 4) {
+			for (unsigned int i = i0; i < i1; ++i)
+				dst.plane(0)[(size_t)i * 4 + 3] = opaque;
+		}
+	});
+}
+
+#endif
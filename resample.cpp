@@ -0,0 +1,457 @@
+///
+/// \file resample.cpp
+/// \brief Separable image resampling (box, bilinear, bicubic, Lanczos)
+///
+
+#include "resample.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+//fractional bits of the fixed-point weights; a weight of 1 is 1 << WEIGHT_BITS
+static const int WEIGHT_BITS = 14;
+//fractional bits the 16-bit intermediate of 8-bit planes keeps, so the
+//overshoot of the cubic and Lanczos filters survives between the passes
+static const int MID_BITS = 6;
+//the horizontal 8-bit taps are padded to a multiple of this for the vector loop
+static const unsigned int HORIZONTAL_TAP_PAD = 16;
+
+static double filter_box(double x) {
+	return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+}
+
+static double filter_triangle(double x) {
+	x = std::fabs(x);
+	return x < 1.0 ? 1.0 - x : 0.0;
+}
+
+static double filter_cubic(double x) {
+	const double a = -0.5;
+	x = std::fabs(x);
+	if (x < 1.0)
+		return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+	if (x < 2.0)
+		return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+	return 0.0;
+}
+
+static double sinc(double x) {
+	if (x == 0.0)
+		return 1.0;
+	x *= 3.14159265358979323846;
+	return std::sin(x) / x;
+}
+
+static double filter_lanczos3(double x) {
+	return x > -3.0 && x < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+}
+
+///The taps of one pass: output i reads inputs start[i] to start[i] + count[i]
+///with the weights in row i of weights (and fixed).  Every row of weights
+///holds taps entries, zero past count.
+struct resample_weights {
+	std::vector<unsigned int> start;
+	std::vector<unsigned int> count;
+	unsigned int taps;
+	//true if count[i] == taps for every output and the reads stay inside the input
+	bool padded;
+	std::vector<float> weights;
+	std::vector<int16_t> fixed;
+
+	resample_weights(unsigned int in_size, unsigned int out_size, resample_filter filter, unsigned int pad);
+};
+
+///This will compute the taps of one pass.  The filter is stretched by the
+///scale factor when shrinking so it covers every input; taps falling off
+///the edges are dropped and the rest renormalized.
+///
+/// \param in_size the number of input samples
+/// \param out_size the number of output samples
+/// \param filter the reconstruction filter
+/// \param pad round the taps up to a multiple of pad, moving windows that
+///would then read past the end back inside the input
+///
+resample_weights::resample_weights(unsigned int in_size, unsigned int out_size, resample_filter filter, unsigned int pad)
+	: start(out_size), count(out_size), taps(0), padded(false) {
+	double (*fn)(double) = filter_cubic;
+	double support = 2.0;
+	if (filter == resample_box) {
+		fn = filter_box;
+		support = 0.5;
+	}
+	else if (filter == resample_bilinear) {
+		fn = filter_triangle;
+		support = 1.0;
+	}
+	else if (filter == resample_lanczos3) {
+		fn = filter_lanczos3;
+		support = 3.0;
+	}
+	const double scale = (double)in_size / out_size;
+	const double stretch = std::max(scale, 1.0);
+	support *= stretch;
+	const unsigned int max_count = std::min((unsigned int)std::ceil(support) * 2 + 1, in_size);
+	taps = (max_count + pad - 1) / pad * pad;
+	padded = pad > 1 && taps <= in_size;
+	if (!padded)
+		taps = max_count;
+	weights.assign((size_t)out_size * taps, 0.0f);
+	fixed.assign((size_t)out_size * taps, 0);
+
+	for (unsigned int i = 0; i < out_size; ++i) {
+		const double center = (i + 0.5) * scale;
+		const int lo = std::max((int)(center - support + 0.5), 0);
+		const int hi = std::min((int)(center + support + 0.5), (int)in_size);
+		const unsigned int n = (unsigned int)std::max(std::min(hi - lo, (int)max_count), 1);
+		std::vector<double> w(n);
+		double total = 0.0;
+		for (unsigned int k = 0; k < n; ++k) {
+			w[k] = fn((lo + k - center + 0.5) / stretch);
+			total += w[k];
+		}
+		//a box narrower than the input spacing can fall between two samples, its
+		//only tap sitting on the open end of the interval; take the nearest sample
+		if (total == 0.0) {
+			unsigned int nearest = 0;
+			for (unsigned int k = 1; k < n; ++k)
+				if (std::fabs(lo + k - center + 0.5) < std::fabs(lo + nearest - center + 0.5))
+					nearest = k;
+			w[nearest] = total = 1.0;
+		}
+		start[i] = (unsigned int)lo;
+		count[i] = n;
+		unsigned int offset = 0;
+		if (padded) {
+			if (start[i] + taps > in_size) {
+				offset = start[i] + taps - in_size;
+				start[i] = in_size - taps;
+			}
+			count[i] = taps;
+		}
+		float *row = &weights[(size_t)i * taps + offset];
+		int16_t *fixed_row = &fixed[(size_t)i * taps + offset];
+		for (unsigned int k = 0; k < n; ++k) {
+			row[k] = (float)(w[k] / total);
+			fixed_row[k] = (int16_t)std::floor(row[k] * (1 << WEIGHT_BITS) + 0.5f);
+		}
+	}
+}
+
+///This will turn a fixed-point sum of 8-bit samples into an 8-bit sample,
+///rounding and clamping
+static inline void store_fixed(int sum, unsigned char &out) {
+	sum = (sum + (1 << (WEIGHT_BITS - 1))) >> WEIGHT_BITS;
+	out = (unsigned char)(sum < 0 ? 0 : (sum > 255 ? 255 : sum));
+}
+///This will turn a fixed-point sum of 8-bit samples into an intermediate
+///sample with MID_BITS fractional bits
+static inline void store_fixed(int sum, int16_t &out) {
+	sum = (sum + (1 << (WEIGHT_BITS - MID_BITS - 1))) >> (WEIGHT_BITS - MID_BITS);
+	out = (int16_t)(sum < -32768 ? -32768 : (sum > 32767 ? 32767 : sum));
+}
+
+//fractional bits of an input sample of the vertical pass
+static inline int fraction_bits(const unsigned char *) {
+	return 0;
+}
+static inline int fraction_bits(const int16_t *) {
+	return MID_BITS;
+}
+
+#if defined(__AVX2__)
+///This will load 16 samples of the vertical pass as 16-bit integers
+static inline __m256i load16(const unsigned char *p) {
+	return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+}
+static inline __m256i load16(const int16_t *p) {
+	return _mm256_loadu_si256((const __m256i *)p);
+}
+#endif
+
+///This will resample one dense 8-bit row horizontally
+///
+/// \param in the input row
+/// \param out the first output sample, 8-bit or intermediate
+/// \param step the number of samples between two outputs
+/// \param w the taps
+///
+template <typename O>
+static void horizontal_row(const unsigned char *in, O *out, size_t step, const resample_weights &w) {
+	const unsigned int n = (unsigned int)w.start.size();
+	for (unsigned int x = 0; x < n; ++x) {
+		const unsigned char *p = in + w.start[x];
+		const int16_t *wt = &w.fixed[(size_t)x * w.taps];
+		int sum = 0;
+#if defined(__AVX2__)
+		if (w.padded) {
+			__m256i acc = _mm256_setzero_si256();
+			for (unsigned int t = 0; t < w.taps; t += 16) {
+				const __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + t)));
+				acc = _mm256_add_epi32(acc, _mm256_madd_epi16(v, _mm256_loadu_si256((const __m256i *)(wt + t))));
+			}
+			__m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+			s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+			sum = _mm_cvtsi128_si32(s);
+		}
+		else
+#endif
+		{
+			for (unsigned int t = 0; t < w.count[x]; ++t)
+				sum += p[t] * wt[t];
+		}
+		store_fixed(sum, out[(size_t)x * step]);
+	}
+}
+
+///This will resample one dense float row horizontally
+///
+/// \param in the input row
+/// \param out the first output sample
+/// \param step the number of samples between two outputs
+/// \param w the taps
+///
+static void horizontal_row(const float *in, float *out, size_t step, const resample_weights &w) {
+	const unsigned int n = (unsigned int)w.start.size();
+	for (unsigned int x = 0; x < n; ++x) {
+		const float *p = in + w.start[x];
+		const float *wt = &w.weights[(size_t)x * w.taps];
+		float sum = 0.0f;
+		for (unsigned int t = 0; t < w.count[x]; ++t)
+			sum += p[t] * wt[t];
+		out[(size_t)x * step] = sum;
+	}
+}
+
+///This will compute one output row of the vertical pass over 8-bit or
+///intermediate rows
+///
+/// \param mid the horizontally resampled plane
+/// \param w the taps
+/// \param y the output row
+/// \param out the dense output row, mid.width samples
+///
+template <typename S>
+static void vertical_row(const image_view<const S> &mid, const resample_weights &w, unsigned int y,
+	unsigned char *out) {
+	const unsigned int width = mid.width;
+	const unsigned int n = w.count[y];
+	const int16_t *wt = &w.fixed[(size_t)y * w.taps];
+	const int shift = fraction_bits((const S *)0);
+	const S *rows[64];
+	std::vector<const S *> more;
+	const S **r = rows;
+	if (n > 64) {
+		more.resize(n);
+		r = more.data();
+	}
+	for (unsigned int j = 0; j < n; ++j)
+		r[j] = mid.row(w.start[y] + j);
+	unsigned int x = 0;
+#if defined(__AVX2__)
+	if (mid.dense()) {
+		const __m256i round = _mm256_set1_epi32(1 << (WEIGHT_BITS + shift - 1));
+		for (; x + 16 <= width; x += 16) {
+			__m256i lo = round, hi = round;
+			//rows go in pairs: interleaved 16-bit samples times a (w0, w1) pair sum both rows in one madd
+			for (unsigned int j = 0; j < n; j += 2) {
+				const __m256i a = load16(r[j] + x);
+				const __m256i b = j + 1 < n ? load16(r[j + 1] + x) : _mm256_setzero_si256();
+				const int w1 = j + 1 < n ? wt[j + 1] : 0;
+				const __m256i pair = _mm256_set1_epi32((int)(((uint32_t)(uint16_t)w1 << 16) | (uint16_t)wt[j]));
+				lo = _mm256_add_epi32(lo, _mm256_madd_epi16(_mm256_unpacklo_epi16(a, b), pair));
+				hi = _mm256_add_epi32(hi, _mm256_madd_epi16(_mm256_unpackhi_epi16(a, b), pair));
+			}
+			const __m128i count = _mm_cvtsi32_si128(WEIGHT_BITS + shift);
+			lo = _mm256_sra_epi32(lo, count);
+			hi = _mm256_sra_epi32(hi, count);
+			//the unpacks and packs both work within 128-bit lanes, so the samples come back in order
+			const __m256i words = _mm256_packs_epi32(lo, hi);
+			const __m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0xD8);
+			_mm_storeu_si128((__m128i *)(out + x), _mm256_castsi256_si128(bytes));
+		}
+	}
+#endif
+	for (; x < width; ++x) {
+		int sum = 0;
+		for (unsigned int j = 0; j < n; ++j)
+			sum += r[j][(size_t)x * mid.step] * wt[j];
+		sum = (sum + (1 << (WEIGHT_BITS + shift - 1))) >> (WEIGHT_BITS + shift);
+		out[x] = (unsigned char)(sum < 0 ? 0 : (sum > 255 ? 255 : sum));
+	}
+}
+
+///This will compute one output row of the vertical pass over float rows
+///
+/// \param mid the horizontally resampled plane
+/// \param w the taps
+/// \param y the output row
+/// \param out the dense output row, mid.width samples
+///
+static void vertical_row(const image_view<const float> &mid, const resample_weights &w, unsigned int y, float *out) {
+	const unsigned int width = mid.width;
+	const float *wt = &w.weights[(size_t)y * w.taps];
+	std::fill(out, out + width, 0.0f);
+	for (unsigned int j = 0; j < w.count[y]; ++j) {
+		const float *row = mid.row(w.start[y] + j);
+		const float k = wt[j];
+		if (mid.dense()) {
+			for (unsigned int x = 0; x < width; ++x)
+				out[x] += k * row[x];
+		}
+		else {
+			for (unsigned int x = 0; x < width; ++x)
+				out[x] += k * row[(size_t)x * mid.step];
+		}
+	}
+}
+
+///This will run the vertical pass over a plane
+///
+/// \param mid the plane, horizontally resampled already or not at all
+/// \param rows the taps
+/// \param out the output plane
+///
+template <typename S, typename T>
+static void vertical_pass(const image_view<const S> &mid, const resample_weights &rows, const image_view<T> &out) {
+	const unsigned int width = out.width;
+	parallel_for(0, out.height, 8, [&](unsigned int y0, unsigned int y1) {
+		pixel_buffer<T> dense;
+		if (!out.dense())
+			dense.resize(width);
+		for (unsigned int y = y0; y < y1; ++y) {
+			T *row = out.dense() ? out.row(y) : dense.data();
+			vertical_row(mid, rows, y, row);
+			if (!out.dense()) {
+				T *o = out.row(y);
+				for (unsigned int x = 0; x < width; ++x)
+					o[(size_t)x * out.step] = row[x];
+			}
+		}
+	});
+}
+
+//the sample type of the plane between the two passes
+template <typename T>
+struct resample_intermediate {
+	typedef T type;
+};
+template <>
+struct resample_intermediate<unsigned char> {
+	typedef int16_t type;
+};
+
+///This will resize planes of one size to another size with shared tables
+///
+/// \param src the planes to resize
+/// \param dst the resized planes
+/// \param planes the number of planes
+/// \param filter the reconstruction filter
+///
+template <typename T>
+static void resample_planes(const image_view<const T> *src, const image_view<T> *dst, unsigned int planes,
+	resample_filter filter) {
+	if (planes == 0 || src[0].empty() || dst[0].empty())
+		return;
+	const unsigned int src_w = src[0].width, src_h = src[0].height;
+	const unsigned int dst_w = dst[0].width, dst_h = dst[0].height;
+	const bool horizontal = src_w != dst_w;
+	const bool vertical = src_h != dst_h;
+	if (!horizontal && !vertical) {
+		for (unsigned int c = 0; c < planes; ++c)
+			copy(src[c], dst[c]);
+		return;
+	}
+	const resample_weights columns(src_w, dst_w, filter, sizeof(T) == 1 ? HORIZONTAL_TAP_PAD : 1);
+	const resample_weights rows(src_h, dst_h, filter, 1);
+	typedef typename resample_intermediate<T>::type M;
+
+	for (unsigned int c = 0; c < planes; ++c) {
+		const image_view<const T> &in = src[c];
+		if (!vertical) {
+			parallel_for(0, src_h, 8, [&](unsigned int y0, unsigned int y1) {
+				pixel_buffer<T> gathered;
+				if (!in.dense())
+					gathered.resize(src_w);
+				for (unsigned int y = y0; y < y1; ++y) {
+					const T *row = in.row(y);
+					if (!in.dense()) {
+						for (unsigned int x = 0; x < src_w; ++x)
+							gathered[x] = row[(size_t)x * in.step];
+						row = gathered.data();
+					}
+					horizontal_row(row, dst[c].row(y), dst[c].step, columns);
+				}
+			});
+		}
+		else if (!horizontal)
+			vertical_pass(in, rows, dst[c]);
+		else {
+			pixel_buffer<M> mid_buffer((size_t)dst_w * src_h, uninitialized);
+			const image_view<M> mid(mid_buffer.data(), dst_w, src_h, dst_w);
+			parallel_for(0, src_h, 8, [&](unsigned int y0, unsigned int y1) {
+				pixel_buffer<T> gathered;
+				if (!in.dense())
+					gathered.resize(src_w);
+				for (unsigned int y = y0; y < y1; ++y) {
+					const T *row = in.row(y);
+					if (!in.dense()) {
+						for (unsigned int x = 0; x < src_w; ++x)
+							gathered[x] = row[(size_t)x * in.step];
+						row = gathered.data();
+					}
+					horizontal_row(row, mid.row(y), 1, columns);
+				}
+			});
+			vertical_pass(image_view<const M>(mid), rows, dst[c]);
+		}
+	}
+}
+
+///This will resize an 8-bit plane
+///
+/// \param src the plane to resize
+/// \param dst the resized plane, not overlapping src
+/// \param filter the reconstruction filter
+///
+void resample(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst, resample_filter filter) {
+	resample_planes(&src, &dst, 1, filter);
+}
+
+///This will resize a float plane
+///
+/// \param src the plane to resize
+/// \param dst the resized plane, not overlapping src
+/// \param filter the reconstruction filter
+///
+void resample(const image_view<const float> &src, const image_view<float> &dst, resample_filter filter) {
+	resample_planes(&src, &dst, 1, filter);
+}
+
+///This will resize the three channels of an 8-bit image
+///
+/// \param src the image to resize
+/// \param dst the resized image, not overlapping src
+/// \param filter the reconstruction filter
+///
+void resample(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst, resample_filter filter) {
+	resample_planes(src.planes, dst.planes, 3, filter);
+}
+
+///This will resize the three channels of a float image
+///
+/// \param src the image to resize
+/// \param dst the resized image, not overlapping src
+/// \param filter the reconstruction filter
+///
+void resample(const rgb_view<const float> &src, const rgb_view<float> &dst, resample_filter filter) {
+	resample_planes(src.planes, dst.planes, 3, filter);
+}
@@ -0,0 +1,42 @@
+///
+/// \file resample.h
+/// \brief Separable image resampling (box, bilinear, bicubic, Lanczos)
+///
+/// Resizing runs as a horizontal pass into an intermediate plane followed by
+/// a vertical pass.  For every output column (and row) the taps and their
+/// weights are computed once up front, widened by the scale factor when
+/// shrinking so every input sample contributes.  8-bit planes use 14-bit
+/// fixed-point weights and AVX2 multiply-add of 16-bit pairs; float planes
+/// use the float weights.  Rows are spread over the thread pool.
+///
+
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include "image_view.h"
+
+//the reconstruction filter of a resize
+enum resample_filter {
+	//area average; the mean of the inputs under each output pixel
+	resample_box,
+	//triangle, 1 tap each way at scale 1
+	resample_bilinear,
+	//Keys cubic with a = -0.5 (Catmull-Rom), 2 taps each way
+	resample_bicubic,
+	//windowed sinc, 3 taps each way
+	resample_lanczos3
+};
+
+//resize src into dst; the scale is dst's size over src's, and the views must not overlap
+void resample(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	resample_filter filter = resample_bicubic);
+void resample(const image_view<const float> &src, const image_view<float> &dst,
+	resample_filter filter = resample_bicubic);
+
+//the same for all three channels, sharing the weight tables
+void resample(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	resample_filter filter = resample_bicubic);
+void resample(const rgb_view<const float> &src, const rgb_view<float> &dst,
+	resample_filter filter = resample_bicubic);
+
+#endif
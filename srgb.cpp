@@ -0,0 +1,211 @@
+///
+/// \file srgb.cpp
+/// \brief Conversion of 8-bit sRGB samples to and from linear light
+///
+
+#include "srgb.h"
+#include "thread_pool.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+///This will return y^n for a small whole n
+static constexpr double power(double y, int n) {
+	return n == 0 ? 1.0 : y * power(y, n - 1);
+}
+
+///This will finish root(): step from y, whose next iterate is next, until
+///rounding stops the iterates from falling
+static constexpr double root_from(double a, int n, double y, double next) {
+	return next >= y ? y : root_from(a, n, next, ((n - 1) * next + a / power(next, n - 1)) / n);
+}
+
+///This will return the nth root of a by Newton's method, starting from 1
+///above the root so the iterates fall monotonically onto it.  C++11
+///constexpr functions are a single return, hence the recursion.
+///
+/// \param a the value, in (0, 1]
+/// \param n the root
+/// \return the root
+///
+static constexpr double root(double a, int n) {
+	return root_from(a, n, 1.0, ((n - 1) + a) / n);
+}
+
+///This will return x^2.4 as x^2 (x^2)^(1/5), which needs no pow()
+static constexpr double power_2_4(double x) {
+	return x * x * root(x * x, 5);
+}
+
+///This will decode an sRGB value in [0, 1] exactly
+static constexpr double decode(double v) {
+	return v <= 0.04045 ? v / 12.92 : power_2_4((v + 0.055) / 1.055);
+}
+
+///This will encode a linear intensity in [0, 1] exactly, x^(1/2.4) being (x^(1/12))^5
+static constexpr double encode(double x) {
+	return x <= 0.0031308 ? 12.92 * x : 1.055 * power(root(x, 12), 5) - 0.055;
+}
+
+//a pack of the indices 0 to n - 1, for generating the table one entry per index
+template <unsigned int... I>
+struct index_list {};
+template <unsigned int N, unsigned int... I>
+struct make_index_list : make_index_list<N - 1, N - 1, I...> {};
+template <unsigned int... I>
+struct make_index_list<0, I...> {
+	typedef index_list<I...> type;
+};
+
+template <unsigned int... I>
+static constexpr srgb_table make_decode_table(index_list<I...>) {
+	return srgb_table{ { (float)decode(I / 255.0)... } };
+}
+
+constexpr srgb_table SRGB_TO_LINEAR = make_decode_table(make_index_list<256>::type());
+static_assert(SRGB_TO_LINEAR.values[0] == 0.0f && SRGB_TO_LINEAR.values[255] == 1.0f, "sRGB table endpoints");
+
+//The piece of x is the 3 bits above t in ((bits of x) - (bits of 2^-13)) >> 20, 8 pieces per
+//power of two, and t, the next 8 bits, places x in one of 256 buckets across its piece.  The
+//fit of each piece is a line in t against 255 encode(x) + 0.5, so the integer part of the line
+//is the rounded encoding.  Its slope is that of the chord across the piece; the curve is concave,
+//so the chord lies below it and the curve rises furthest above a line of that slope at one
+//point, found by ternary search, and the line is put midway.  A line held over a bucket also
+//misses the rise of the curve across the bucket, one slope's worth, which the midpoint takes in.
+//Over every float of [2^-13, 1) the result is within 0.56 of a level of the exact encoding.
+
+///This will return 255 encode(x) + 0.5 for the x at bucket position s of a piece
+///
+/// \param piece the piece, 0 to 103
+/// \param s the position, 0 at the start of the piece and 256 at its end
+/// \return the level
+///
+static constexpr double fit_level(unsigned int piece, double s) {
+	return 255.0 * encode(power(2.0, (int)(piece >> 3)) / 8192.0 * (1.0 + ((piece & 7) * 256 + s) / 2048.0)) + 0.5;
+}
+
+///This will return how far the curve of a piece rises above a line of a slope
+static constexpr double fit_rise(unsigned int piece, double s, double slope) {
+	return fit_level(piece, s) - slope * s;
+}
+
+///This will return the largest rise of the curve of a piece above a line of a
+///slope by ternary search over the positions lo to hi
+static constexpr double fit_peak(unsigned int piece, double slope, double lo, double hi, int steps) {
+	return steps == 0 ? fit_rise(piece, lo, slope)
+		: fit_rise(piece, lo + (hi - lo) / 3.0, slope) < fit_rise(piece, hi - (hi - lo) / 3.0, slope)
+		? fit_peak(piece, slope, lo + (hi - lo) / 3.0, hi, steps - 1)
+		: fit_peak(piece, slope, lo, hi - (hi - lo) / 3.0, steps - 1);
+}
+
+///This will return the fixed-point slope of a piece, the chord of its curve
+static constexpr uint32_t fit_scale(unsigned int piece) {
+	return (uint32_t)((fit_level(piece, 256.0) - fit_level(piece, 0.0)) / 256.0 * 65536.0 + 0.5);
+}
+
+///This will return the fixed-point bias of a piece: the midpoint between the
+///lowest and highest rise of the curve above its line, the highest lifted by
+///the slope the line misses across a bucket
+static constexpr uint32_t fit_bias(unsigned int piece, double slope) {
+	return (uint32_t)(64.0 * (fit_peak(piece, slope, 0.0, 256.0, 24) + slope +
+		(fit_rise(piece, 0.0, slope) < fit_rise(piece, 256.0, slope) ? fit_rise(piece, 0.0, slope)
+		: fit_rise(piece, 256.0, slope))) + 0.5);
+}
+
+static constexpr uint32_t make_fit(unsigned int piece, uint32_t scale) {
+	return fit_bias(piece, scale / 65536.0) << 16 | scale;
+}
+
+template <unsigned int... I>
+static constexpr srgb_fit make_fit_table(index_list<I...>) {
+	return srgb_fit{ { make_fit(I, fit_scale(I))... } };
+}
+
+constexpr srgb_fit LINEAR_TO_SRGB_FIT = make_fit_table(make_index_list<104>::type());
+static_assert(((LINEAR_TO_SRGB_FIT.pieces[0] >> 16) << 9) >> 16 == 0 &&
+	(((LINEAR_TO_SRGB_FIT.pieces[103] >> 16) << 9) + (LINEAR_TO_SRGB_FIT.pieces[103] & 0xffff) * 255) >> 16 == 255,
+	"sRGB fit endpoints");
+
+#if defined(__AVX2__)
+///This will encode 8 linear intensities as sRGB samples
+///
+/// \param v the intensities
+/// \param out the 8 samples
+///
+static inline void encode8(__m256 v, unsigned char *out) {
+	v = _mm256_max_ps(v, _mm256_set1_ps(1.0f / 8192.0f));
+	v = _mm256_min_ps(v, _mm256_set1_ps(0.99999994f));
+	const __m256i bits = _mm256_castps_si256(v);
+	const __m256i piece = _mm256_srli_epi32(_mm256_sub_epi32(bits, _mm256_set1_epi32((127 - 13) << 23)), 20);
+	const __m256i fit = _mm256_i32gather_epi32((const int *)LINEAR_TO_SRGB_FIT.pieces, piece, 4);
+	const __m256i bias = _mm256_slli_epi32(_mm256_srli_epi32(fit, 16), 9);
+	const __m256i scale = _mm256_and_si256(fit, _mm256_set1_epi32(0xffff));
+	const __m256i t = _mm256_and_si256(_mm256_srli_epi32(bits, 12), _mm256_set1_epi32(0xff));
+	const __m256i s = _mm256_srli_epi32(_mm256_add_epi32(bias, _mm256_mullo_epi32(scale, t)), 16);
+	//the packs work within 128-bit lanes: samples 0-3 end up in the low lane, 4-7 in the high one
+	const __m256i words = _mm256_packus_epi32(s, s);
+	const __m256i bytes = _mm256_packus_epi16(words, words);
+	const __m128i joined = _mm_unpacklo_epi32(_mm256_castsi256_si128(bytes), _mm256_extracti128_si256(bytes, 1));
+	_mm_storel_epi64((__m128i *)out, joined);
+}
+#endif
+
+///This will decode an 8-bit sRGB plane to linear intensities
+///
+/// \param src the sRGB plane
+/// \param dst the linear plane, the size of src
+///
+void srgb_to_linear(const image_view<const unsigned char> &src, const image_view<float> &dst) {
+	parallel_for(0, src.height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const unsigned char *in = src.row(y);
+			float *out = dst.row(y);
+			for (unsigned int x = 0; x < src.width; ++x)
+				out[(size_t)x * dst.step] = SRGB_TO_LINEAR.values[in[(size_t)x * src.step]];
+		}
+	});
+}
+
+///This will encode linear intensities as an 8-bit sRGB plane
+///
+/// \param src the linear plane; values outside [0, 1] are clamped
+/// \param dst the sRGB plane, the size of src
+///
+void linear_to_srgb(const image_view<const float> &src, const image_view<unsigned char> &dst) {
+	parallel_for(0, src.height, 16, [&](unsigned int y0, unsigned int y1) {
+		for (unsigned int y = y0; y < y1; ++y) {
+			const float *in = src.row(y);
+			unsigned char *out = dst.row(y);
+			unsigned int x = 0;
+#if defined(__AVX2__)
+			if (src.dense() && dst.dense()) {
+				for (; x + 8 <= src.width; x += 8)
+					encode8(_mm256_loadu_ps(in + x), out + x);
+			}
+#endif
+			for (; x < src.width; ++x)
+				out[(size_t)x * dst.step] = linear_to_srgb(in[(size_t)x * src.step]);
+		}
+	});
+}
+
+///This will decode the three channels of an 8-bit sRGB image
+///
+/// \param src the sRGB image
+/// \param dst the linear image, the size of src
+///
+void srgb_to_linear(const rgb_view<const unsigned char> &src, const rgb_view<float> &dst) {
+	for (unsigned int c = 0; c < 3; ++c)
+		srgb_to_linear(src[c], dst[c]);
+}
+
+///This will encode the three channels of a linear image as 8-bit sRGB
+///
+/// \param src the linear image
+/// \param dst the sRGB image, the size of src
+///
+void linear_to_srgb(const rgb_view<const float> &src, const rgb_view<unsigned char> &dst) {
+	for (unsigned int c = 0; c < 3; ++c)
+		linear_to_srgb(src[c], dst[c]);
+}
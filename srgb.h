@@ -0,0 +1,76 @@
+///
+/// \file srgb.h
+/// \brief Conversion of 8-bit sRGB samples to and from linear light
+///
+/// Filters that average samples (blurs, resampling, blending) are only
+/// physically right on linear intensities, while 8-bit images store the
+/// sRGB encoding of them.  Decoding looks each of the 256 codes up in a
+/// table the compiler generates.  Encoding splits the float range [2^-13, 1)
+/// into 104 pieces by exponent and top mantissa bits and evaluates a linear
+/// fit of the curve on each piece in fixed point, 8 samples at a time with
+/// AVX2; the result is within 0.56 of a level of the exact encoding, so a
+/// decoded code always encodes back to itself.
+///
+
+#ifndef SRGB_H
+#define SRGB_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "image_view.h"
+
+struct srgb_table {
+	float values[256];
+};
+struct srgb_fit {
+	uint32_t pieces[104];
+};
+
+//the linear intensity of each 8-bit sRGB code
+extern const srgb_table SRGB_TO_LINEAR;
+//(bias << 16 | scale) of the linear fit of the encoding on each of 104 pieces of [2^-13, 1)
+extern const srgb_fit LINEAR_TO_SRGB_FIT;
+
+///This will decode an 8-bit sRGB sample
+///
+/// \param v the sample
+/// \return the linear intensity in [0, 1]
+///
+inline float srgb_to_linear(unsigned char v) {
+	return SRGB_TO_LINEAR.values[v];
+}
+
+///This will encode a linear intensity as an 8-bit sRGB sample, clamping it
+///to [0, 1]
+///
+/// \param v the intensity
+/// \return the sample
+///
+inline unsigned char linear_to_srgb(float v) {
+	const float lowest = 1.0f / 8192.0f;
+	const float almost_one = 0.99999994f;
+	//written so a NaN clamps to the bottom
+	if (!(v > lowest))
+		v = lowest;
+	if (v > almost_one)
+		v = almost_one;
+	uint32_t bits;
+	std::memcpy(&bits, &v, sizeof(bits));
+	const uint32_t fit = LINEAR_TO_SRGB_FIT.pieces[(bits - ((127u - 13u) << 23)) >> 20];
+	const uint32_t bias = (fit >> 16) << 9;
+	const uint32_t scale = fit & 0xffff;
+	const uint32_t t = (bits >> 12) & 0xff;
+	return (unsigned char)((bias + scale * t) >> 16);
+}
+
+//decode an 8-bit sRGB plane to linear intensities
+void srgb_to_linear(const image_view<const unsigned char> &src, const image_view<float> &dst);
+//encode linear intensities, clamped to [0, 1], as an 8-bit sRGB plane
+void linear_to_srgb(const image_view<const float> &src, const image_view<unsigned char> &dst);
+
+//the same for all three channels
+void srgb_to_linear(const rgb_view<const unsigned char> &src, const rgb_view<float> &dst);
+void linear_to_srgb(const rgb_view<const float> &src, const rgb_view<unsigned char> &dst);
+
+#endif
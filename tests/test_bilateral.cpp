@@ -0,0 +1,135 @@
+///
+/// \file test_bilateral.cpp
+/// \brief Tests of the bilateral grid
+///
+
+#include "tests.h"
+#include "bilateral.h"
+
+#include <vector>
+
+///This will run the bilateral filter directly, summing a window of
+///2 sigma_space around each pixel, as the reference for the grid
+///
+/// \param src the image
+/// \param dst the filtered image, not src
+/// \param sigma_space the spatial standard deviation in pixels
+/// \param sigma_range the luma standard deviation in levels
+///
+static void bilateral_reference(const rgb_view<const unsigned char> &src, const rgb_view<unsigned char> &dst,
+	float sigma_space, float sigma_range) {
+	const int r = (int)std::ceil(2.0f * sigma_space);
+	const int width = (int)src.width(), height = (int)src.height();
+	std::vector<double> spatial(r + 1), range(256);
+	for (int k = 0; k <= r; ++k)
+		spatial[k] = std::exp(-(double)(k * k) / (2.0 * sigma_space * sigma_space));
+	for (int k = 0; k < 256; ++k)
+		range[k] = std::exp(-(double)(k * k) / (2.0 * sigma_range * sigma_range));
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			const int luma = (54 * src[0](x, y) + 183 * src[1](x, y) + 19 * src[2](x, y) + 128) >> 8;
+			double sum[3] = { 0.0, 0.0, 0.0 }, weight = 0.0;
+			for (int j = std::max(y - r, 0); j <= std::min(y + r, height - 1); ++j) {
+				for (int i = std::max(x - r, 0); i <= std::min(x + r, width - 1); ++i) {
+					const int l = (54 * src[0](i, j) + 183 * src[1](i, j) + 19 * src[2](i, j) + 128) >> 8;
+					const double w = spatial[std::abs(i - x)] * spatial[std::abs(j - y)] * range[std::abs(l - luma)];
+					for (unsigned int c = 0; c < 3; ++c)
+						sum[c] += w * src[c](i, j);
+					weight += w;
+				}
+			}
+			for (unsigned int c = 0; c < 3; ++c)
+				dst[c](x, y) = (unsigned char)std::min(sum[c] / weight + 0.5, 255.0);
+		}
+	}
+}
+
+///This will return an image of four flat quadrants of different brightness
+///with noise of a few levels on top
+///
+/// \param width the width in pixels
+/// \param height the height in pixels
+/// \param seed the seed of the noise
+/// \return the image
+///
+static ppm<> quadrant_image(unsigned int width, unsigned int height, unsigned int seed) {
+	const ppm<> noise = random_image(width, height, seed);
+	const unsigned char levels[4][3] = { { 30, 40, 20 }, { 220, 200, 180 }, { 90, 160, 60 }, { 160, 60, 200 } };
+	ppm<> img(width, height, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int y = 0; y < height; ++y) {
+			for (unsigned int x = 0; x < width; ++x) {
+				const unsigned int q = (x >= width / 2 ? 1 : 0) + (y >= height / 2 ? 2 : 0);
+				img.view(c)(x, y) = (unsigned char)(levels[q][c] + noise.view(c)(x, y) % 9 - 4);
+			}
+		}
+	}
+	return img;
+}
+
+///This will return the mean absolute difference of two images
+static double mean_difference(const rgb_view<const unsigned char> &a, const rgb_view<const unsigned char> &b) {
+	double sum = 0.0;
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < a.height(); ++y)
+			for (unsigned int x = 0; x < a.width(); ++x)
+				sum += std::fabs((double)a[c](x, y) - b[c](x, y));
+	return sum / (3.0 * a.width() * a.height());
+}
+
+void test_bilateral() {
+	//a flat image stays flat for any sigmas and sizes, sigmas below the grid's minimum included
+	const unsigned int sizes[][2] = { { 1, 1 }, { 2, 7 }, { 13, 5 }, { 70, 41 } };
+	const float sigmas[][2] = { { 1.0f, 1.0f }, { 4.0f, 20.0f }, { 10.0f, 50.0f }, { 64.0f, 8.0f } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const ppm<> flat = constant_image(sizes[s][0], sizes[s][1], 0, 117, 255);
+		ppm<> out(flat.width, flat.height, uninitialized);
+		for (unsigned int k = 0; k < sizeof(sigmas) / sizeof(sigmas[0]); ++k) {
+			bilateral_filter(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(out.view()), sigmas[k][0],
+				sigmas[k][1]);
+			CHECK(all_equal(out.view(0), 0) && all_equal(out.view(1), 117) && all_equal(out.view(2), 255));
+		}
+	}
+
+	//the grid comes close to the direct filter, and keeps the edges between the quadrants sharp where a blur
+	//of the same size would spread them over several pixels
+	const ppm<> img = quadrant_image(96, 80, 1);
+	const rgb_view<const unsigned char> src(img.view());
+	ppm<> out(img.width, img.height, uninitialized), reference(img.width, img.height, uninitialized);
+	//the grid's cells grow with sigma_space, and so does how far it strays
+	const float space[] = { 4.0f, 8.0f, 16.0f };
+	const double bounds[] = { 0.5, 1.0, 2.0 };
+	for (unsigned int k = 0; k < 3; ++k) {
+		bilateral_filter(src, rgb_view<unsigned char>(out.view()), space[k], 20.0f);
+		bilateral_reference(src, rgb_view<unsigned char>(reference.view()), space[k], 20.0f);
+		CHECK(mean_difference(rgb_view<const unsigned char>(out.view()), rgb_view<const unsigned char>(reference.view()))
+			<= bounds[k]);
+		CHECK(std::abs((int)out.view(1)(img.width / 2 - 2, 10) - 40) <= 10);
+		CHECK(std::abs((int)out.view(1)(img.width / 2 + 1, 10) - 200) <= 10);
+	}
+
+	//the noise is smoothed away within the quadrants
+	bilateral_filter(src, rgb_view<unsigned char>(out.view()), 4.0f, 20.0f);
+	double spread = 0.0;
+	for (unsigned int x = 10; x < 38; ++x)
+		spread = std::max(spread, std::fabs((double)out.view(0)(x, 20) - out.view(0)(10, 20)));
+	CHECK(spread <= 3.0);
+
+	//in place, and on a strided image
+	ppm<> in_place = img;
+	bilateral_filter(rgb_view<const unsigned char>(in_place.view()), rgb_view<unsigned char>(in_place.view()), 6.0f, 25.0f);
+	bilateral_filter(src, rgb_view<unsigned char>(out.view()), 6.0f, 25.0f);
+	CHECK(max_difference(rgb_view<const unsigned char>(in_place.view()), rgb_view<const unsigned char>(out.view())) == 0);
+	const ppm<unsigned char, interleaved> packed(src, 255);
+	ppm<unsigned char, interleaved> packed_out(img.width, img.height, uninitialized);
+	bilateral_filter(rgb_view<const unsigned char>(packed.view()), rgb_view<unsigned char>(packed_out.view()), 6.0f, 25.0f);
+	CHECK(max_difference(rgb_view<const unsigned char>(packed_out.view()), rgb_view<const unsigned char>(out.view())) == 0);
+
+	//the grid and the slices come out the same however they are spread over threads
+	const ppm<> large = quadrant_image(400, 300, 2);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height, uninitialized);
+		bilateral_filter(rgb_view<const unsigned char>(large.view()), rgb_view<unsigned char>(result.view()), 5.0f, 15.0f);
+		return result;
+	}));
+}
@@ -0,0 +1,107 @@
+///
+/// \file test_blur.cpp
+/// \brief Tests of the Gaussian, box and recursive blurs
+///
+
+#include "tests.h"
+#include "blur.h"
+
+#include <algorithm>
+#include <cmath>
+
+///This will blur a plane with the full 2D sampled Gaussian, edges clamped,
+///as the reference for the separable passes
+///
+/// \param src the plane to blur
+/// \param dst the blurred plane, not src
+/// \param sigma the standard deviation in pixels
+///
+static void blur_reference(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	float sigma) {
+	const std::vector<float> w = gaussian_kernel(sigma);
+	const int r = (int)w.size() - 1;
+	const int width = (int)src.width, height = (int)src.height;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			double acc = 0.0;
+			for (int j = -r; j <= r; ++j) {
+				const int yy = std::min(std::max(y + j, 0), height - 1);
+				for (int i = -r; i <= r; ++i) {
+					const int xx = std::min(std::max(x + i, 0), width - 1);
+					acc += (double)w[std::abs(j)] * w[std::abs(i)] * src(xx, yy);
+				}
+			}
+			dst(x, y) = (unsigned char)std::min(acc + 0.5, 255.0);
+		}
+	}
+}
+
+void test_blur() {
+	const blur_method methods[] = { blur_auto, blur_direct, blur_box, blur_iir };
+	const float sigmas[] = { 0.8f, 3.0f, 10.0f };
+	const unsigned int sizes[][2] = { { 1, 1 }, { 7, 5 }, { 33, 17 }, { 130, 67 } };
+
+	//a flat image stays flat whatever the method, sigma and size
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const ppm<> flat = constant_image(sizes[s][0], sizes[s][1], 0, 137, 255);
+		ppm<> out(flat.width, flat.height, uninitialized);
+		for (unsigned int m = 0; m < 4; ++m) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				gaussian_blur(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(out.view()), sigmas[k],
+					methods[m]);
+				CHECK(all_equal(out.view(0), 0) && all_equal(out.view(1), 137) && all_equal(out.view(2), 255));
+			}
+		}
+		for (unsigned int radius = 0; radius <= 5; ++radius) {
+			box_blur(flat.view(1), out.view(1), radius);
+			CHECK(all_equal(out.view(1), 137));
+		}
+	}
+
+	//the separable passes match the 2D convolution; away from the edges, which each pass of the approximations
+	//clamps on its own, the box cascade and the recursive filter come close to it once sigma is a few pixels
+	const ppm<> img = random_image(121, 101, 1);
+	ppm<> reference(img.width, img.height, uninitialized), out(img.width, img.height, uninitialized);
+	for (unsigned int k = 0; k < 3; ++k) {
+		blur_reference(img.view(0), reference.view(0), sigmas[k]);
+		gaussian_blur(img.view(0), out.view(0), sigmas[k], blur_direct);
+		CHECK(max_difference(out.view(0), reference.view(0)) <= 1);
+		if (sigmas[k] < 3.0f)
+			continue;
+		const unsigned int m = (unsigned int)(3.0f * sigmas[k]);
+		const image_view<const unsigned char> inside = reference.view(0).crop(m, m, img.width - 2 * m, img.height - 2 * m);
+		gaussian_blur(img.view(0), out.view(0), sigmas[k], blur_box);
+		CHECK(max_difference(out.view(0).crop(m, m, inside.width, inside.height), inside) <= 3);
+		gaussian_blur(img.view(0), out.view(0), sigmas[k], blur_iir);
+		CHECK(max_difference(out.view(0).crop(m, m, inside.width, inside.height), inside) <= 3);
+	}
+
+	//blurring in place gives what blurring into another plane does
+	for (unsigned int m = 0; m < 4; ++m) {
+		ppm<> in_place = img;
+		gaussian_blur(img.view(0), out.view(0), 2.5f, methods[m]);
+		gaussian_blur(in_place.view(0), in_place.view(0), 2.5f, methods[m]);
+		CHECK(max_difference(in_place.view(0), out.view(0)) == 0);
+	}
+	ppm<> in_place = img;
+	box_blur(img.view(0), out.view(0), 3);
+	box_blur(in_place.view(0), in_place.view(0), 3);
+	CHECK(max_difference(in_place.view(0), out.view(0)) == 0);
+
+	//the float planes agree with the 8-bit ones before rounding
+	ppm<float> linear(img.width, img.height, uninitialized), blurred(img.width, img.height, uninitialized);
+	copy(img.view(1), linear.view(1));
+	gaussian_blur(linear.view(1), blurred.view(1), 3.0f, blur_direct);
+	blur_reference(img.view(1), reference.view(1), 3.0f);
+	CHECK(max_difference(blurred.view(1), reference.view(1)) <= 0.51);
+
+	//the result does not depend on how the rows are split over threads
+	const ppm<> large = random_image(300, 200, 2);
+	for (unsigned int m = 0; m < 4; ++m) {
+		CHECK(same_on_every_thread_count([&]() {
+			ppm<> result(large.width, large.height);
+			gaussian_blur(large.view(2), result.view(2), 6.0f, methods[m]);
+			return result;
+		}));
+	}
+}
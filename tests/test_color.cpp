@@ -0,0 +1,125 @@
+///
+/// \file test_color.cpp
+/// \brief Tests of the 3x3 color matrices
+///
+
+#include "tests.h"
+#include "color_matrix.h"
+
+///This will apply a matrix to every pixel one sample at a time in double
+///precision, rounding and clamping, as the reference for the 8-bit path
+///
+/// \param src the image
+/// \param m the matrix
+/// \return the result
+///
+static ppm<> color_reference(const ppm<> &src, const color_matrix &m) {
+	ppm<> out(src.width, src.height, uninitialized);
+	for (unsigned int y = 0; y < src.height; ++y) {
+		for (unsigned int x = 0; x < src.width; ++x) {
+			for (unsigned int i = 0; i < 3; ++i) {
+				double v = m.offset[i];
+				for (unsigned int j = 0; j < 3; ++j)
+					v += (double)m.m[i][j] * src.view(j)(x, y);
+				out.view(i)(x, y) = (unsigned char)std::min(std::max(std::floor(v + 0.5), 0.0), 255.0);
+			}
+		}
+	}
+	return out;
+}
+
+void test_color() {
+	color_matrix shifted = color_matrix::saturation(1.7f) * color_matrix::white_balance(1.1f, 0.9f, 1.3f);
+	shifted.offset[0] = 12.0f;
+	shifted.offset[2] = -30.5f;
+	//a gain past the fixed-point range takes the float fallback
+	const color_matrix matrices[] = { color_matrix(), color_matrix::white_balance(1.2f, 1.0f, 0.7f),
+		color_matrix::saturation(0.4f), color_matrix::saturation(2.5f), color_matrix::channel_swap(2, 0, 1),
+		color_matrix::grayscale(), shifted, color_matrix::white_balance(9.0f, 0.5f, 1.0f) };
+	const unsigned int count = sizeof(matrices) / sizeof(matrices[0]);
+	const unsigned int sizes[][2] = { { 1, 1 }, { 15, 3 }, { 16, 2 }, { 37, 21 }, { 200, 40 } };
+
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 1 + s);
+		const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+		for (unsigned int n = 0; n < count; ++n) {
+			//the vector and scalar loops and the fixed-point rounding stay within a level of double precision
+			const ppm<> reference = color_reference(img, matrices[n]);
+			ppm<> out(width, height, uninitialized);
+			apply_color_matrix(rgb_view<const unsigned char>(img.view()), rgb_view<unsigned char>(out.view()), matrices[n]);
+			CHECK(max_difference(rgb_view<const unsigned char>(out.view()), rgb_view<const unsigned char>(reference.view())) <= 1);
+
+			//a strided image gives what a planar one does
+			ppm<unsigned char, interleaved> packed_out(width, height, uninitialized);
+			apply_color_matrix(rgb_view<const unsigned char>(packed.view()), rgb_view<unsigned char>(packed_out.view()),
+				matrices[n]);
+			CHECK(max_difference(rgb_view<const unsigned char>(packed_out.view()), rgb_view<const unsigned char>(out.view())) == 0);
+
+			//in place, also into the source's planes in another order
+			ppm<> in_place = img;
+			apply_color_matrix(rgb_view<const unsigned char>(in_place.view()), rgb_view<unsigned char>(in_place.view()),
+				matrices[n]);
+			CHECK(max_difference(rgb_view<const unsigned char>(in_place.view()), rgb_view<const unsigned char>(out.view())) == 0);
+			ppm<> rotated = img;
+			const rgb_view<unsigned char> planes(rotated.view());
+			apply_color_matrix(rgb_view<const unsigned char>(planes), rgb_view<unsigned char>(planes[2], planes[0], planes[1]),
+				matrices[n]);
+			CHECK(max_difference(rotated.view(2), out.view(0)) == 0 && max_difference(rotated.view(0), out.view(1)) == 0
+				&& max_difference(rotated.view(1), out.view(2)) == 0);
+
+			//float planes match the double result before rounding
+			ppm<float> linear(width, height, uninitialized), linear_out(width, height, uninitialized);
+			for (unsigned int c = 0; c < 3; ++c)
+				copy(img.view(c), linear.view(c));
+			apply_color_matrix(rgb_view<const float>(linear.view()), rgb_view<float>(linear_out.view()), matrices[n]);
+			bool close = true;
+			for (unsigned int c = 0; c < 3; ++c) {
+				for (unsigned int y = 0; y < height; ++y) {
+					for (unsigned int x = 0; x < width; ++x) {
+						double v = matrices[n].offset[c];
+						for (unsigned int j = 0; j < 3; ++j)
+							v += (double)matrices[n].m[c][j] * img.view(j)(x, y);
+						close = close && std::fabs(linear_out.view(c)(x, y) - v) <= 1e-3;
+					}
+				}
+			}
+			CHECK(close);
+		}
+
+		//the identity and channel swaps move samples exactly; grays stay gray and keep their level
+		ppm<> out(width, height, uninitialized);
+		apply_color_matrix(rgb_view<const unsigned char>(img.view()), rgb_view<unsigned char>(out.view()), color_matrix());
+		CHECK(max_difference(rgb_view<const unsigned char>(out.view()), rgb_view<const unsigned char>(img.view())) == 0);
+		apply_color_matrix(rgb_view<const unsigned char>(img.view()), rgb_view<unsigned char>(out.view()),
+			color_matrix::channel_swap(2, 1, 0));
+		CHECK(max_difference(out.view(0), img.view(2)) == 0 && max_difference(out.view(2), img.view(0)) == 0);
+	}
+	bool gray = true;
+	for (unsigned int v = 0; v < 256; ++v) {
+		const ppm<> flat = constant_image(17, 3, (unsigned char)v, (unsigned char)v, (unsigned char)v);
+		ppm<> out(flat.width, flat.height, uninitialized);
+		apply_color_matrix(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(out.view()),
+			color_matrix::saturation(1.8f));
+		gray = gray && all_equal(out.view(0), (unsigned char)v) && all_equal(out.view(1), (unsigned char)v)
+			&& all_equal(out.view(2), (unsigned char)v);
+	}
+	CHECK(gray);
+
+	//combining two matrices gives what applying one after the other does, before rounding
+	const color_matrix first = color_matrix::white_balance(1.2f, 0.8f, 1.0f), second = color_matrix::saturation(1.5f);
+	const ppm<float> values = random_float_image(33, 9, 7, 0.0f, 1.0f);
+	ppm<float> twice(values.width, values.height, uninitialized), once(values.width, values.height, uninitialized);
+	apply_color_matrix(rgb_view<const float>(values.view()), rgb_view<float>(twice.view()), first);
+	apply_color_matrix(rgb_view<const float>(twice.view()), rgb_view<float>(twice.view()), second);
+	apply_color_matrix(rgb_view<const float>(values.view()), rgb_view<float>(once.view()), second * first);
+	CHECK(max_difference(rgb_view<const float>(once.view()), rgb_view<const float>(twice.view())) <= 1e-5);
+
+	//the rows come out the same however they are spread over threads
+	const ppm<> large = random_image(300, 200, 20);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height, uninitialized);
+		apply_color_matrix(rgb_view<const unsigned char>(large.view()), rgb_view<unsigned char>(result.view()), shifted);
+		return result;
+	}));
+}
@@ -0,0 +1,182 @@
+///
+/// \file test_components.cpp
+/// \brief Tests of connected-component labeling and the component statistics
+///
+
+#include "tests.h"
+#include "components.h"
+#include "mask.h"
+
+#include <vector>
+
+///This will label the set pixels of a mask by flooding each component in
+///turn from its first pixel in raster order, as the reference
+///
+/// \param src the mask
+/// \param connected which neighbors are connected
+/// \param labels the labels, row after row
+/// \return the number of components
+///
+static unsigned int label_reference(const image_view<const unsigned char> &src, connectivity connected,
+	std::vector<uint32_t> &labels) {
+	const int width = (int)src.width, height = (int)src.height;
+	labels.assign((size_t)width * height, 0);
+	std::vector<int> stack;
+	unsigned int count = 0;
+	for (int start = 0; start < width * height; ++start) {
+		if (!src(start % width, start / width) || labels[start])
+			continue;
+		labels[start] = ++count;
+		stack.push_back(start);
+		while (!stack.empty()) {
+			const int p = stack.back(), px = p % width, py = p / width;
+			stack.pop_back();
+			for (int dy = -1; dy <= 1; ++dy) {
+				for (int dx = -1; dx <= 1; ++dx) {
+					const int nx = px + dx, ny = py + dy;
+					if ((dx == 0 && dy == 0) || (connected == connect_4 && dx != 0 && dy != 0) ||
+						nx < 0 || ny < 0 || nx >= width || ny >= height)
+						continue;
+					if (src(nx, ny) && !labels[(size_t)ny * width + nx]) {
+						labels[(size_t)ny * width + nx] = count;
+						stack.push_back(ny * width + nx);
+					}
+				}
+			}
+		}
+	}
+	return count;
+}
+
+///This will tell whether a labeling is the reference's, statistics included
+///
+/// \param components the labeling
+/// \param src the mask it labels
+/// \param connected which neighbors are connected
+/// \return true if every label and statistic matches
+///
+static bool labeled(const connected_components &components, const image_view<const unsigned char> &src,
+	connectivity connected) {
+	std::vector<uint32_t> labels;
+	const unsigned int count = label_reference(src, connected, labels);
+	bool same = components.width == src.width && components.height == src.height && components.count() == count;
+	for (size_t i = 0; same && i < labels.size(); ++i)
+		same = components.labels[i] == labels[i];
+	//the statistics of each component, summed directly
+	std::vector<component_stats> stats(count);
+	for (unsigned int l = 0; l < count; ++l) {
+		stats[l].area = stats[l].sum_x = stats[l].sum_y = 0;
+		stats[l].left = stats[l].top = 0xffffffffu;
+		stats[l].right = stats[l].bottom = 0;
+	}
+	for (unsigned int y = 0; y < src.height; ++y) {
+		for (unsigned int x = 0; x < src.width; ++x) {
+			const uint32_t l = labels[(size_t)y * src.width + x];
+			if (l == 0)
+				continue;
+			component_stats &s = stats[l - 1];
+			s.area++;
+			s.sum_x += x;
+			s.sum_y += y;
+			s.left = std::min(s.left, x);
+			s.top = std::min(s.top, y);
+			s.right = std::max(s.right, x);
+			s.bottom = std::max(s.bottom, y);
+		}
+	}
+	for (unsigned int l = 0; same && l < count; ++l) {
+		const component_stats &a = components.stats[l], &b = stats[l];
+		same = a.area == b.area && a.sum_x == b.sum_x && a.sum_y == b.sum_y && a.left == b.left && a.top == b.top
+			&& a.right == b.right && a.bottom == b.bottom;
+	}
+	return same;
+}
+
+///This will tell whether two labelings agree on every label and statistic
+static bool same_components(const connected_components &a, const connected_components &b) {
+	bool same = a.width == b.width && a.height == b.height && a.count() == b.count()
+		&& max_difference(a.view(), b.view()) == 0;
+	for (unsigned int l = 0; same && l < a.count(); ++l) {
+		const component_stats &s = a.stats[l], &t = b.stats[l];
+		same = s.area == t.area && s.sum_x == t.sum_x && s.sum_y == t.sum_y && s.left == t.left && s.top == t.top
+			&& s.right == t.right && s.bottom == t.bottom;
+	}
+	return same;
+}
+
+///This will return a mask with about percent of its pixels set, from a fixed seed
+static mask random_mask(unsigned int width, unsigned int height, unsigned int seed, unsigned int percent) {
+	const ppm<> img = random_image(width, height, seed);
+	mask m(width, height);
+	for (unsigned int y = 0; y < height; ++y)
+		for (unsigned int x = 0; x < width; ++x)
+			m.view()(x, y) = img.view(0)(x, y) * 100 < percent * 256 ? 255 : 0;
+	return m;
+}
+
+void test_components() {
+	const connectivity kinds[] = { connect_4, connect_8 };
+	//1x1, single rows and columns, and heights that split into several bands which must be joined
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 40 }, { 37, 1 }, { 9, 7 }, { 50, 64 }, { 45, 130 }, { 120, 300 } };
+	const unsigned int densities[] = { 20, 45, 60, 90 };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		for (unsigned int d = 0; d < sizeof(densities) / sizeof(densities[0]); ++d) {
+			const mask m = random_mask(width, height, 1 + s * 4 + d, densities[d]);
+			//a strided copy of the mask
+			ppm<unsigned char, interleaved> packed(width, height, uninitialized);
+			copy(m.view(), packed.view(2));
+			for (unsigned int k = 0; k < 2; ++k) {
+				CHECK(labeled(label_components(m.view(), kinds[k]), m.view(), kinds[k]));
+				CHECK(labeled(label_components(packed.view(2), kinds[k]), m.view(), kinds[k]));
+			}
+		}
+
+		//an empty mask has no components, a full one has one covering it, any nonzero value counts as set
+		mask empty(width, height), full(width, height);
+		fill(full.view(), (unsigned char)1);
+		for (unsigned int k = 0; k < 2; ++k) {
+			const connected_components none = label_components(empty.view(), kinds[k]);
+			CHECK(none.count() == 0 && none.width == width && none.height == height);
+			const connected_components one = label_components(full.view(), kinds[k]);
+			CHECK(one.count() == 1 && one.stats[0].area == (uint64_t)width * height && one.stats[0].left == 0
+				&& one.stats[0].top == 0 && one.stats[0].right == width - 1 && one.stats[0].bottom == height - 1);
+		}
+	}
+
+	//a diagonal line is one component 8-connected and one per pixel 4-connected
+	mask diagonal(80, 80);
+	for (unsigned int i = 0; i < 80; ++i)
+		diagonal.view()(i, i) = 255;
+	CHECK(label_components(diagonal.view(), connect_8).count() == 1);
+	CHECK(label_components(diagonal.view(), connect_4).count() == 80);
+
+	//nested hooks, each crossing every band boundary twice; a rectangle's centroid comes out of the sums
+	mask hooks(200, 200);
+	for (unsigned int r = 0; r < 50; r += 4) {
+		const unsigned int lo = 2 * r, hi = 199 - 2 * r;
+		fill(hooks.view().crop(lo, lo, hi - lo + 1, 1), (unsigned char)255);
+		fill(hooks.view().crop(hi, lo, 1, hi - lo + 1), (unsigned char)255);
+		fill(hooks.view().crop(lo + 4, hi, hi - lo - 3, 1), (unsigned char)255);
+		fill(hooks.view().crop(lo + 4, lo + 4, 1, hi - lo - 3), (unsigned char)255);
+	}
+	for (unsigned int k = 0; k < 2; ++k) {
+		const connected_components components = label_components(hooks.view(), kinds[k]);
+		CHECK(labeled(components, hooks.view(), kinds[k]));
+		CHECK(components.count() == 13 && components.stats[0].left == 0 && components.stats[0].bottom == 199);
+	}
+	mask square(40, 30);
+	fill(square.view().crop(10, 5, 11, 7), (unsigned char)255);
+	const connected_components one = label_components(square.view());
+	CHECK(one.count() == 1 && one.stats[0].centroid_x() == 15.0 && one.stats[0].centroid_y() == 8.0);
+	CHECK(label_components(square.view().crop(0, 0, 0, 30)).count() == 0);
+
+	//the bands join to the same labels however they are spread over threads
+	const mask large = random_mask(400, 500, 50, 45);
+	for (unsigned int k = 0; k < 2; ++k) {
+		CHECK(labeled(label_components(large.view(), kinds[k]), large.view(), kinds[k]));
+		CHECK(same_on_every_thread_count([&]() {
+			return label_components(large.view(), kinds[k]);
+		}, same_components));
+	}
+}
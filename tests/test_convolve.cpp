@@ -0,0 +1,152 @@
+///
+/// \file test_convolve.cpp
+/// \brief Tests of the direct and FFT convolution paths
+///
+
+#include "tests.h"
+#include "convolve.h"
+
+#include <algorithm>
+
+///This will correlate a float plane with a kernel one tap at a time, edges
+///repeated, as the reference for both convolution paths
+///
+/// \param src the plane
+/// \param dst the result, not src
+/// \param k the kernel
+/// \param bias the value added to every sample
+///
+static void convolve_reference(const image_view<const float> &src, const image_view<float> &dst, const kernel2d &k,
+	float bias) {
+	const int width = (int)src.width, height = (int)src.height;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			double acc = bias;
+			for (int j = 0; j < (int)k.height; ++j) {
+				const int yy = std::min(std::max(y + j - (int)k.center_y(), 0), height - 1);
+				for (int i = 0; i < (int)k.width; ++i) {
+					const int xx = std::min(std::max(x + i - (int)k.center_x(), 0), width - 1);
+					acc += (double)k(i, j) * src(xx, yy);
+				}
+			}
+			dst(x, y) = (float)acc;
+		}
+	}
+}
+
+///This will return a kernel of random taps from a fixed seed
+///
+/// \param width the number of columns
+/// \param height the number of rows
+/// \param seed the seed
+/// \return the kernel, its taps between -1 and 1
+///
+static kernel2d random_kernel(unsigned int width, unsigned int height, unsigned int seed) {
+	const ppm<float> taps = random_float_image(width, height, seed, -1.0f, 1.0f);
+	kernel2d k(width, height);
+	for (unsigned int y = 0; y < height; ++y)
+		for (unsigned int x = 0; x < width; ++x)
+			k(x, y) = taps.view(0)(x, y);
+	return k;
+}
+
+void test_convolve() {
+	//the 3x3 and 5x5 specializations, even sizes whose center is off the middle, lines and the general path
+	const unsigned int kernels[][2] = { { 1, 1 }, { 3, 3 }, { 5, 5 }, { 4, 3 }, { 7, 1 }, { 1, 6 }, { 9, 9 } };
+	const unsigned int sizes[][2] = { { 1, 1 }, { 3, 2 }, { 17, 11 }, { 300, 70 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<float> img = random_float_image(width, height, 20 + s, 0.0f, 255.0f);
+		ppm<float> reference(width, height, uninitialized), out(width, height, uninitialized);
+		for (unsigned int n = 0; n < sizeof(kernels) / sizeof(kernels[0]); ++n) {
+			const kernel2d k = random_kernel(kernels[n][0], kernels[n][1], n);
+			convolve_reference(img.view(0), reference.view(0), k, 3.0f);
+			convolve(img.view(0), out.view(0), k, 3.0f, convolve_direct);
+			CHECK(max_difference(out.view(0), reference.view(0)) <= 1e-3);
+
+			//a normalized kernel keeps a flat image flat
+			const ppm<> flat = constant_image(width, height, 0, 201, 255);
+			ppm<> flat_out(width, height, uninitialized);
+			kernel2d positive = k;
+			for (size_t i = 0; i < positive.taps.size(); ++i)
+				positive.taps[i] = positive.taps[i] + 1.5f;
+			convolve(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(flat_out.view()),
+				positive.normalized(), 0.0f, convolve_direct);
+			CHECK(all_equal(flat_out.view(0), 0) && all_equal(flat_out.view(1), 201) && all_equal(flat_out.view(2), 255));
+		}
+	}
+
+	//8-bit planes round and clamp the float result; a strided source gives what a dense one does
+	const ppm<> img = random_image(77, 41, 30);
+	ppm<float> linear(img.width, img.height, uninitialized), reference(img.width, img.height, uninitialized);
+	copy(img.view(1), linear.view(0));
+	const kernel2d k = random_kernel(5, 5, 31);
+	convolve_reference(linear.view(0), reference.view(0), k, 100.0f);
+	ppm<> out(img.width, img.height, uninitialized);
+	convolve(img.view(1), out.view(0), k, 100.0f, convolve_direct);
+	bool rounded = true;
+	for (unsigned int y = 0; y < img.height; ++y) {
+		for (unsigned int x = 0; x < img.width; ++x) {
+			const float v = std::min(std::max(reference.view(0)(x, y), 0.0f), 255.0f);
+			rounded = rounded && std::abs((int)out.view(0)(x, y) - (int)(v + 0.5f)) <= 1;
+		}
+	}
+	CHECK(rounded);
+	const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+	ppm<> strided(img.width, img.height, uninitialized);
+	convolve(packed.view(1), strided.view(0), k, 100.0f, convolve_direct);
+	CHECK(max_difference(strided.view(0), out.view(0)) == 0);
+
+	//in place gives what a separate output does
+	const kernel2d in_place_kernels[] = { random_kernel(3, 3, 32), random_kernel(5, 5, 33), random_kernel(8, 6, 34) };
+	for (unsigned int n = 0; n < 3; ++n) {
+		ppm<> in_place = img;
+		convolve(img.view(2), out.view(2), in_place_kernels[n], 128.0f, convolve_direct);
+		convolve(in_place.view(2), in_place.view(2), in_place_kernels[n], 128.0f, convolve_direct);
+		CHECK(max_difference(in_place.view(2), out.view(2)) == 0);
+	}
+
+	//the tiles come out the same however they are spread over threads
+	const ppm<> large = random_image(530, 300, 35);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height);
+		convolve(large.view(0), result.view(0), random_kernel(7, 7, 36), 128.0f, convolve_direct);
+		return result;
+	}));
+
+	//the FFT path agrees with the direct one on odd sizes, 1x1 and kernels larger than the image
+	const unsigned int fft_sizes[][2] = { { 1, 1 }, { 5, 3 }, { 37, 29 }, { 200, 91 } };
+	const unsigned int fft_kernels[][2] = { { 1, 1 }, { 3, 3 }, { 4, 7 }, { 15, 15 }, { 33, 9 } };
+	for (unsigned int s = 0; s < sizeof(fft_sizes) / sizeof(fft_sizes[0]); ++s) {
+		const unsigned int width = fft_sizes[s][0], height = fft_sizes[s][1];
+		const ppm<float> plane = random_float_image(width, height, 40 + s, 0.0f, 255.0f);
+		const ppm<> samples = random_image(width, height, 50 + s);
+		ppm<float> direct(width, height, uninitialized), fft(width, height, uninitialized);
+		ppm<> direct8(width, height, uninitialized), fft8(width, height, uninitialized);
+		for (unsigned int n = 0; n < sizeof(fft_kernels) / sizeof(fft_kernels[0]); ++n) {
+			const kernel2d k = random_kernel(fft_kernels[n][0], fft_kernels[n][1], 60 + n);
+			convolve(plane.view(0), direct.view(0), k, -7.0f, convolve_direct);
+			convolve(plane.view(0), fft.view(0), k, -7.0f, convolve_fft);
+			CHECK(max_difference(fft.view(0), direct.view(0)) <= 0.05);
+			const kernel2d box = kernel2d(fft_kernels[n][0], fft_kernels[n][1],
+				std::vector<float>((size_t)fft_kernels[n][0] * fft_kernels[n][1], 1.0f).data()).normalized();
+			convolve(rgb_view<const unsigned char>(samples.view()), rgb_view<unsigned char>(direct8.view()), box, 0.0f,
+				convolve_direct);
+			convolve(rgb_view<const unsigned char>(samples.view()), rgb_view<unsigned char>(fft8.view()), box, 0.0f,
+				convolve_fft);
+			CHECK(max_difference(rgb_view<const unsigned char>(fft8.view()), rgb_view<const unsigned char>(direct8.view())) <= 1);
+		}
+	}
+
+	//the FFT path in place, and the same however its rows and columns are spread over threads
+	const kernel2d wide = random_kernel(21, 17, 70);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height);
+		convolve(large.view(1), result.view(1), wide, 128.0f, convolve_fft);
+		return result;
+	}));
+	ppm<> fft_out(large.width, large.height, uninitialized), fft_in_place = large;
+	convolve(large.view(1), fft_out.view(1), wide, 128.0f, convolve_fft);
+	convolve(fft_in_place.view(1), fft_in_place.view(1), wide, 128.0f, convolve_fft);
+	CHECK(max_difference(fft_in_place.view(1), fft_out.view(1)) == 0);
+}
@@ -0,0 +1,72 @@
+///
+/// \file test_fft.cpp
+/// \brief Tests of the mixed-radix FFT
+///
+
+#include "tests.h"
+#include "fft.h"
+
+#include <complex>
+#include <vector>
+
+///This will return the largest difference between a plan's transform of
+///random points and a DFT summed in double precision, relative to the
+///largest output
+///
+/// \param n the length
+/// \param inverse true to check the unscaled inverse
+/// \return the relative error
+///
+static double transform_error(unsigned int n, bool inverse) {
+	const ppm<float> values = random_float_image(n, 2, n, -1.0f, 1.0f);
+	std::vector<complex_float> in(n), out(n);
+	for (unsigned int k = 0; k < n; ++k)
+		in[k] = complex_float(values.view(0)(k, 0), values.view(0)(k, 1));
+	const fft_plan plan(n);
+	if (inverse)
+		plan.inverse(in.data(), out.data());
+	else
+		plan.forward(in.data(), out.data());
+	const double pi = 3.14159265358979323846;
+	double error = 0.0, largest = 1e-30;
+	for (unsigned int j = 0; j < n; ++j) {
+		std::complex<double> sum;
+		for (unsigned int k = 0; k < n; ++k) {
+			const double phase = (inverse ? 2.0 : -2.0) * pi * (double)((unsigned long long)j * k % n) / n;
+			sum += std::complex<double>(in[k].real(), in[k].imag()) * std::complex<double>(std::cos(phase), std::sin(phase));
+		}
+		error = std::max(error, std::abs(sum - std::complex<double>(out[j].real(), out[j].imag())));
+		largest = std::max(largest, std::abs(sum));
+	}
+	return error / largest;
+}
+
+void test_fft() {
+	//every length up to 64, whatever its factors, then longer mixes of the radices and primes
+	for (unsigned int n = 1; n <= 64; ++n) {
+		CHECK(transform_error(n, false) < 1e-5);
+		CHECK(transform_error(n, true) < 1e-5);
+	}
+	const unsigned int lengths[] = { 97, 128, 243, 250, 360, 625, 1000, 1024, 2 * 3 * 5 * 7 * 11, 17 * 19 };
+	for (unsigned int i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i) {
+		CHECK(transform_error(lengths[i], false) < 1e-5);
+		CHECK(transform_error(lengths[i], true) < 1e-5);
+	}
+
+	//forward then inverse gives n times the input
+	const unsigned int n = 3240;
+	const ppm<float> values = random_float_image(n, 2, 7, -1.0f, 1.0f);
+	std::vector<complex_float> in(n), spectrum(n), back(n);
+	for (unsigned int k = 0; k < n; ++k)
+		in[k] = complex_float(values.view(0)(k, 0), values.view(0)(k, 1));
+	const fft_plan plan(n);
+	plan.forward(in.data(), spectrum.data());
+	plan.inverse(spectrum.data(), back.data());
+	double error = 0.0;
+	for (unsigned int k = 0; k < n; ++k)
+		error = std::max(error, (double)std::abs(back[k] / (float)n - in[k]));
+	CHECK(error < 1e-5);
+
+	//the good sizes only have the factors 2, 3 and 5
+	CHECK(fft_good_size(1) == 1 && fft_good_size(7) == 8 && fft_good_size(31) == 32 && fft_good_size(3231) == 3240);
+}
@@ -0,0 +1,147 @@
+///
+/// \file test_fill.cpp
+/// \brief Tests of the scanline flood fill
+///
+
+#include "tests.h"
+#include "fill.h"
+#include "mask.h"
+
+#include <cstdlib>
+#include <vector>
+
+///This will fill the region around a pixel one pixel at a time, pushing
+///every 4-connected neighbor that matches, as the reference
+///
+/// \param src the image
+/// \param x the column of the pixel
+/// \param y the row of the pixel
+/// \param tolerance the most any channel may differ from the pixel's
+/// \param region the pixels filled; pixels already set are not filled
+/// \param bounds the bounding box of the pixels filled
+/// \return the number of pixels filled
+///
+static uint64_t fill_reference(const rgb_view<const unsigned char> &src, unsigned int x, unsigned int y,
+	unsigned int tolerance, const image_view<unsigned char> &region, fill_bounds &bounds) {
+	bounds.x = bounds.y = bounds.w = bounds.h = 0;
+	if (x >= src.width() || y >= src.height() || region(x, y))
+		return 0;
+	const int color[3] = { src[0](x, y), src[1](x, y), src[2](x, y) };
+	unsigned int left = x, right = x, top = y, bottom = y;
+	uint64_t filled = 0;
+	std::vector<fill_bounds> stack;
+	const fill_bounds start = { x, y, 1, 1 };
+	stack.push_back(start);
+	while (!stack.empty()) {
+		const unsigned int px = stack.back().x, py = stack.back().y;
+		stack.pop_back();
+		if (px >= src.width() || py >= src.height() || region(px, py))
+			continue;
+		bool match = true;
+		for (unsigned int c = 0; c < 3; ++c)
+			match = match && (unsigned int)std::abs(src[c](px, py) - color[c]) <= tolerance;
+		if (!match)
+			continue;
+		region(px, py) = 255;
+		filled++;
+		left = std::min(left, px);
+		right = std::max(right, px);
+		top = std::min(top, py);
+		bottom = std::max(bottom, py);
+		//unsigned wrap-around takes the neighbors past the left and top edges out of range
+		const fill_bounds next[4] = { { px - 1, py, 1, 1 }, { px + 1, py, 1, 1 }, { px, py - 1, 1, 1 },
+			{ px, py + 1, 1, 1 } };
+		stack.insert(stack.end(), next, next + 4);
+	}
+	bounds.x = left;
+	bounds.y = top;
+	bounds.w = right - left + 1;
+	bounds.h = bottom - top + 1;
+	return filled;
+}
+
+///This will fill from a pixel with both fills and tell whether they agree
+///on the count, the bounds and every pixel of the region
+///
+/// \param src the image
+/// \param x the column of the pixel
+/// \param y the row of the pixel
+/// \param tolerance the most any channel may differ from the pixel's
+/// \param region the pixels filled by flood_fill, set beforehand where it must not fill
+/// \return true if the fills agree
+///
+static bool same_fill(const rgb_view<const unsigned char> &src, unsigned int x, unsigned int y, unsigned int tolerance,
+	const image_view<unsigned char> &region) {
+	mask expected(src.width(), src.height());
+	copy(region, expected.view());
+	fill_bounds bounds, expected_bounds;
+	const uint64_t filled = flood_fill(src, x, y, tolerance, region, bounds);
+	const uint64_t expected_filled = fill_reference(src, x, y, std::min(tolerance, 255u), expected.view(), expected_bounds);
+	return filled == expected_filled && bounds.x == expected_bounds.x && bounds.y == expected_bounds.y
+		&& bounds.w == expected_bounds.w && bounds.h == expected_bounds.h && max_difference(region, expected.view()) == 0;
+}
+
+///This will return an image of random samples rounded down to a few levels,
+///so regions of equal color are large and ragged
+static ppm<> coarse_image(unsigned int width, unsigned int height, unsigned int seed) {
+	ppm<> img = random_image(width, height, seed);
+	ppm<> smooth(width, height, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				smooth.view(c)(x, y) = (unsigned char)(img.view(c)(x, y) < 90 ? 40 : img.view(c)(x, y) < 180 ? 60 : 200);
+	return smooth;
+}
+
+void test_fill() {
+	//widths around the 32 pixels tested at once, 1x1, and tolerances from exact to everything
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 20 }, { 33, 1 }, { 31, 9 }, { 32, 7 }, { 65, 40 }, { 200, 90 } };
+	const unsigned int tolerances[] = { 0, 20, 150, 255, 1000 };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = coarse_image(width, height, 1 + s);
+		const rgb_view<const unsigned char> src(img.view());
+		const ppm<unsigned char, interleaved> packed(src, 255);
+		for (unsigned int k = 0; k < sizeof(tolerances) / sizeof(tolerances[0]); ++k) {
+			const unsigned int seeds[][2] = { { 0, 0 }, { width - 1, height - 1 }, { width / 2, height / 3 } };
+			for (unsigned int n = 0; n < 3; ++n) {
+				mask region(width, height);
+				CHECK(same_fill(src, seeds[n][0], seeds[n][1], tolerances[k], region.view()));
+				//a strided image and a strided region take the scalar test
+				ppm<unsigned char, interleaved> packed_region(width, height);
+				CHECK(same_fill(rgb_view<const unsigned char>(packed.view()), seeds[n][0], seeds[n][1], tolerances[k],
+					packed_region.view(1)));
+				CHECK(max_difference(packed_region.view(1), region.view()) == 0);
+			}
+		}
+
+		//a flat image fills whole from any pixel
+		const ppm<> flat = constant_image(width, height, 3, 3, 3);
+		mask region(width, height);
+		fill_bounds bounds;
+		CHECK(flood_fill(rgb_view<const unsigned char>(flat.view()), width / 2, height / 2, 0, region.view(), bounds)
+			== (uint64_t)width * height);
+		CHECK(all_equal(region.view(), 255) && bounds.x == 0 && bounds.y == 0 && bounds.w == width && bounds.h == height);
+	}
+
+	//pixels already set in the region are walls; starting on one, or off the image, fills nothing
+	const ppm<> flat = constant_image(100, 60, 10, 20, 30);
+	const rgb_view<const unsigned char> src(flat.view());
+	mask walls(100, 60);
+	fill(walls.view().crop(50, 0, 1, 60), (unsigned char)255);
+	CHECK(same_fill(src, 10, 10, 0, walls.view()));
+	CHECK(all_equal(walls.view().crop(0, 0, 51, 60), 255) && all_equal(walls.view().crop(51, 0, 49, 60), 0));
+	fill_bounds bounds;
+	CHECK(flood_fill(src, 50, 5, 0, walls.view(), bounds) == 0 && bounds.w == 0 && bounds.h == 0);
+	CHECK(flood_fill(src, 100, 5, 0, walls.view(), bounds) == 0 && flood_fill(src, 5, 60, 0, walls.view(), bounds) == 0);
+
+	//a serpentine corridor one pixel wide, which the fill follows up and down the rows
+	ppm<> maze = constant_image(97, 41, 0, 0, 0);
+	for (unsigned int y = 1; y < 41; y += 4) {
+		fill(maze.view(0).crop(1, y, 95, 1), (unsigned char)255);
+		fill(maze.view(0).crop(y % 8 == 1 ? 95 : 1, y, 1, 5), (unsigned char)255);
+	}
+	mask corridor(97, 41);
+	CHECK(same_fill(rgb_view<const unsigned char>(maze.view()), 1, 1, 100, corridor.view()));
+	CHECK(corridor.view()(1, 37) == 255 && corridor.view()(0, 0) == 0);
+}
@@ -0,0 +1,133 @@
+///
+/// \file test_gradient.cpp
+/// \brief Tests of the Sobel and Scharr gradients
+///
+
+#include "tests.h"
+#include "gradient.h"
+
+static const double PI = 3.14159265358979;
+
+///This will compute the gradient of a plane one pixel at a time in double
+///precision, edges repeated, as the reference
+///
+/// \param src the plane
+/// \param magnitude the magnitude in levels per pixel
+/// \param orientation the direction in radians
+/// \param op the operator
+///
+static void gradient_reference(const image_view<const unsigned char> &src, const image_view<float> &magnitude,
+	const image_view<float> &orientation, gradient_operator op) {
+	const int side = op == gradient_scharr ? 3 : 1, center = op == gradient_scharr ? 10 : 2;
+	const int width = (int)src.width, height = (int)src.height;
+	for (int y = 0; y < height; ++y) {
+		const int u = std::max(y - 1, 0), d = std::min(y + 1, height - 1);
+		for (int x = 0; x < width; ++x) {
+			const int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+			const int gx = side * (src(r, u) + src(r, d) - src(l, u) - src(l, d)) + center * (src(r, y) - src(l, y));
+			const int gy = side * (src(l, d) + src(r, d) - src(l, u) - src(r, u)) + center * (src(x, d) - src(x, u));
+			magnitude(x, y) = (float)(std::sqrt((double)(gx * gx + gy * gy)) / (2.0 * (2 * side + center)));
+			orientation(x, y) = (float)std::atan2((double)gy, (double)gx);
+		}
+	}
+}
+
+///This will return the largest difference between two planes of angles,
+///going the short way around the circle
+static double angle_difference(const image_view<const float> &a, const image_view<const float> &b) {
+	double diff = 0.0;
+	for (unsigned int y = 0; y < a.height; ++y) {
+		for (unsigned int x = 0; x < a.width; ++x) {
+			const double d = std::fabs((double)a(x, y) - b(x, y));
+			diff = std::max(diff, std::min(d, 2.0 * PI - d));
+		}
+	}
+	return diff;
+}
+
+void test_gradient() {
+	const gradient_operator ops[] = { gradient_sobel, gradient_scharr };
+	//sizes around the 16-pixel vector step and its edge columns, and 1x1
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 6 }, { 7, 1 }, { 17, 3 }, { 18, 4 }, { 34, 5 }, { 70, 45 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 1 + s);
+		const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+		ppm<float> reference(width, height, uninitialized), out(width, height, uninitialized);
+		ppm<float, interleaved> packed_out(width, height, uninitialized);
+		ppm<> edges(width, height, uninitialized), packed_edges(width, height, uninitialized);
+		for (unsigned int o = 0; o < 2; ++o) {
+			gradient_reference(img.view(1), reference.view(0), reference.view(1), ops[o]);
+			gradient(img.view(1), out.view(0), out.view(1), ops[o]);
+			CHECK(max_difference(out.view(0), reference.view(0)) <= 1e-4);
+			CHECK(angle_difference(out.view(1), reference.view(1)) <= 2e-5);
+			//the magnitude alone is the same as with the orientation
+			gradient(img.view(1), out.view(2), image_view<float>(), ops[o]);
+			CHECK(max_difference(out.view(2), out.view(0)) == 0);
+
+			//a strided source, and strided outputs
+			gradient(packed.view(1), packed_out.view(0), packed_out.view(2), ops[o]);
+			CHECK(max_difference(packed_out.view(0), out.view(0)) == 0 && max_difference(packed_out.view(2), out.view(1)) == 0);
+
+			//8-bit magnitudes are twice the float ones, rounded and clamped
+			gradient(img.view(1), edges.view(1), ops[o]);
+			bool rounded = true;
+			for (unsigned int y = 0; y < height; ++y)
+				for (unsigned int x = 0; x < width; ++x)
+					rounded = rounded
+						&& std::fabs(edges.view(1)(x, y) - std::min(2.0 * reference.view(0)(x, y), 255.0)) <= 0.5001;
+			CHECK(rounded);
+			gradient(packed.view(1), packed_edges.view(0), ops[o]);
+			CHECK(max_difference(packed_edges.view(0), edges.view(1)) == 0);
+		}
+
+		//a flat plane has no gradient, and its orientation is 0
+		const ppm<> flat = constant_image(width, height, 0, 200, 255);
+		for (unsigned int o = 0; o < 2; ++o) {
+			fill(out.view(1), 1.0f);
+			gradient(flat.view(1), out.view(0), out.view(1), ops[o]);
+			gradient(flat.view(2), edges.view(2), ops[o]);
+			bool zero = all_equal(edges.view(2), 0);
+			for (unsigned int y = 0; y < height; ++y)
+				for (unsigned int x = 0; x < width; ++x)
+					zero = zero && out.view(0)(x, y) == 0.0f && out.view(1)(x, y) == 0.0f;
+			CHECK(zero);
+		}
+	}
+
+	//ramps away from the edges: 3 levels per pixel along x points at 0, along y at pi / 2 and against x at pi
+	ppm<> ramps(40, 20, uninitialized);
+	for (unsigned int y = 0; y < 20; ++y) {
+		for (unsigned int x = 0; x < 40; ++x) {
+			ramps.view(0)(x, y) = (unsigned char)(3 * x);
+			ramps.view(1)(x, y) = (unsigned char)(3 * y);
+			ramps.view(2)(x, y) = (unsigned char)(200 - 3 * x);
+		}
+	}
+	const float directions[] = { 0.0f, (float)(PI / 2.0), (float)PI };
+	ppm<float> out(40, 20, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int o = 0; o < 2; ++o) {
+			gradient(ramps.view(c), out.view(0), out.view(1), ops[o]);
+			bool along = true;
+			for (unsigned int y = 1; y < 19; ++y)
+				for (unsigned int x = 1; x < 39; ++x)
+					along = along && std::fabs(out.view(0)(x, y) - 3.0f) <= 1e-5f
+						&& std::fabs(out.view(1)(x, y) - directions[c]) <= 2e-5f;
+			CHECK(along);
+		}
+	}
+
+	//the rows come out the same however they are spread over threads
+	const ppm<> large = random_image(500, 300, 20);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<float> result(large.width, large.height);
+		gradient(large.view(0), result.view(0), result.view(1), gradient_scharr);
+		return result;
+	}));
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> edges(large.width, large.height);
+		gradient(large.view(0), edges.view(0), gradient_sobel);
+		return edges;
+	}));
+}
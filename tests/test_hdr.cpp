@@ -0,0 +1,261 @@
+///
+/// \file test_hdr.cpp
+/// \brief Tests of the Radiance RGBE and PFM writers
+///
+
+#include "tests.h"
+#include "ppm.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+///This will read a whole file
+///
+/// \param name the file
+/// \return its bytes, none if it could not be opened
+///
+static std::vector<unsigned char> read_file(const char *name) {
+	std::ifstream input(name, std::ios::in | std::ios::binary);
+	return std::vector<unsigned char>(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+}
+
+///This will parse the line of a file starting at pos, moving pos past it
+///
+/// \param file the bytes of the file
+/// \param pos where the line starts, advanced past its newline
+/// \return the line without its newline
+///
+static std::string next_line(const std::vector<unsigned char> &file, size_t &pos) {
+	std::string line;
+	while (pos < file.size() && file[pos] != '\n')
+		line += (char)file[pos++];
+	pos++;
+	return line;
+}
+
+///This will decode one run length encoded component of an RGBE scanline,
+///rejecting runs and literals that are empty or overrun the scanline
+///
+/// \param file the bytes of the file
+/// \param pos where the component starts, advanced past it
+/// \param width the number of pixels in the scanline
+/// \param out the component of each pixel
+/// \return true if the component is well formed
+///
+static bool decode_component(const std::vector<unsigned char> &file, size_t &pos, unsigned int width,
+	std::vector<unsigned char> &out) {
+	out.clear();
+	while (out.size() < width) {
+		if (pos >= file.size())
+			return false;
+		const unsigned int code = file[pos++];
+		if (code > 128) {
+			if (code - 128 > width - out.size() || pos >= file.size())
+				return false;
+			out.insert(out.end(), code - 128, file[pos++]);
+		}
+		else {
+			if (code == 0 || code > width - out.size() || pos + code > file.size())
+				return false;
+			out.insert(out.end(), file.begin() + pos, file.begin() + pos + code);
+			pos += code;
+		}
+	}
+	return true;
+}
+
+///This will decode a Radiance RGBE file the way a reader would: run length
+///encoded scanlines for widths from 8 to 32767, flat ones otherwise
+///
+/// \param name the file
+/// \param out the decoded image
+/// \return true if the header and every scanline are well formed and nothing follows them
+///
+static bool decode_rgbe(const char *name, ppm<float> &out) {
+	const std::vector<unsigned char> file = read_file(name);
+	size_t pos = 0;
+	unsigned int width = 0, height = 0;
+	if (next_line(file, pos) != "#?RADIANCE" || next_line(file, pos) != "FORMAT=32-bit_rle_rgbe"
+		|| next_line(file, pos) != "" || std::sscanf(next_line(file, pos).c_str(), "-Y %u +X %u", &height, &width) != 2)
+		return false;
+	out = ppm<float>(width, height, uninitialized);
+	const bool rle = width >= 8 && width < 32768;
+	std::vector<unsigned char> rgbe(4 * (size_t)width), component;
+	for (unsigned int y = 0; y < height; ++y) {
+		if (rle) {
+			if (pos + 4 > file.size() || file[pos] != 2 || file[pos + 1] != 2
+				|| ((unsigned int)file[pos + 2] << 8 | file[pos + 3]) != width)
+				return false;
+			pos += 4;
+			for (unsigned int c = 0; c < 4; ++c) {
+				if (!decode_component(file, pos, width, component))
+					return false;
+				for (unsigned int x = 0; x < width; ++x)
+					rgbe[4 * x + c] = component[x];
+			}
+		}
+		else {
+			if (pos + rgbe.size() > file.size())
+				return false;
+			std::copy(file.begin() + pos, file.begin() + pos + rgbe.size(), rgbe.begin());
+			pos += rgbe.size();
+		}
+		for (unsigned int x = 0; x < width; ++x) {
+			const int e = rgbe[4 * x + 3];
+			for (unsigned int c = 0; c < 3; ++c)
+				out.view(c)(x, y) = e == 0 ? 0.0f : (float)std::ldexp((double)rgbe[4 * x + c], e - 136);
+		}
+	}
+	return pos == file.size();
+}
+
+///This will tell whether a decoded RGBE image matches the image written:
+///each channel within 1/128 of the pixel's largest, negatives clamped to
+///zero, and black pixels exactly zero
+///
+/// \param decoded the decoded image
+/// \param src the image written
+/// \return true if every pixel matches
+///
+static bool rgbe_matches(const ppm<float> &decoded, const rgb_view<const float> &src) {
+	if (decoded.width != src.width() || decoded.height != src.height())
+		return false;
+	for (unsigned int y = 0; y < src.height(); ++y) {
+		for (unsigned int x = 0; x < src.width(); ++x) {
+			const float largest = std::max(src[0](x, y), std::max(src[1](x, y), src[2](x, y)));
+			for (unsigned int c = 0; c < 3; ++c) {
+				const float want = std::max(src[c](x, y), 0.0f), got = decoded.view(c)(x, y);
+				if (largest <= 0.0f ? got != 0.0f : !(std::fabs(got - want) <= largest / 128.0f))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+///This will tell whether a PFM file holds exactly the samples of an image,
+///rows bottom to top
+///
+/// \param name the file
+/// \param src the image written
+/// \return true if the header is right and every sample is bit for bit the same
+///
+static bool pfm_matches(const char *name, const rgb_view<const float> &src) {
+	const std::vector<unsigned char> file = read_file(name);
+	size_t pos = 0;
+	unsigned int width = 0, height = 0;
+	float scale = 0.0f;
+	if (next_line(file, pos) != "PF" || std::sscanf(next_line(file, pos).c_str(), "%u %u", &width, &height) != 2
+		|| std::sscanf(next_line(file, pos).c_str(), "%f", &scale) != 1)
+		return false;
+	const unsigned int one = 1;
+	const bool little_endian = *(const unsigned char *)&one == 1;
+	if (width != src.width() || height != src.height() || (scale < 0.0f) != little_endian
+		|| file.size() - pos != 3 * sizeof(float) * (size_t)width * height)
+		return false;
+	for (unsigned int y = 0; y < height; ++y) {
+		for (unsigned int x = 0; x < width; ++x) {
+			for (unsigned int c = 0; c < 3; ++c) {
+				const float v = src[c](x, height - 1 - y);
+				if (std::memcmp(&file[pos], &v, sizeof(float)) != 0)
+					return false;
+				pos += sizeof(float);
+			}
+		}
+	}
+	return true;
+}
+
+///This will return an image of runs of equal pixels, of lengths around the
+///shortest run encoded and the longest, between stretches of up to 300
+///pixels that all differ, over a wide range of exponents, with black and
+///negative pixels among them
+///
+/// \param width the width in pixels
+/// \param height the height in pixels
+/// \param seed the seed
+/// \return the image
+///
+static ppm<float> hdr_image(unsigned int width, unsigned int height, unsigned int seed) {
+	const unsigned int runs[] = { 1, 2, 3, 4, 5, 126, 127, 128, 129, 300 };
+	ppm<float> img(width, height, uninitialized);
+	unsigned int state = seed;
+	for (unsigned int y = 0; y < height; ++y) {
+		unsigned int x = 0;
+		while (x < width) {
+			state = state * 1664525u + 1013904223u;
+			const bool noise = (state >> 8) % 4 == 0;
+			const unsigned int run = std::min(noise ? 1 + (state >> 12) % 300 : runs[(state >> 12) % 10], width - x);
+			float color[3];
+			for (unsigned int i = 0; i < run; ++i, ++x) {
+				if (i == 0 || noise) {
+					for (unsigned int c = 0; c < 3; ++c) {
+						state = state * 1664525u + 1013904223u;
+						color[c] = std::ldexp((float)(state >> 8) / 16777216.0f, (int)((state >> 4) % 40) - 25);
+					}
+					if ((state >> 13) % 9 == 0)
+						color[0] = color[1] = color[2] = 0.0f;
+					else if ((state >> 13) % 9 == 1)
+						color[1] = -color[1];
+				}
+				for (unsigned int c = 0; c < 3; ++c)
+					img.view(c)(x, y) = color[c];
+			}
+		}
+	}
+	return img;
+}
+
+void test_hdr() {
+	const char *rgbe_name = "test_hdr.hdr";
+	const char *pfm_name = "test_hdr.pfm";
+	//widths below 8, which are written flat, up to 32767 and past it; heights past the 64 rows encoded at
+	//once; and PFM rows that take several chunks, or more than one chunk each
+	const unsigned int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 8, 2 }, { 9, 5 }, { 128, 3 }, { 300, 70 }, { 1000, 130 },
+		{ 32767, 2 }, { 40000, 2 }, { 90000, 2 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const ppm<float> img = hdr_image(sizes[s][0], sizes[s][1], 1 + s);
+		ppm<float> decoded;
+		img.write_rgbe(rgbe_name);
+		CHECK(decode_rgbe(rgbe_name, decoded) && rgbe_matches(decoded, img.view()));
+		img.write_pfm(pfm_name);
+		CHECK(pfm_matches(pfm_name, img.view()));
+		//a strided float image writes the same files
+		const ppm<float, interleaved> packed(img.view(), 1);
+		packed.write_rgbe(rgbe_name);
+		CHECK(decode_rgbe(rgbe_name, decoded) && rgbe_matches(decoded, img.view()));
+		packed.write_pfm(pfm_name);
+		CHECK(pfm_matches(pfm_name, img.view()));
+	}
+
+	//8-bit images are written scaled to [0, 1]
+	const ppm<> img = random_image(50, 70, 20);
+	const ppm<float> scaled = to_float(img);
+	CHECK(scaled.normalized(0, 0) == img.view(0)(0, 0) / 255.0f);
+	ppm<float> decoded;
+	img.write_rgbe(rgbe_name);
+	CHECK(decode_rgbe(rgbe_name, decoded) && rgbe_matches(decoded, scaled.view()));
+	img.write_pfm(pfm_name);
+	CHECK(pfm_matches(pfm_name, scaled.view()));
+
+	//a flat image compresses to a few runs per scanline, and black stays black
+	const ppm<float> flat(300, 4);
+	flat.write_rgbe(rgbe_name);
+	CHECK(read_file(rgbe_name).size() < 200 && decode_rgbe(rgbe_name, decoded) && rgbe_matches(decoded, flat.view()));
+
+	//the files come out the same however the rows are spread over threads
+	const ppm<float> large = hdr_image(700, 200, 30);
+	CHECK(same_on_every_thread_count([&]() {
+		large.write_rgbe(rgbe_name);
+		return read_file(rgbe_name);
+	}, [](const std::vector<unsigned char> &a, const std::vector<unsigned char> &b) { return a == b; }));
+	CHECK(same_on_every_thread_count([&]() {
+		large.write_pfm(pfm_name);
+		return read_file(pfm_name);
+	}, [](const std::vector<unsigned char> &a, const std::vector<unsigned char> &b) { return a == b; }));
+	std::remove(rgbe_name);
+	std::remove(pfm_name);
+}
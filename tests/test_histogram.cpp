@@ -0,0 +1,158 @@
+///
+/// \file test_histogram.cpp
+/// \brief Tests of the histograms, their incremental updates and the curves
+///
+
+#include "tests.h"
+#include "histogram.h"
+
+///This will count an image one sample at a time, as the reference
+///
+/// \param src the image
+/// \return the histogram, statistics included
+///
+static histogram histogram_reference(const rgb_view<const unsigned char> &src) {
+	histogram h;
+	h.samples = src.width() * src.height();
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < src.height(); ++y)
+			for (unsigned int x = 0; x < src.width(); ++x)
+				h.counts[c][src[c](x, y)]++;
+	for (unsigned int c = 0; c < 3; ++c) {
+		bool found = false;
+		for (unsigned int v = 0; v < 256; ++v) {
+			if (h.counts[c][v] == 0)
+				continue;
+			h.sum[c] += (uint64_t)v * h.counts[c][v];
+			if (!found)
+				h.lowest[c] = (unsigned char)v;
+			h.highest[c] = (unsigned char)v;
+			found = true;
+		}
+	}
+	return h;
+}
+
+///This will tell whether two histograms hold the same counts and statistics
+static bool same_histogram(const histogram &a, const histogram &b) {
+	bool same = a.samples == b.samples;
+	for (unsigned int c = 0; c < 3; ++c) {
+		same = same && a.sum[c] == b.sum[c] && a.lowest[c] == b.lowest[c] && a.highest[c] == b.highest[c];
+		for (unsigned int v = 0; v < 256; ++v)
+			same = same && a.counts[c][v] == b.counts[c][v];
+	}
+	return same;
+}
+
+void test_histogram() {
+	//counting matches one sample at a time on odd sizes, 1x1, strided images and an empty region
+	const unsigned int sizes[][2] = { { 1, 1 }, { 3, 1 }, { 5, 7 }, { 131, 67 }, { 640, 100 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const ppm<> img = random_image(sizes[s][0], sizes[s][1], 1 + s);
+		const rgb_view<const unsigned char> src(img.view());
+		CHECK(same_histogram(compute_histogram(src), histogram_reference(src)));
+		const ppm<unsigned char, interleaved> packed(src, 255);
+		CHECK(same_histogram(compute_histogram(rgb_view<const unsigned char>(packed.view())), histogram_reference(src)));
+	}
+	const ppm<> img = random_image(200, 150, 10);
+	const rgb_view<const unsigned char> src(img.view());
+	CHECK(same_histogram(compute_histogram(src.crop(10, 10, 0, 20)), histogram()));
+
+	//runs of equal samples, which the interleaved copies are for
+	const ppm<> flat = constant_image(97, 13, 0, 128, 255);
+	const histogram flat_h = compute_histogram(rgb_view<const unsigned char>(flat.view()));
+	CHECK(same_histogram(flat_h, histogram_reference(rgb_view<const unsigned char>(flat.view()))));
+	CHECK(flat_h.peak(1) == 97 * 13 && flat_h.percentile(1, 0.0f) == 128 && flat_h.percentile(1, 1.0f) == 128);
+
+	//percentiles count samples at or below
+	histogram ramp;
+	for (unsigned int v = 0; v < 100; ++v)
+		ramp.counts[0][v] = 1;
+	ramp.samples = 100;
+	CHECK(ramp.percentile(0, 0.0f) == 0 && ramp.percentile(0, 0.5f) == 49 && ramp.percentile(0, 1.0f) == 99);
+
+	//replacing samples one at a time keeps the counts and statistics current, also when the last
+	//sample at the minimum or maximum leaves it
+	ppm<> edited = img;
+	histogram h = compute_histogram(src);
+	unsigned int state = 7;
+	for (unsigned int n = 0; n < 2000; ++n) {
+		state = state * 1664525u + 1013904223u;
+		const unsigned int x = (state >> 8) % img.width, y = (state >> 16) % img.height, c = n % 3;
+		const unsigned char value = (unsigned char)(n < 1000 ? 100 + n % 50 : (state >> 24));
+		h.replace(c, edited.view(c)(x, y), value);
+		edited.view(c)(x, y) = value;
+	}
+	CHECK(same_histogram(h, histogram_reference(rgb_view<const unsigned char>(edited.view()))));
+	ppm<> single = constant_image(1, 1, 5, 5, 5);
+	histogram one = compute_histogram(rgb_view<const unsigned char>(single.view()));
+	one.replace(0, 5, 200);
+	single.view(0)(0, 0) = 200;
+	CHECK(same_histogram(one, histogram_reference(rgb_view<const unsigned char>(single.view()))));
+
+	//a region counted out, redrawn and counted back in gives the histogram of the new image
+	const rgb_view<const unsigned char> region = rgb_view<const unsigned char>(edited.view()).crop(30, 20, 64, 64);
+	h.remove(region);
+	const ppm<> patch = constant_image(64, 64, 0, 255, 3);
+	for (unsigned int c = 0; c < 3; ++c)
+		copy(patch.view(c), edited.view(c).crop(30, 20, 64, 64));
+	h.add(region);
+	CHECK(same_histogram(h, histogram_reference(rgb_view<const unsigned char>(edited.view()))));
+	h.remove(rgb_view<const unsigned char>(edited.view()));
+	CHECK(same_histogram(h, histogram()));
+	h.add(rgb_view<const unsigned char>(edited.view()));
+	CHECK(same_histogram(h, histogram_reference(rgb_view<const unsigned char>(edited.view()))));
+
+	//auto-levels stretches the clip percentiles to the ends; equalization spreads two values to both ends;
+	//both leave a channel of one value alone
+	ppm<> narrow(60, 10, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < narrow.height; ++y)
+			for (unsigned int x = 0; x < narrow.width; ++x)
+				narrow.view(c)(x, y) = (unsigned char)(c == 2 ? 77 : 50 + (x + y * 7) % 101);
+	ppm<> out(narrow.width, narrow.height, uninitialized);
+	auto_levels(rgb_view<const unsigned char>(narrow.view()), rgb_view<unsigned char>(out.view()), 0.0f);
+	const channel_curves levels = auto_levels_curves(compute_histogram(rgb_view<const unsigned char>(narrow.view())), 0.0f);
+	CHECK(levels.map[0][50] == 0 && levels.map[0][150] == 255 && levels.map[0][100] == 128 && levels.map[0][10] == 0);
+	CHECK(levels.map[2][77] == 77 && all_equal(out.view(2), 77));
+	CHECK(out.view(0)(0, 0) == 0 && out.view(1)(51, 7) == 255 && out.view(1)(50, 0) == 128);
+	ppm<> two(8, 8, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < 8; ++y)
+			for (unsigned int x = 0; x < 8; ++x)
+				two.view(c)(x, y) = (unsigned char)((x + y) % 2 ? 90 : 30);
+	equalize(rgb_view<const unsigned char>(two.view()), rgb_view<unsigned char>(two.view()));
+	bool spread = true;
+	for (unsigned int y = 0; y < 8; ++y)
+		for (unsigned int x = 0; x < 8; ++x)
+			spread = spread && two.view(1)(x, y) == ((x + y) % 2 ? 255 : 0);
+	CHECK(spread);
+	const channel_curves equal = equalize_curves(flat_h);
+	CHECK(equal.map[0][0] == 0 && equal.map[1][128] == 128 && equal.map[2][255] == 255);
+
+	//curves in place and on strided images give what they give on a separate planar output
+	const channel_curves curves = equalize_curves(compute_histogram(src));
+	ppm<> curved(img.width, img.height, uninitialized);
+	apply_curves(src, rgb_view<unsigned char>(curved.view()), curves);
+	bool mapped = true;
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < img.height; ++y)
+			for (unsigned int x = 0; x < img.width; ++x)
+				mapped = mapped && curved.view(c)(x, y) == curves.map[c][img.view(c)(x, y)];
+	CHECK(mapped);
+	ppm<> in_place = img;
+	apply_curves(rgb_view<const unsigned char>(in_place.view()), rgb_view<unsigned char>(in_place.view()), curves);
+	CHECK(max_difference(rgb_view<const unsigned char>(in_place.view()), rgb_view<const unsigned char>(curved.view())) == 0);
+	const ppm<unsigned char, interleaved> packed(src, 255);
+	ppm<unsigned char, interleaved> packed_out(img.width, img.height, uninitialized);
+	apply_curves(rgb_view<const unsigned char>(packed.view()), rgb_view<unsigned char>(packed_out.view()), curves);
+	CHECK(max_difference(rgb_view<const unsigned char>(packed_out.view()), rgb_view<const unsigned char>(curved.view())) == 0);
+
+	//the bands sum to the same counts however they are spread over threads
+	const ppm<> large = random_image(500, 300, 20);
+	const rgb_view<const unsigned char> large_src(large.view());
+	CHECK(same_histogram(compute_histogram(large_src), histogram_reference(large_src)));
+	CHECK(same_on_every_thread_count([&]() {
+		return compute_histogram(large_src);
+	}, same_histogram));
+}
@@ -0,0 +1,161 @@
+///
+/// \file test_integral.cpp
+/// \brief Tests of the summed-area tables and the box means built on them
+///
+
+#include "tests.h"
+#include "integral.h"
+
+#include <cstdint>
+
+///This will sum a rectangle of a plane and its squares one sample at a
+///time, as the reference
+///
+/// \param src the plane
+/// \param x the first column
+/// \param y the first row
+/// \param w the number of columns
+/// \param h the number of rows
+/// \param square the sum of the squares of the samples
+/// \return the sum of the samples
+///
+static uint64_t sum_reference(const image_view<const unsigned char> &src, unsigned int x, unsigned int y,
+	unsigned int w, unsigned int h, uint64_t &square) {
+	uint64_t sum = 0;
+	square = 0;
+	for (unsigned int j = y; j < y + h; ++j) {
+		for (unsigned int i = x; i < x + w; ++i) {
+			sum += src(i, j);
+			square += (uint64_t)src(i, j) * src(i, j);
+		}
+	}
+	return sum;
+}
+
+///This will take the mean of the square around every sample directly,
+///over the part of it inside the plane, as the reference
+///
+/// \param src the plane
+/// \param dst the result, not src
+/// \param radius the radius of the square
+///
+static void box_mean_reference(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int radius) {
+	for (unsigned int y = 0; y < src.height; ++y) {
+		for (unsigned int x = 0; x < src.width; ++x) {
+			const unsigned int left = x > radius ? x - radius : 0, top = y > radius ? y - radius : 0;
+			const unsigned int right = std::min(x + radius + 1, src.width), bottom = std::min(y + radius + 1, src.height);
+			uint64_t square;
+			const uint64_t sum = sum_reference(src, left, top, right - left, bottom - top, square);
+			dst(x, y) = (unsigned char)((double)sum / ((double)(right - left) * (bottom - top)) + 0.5);
+		}
+	}
+}
+
+///This will check every statistic of a table against the reference on
+///rectangles drawn from a fixed seed, every rectangle of a small plane
+///
+/// \param table the table of src
+/// \param src the plane
+/// \return true if all of them match
+///
+static bool rectangles_match(const summed_area_table &table, const image_view<const unsigned char> &src) {
+	bool match = table.width == src.width && table.height == src.height;
+	const bool every = (uint64_t)src.width * src.height <= 200;
+	unsigned int state = 3;
+	for (unsigned int n = 0; match && n < (every ? src.width * src.height : 500u); ++n) {
+		unsigned int x, y;
+		if (every) {
+			x = n % src.width;
+			y = n / src.width;
+		}
+		else {
+			state = state * 1664525u + 1013904223u;
+			x = (state >> 8) % src.width;
+			y = (state >> 16) % src.height;
+		}
+		for (unsigned int h = 1; match && y + h <= src.height; h += every ? 1 : 1 + src.height / 7) {
+			for (unsigned int w = 1; match && x + w <= src.width; w += every ? 1 : 1 + src.width / 7) {
+				uint64_t square;
+				const uint64_t sum = sum_reference(src, x, y, w, h, square);
+				const double count = (double)w * h, mean = sum / count;
+				match = table.sum(x, y, w, h) == sum && table.sum_squares(x, y, w, h) == square
+					&& std::fabs(table.mean(x, y, w, h) - mean) <= 1e-9
+					&& std::fabs(table.variance(x, y, w, h) - std::max(square / count - mean * mean, 0.0)) <= 1e-6;
+			}
+		}
+	}
+	return match;
+}
+
+void test_integral() {
+	//sizes around the column strips of the second pass, and 1x1
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 9 }, { 11, 1 }, { 7, 13 }, { 511, 3 }, { 513, 5 }, { 90, 70 } };
+	const unsigned int radii[] = { 0, 1, 2, 5, 100 };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 1 + s);
+		const summed_area_table table(img.view(0));
+		CHECK(rectangles_match(table, img.view(0)));
+		//a strided plane gives the same table
+		const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+		const summed_area_table packed_table(packed.view(0));
+		CHECK(rectangles_match(packed_table, img.view(0)));
+
+		ppm<> reference(width, height, uninitialized), out(width, height, uninitialized);
+		for (unsigned int k = 0; k < sizeof(radii) / sizeof(radii[0]); ++k) {
+			box_mean_reference(img.view(0), reference.view(0), radii[k]);
+			box_mean(table, out.view(0), radii[k]);
+			CHECK(max_difference(out.view(0), reference.view(0)) == 0);
+			//into the plane the table was built from, and into a strided plane
+			ppm<> in_place = img;
+			box_mean(summed_area_table(in_place.view(0)), in_place.view(0), radii[k]);
+			CHECK(max_difference(in_place.view(0), reference.view(0)) == 0);
+			ppm<unsigned char, interleaved> packed_out(width, height, uninitialized);
+			box_mean(table, packed_out.view(1), radii[k]);
+			CHECK(max_difference(packed_out.view(1), reference.view(0)) == 0);
+		}
+
+		//a flat plane has its value for every mean and no variance
+		const ppm<> flat = constant_image(width, height, 0, 201, 255);
+		const summed_area_table flat_table(flat.view(1));
+		CHECK(flat_table.mean(0, 0, width, height) == 201.0 && flat_table.variance(0, 0, width, height) == 0.0);
+		box_mean(flat_table, out.view(1), 3);
+		CHECK(all_equal(out.view(1), 201));
+	}
+
+	//an empty plane gives an empty table, and rebuilding a table for another size replaces it
+	summed_area_table table;
+	CHECK(table.empty());
+	const ppm<> img = random_image(40, 30, 10);
+	table.build(img.view(2).crop(0, 0, 0, 30));
+	CHECK(table.empty());
+	table.build(img.view(2));
+	CHECK(rectangles_match(table, img.view(2)));
+	table.build(img.view(2).crop(5, 3, 17, 9));
+	CHECK(rectangles_match(table, img.view(2).crop(5, 3, 17, 9)));
+
+	//past SAT_MAX_NARROW_PIXELS the sums of a white plane no longer fit 32 bits and take 64
+	const unsigned int wide_width = 4200, wide_height = 4011;
+	CHECK((uint64_t)wide_width * wide_height > SAT_MAX_NARROW_PIXELS);
+	pixel_buffer<unsigned char> white((size_t)wide_width * wide_height, uninitialized);
+	const image_view<unsigned char> white_view(white.data(), wide_width, wide_height, wide_width);
+	fill(white_view, (unsigned char)255);
+	table.build(white_view);
+	CHECK(table.sums.size() == 0 && table.wide_sums.size() > 0);
+	CHECK(table.sum(0, 0, wide_width, wide_height) == (uint64_t)255 * wide_width * wide_height);
+	CHECK(table.sum(1, 2, wide_width - 1, wide_height - 2) == (uint64_t)255 * (wide_width - 1) * (wide_height - 2));
+	CHECK(table.variance(0, 0, wide_width, wide_height) == 0.0);
+	table = summed_area_table();
+
+	//the bands and strips sum the same however they are spread over threads
+	const ppm<> large = random_image(1300, 300, 20);
+	CHECK(same_on_every_thread_count([&]() {
+		return summed_area_table(large.view(1));
+	}, [](const summed_area_table &a, const summed_area_table &b) {
+		bool same = a.sums.size() == b.sums.size();
+		for (size_t i = 0; same && i < a.sums.size(); ++i)
+			same = a.sums[i] == b.sums[i] && a.squares[i] == b.squares[i];
+		return same;
+	}));
+}
@@ -0,0 +1,180 @@
+///
+/// \file test_layers.cpp
+/// \brief Tests of Porter-Duff compositing and the stack's tile cache
+///
+
+#include "tests.h"
+#include "layers.h"
+
+///This will divide by 255, rounded to nearest
+static unsigned int divide255(unsigned int x) {
+	return (2 * x + 255) / 510;
+}
+
+///This will composite an image one pixel at a time from the Porter-Duff
+///factors of each operator, as the reference
+///
+/// \param src the image to composite
+/// \param alpha its coverage, or an empty view if it is opaque
+/// \param opacity scales the coverage, 0 to 1
+/// \param op the operator
+/// \param dst the premultiplied image below, replaced by the result
+/// \param dst_alpha the coverage below, replaced by the result
+///
+static void composite_reference(const rgb_view<const unsigned char> &src, const image_view<const unsigned char> &alpha,
+	float opacity, blend_op op, const rgb_view<unsigned char> &dst, const image_view<unsigned char> &dst_alpha) {
+	const unsigned int opacity8 = (unsigned int)(std::min(std::max(opacity, 0.0f), 1.0f) * 255.0f + 0.5f);
+	for (unsigned int y = 0; y < src.height(); ++y) {
+		for (unsigned int x = 0; x < src.width(); ++x) {
+			const unsigned int sa = alpha.empty() ? opacity8 : divide255(alpha(x, y) * opacity8), da = dst_alpha(x, y);
+			unsigned int fa = 0, fb = 0;
+			switch (op) {
+			case blend_clear: fa = 0; fb = 0; break;
+			case blend_copy: fa = 255; fb = 0; break;
+			case blend_over: fa = 255; fb = 255 - sa; break;
+			case blend_dst_over: fa = 255 - da; fb = 255; break;
+			case blend_in: fa = da; fb = 0; break;
+			case blend_out: fa = 255 - da; fb = 0; break;
+			case blend_atop: fa = da; fb = 255 - sa; break;
+			case blend_xor: fa = 255 - da; fb = 255 - sa; break;
+			case blend_plus: fa = 255; fb = 255; break;
+			}
+			for (unsigned int c = 0; c < 3; ++c)
+				dst[c](x, y) = (unsigned char)std::min(divide255(fa * divide255(src[c](x, y) * sa)) + divide255(fb * dst[c](x, y)),
+					255u);
+			dst_alpha(x, y) = (unsigned char)std::min(divide255(fa * sa) + divide255(fb * da), 255u);
+		}
+	}
+}
+
+///This will flatten a stack by compositing its visible layers in turn
+///over the whole image, as the reference for the tiles
+///
+/// \param stack the stack
+/// \param out the colors, premultiplied
+/// \param coverage the coverage
+///
+static void flatten_reference(const layer_stack &stack, ppm<> &out, ppm<> &coverage) {
+	for (unsigned int c = 0; c < 3; ++c)
+		fill(out.view(c), (unsigned char)0);
+	fill(coverage.view(0), (unsigned char)0);
+	for (size_t i = 0; i < stack.layers.size(); ++i) {
+		const layer &l = stack.layers[i];
+		if (l.visible)
+			composite_reference(rgb_view<const unsigned char>(l.image.view()), l.alpha.view(), l.opacity, l.op,
+				rgb_view<unsigned char>(out.view()), coverage.view(0));
+	}
+}
+
+///This will tell whether a stack's flattened result is the reference's
+static bool flattened(const layer_stack &stack) {
+	ppm<> out(stack.width, stack.height, uninitialized), coverage(stack.width, stack.height, uninitialized);
+	flatten_reference(stack, out, coverage);
+	return max_difference(rgb_view<const unsigned char>(stack.flat.view()), rgb_view<const unsigned char>(out.view())) == 0
+		&& max_difference(stack.coverage_view(), coverage.view(0)) == 0;
+}
+
+void test_layers() {
+	const blend_op ops[] = { blend_clear, blend_copy, blend_over, blend_dst_over, blend_in, blend_out, blend_atop,
+		blend_xor, blend_plus };
+	const float opacities[] = { 0.0f, 0.3f, 1.0f };
+	//sizes around the 16-pixel vector step, and 1x1
+	const unsigned int sizes[][2] = { { 1, 1 }, { 15, 2 }, { 16, 3 }, { 17, 1 }, { 70, 33 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> src = random_image(width, height, 1 + s), below = random_image(width, height, 20 + s);
+		//the layer's coverage, and the coverage below
+		const ppm<> alphas = random_image(width, height, 40 + s);
+		const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(src.view()), 255);
+		for (unsigned int o = 0; o < sizeof(ops) / sizeof(ops[0]); ++o) {
+			for (unsigned int k = 0; k < 3; ++k) {
+				for (unsigned int masked = 0; masked < 2; ++masked) {
+					const image_view<const unsigned char> alpha = masked ? alphas.view(0) : image_view<const unsigned char>();
+					//three copies of the coverage below, one per call
+					ppm<> reference = below, out = below, coverage = alphas;
+					copy(alphas.view(1), coverage.view(0));
+					copy(alphas.view(1), coverage.view(2));
+					composite_reference(rgb_view<const unsigned char>(src.view()), alpha, opacities[k], ops[o],
+						rgb_view<unsigned char>(reference.view()), coverage.view(1));
+					composite(rgb_view<const unsigned char>(src.view()), alpha, opacities[k], ops[o],
+						rgb_view<unsigned char>(out.view()), coverage.view(2));
+					CHECK(max_difference(rgb_view<const unsigned char>(out.view()), rgb_view<const unsigned char>(reference.view()))
+						== 0);
+					CHECK(max_difference(coverage.view(2), coverage.view(1)) == 0);
+
+					//a strided layer takes the scalar loop
+					ppm<unsigned char, interleaved> packed_below(rgb_view<const unsigned char>(below.view()), 255);
+					composite(rgb_view<const unsigned char>(packed.view()), alpha, opacities[k], ops[o],
+						rgb_view<unsigned char>(packed_below.view()), coverage.view(0));
+					CHECK(max_difference(rgb_view<const unsigned char>(packed_below.view()),
+						rgb_view<const unsigned char>(reference.view())) == 0);
+					CHECK(max_difference(coverage.view(0), coverage.view(1)) == 0);
+				}
+			}
+		}
+	}
+
+	//opaque white over anything is white, and clear leaves nothing
+	const ppm<> white = constant_image(33, 5, 255, 255, 255);
+	ppm<> dst = random_image(33, 5, 60), coverage = random_image(33, 5, 61);
+	composite(rgb_view<const unsigned char>(white.view()), image_view<const unsigned char>(), 1.0f, blend_over,
+		rgb_view<unsigned char>(dst.view()), coverage.view(0));
+	CHECK(all_equal(dst.view(0), 255) && all_equal(dst.view(1), 255) && all_equal(dst.view(2), 255));
+	CHECK(all_equal(coverage.view(0), 255));
+	composite(rgb_view<const unsigned char>(white.view()), image_view<const unsigned char>(), 1.0f, blend_clear,
+		rgb_view<unsigned char>(dst.view()), coverage.view(0));
+	CHECK(all_equal(dst.view(0), 0) && all_equal(dst.view(1), 0) && all_equal(dst.view(2), 0));
+	CHECK(all_equal(coverage.view(0), 0));
+
+	//a stack over sizes that leave partial tiles starts transparent black, and flattens to compositing its
+	//layers in turn
+	const unsigned int width = 150, height = 100;
+	layer_stack stack(width, height);
+	CHECK(stack.tiles_across() == 3 && stack.tiles_down() == 2 && stack.flatten().empty());
+	CHECK(all_equal(stack.coverage_view(), 0) && all_equal(stack.flat.view(0), 0));
+	unsigned int x, y, w, h;
+	stack.tile_bounds(5, x, y, w, h);
+	CHECK(x == 128 && y == 64 && w == 22 && h == 36);
+	const blend_op stacked[] = { blend_copy, blend_over, blend_atop, blend_plus, blend_xor };
+	for (unsigned int k = 0; k < 5; ++k) {
+		mask alpha;
+		if (k > 0)
+			alpha = threshold(random_image(width, height, 70 + k).view(0), 100);
+		CHECK(stack.add(layer(random_image(width, height, 80 + k), alpha, stacked[k], 1.0f - 0.15f * k)));
+	}
+	CHECK(stack.flatten().size() == 6 && flattened(stack));
+	//layers of another size are refused
+	CHECK(!stack.add(layer(random_image(width, height + 1, 90))) && stack.layers.size() == 5);
+	CHECK(!stack.add(layer(random_image(width, height, 90), mask(width - 1, height))) && stack.layers.size() == 5);
+
+	//an edit touching one pixel recomposites only its tile; one across a tile corner, the four tiles it overlaps
+	layer &top = stack.layers.back();
+	top.image.view(0)(70, 10) = 1;
+	stack.touch(70, 10, 1, 1);
+	std::vector<unsigned int> tiles = stack.flatten();
+	CHECK(tiles.size() == 1 && tiles[0] == 1 && flattened(stack));
+	fill(top.image.view(1).crop(60, 60, 10, 10), (unsigned char)200);
+	fill(top.alpha.view().crop(60, 60, 10, 10), (unsigned char)255);
+	stack.touch(60, 60, 10, 10);
+	tiles = stack.flatten();
+	CHECK(tiles.size() == 4 && tiles[0] == 0 && tiles[1] == 1 && tiles[2] == 3 && tiles[3] == 4 && flattened(stack));
+	//rectangles past the edges are clipped, and nothing is left to flatten after a flatten
+	stack.touch(width - 1, height - 1, 50, 50);
+	stack.touch(width, 0, 5, 5);
+	stack.touch(0, 0, 0, 5);
+	tiles = stack.flatten();
+	CHECK(tiles.size() == 1 && tiles[0] == 5 && stack.flatten().empty());
+	//hiding a layer and changing its opacity and operator
+	stack.layers[2].visible = false;
+	stack.layers[3].opacity = 0.5f;
+	stack.layers[4].op = blend_in;
+	stack.touch_all();
+	CHECK(stack.flatten().size() == 6 && flattened(stack));
+
+	//the tiles come out the same however they are spread over threads
+	CHECK(same_on_every_thread_count([&]() {
+		stack.touch_all();
+		stack.flatten();
+		return stack.flat;
+	}));
+}
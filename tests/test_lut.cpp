@@ -0,0 +1,174 @@
+///
+/// \file test_lut.cpp
+/// \brief Tests of the 3D LUTs: .cube parsing and tetrahedral interpolation
+///
+
+#include "tests.h"
+#include "lut3d.h"
+
+#include <cstdio>
+#include <fstream>
+
+///This will sample a color transform on a grid into a table
+///
+/// \param size the grid points along each axis
+/// \param lo the input of the first grid point on every axis
+/// \param hi the input of the last grid point on every axis
+/// \param fn the transform, mapping an input color to an output color
+/// \return the table
+///
+template <typename F>
+static lut3d make_lut(unsigned int size, float lo, float hi, F fn) {
+	lut3d lut;
+	lut.size = size;
+	for (unsigned int c = 0; c < 3; ++c) {
+		lut.domain_min[c] = lo;
+		lut.domain_max[c] = hi;
+	}
+	for (unsigned int b = 0; b < size; ++b) {
+		for (unsigned int g = 0; g < size; ++g) {
+			for (unsigned int r = 0; r < size; ++r) {
+				const float in[3] = { lo + (hi - lo) * r / (size - 1), lo + (hi - lo) * g / (size - 1),
+					lo + (hi - lo) * b / (size - 1) };
+				float out[3];
+				fn(in, out);
+				lut.table.insert(lut.table.end(), out, out + 3);
+			}
+		}
+	}
+	return lut;
+}
+
+//an affine transform, which the interpolation reproduces exactly between grid points
+static void affine(const float in[3], float out[3]) {
+	out[0] = 0.8f * in[0] + 0.15f * in[1] + 0.05f;
+	out[1] = 0.1f * in[0] + 0.7f * in[1] + 0.2f * in[2];
+	out[2] = 0.3f * in[2] - 0.2f * in[0] + 0.4f;
+}
+
+//a curve applied to each channel alike, which keeps grays gray
+static void squared(const float in[3], float out[3]) {
+	for (unsigned int c = 0; c < 3; ++c)
+		out[c] = in[c] * in[c];
+}
+
+///This will write a text file
+static void write_file(const char *name, const char *text) {
+	std::ofstream out(name);
+	out << text;
+}
+
+void test_lut() {
+	const lut3d identity = make_lut(17, 0.0f, 1.0f, [](const float in[3], float out[3]) {
+		for (unsigned int c = 0; c < 3; ++c)
+			out[c] = in[c];
+	});
+	const lut3d shifted = make_lut(9, 0.0f, 1.0f, affine);
+	const lut3d wide = make_lut(5, -0.5f, 1.5f, affine);
+	const lut3d curve = make_lut(33, 0.0f, 1.0f, squared);
+	const unsigned int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 8, 2 }, { 37, 21 }, { 200, 40 } };
+
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 1 + s);
+		const rgb_view<const unsigned char> src(img.view());
+		ppm<> out(width, height, uninitialized);
+
+		//the identity, strength 0 and an empty table leave the image alone
+		apply_lut3d(src, rgb_view<unsigned char>(out.view()), identity);
+		CHECK(max_difference(rgb_view<const unsigned char>(out.view()), src) == 0);
+		apply_lut3d(src, rgb_view<unsigned char>(out.view()), curve, 0.0f);
+		CHECK(max_difference(rgb_view<const unsigned char>(out.view()), src) == 0);
+		apply_lut3d(src, rgb_view<unsigned char>(out.view()), lut3d());
+		CHECK(max_difference(rgb_view<const unsigned char>(out.view()), src) == 0);
+
+		//an affine table gives the affine transform, also over a domain wider than [0, 1]
+		const lut3d *affine_luts[] = { &shifted, &wide };
+		for (unsigned int n = 0; n < 2; ++n) {
+			ppm<float> linear(width, height, uninitialized), graded(width, height, uninitialized);
+			for (unsigned int c = 0; c < 3; ++c)
+				copy(img.view(c), linear.view(c));
+			for (unsigned int c = 0; c < 3; ++c)
+				for (unsigned int y = 0; y < height; ++y)
+					for (unsigned int x = 0; x < width; ++x)
+						linear.view(c)(x, y) /= 255.0f;
+			apply_lut3d(rgb_view<const float>(linear.view()), rgb_view<float>(graded.view()), *affine_luts[n], 0.75f);
+			apply_lut3d(src, rgb_view<unsigned char>(out.view()), *affine_luts[n], 0.75f);
+			bool exact = true, rounded = true;
+			for (unsigned int y = 0; y < height; ++y) {
+				for (unsigned int x = 0; x < width; ++x) {
+					const float in[3] = { linear.view(0)(x, y), linear.view(1)(x, y), linear.view(2)(x, y) };
+					float expected[3];
+					affine(in, expected);
+					for (unsigned int c = 0; c < 3; ++c) {
+						const float v = in[c] + 0.75f * (expected[c] - in[c]);
+						exact = exact && std::fabs(graded.view(c)(x, y) - v) <= 1e-5f;
+						rounded = rounded && std::fabs(out.view(c)(x, y) - std::min(std::max(v, 0.0f), 1.0f) * 255.0f) <= 0.51f;
+					}
+				}
+			}
+			CHECK(exact);
+			CHECK(rounded);
+		}
+
+		//the vector and scalar loops agree: a strided image takes the scalar one
+		const ppm<unsigned char, interleaved> packed(src, 255);
+		ppm<unsigned char, interleaved> packed_out(width, height, uninitialized);
+		apply_lut3d(src, rgb_view<unsigned char>(out.view()), curve, 0.8f);
+		apply_lut3d(rgb_view<const unsigned char>(packed.view()), rgb_view<unsigned char>(packed_out.view()), curve, 0.8f);
+		CHECK(max_difference(rgb_view<const unsigned char>(packed_out.view()), rgb_view<const unsigned char>(out.view())) <= 1);
+
+		//in place gives what a separate output does
+		ppm<> in_place = img;
+		apply_lut3d(rgb_view<const unsigned char>(in_place.view()), rgb_view<unsigned char>(in_place.view()), curve, 0.8f);
+		CHECK(max_difference(rgb_view<const unsigned char>(in_place.view()), rgb_view<const unsigned char>(out.view())) == 0);
+	}
+
+	//a table that keeps grays gray keeps them gray between its grid points
+	bool gray = true;
+	for (unsigned int v = 0; v < 256; ++v) {
+		const ppm<> flat = constant_image(11, 2, (unsigned char)v, (unsigned char)v, (unsigned char)v);
+		ppm<> out(flat.width, flat.height, uninitialized);
+		apply_lut3d(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(out.view()), curve);
+		gray = gray && max_difference(out.view(0), out.view(1)) == 0 && max_difference(out.view(1), out.view(2)) == 0;
+	}
+	CHECK(gray);
+
+	//colors outside the domain look up its edges, through the vector loop and the scalar one
+	ppm<float> odd(9, 1, uninitialized), odd_out(9, 1, uninitialized);
+	const float values[] = { -3.0f, 0.0f, 1.0f, 4.0f, 0.5f, -1.0f, 2.0f, 0.25f, 9.0f };
+	for (unsigned int x = 0; x < 9; ++x)
+		odd.view(0)(x, 0) = odd.view(1)(x, 0) = odd.view(2)(x, 0) = values[x];
+	apply_lut3d(rgb_view<const float>(odd.view()), rgb_view<float>(odd_out.view()), curve);
+	const float clamped[] = { 0.0f, 0.0f, 1.0f, 1.0f, 0.25f, 0.0f, 1.0f, 0.0625f, 1.0f };
+	bool clamps = true;
+	for (unsigned int x = 0; x < 9; ++x)
+		clamps = clamps && std::fabs(odd_out.view(0)(x, 0) - clamped[x]) <= 1e-3f;
+	CHECK(clamps);
+
+	//.cube files: comments, CRLF lines, the title and the domain keywords; bad files leave the table empty
+	const char *name = "test_lut.cube";
+	write_file(name, "# a comment\r\nTITLE \"two\"\r\nLUT_3D_SIZE 2\r\nDOMAIN_MIN 0 0 0\r\nDOMAIN_MAX 1 2 1\r\n"
+		"0 0 0\r\n1 0 0\r\n0 1 0\r\n1 1 0\r\n0 0 1\r\n1 0 1\r\n0 1 1\r\n1 1 1\r\n");
+	const lut3d loaded(name);
+	CHECK(loaded.size == 2 && loaded.title == "two" && loaded.table.size() == 24);
+	CHECK(loaded.domain_max[1] == 2.0f && loaded.table[3] == 1.0f && loaded.table[23] == 1.0f);
+	const char *bad[] = { "LUT_3D_SIZE 2\n0 0 0\n", "LUT_1D_SIZE 4\n0 0 0\n", "LUT_3D_SIZE 1\n0 0 0\n",
+		"LUT_3D_SIZE 2\nDOMAIN_MIN 1 1 1\nDOMAIN_MAX 1 1 1\n0 0 0\n1 0 0\n0 1 0\n1 1 0\n0 0 1\n1 0 1\n0 1 1\n1 1 1\n",
+		"LUT_3D_SIZE 2\n0 0\n" };
+	for (unsigned int n = 0; n < sizeof(bad) / sizeof(bad[0]); ++n) {
+		write_file(name, bad[n]);
+		lut3d rejected;
+		CHECK(!rejected.read(name) && rejected.empty());
+	}
+	std::remove(name);
+	CHECK(lut3d("no such file.cube").empty());
+
+	//the rows come out the same however they are spread over threads
+	const ppm<> large = random_image(300, 200, 20);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height, uninitialized);
+		apply_lut3d(rgb_view<const unsigned char>(large.view()), rgb_view<unsigned char>(result.view()), curve, 0.6f);
+		return result;
+	}));
+}
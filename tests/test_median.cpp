@@ -0,0 +1,100 @@
+///
+/// \file test_median.cpp
+/// \brief Tests of the constant-time median filter
+///
+
+#include "tests.h"
+#include "median.h"
+
+#include <algorithm>
+#include <vector>
+
+///This will median filter a plane by sorting each window, edges repeated,
+///as the reference
+///
+/// \param src the plane
+/// \param dst the filtered plane, not src
+/// \param radius the radius of the window
+///
+static void median_reference(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	unsigned int radius) {
+	const int r = (int)radius, width = (int)src.width, height = (int)src.height;
+	std::vector<unsigned char> window;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			window.clear();
+			for (int j = -r; j <= r; ++j)
+				for (int i = -r; i <= r; ++i)
+					window.push_back(src(std::min(std::max(x + i, 0), width - 1), std::min(std::max(y + j, 0), height - 1)));
+			std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+			dst(x, y) = window[window.size() / 2];
+		}
+	}
+}
+
+void test_median() {
+	//odd sizes, 1x1, and radii past the image size
+	const unsigned int sizes[][2] = { { 1, 1 }, { 2, 5 }, { 9, 4 }, { 33, 17 }, { 130, 61 } };
+	const unsigned int radii[] = { 0, 1, 2, 3, 7, 20 };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 1 + s);
+		//few distinct values, so many windows have their median at a run of equal samples
+		ppm<> coarse(width, height, uninitialized);
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				coarse.view(0)(x, y) = (unsigned char)(img.view(0)(x, y) & 0xe0);
+		const ppm<> flat = constant_image(width, height, 0, 99, 255);
+		ppm<> reference(width, height, uninitialized), out(width, height, uninitialized);
+		for (unsigned int k = 0; k < sizeof(radii) / sizeof(radii[0]); ++k) {
+			median_reference(img.view(1), reference.view(1), radii[k]);
+			median_filter(img.view(1), out.view(1), radii[k]);
+			CHECK(max_difference(out.view(1), reference.view(1)) == 0);
+			median_reference(coarse.view(0), reference.view(0), radii[k]);
+			median_filter(coarse.view(0), out.view(0), radii[k]);
+			CHECK(max_difference(out.view(0), reference.view(0)) == 0);
+
+			median_filter(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(out.view()), radii[k]);
+			CHECK(all_equal(out.view(0), 0) && all_equal(out.view(1), 99) && all_equal(out.view(2), 255));
+
+			//in place, and on a strided plane
+			ppm<> in_place = img;
+			median_filter(in_place.view(1), in_place.view(1), radii[k]);
+			median_reference(img.view(1), reference.view(1), radii[k]);
+			CHECK(max_difference(in_place.view(1), reference.view(1)) == 0);
+			const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+			ppm<unsigned char, interleaved> packed_out(width, height, uninitialized);
+			median_filter(packed.view(1), packed_out.view(1), radii[k]);
+			CHECK(max_difference(packed_out.view(1), reference.view(1)) == 0);
+		}
+	}
+
+	//images wider than two strips, so windows straddle the seams, also with radii past 127, where the
+	//counters are 32 bits
+	const unsigned int wide_sizes[][3] = { { 600, 24, 3 }, { 530, 12, 30 }, { 270, 3, 128 } };
+	for (unsigned int s = 0; s < sizeof(wide_sizes) / sizeof(wide_sizes[0]); ++s) {
+		const unsigned int width = wide_sizes[s][0], height = wide_sizes[s][1], radius = wide_sizes[s][2];
+		const ppm<> img = random_image(width, height, 30 + s);
+		ppm<> reference(width, height, uninitialized), out(width, height, uninitialized);
+		median_reference(img.view(0), reference.view(0), radius);
+		median_filter(img.view(0), out.view(0), radius);
+		CHECK(max_difference(out.view(0), reference.view(0)) == 0);
+	}
+	//a flat plane with a few specks, where one value fills more of a window than 16 bits can count
+	ppm<> specks = constant_image(20, 9, 100, 100, 100);
+	specks.view(0)(3, 4) = 0;
+	specks.view(0)(15, 1) = 255;
+	specks.view(0)(9, 8) = 255;
+	ppm<> reference(20, 9, uninitialized), out(20, 9, uninitialized);
+	median_reference(specks.view(0), reference.view(0), 130);
+	median_filter(specks.view(0), out.view(0), 130);
+	CHECK(max_difference(out.view(0), reference.view(0)) == 0);
+
+	//the strips come out the same however they are spread over threads
+	const ppm<> large = random_image(700, 120, 20);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height);
+		median_filter(large.view(2), result.view(2), 5);
+		return result;
+	}));
+}
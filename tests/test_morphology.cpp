@@ -0,0 +1,118 @@
+///
+/// \file test_morphology.cpp
+/// \brief Tests of erosion, dilation, opening and closing, and of masks
+///
+
+#include "tests.h"
+#include "morphology.h"
+#include "mask.h"
+
+#include <cstdio>
+
+///This will take the minimum or maximum over every rectangle directly,
+///skipping samples past the edges, as the reference
+///
+/// \param src the plane
+/// \param dst the result, not src
+/// \param dilate true for the maximum, false for the minimum
+/// \param rx the horizontal radius
+/// \param ry the vertical radius
+///
+static void extremum_reference(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	bool dilate, unsigned int rx, unsigned int ry) {
+	const int width = (int)src.width, height = (int)src.height;
+	for (int y = 0; y < height; ++y) {
+		for (int x = 0; x < width; ++x) {
+			unsigned char v = dilate ? 0 : 255;
+			for (int j = std::max(y - (int)ry, 0); j <= std::min(y + (int)ry, height - 1); ++j)
+				for (int i = std::max(x - (int)rx, 0); i <= std::min(x + (int)rx, width - 1); ++i)
+					v = dilate ? std::max(v, src(i, j)) : std::min(v, src(i, j));
+			dst(x, y) = v;
+		}
+	}
+}
+
+///This will apply an operation through the reference
+static void morphology_reference(const image_view<const unsigned char> &src, const image_view<unsigned char> &dst,
+	morphology_op op, unsigned int rx, unsigned int ry) {
+	if (op == morph_erode || op == morph_dilate) {
+		extremum_reference(src, dst, op == morph_dilate, rx, ry);
+		return;
+	}
+	ppm<> first(src.width, src.height, uninitialized);
+	extremum_reference(src, first.view(0), op == morph_close, rx, ry);
+	extremum_reference(first.view(0), dst, op == morph_open, rx, ry);
+}
+
+void test_morphology() {
+	const morphology_op ops[] = { morph_erode, morph_dilate, morph_open, morph_close };
+	//radii of 0, within a block, unequal, and past the image size
+	const unsigned int radii[][2] = { { 0, 0 }, { 1, 1 }, { 2, 0 }, { 0, 3 }, { 3, 5 }, { 8, 8 }, { 40, 2 } };
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 9 }, { 9, 1 }, { 17, 6 }, { 70, 45 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 1 + s);
+		const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+		const ppm<> flat = constant_image(width, height, 0, 42, 255);
+		ppm<> reference(width, height, uninitialized), out(width, height, uninitialized);
+		for (unsigned int o = 0; o < 4; ++o) {
+			for (unsigned int r = 0; r < sizeof(radii) / sizeof(radii[0]); ++r) {
+				const unsigned int rx = radii[r][0], ry = radii[r][1];
+				morphology_reference(img.view(1), reference.view(1), ops[o], rx, ry);
+				morphology(img.view(1), out.view(1), ops[o], rx, ry);
+				CHECK(max_difference(out.view(1), reference.view(1)) == 0);
+
+				//in place, and on a strided plane
+				ppm<> in_place = img;
+				morphology(in_place.view(1), in_place.view(1), ops[o], rx, ry);
+				CHECK(max_difference(in_place.view(1), reference.view(1)) == 0);
+				ppm<unsigned char, interleaved> packed_out(width, height, uninitialized);
+				morphology(packed.view(1), packed_out.view(1), ops[o], rx, ry);
+				CHECK(max_difference(packed_out.view(1), reference.view(1)) == 0);
+
+				morphology(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(out.view()), ops[o], rx, ry);
+				CHECK(all_equal(out.view(0), 0) && all_equal(out.view(1), 42) && all_equal(out.view(2), 255));
+			}
+		}
+	}
+
+	//masks: thresholding, and PBM and PGM files written and read back
+	const ppm<> img = random_image(37, 11, 20);
+	const mask m = threshold(img.view(0), 128);
+	bool thresholded = m.width == 37 && m.height == 11;
+	for (unsigned int y = 0; thresholded && y < 11; ++y)
+		for (unsigned int x = 0; x < 37; ++x)
+			thresholded = thresholded && m.view()(x, y) == (img.view(0)(x, y) >= 128 ? 255 : 0);
+	CHECK(thresholded);
+	const char *bitmap = "test_morphology.pbm", *graymap = "test_morphology.pgm";
+	CHECK(m.write(bitmap, true));
+	const mask from_bitmap(bitmap);
+	CHECK(from_bitmap.width == 37 && from_bitmap.height == 11 && max_difference(from_bitmap.view(), m.view()) == 0);
+	mask gray(37, 11);
+	copy(img.view(2), gray.view());
+	CHECK(gray.write(graymap, false));
+	const mask from_graymap(graymap);
+	CHECK(from_graymap.width == 37 && from_graymap.height == 11 && max_difference(from_graymap.view(), img.view(2)) == 0);
+	std::remove(bitmap);
+	std::remove(graymap);
+
+	//opening removes a speck smaller than the element from a mask, closing fills a gap narrower than it
+	mask gap(40, 20);
+	fill(gap.view().crop(5, 5, 30, 10), (unsigned char)255);
+	fill(gap.view().crop(19, 5, 2, 10), (unsigned char)0);
+	gap.view()(2, 2) = 255;
+	morphology(gap.view(), gap.view(), morph_open, 1, 1);
+	CHECK(gap.view()(2, 2) == 0 && gap.view()(19, 8) == 0 && all_equal(gap.view().crop(5, 5, 14, 10), 255));
+	morphology(gap.view(), gap.view(), morph_close, 2, 2);
+	CHECK(all_equal(gap.view().crop(5, 5, 30, 10), 255) && all_equal(gap.view().crop(0, 0, 40, 5), 0));
+
+	//the strips come out the same however they are spread over threads
+	const ppm<> large = random_image(500, 300, 21);
+	for (unsigned int o = 0; o < 4; ++o) {
+		CHECK(same_on_every_thread_count([&]() {
+			ppm<> result(large.width, large.height);
+			morphology(large.view(0), result.view(0), ops[o], 6, 3);
+			return result;
+		}));
+	}
+}
@@ -0,0 +1,223 @@
+///
+/// \file test_palette.cpp
+/// \brief Tests of palette generation, the nearest color grid and dithering
+///
+
+#include "tests.h"
+#include "palette.h"
+
+#include <vector>
+
+///This will find the entry nearest a color by testing all of them, the
+///lowest on ties, as the reference for the lookup grid
+///
+/// \param p the palette
+/// \param r the red level
+/// \param g the green level
+/// \param b the blue level
+/// \return the index of the entry
+///
+static unsigned int nearest_reference(const palette &p, int r, int g, int b) {
+	unsigned int best = 0, best_distance = 0xffffffffu;
+	for (unsigned int k = 0; k < p.size(); ++k) {
+		const int dr = r - p.colors[3 * k], dg = g - p.colors[3 * k + 1], db = b - p.colors[3 * k + 2];
+		const unsigned int d = (unsigned int)(dr * dr + dg * dg + db * db);
+		if (d < best_distance) {
+			best_distance = d;
+			best = k;
+		}
+	}
+	return best;
+}
+
+///This will quantize an image with Floyd-Steinberg error diffusion one
+///row after another, as the reference for the wavefront
+///
+/// \param src the image
+/// \param indices the entry of each pixel
+/// \param p the palette
+///
+static void floyd_steinberg_reference(const rgb_view<const unsigned char> &src, const image_view<unsigned char> &indices,
+	const palette &p) {
+	const unsigned int width = src.width();
+	//the error diffused into the current row and the next one, pixel x at x + 1
+	std::vector<float> current(3 * ((size_t)width + 2), 0.0f), next(current.size(), 0.0f);
+	for (unsigned int y = 0; y < src.height(); ++y) {
+		float carry[3] = { 0.0f, 0.0f, 0.0f };
+		for (unsigned int x = 0; x < width; ++x) {
+			float want[3];
+			unsigned int v[3];
+			for (unsigned int c = 0; c < 3; ++c) {
+				want[c] = std::min(std::max((float)src[c](x, y) + carry[c] + current[3 * (x + 1) + c], 0.0f), 255.0f);
+				v[c] = (unsigned int)(want[c] + 0.5f);
+			}
+			const unsigned int k = nearest_reference(p, (int)v[0], (int)v[1], (int)v[2]);
+			indices(x, y) = (unsigned char)k;
+			for (unsigned int c = 0; c < 3; ++c) {
+				const float e = want[c] - p.colors[3 * k + c];
+				carry[c] = e * (7.0f / 16.0f);
+				next[3 * x + c] += e * (3.0f / 16.0f);
+				next[3 * (x + 1) + c] += e * (5.0f / 16.0f);
+				next[3 * (x + 2) + c] += e * (1.0f / 16.0f);
+			}
+		}
+		current.swap(next);
+		std::fill(next.begin(), next.end(), 0.0f);
+	}
+}
+
+///This will return a palette of random colors drawn from a fixed seed,
+///with every fifth entry repeating an earlier one so ties come up
+static palette random_palette(unsigned int n, unsigned int seed) {
+	std::vector<unsigned char> colors(3 * n);
+	unsigned int state = seed;
+	for (unsigned int i = 0; i < 3 * n; ++i) {
+		state = state * 1664525u + 1013904223u;
+		colors[i] = (unsigned char)(state >> 24);
+	}
+	for (unsigned int i = 5; i < n; i += 5)
+		for (unsigned int c = 0; c < 3; ++c)
+			colors[3 * i + c] = colors[3 * (i / 5) + c];
+	return palette(colors);
+}
+
+///This will tell whether a plane of indices maps every pixel to the entry
+///nearest to it
+static bool all_nearest(const rgb_view<const unsigned char> &src, const image_view<const unsigned char> &indices,
+	const palette &p) {
+	bool nearest = true;
+	for (unsigned int y = 0; y < src.height(); ++y)
+		for (unsigned int x = 0; x < src.width(); ++x)
+			nearest = nearest && indices(x, y) == nearest_reference(p, src[0](x, y), src[1](x, y), src[2](x, y));
+	return nearest;
+}
+
+void test_palette() {
+	//the grid finds the nearest entry, the lowest on ties, for colors all over the cube and on the cell corners
+	const unsigned int counts[] = { 1, 2, 6, 17, 100, 256 };
+	for (unsigned int n = 0; n < sizeof(counts) / sizeof(counts[0]); ++n) {
+		const palette p = random_palette(counts[n], 1 + n);
+		CHECK(p.size() == counts[n] && p.cell_start.size() == 32 * 32 * 32 + 1);
+		bool nearest = true;
+		for (unsigned int r = 0; r < 256; r += 7)
+			for (unsigned int g = 0; g < 256; g += 5)
+				for (unsigned int b = 0; b < 256; b += 3)
+					nearest = nearest && p.nearest(r, g, b) == nearest_reference(p, (int)r, (int)g, (int)b);
+		const unsigned int corners[] = { 0, 7, 8, 127, 128, 248, 255 };
+		for (unsigned int i = 0; i < 7 * 7 * 7; ++i)
+			nearest = nearest && p.nearest(corners[i / 49], corners[i / 7 % 7], corners[i % 7])
+				== nearest_reference(p, corners[i / 49], corners[i / 7 % 7], corners[i % 7]);
+		CHECK(nearest);
+	}
+
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 7 }, { 9, 1 }, { 65, 3 }, { 130, 67 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<> img = random_image(width, height, 10 + s);
+		const rgb_view<const unsigned char> src(img.view());
+		const ppm<unsigned char, interleaved> packed(src, 255);
+		ppm<> indices(width, height, uninitialized), out(width, height, uninitialized);
+		ppm<unsigned char, interleaved> packed_indices(width, height, uninitialized);
+
+		//a palette has at most the colors asked for, whichever the method
+		const palette cut = build_palette(src, 16, palette_median_cut);
+		const palette refined = build_palette(src, 16, palette_kmeans);
+		CHECK(cut.size() >= 1 && cut.size() <= std::min(16u, width * height));
+		CHECK(refined.size() == cut.size());
+
+		//without dithering every pixel takes its nearest entry, also through strided views
+		quantize(src, indices.view(0), refined, dither_none);
+		CHECK(all_nearest(src, indices.view(0), refined));
+		quantize(rgb_view<const unsigned char>(packed.view()), packed_indices.view(1), refined, dither_none);
+		CHECK(max_difference(packed_indices.view(1), indices.view(0)) == 0);
+
+		//Floyd-Steinberg matches diffusing the rows one after another
+		floyd_steinberg_reference(src, indices.view(1), refined);
+		quantize(src, indices.view(0), refined, dither_floyd_steinberg);
+		CHECK(max_difference(indices.view(0), indices.view(1)) == 0);
+		quantize(rgb_view<const unsigned char>(packed.view()), packed_indices.view(2), refined, dither_floyd_steinberg);
+		CHECK(max_difference(packed_indices.view(2), indices.view(1)) == 0);
+
+		//ordered dithering gives the same through strided views, and the indices expand to palette colors
+		quantize(src, indices.view(2), refined, dither_ordered);
+		quantize(rgb_view<const unsigned char>(packed.view()), packed_indices.view(0), refined, dither_ordered);
+		CHECK(max_difference(packed_indices.view(0), indices.view(2)) == 0);
+		bool in_range = true;
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				in_range = in_range && indices.view(2)(x, y) < refined.size();
+		CHECK(in_range);
+		expand_indices(indices.view(2), refined, rgb_view<unsigned char>(out.view()));
+		ppm<unsigned char, interleaved> packed_out(width, height, uninitialized);
+		expand_indices(packed_indices.view(0), refined, rgb_view<unsigned char>(packed_out.view()));
+		bool expanded = true;
+		for (unsigned int c = 0; c < 3; ++c)
+			for (unsigned int y = 0; y < height; ++y)
+				for (unsigned int x = 0; x < width; ++x)
+					expanded = expanded && out.view(c)(x, y) == refined.colors[3 * indices.view(2)(x, y) + c];
+		CHECK(expanded);
+		CHECK(max_difference(rgb_view<const unsigned char>(packed_out.view()), rgb_view<const unsigned char>(out.view())) == 0);
+
+		//a flat image gets a palette of its color, and every method maps it there
+		const ppm<> flat = constant_image(width, height, 0, 90, 255);
+		const palette one = build_palette(rgb_view<const unsigned char>(flat.view()), 256);
+		CHECK(one.size() == 1 && one.colors[0] == 0 && one.colors[1] == 90 && one.colors[2] == 255);
+		const dither_method methods[] = { dither_none, dither_ordered, dither_floyd_steinberg };
+		for (unsigned int m = 0; m < 3; ++m) {
+			fill(indices.view(0), (unsigned char)7);
+			quantize(rgb_view<const unsigned char>(flat.view()), indices.view(0), one, methods[m]);
+			CHECK(all_equal(indices.view(0), 0));
+		}
+	}
+
+	//an image of a few colors in separate cells gets exactly those colors back, and maps to them without error
+	const unsigned char few[5][3] = { { 0, 0, 0 }, { 255, 255, 255 }, { 200, 30, 40 }, { 20, 180, 60 }, { 90, 90, 220 } };
+	ppm<> img(50, 20, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < img.height; ++y)
+			for (unsigned int x = 0; x < img.width; ++x)
+				img.view(c)(x, y) = few[(x / 3 + y) % 5][c];
+	const rgb_view<const unsigned char> src(img.view());
+	for (unsigned int m = 0; m < 2; ++m) {
+		const palette p = build_palette(src, 256, m == 0 ? palette_median_cut : palette_kmeans);
+		CHECK(p.size() == 5);
+		ppm<> indices(img.width, img.height, uninitialized), out(img.width, img.height, uninitialized);
+		quantize(src, indices.view(0), p, dither_floyd_steinberg);
+		expand_indices(indices.view(0), p, rgb_view<unsigned char>(out.view()));
+		CHECK(max_difference(rgb_view<const unsigned char>(out.view()), src) == 0);
+	}
+	CHECK(build_palette(src, 0).empty() && build_palette(src.crop(0, 0, 0, 5), 8).empty());
+	CHECK(build_palette(src, 1000).size() == 5 && build_palette(src, 3).size() == 3);
+
+	//diffusing onto black and white keeps the mean level of a gray ramp
+	ppm<> ramp(256, 32, uninitialized);
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < ramp.height; ++y)
+			for (unsigned int x = 0; x < ramp.width; ++x)
+				ramp.view(c)(x, y) = (unsigned char)x;
+	const unsigned char bw[] = { 0, 0, 0, 255, 255, 255 };
+	const palette two(std::vector<unsigned char>(bw, bw + 6));
+	ppm<> dithered(ramp.width, ramp.height, uninitialized);
+	quantize(rgb_view<const unsigned char>(ramp.view()), dithered.view(0), two, dither_floyd_steinberg);
+	double level = 0.0;
+	for (unsigned int y = 0; y < ramp.height; ++y)
+		for (unsigned int x = 0; x < ramp.width; ++x)
+			level += dithered.view(0)(x, y) * 255.0;
+	CHECK(std::fabs(level / (ramp.width * ramp.height) - 127.5) <= 1.0);
+
+	//the palette and the rows come out the same however they are spread over threads
+	const ppm<> large = random_image(300, 200, 20);
+	const rgb_view<const unsigned char> large_src(large.view());
+	CHECK(same_on_every_thread_count([&]() {
+		return build_palette(large_src, 64);
+	}, [](const palette &a, const palette &b) {
+		return a.colors == b.colors && a.candidates == b.candidates;
+	}));
+	const palette p = build_palette(large_src, 64);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<> result(large.width, large.height);
+		quantize(large_src, result.view(0), p, dither_floyd_steinberg);
+		quantize(large_src, result.view(1), p, dither_ordered);
+		return result;
+	}));
+}
@@ -0,0 +1,145 @@
+///
+/// \file test_pixel_buffer.cpp
+/// \brief Tests of the size-class buffer pool and the placement of large blocks
+///
+
+#include "tests.h"
+#include "pixel_buffer.h"
+#include "numa.h"
+#include "thread_pool.h"
+
+#include <cstdint>
+#include <vector>
+
+///This will tell whether a request is served by the smallest class that
+///holds it
+///
+/// \param bytes the size of the request
+/// \return true if the class holds bytes and the class below it does not
+///
+static bool fits_class(size_t bytes) {
+	const unsigned int c = buffer_pool::size_class(bytes);
+	return bytes <= buffer_pool::class_bytes(c) && (c == 0 || bytes > buffer_pool::class_bytes(c - 1));
+}
+
+///This will tell whether a block starts on a PIXEL_ALIGNMENT boundary
+static bool aligned(const void *block) {
+	return (uintptr_t)block % PIXEL_ALIGNMENT == 0;
+}
+
+///This will tell whether every byte of a block is zero
+static bool all_zero(const unsigned char *block, size_t bytes) {
+	for (size_t i = 0; i < bytes; ++i)
+		if (block[i] != 0)
+			return false;
+	return true;
+}
+
+void test_pixel_buffer() {
+	//every request fits its class, which is the smallest that does, and classes grow with the request: every
+	//size up to 70000 bytes, then around each power of two and its quarters up to 2^46
+	bool fits = true, monotonic = true;
+	for (size_t bytes = 1; bytes <= 70000; ++bytes) {
+		fits = fits && fits_class(bytes);
+		monotonic = monotonic && buffer_pool::size_class(bytes) <= buffer_pool::size_class(bytes + 1);
+	}
+	for (unsigned int k = 16; k < 46; ++k) {
+		for (size_t q = 4; q < 8; ++q) {
+			const size_t edge = q << (k - 2);
+			for (size_t bytes = edge - 2; bytes <= edge + 2; ++bytes) {
+				fits = fits && fits_class(bytes);
+				monotonic = monotonic && buffer_pool::size_class(bytes) <= buffer_pool::size_class(bytes + 1);
+			}
+		}
+	}
+	for (unsigned int c = 0; c + 1 < 4 * 48; ++c)
+		monotonic = monotonic && buffer_pool::class_bytes(c) < buffer_pool::class_bytes(c + 1)
+			&& buffer_pool::size_class(buffer_pool::class_bytes(c)) == c;
+	CHECK(fits && monotonic);
+	//a class wastes at most a quarter of its blocks
+	CHECK(buffer_pool::size_class(64) == 0 && buffer_pool::size_class(65) == 1 && buffer_pool::class_bytes(1) == 80);
+	CHECK(buffer_pool::class_bytes(buffer_pool::size_class(1025)) == 1280);
+
+	buffer_pool &pool = buffer_pool::instance();
+	const size_t limit = pool.get_limit();
+	pool.trim();
+
+	//a released block is handed out again for any request of its class, and is counted while pooled
+	const size_t bytes = 3000, block_bytes = buffer_pool::class_bytes(buffer_pool::size_class(bytes));
+	void *block = pool.acquire(bytes);
+	CHECK(aligned(block) && pool.bytes_pooled() == 0);
+	pool.release(block, block_bytes);
+	CHECK(pool.bytes_pooled() == block_bytes);
+	void *again = pool.acquire(block_bytes - 1);
+	CHECK(again == block && pool.bytes_pooled() == 0);
+
+	//the pool keeps released blocks only up to its limit
+	void *second = pool.acquire(bytes);
+	pool.set_limit(block_bytes);
+	pool.release(again, block_bytes);
+	pool.release(second, block_bytes);
+	CHECK(pool.bytes_pooled() == block_bytes);
+	pool.set_limit(0);
+	CHECK(pool.bytes_pooled() == 0);
+	block = pool.acquire(bytes);
+	pool.release(block, block_bytes);
+	CHECK(pool.bytes_pooled() == 0);
+	pool.set_limit(limit);
+
+	//small blocks of every class are aligned
+	bool all_aligned = true;
+	std::vector<void *> blocks;
+	for (size_t n = 1; n < 100000; n = n * 3 / 2 + 1) {
+		blocks.push_back(pool.acquire(n));
+		all_aligned = all_aligned && aligned(blocks.back());
+		std::memset(blocks.back(), 0xff, n);
+	}
+	for (size_t n = 1, i = 0; n < 100000; n = n * 3 / 2 + 1, ++i)
+		pool.release(blocks[i], buffer_pool::class_bytes(buffer_pool::size_class(n)));
+	CHECK(all_aligned);
+
+	//large blocks map and unmap under each placement, with and without huge pages, start aligned at their
+	//own offset into the first huge page, and a zeroed buffer is zero whether its block is fresh or reused
+	const numa_placement placements[] = { placement_default, placement_interleave, placement_first_touch };
+	const size_t large = 3 * HUGE_PAGE_SIZE + 1000;
+	for (unsigned int p = 0; p < 3; ++p) {
+		for (unsigned int huge = 0; huge < 2; ++huge) {
+			unsigned char *mapped = (unsigned char *)map_large_block(large, huge != 0, placements[p]);
+			CHECK(mapped != 0 && aligned(mapped) && all_zero(mapped, large));
+			std::memset(mapped, 0x5a, large);
+			CHECK(mapped[0] == 0x5a && mapped[large - 1] == 0x5a);
+			unmap_large_block(mapped, large);
+		}
+
+		pool.set_placement(placements[p]);
+		CHECK(pool.get_placement() == placements[p]);
+		bool colors_aligned = true, colors_differ = true;
+		std::vector<uintptr_t> offsets;
+		std::vector<pixel_buffer<unsigned char> > buffers;
+		buffers.reserve(16);
+		for (unsigned int i = 0; i < 16; ++i) {
+			buffers.push_back(pixel_buffer<unsigned char>(large));
+			const uintptr_t offset = (uintptr_t)buffers.back().data() % HUGE_PAGE_SIZE;
+			colors_aligned = colors_aligned && aligned(buffers.back().data()) && all_zero(buffers.back().data(), large);
+			for (size_t j = 0; j < offsets.size(); ++j)
+				colors_differ = colors_differ && offsets[j] != offset;
+			offsets.push_back(offset);
+		}
+		CHECK(colors_aligned);
+#if defined(__linux__)
+		CHECK(colors_differ);
+#endif
+		for (unsigned int i = 0; i < 16; ++i)
+			std::memset(buffers[i].data(), 0xa5, large);
+		buffers.clear();
+		CHECK(pool.bytes_pooled() >= 16 * large);
+		pixel_buffer<unsigned char> reused(large);
+		CHECK(all_zero(reused.data(), large));
+		pixel_buffer<unsigned char> kept(large - 1, uninitialized);
+		kept.resize_zeroed(100);
+		CHECK(kept.size() == 100 && all_zero(kept.data(), 100));
+	}
+	pool.set_placement(placement_default);
+	CHECK(!thread_pool::global().is_pinned());
+	pool.trim();
+}
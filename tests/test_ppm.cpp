@@ -0,0 +1,289 @@
+///
+/// \file test_ppm.cpp
+/// \brief Tests of the PPM reader and writer, the half sample type and the
+/// conversions between sample types and layouts
+///
+
+#include "tests.h"
+#include "ppm.h"
+
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <string>
+
+///This will write bytes to a file
+///
+/// \param name the file
+/// \param bytes the contents
+///
+static void write_file(const char *name, const std::string &bytes) {
+	std::ofstream output(name, std::ios::out | std::ios::binary);
+	output.write(bytes.data(), (std::streamsize)bytes.size());
+}
+
+///This will tell whether an image holds nothing
+template <typename T, typename Layout>
+static bool empty(const ppm<T, Layout> &img) {
+	return img.width == 0 && img.height == 0 && img.size == 0;
+}
+
+///This will create a 16-bit image of random samples up to max_color_val,
+///with the first pixel black and the last one at max_color_val
+///
+/// \param width the width in pixels
+/// \param height the height in pixels
+/// \param max_color_val the maximum color value
+/// \param seed the seed
+/// \return the image
+///
+static ppm<unsigned short> random_image16(unsigned int width, unsigned int height, unsigned int max_color_val,
+	unsigned int seed) {
+	ppm<unsigned short> img(width, height, uninitialized);
+	img.max_color_val = max_color_val;
+	unsigned int state = seed;
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int i = 0; i < img.size; ++i) {
+			state = state * 1664525u + 1013904223u;
+			img.plane(c)[i] = (unsigned short)((state >> 8) % (max_color_val + 1));
+		}
+		img.plane(c)[0] = 0;
+		img.plane(c)[img.size - 1] = (unsigned short)max_color_val;
+	}
+	return img;
+}
+
+///This will tell whether float to half conversion rounds to nearest even
+///around the half h and the next one up: the midpoint goes to the even one
+///and the floats on either side of it to the nearer one
+///
+/// \param h a positive finite half bit pattern below the largest
+/// \return true if the midpoint and its neighbours round correctly, with either sign
+///
+static bool rounds_to_nearest_even(uint16_t h) {
+	const float a = half::to_float(h), b = half::to_float((uint16_t)(h + 1));
+	const float mid = (a + b) * 0.5f;
+	const float below = std::nextafter(mid, 0.0f), above = std::nextafter(mid, b + b);
+	const uint16_t even = (h & 1) ? (uint16_t)(h + 1) : h;
+	return half::from_float(below) == h && half::from_float(above) == h + 1 && half::from_float(mid) == even
+		&& half::from_float(-below) == (h | 0x8000) && half::from_float(-mid) == (even | 0x8000);
+}
+
+///This will convert an image to a sample type and layout and tell whether
+///the result holds the same values: exactly for float destinations and
+///integer ones of the same range, within half a step for other integer
+///ones and within the precision of half for half ones
+///
+/// \param src the image to convert
+/// \return true if the converted image matches, with the expected maximum color value and an opaque pad sample
+///
+template <typename T, typename TL, typename S, typename SL>
+static bool converts_to(const ppm<S, SL> &src) {
+	ppm<T, TL> dst;
+	convert(src, dst);
+	const unsigned int max_color_val = !sample_traits<T>::is_integer ? src.max_color_val
+		: sample_traits<S>::is_integer && src.max_color_val <= sample_traits<T>::max() ? src.max_color_val : 255;
+	if (dst.width != src.width || dst.height != src.height || dst.size != src.size || dst.max_color_val != max_color_val)
+		return false;
+	float tolerance = 0.0f;
+	if (sample_traits<T>::is_integer && !(sample_traits<S>::is_integer && max_color_val == src.max_color_val))
+		tolerance = 0.5f / (float)max_color_val + 1e-6f;
+	else if (std::is_same<T, half>::value && !std::is_same<S, half>::value)
+		tolerance = 1.0f / 4096.0f;
+	const T opaque = sample_traits<T>::is_integer ? (T)max_color_val : (T)1.0f;
+	for (unsigned int i = 0; i < src.size; ++i) {
+		for (unsigned int c = 0; c < 3; ++c)
+			if (!(std::fabs(dst.normalized(c, i) - src.normalized(c, i)) <= tolerance))
+				return false;
+		if (TL::step == 4 && (float)dst.plane(0)[(size_t)i * 4 + 3] != (float)opaque)
+			return false;
+	}
+	return true;
+}
+
+///This will convert an image to every sample type and layout
+template <typename S, typename SL>
+static bool converts_to_every_type(const ppm<S, SL> &src) {
+	return converts_to<unsigned char, planar>(src) && converts_to<unsigned char, interleaved>(src)
+		&& converts_to<unsigned char, rgba_padded>(src) && converts_to<unsigned short, planar>(src)
+		&& converts_to<unsigned short, interleaved>(src) && converts_to<unsigned short, rgba_padded>(src)
+		&& converts_to<half, planar>(src) && converts_to<half, interleaved>(src) && converts_to<half, rgba_padded>(src)
+		&& converts_to<float, planar>(src) && converts_to<float, interleaved>(src)
+		&& converts_to<float, rgba_padded>(src);
+}
+
+///This will convert an image to sample type S in every layout, and each of
+///those to every sample type and layout
+template <typename S, typename T, typename Layout>
+static bool converts_from_every_layout(const ppm<T, Layout> &img) {
+	ppm<S, planar> p;
+	ppm<S, interleaved> i;
+	ppm<S, rgba_padded> r;
+	convert(img, p);
+	convert(img, i);
+	convert(img, r);
+	return converts_to_every_type(p) && converts_to_every_type(i) && converts_to_every_type(r);
+}
+
+///This will convert an 8-bit image to sample type T in every layout and
+///each of those back
+///
+/// \param img the image
+/// \return true if the image comes back unchanged every time
+///
+template <typename T>
+static bool round_trips(const ppm<> &img) {
+	ppm<T, planar> p;
+	ppm<T, interleaved> i;
+	ppm<T, rgba_padded> r;
+	ppm<> back_p, back_i, back_r;
+	convert(img, p);
+	convert(img, i);
+	convert(img, r);
+	convert(p, back_p);
+	convert(i, back_i);
+	convert(r, back_r);
+	return same_pixels(back_p, img) && same_pixels(back_i, img) && same_pixels(back_r, img)
+		&& back_p.max_color_val == 255 && back_i.max_color_val == 255 && back_r.max_color_val == 255;
+}
+
+void test_ppm() {
+	//every half converts to float and back unchanged, NaNs stay NaNs, and floats round to the nearest half
+	bool unchanged = true, rounded = true;
+	for (unsigned int h = 0; h < 65536; ++h) {
+		const float f = half::to_float((uint16_t)h);
+		const uint16_t back = half::from_float(f);
+		if ((h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0)
+			unchanged = unchanged && std::isnan(f) && (back & 0x7c00) == 0x7c00 && (back & 0x3ff) != 0
+				&& (back & 0x8000) == (h & 0x8000);
+		else
+			unchanged = unchanged && back == h && (std::signbit(f) != 0) == ((h & 0x8000) != 0);
+		if (h < 0x7bff)
+			rounded = rounded && rounds_to_nearest_even((uint16_t)h);
+	}
+	CHECK(unchanged && rounded);
+	//subnormals, the largest half, infinities and what lies beyond either end
+	CHECK(half::to_float(0x0001) == std::ldexp(1.0f, -24) && half::to_float(0x03ff) == std::ldexp(1023.0f, -24));
+	CHECK(half::to_float(0x0400) == std::ldexp(1.0f, -14) && half::to_float(0x7bff) == 65504.0f);
+	CHECK(half::to_float(0x3c00) == 1.0f && half::to_float(0x8000) == 0.0f && std::signbit(half::to_float(0x8000)));
+	const float inf = std::numeric_limits<float>::infinity();
+	CHECK(half::to_float(0x7c00) == inf && half::to_float(0xfc00) == -inf);
+	CHECK(half::from_float(inf) == 0x7c00 && half::from_float(-inf) == 0xfc00);
+	CHECK(half::from_float(65520.0f) == 0x7c00 && half::from_float(std::nextafter(65520.0f, 0.0f)) == 0x7bff);
+	CHECK(half::from_float(1e10f) == 0x7c00 && half::from_float(-1e10f) == 0xfc00);
+	CHECK(half::from_float(std::ldexp(1.0f, -25)) == 0 && half::from_float(std::ldexp(1.5f, -25)) == 1);
+	CHECK(half::from_float(1e-10f) == 0 && half::from_float(-1e-10f) == 0x8000);
+	CHECK(std::isnan(half::to_float(half::from_float(std::numeric_limits<float>::quiet_NaN()))));
+	CHECK((float)half(0.25f) == 0.25f);
+
+	//16-bit images are written two bytes a sample, most significant first, and read back exactly; the
+	//large one takes more than one chunk to read
+	const char *name = "test_ppm.ppm";
+	const unsigned int sizes[][3] = { { 1, 1, 65535 }, { 7, 5, 65535 }, { 33, 20, 1000 }, { 256, 1, 256 },
+		{ 1200, 1200, 65535 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const ppm<unsigned short> img = random_image16(sizes[s][0], sizes[s][1], sizes[s][2], 1 + s);
+		img.write(name);
+		std::ifstream written(name, std::ios::in | std::ios::binary | std::ios::ate);
+		const std::string header = "P6\n" + std::to_string(img.width) + " " + std::to_string(img.height) + "\n"
+			+ std::to_string(img.max_color_val) + "\n";
+		CHECK((size_t)written.tellg() == header.size() + 6 * (size_t)img.size);
+		written.close();
+		const ppm<unsigned short> back(name);
+		CHECK(back.max_color_val == img.max_color_val && same_pixels(back, img));
+		//and read into other sample types and layouts
+		const ppm<unsigned short, rgba_padded> padded(name);
+		CHECK(padded.max_color_val == img.max_color_val
+			&& max_difference(padded.view(), img.view()) == 0 && padded.plane(0)[3] == img.max_color_val);
+		const ppm<float, interleaved> scaled(name);
+		CHECK(scaled.max_color_val == img.max_color_val
+			&& std::fabs(scaled.normalized(2, img.size - 1) - 1.0f) <= 1e-6f
+			&& std::fabs(scaled.normalized(1, img.size / 2) - img.normalized(1, img.size / 2)) <= 1e-6f);
+		//but not into 8-bit samples, which leave the image empty
+		ppm<> narrow = random_image(4, 4, 1);
+		narrow.read(name);
+		CHECK(empty(narrow));
+	}
+	//the first sample of a 16-bit file is its most significant byte first
+	ppm<unsigned short> one(1, 1);
+	one.max_color_val = 65535;
+	one.plane(0)[0] = 0x1234;
+	one.write(name);
+	std::ifstream raw(name, std::ios::in | std::ios::binary);
+	std::string line;
+	std::getline(raw, line);
+	std::getline(raw, line);
+	std::getline(raw, line);
+	CHECK(raw.get() == 0x12 && raw.get() == 0x34);
+	raw.close();
+	//8-bit files read into 16-bit samples keep their values and maximum color value
+	const ppm<> img8 = random_image(19, 11, 6);
+	img8.write(name);
+	const ppm<unsigned short> wide(name);
+	CHECK(wide.max_color_val == 255 && max_difference(wide.view(), img8.view()) == 0);
+
+	//headers that are malformed, or hold a maximum color value the samples can't, and files cut short leave
+	//the image empty, even one that held an image before
+	const std::string pixels(24, '\x7f');
+	const std::string files[] = { "P6\n2 2\n0\n" + pixels, "P6\n2 2\n70000\n" + pixels, "P6\n2 2\nmany\n" + pixels,
+		"P6\ntwo 2\n255\n" + pixels, "P6\n2\n255\n" + pixels, "P6\n70000 70000\n255\n" + pixels,
+		"P3\n2 2\n255\n" + pixels, "P6\n4 4\n255\n" + pixels, "P6\n2 2\n65535\n" + pixels, "" };
+	for (unsigned int f = 0; f < sizeof(files) / sizeof(files[0]); ++f) {
+		write_file(name, files[f]);
+		ppm<> img = random_image(3, 3, f);
+		img.read(name);
+		ppm<unsigned short> img16 = random_image16(3, 3, 65535, f);
+		img16.read(name);
+		CHECK(empty(img) && (f == 8 || empty(img16)));
+	}
+	//the 16-bit file refused as 8-bit samples reads as 16-bit ones, and comment lines are skipped
+	write_file(name, "P6\n2 2\n65535\n" + pixels);
+	CHECK(ppm<unsigned short>(name).width == 2 && ppm<float>(name).size == 4);
+	write_file(name, "P6\n# a comment\n# another\n2 2\n255\n" + pixels.substr(0, 12));
+	const ppm<> commented(name);
+	CHECK(commented.width == 2 && commented.height == 2 && all_equal(commented.view(0), 0x7f));
+	std::remove(name);
+	CHECK(empty(ppm<>(name)));
+
+	//every sample type and layout converts to every other, from 8-bit and 16-bit images, and 8-bit images
+	//come back unchanged; out of range floats clamp
+	const ppm<> base = random_image(37, 9, 11);
+	const ppm<unsigned short> base16 = random_image16(37, 9, 65535, 12);
+	CHECK(converts_from_every_layout<unsigned char>(base) && converts_from_every_layout<unsigned char>(base16));
+	CHECK(converts_from_every_layout<unsigned short>(base) && converts_from_every_layout<unsigned short>(base16));
+	CHECK(converts_from_every_layout<half>(base) && converts_from_every_layout<half>(base16));
+	CHECK(converts_from_every_layout<float>(base) && converts_from_every_layout<float>(base16));
+	CHECK(round_trips<unsigned char>(base) && round_trips<unsigned short>(base));
+	CHECK(round_trips<half>(base) && round_trips<float>(base));
+	ppm<float, interleaved> outside(2, 1);
+	outside.plane(0)[0] = -0.5f;
+	outside.plane(1)[0] = 1.5f;
+	outside.plane(2)[3] = 2.0f;
+	ppm<> clamped;
+	convert(outside, clamped);
+	CHECK(clamped.view(0)(0, 0) == 0 && clamped.view(1)(0, 0) == 255 && clamped.view(2)(1, 0) == 255);
+	CHECK(same_on_every_thread_count([&]() {
+		ppm<half, rgba_padded> out;
+		convert(base16, out);
+		return to_float(out);
+	}));
+
+	//to_float scales integer samples by their maximum color value and copies floating point ones
+	const ppm<unsigned short> img1000 = random_image16(23, 17, 1000, 13);
+	ppm<unsigned short, rgba_padded> padded1000;
+	convert(img1000, padded1000);
+	const ppm<float> scaled = to_float(padded1000);
+	ppm<half, interleaved> halves;
+	convert(img1000, halves);
+	const ppm<float> widened = to_float(halves);
+	bool scaled_right = scaled.width == 23 && scaled.height == 17, widened_right = widened.size == img1000.size;
+	for (unsigned int c = 0; c < 3; ++c) {
+		for (unsigned int i = 0; i < img1000.size; ++i) {
+			scaled_right = scaled_right && scaled.plane(c)[i] == (float)img1000.plane(c)[i] / 1000.0f;
+			widened_right = widened_right && widened.plane(c)[i] == (float)halves.plane(c)[(size_t)i * 3];
+		}
+	}
+	CHECK(scaled_right && widened_right && scaled.normalized(0, img1000.size - 1) == 1.0f);
+	CHECK(empty(to_float(ppm<half>())));
+}
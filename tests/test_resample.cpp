@@ -0,0 +1,96 @@
+///
+/// \file test_resample.cpp
+/// \brief Tests of the separable resampling filters
+///
+
+#include "tests.h"
+#include "resample.h"
+
+void test_resample() {
+	const resample_filter filters[] = { resample_box, resample_bilinear, resample_bicubic, resample_lanczos3 };
+	//one pixel more or less, where output pixel centers fall exactly between two inputs, and larger factors
+	const unsigned int sizes[][2] = { { 1, 1 }, { 1, 2 }, { 2, 1 }, { 2, 3 }, { 3, 2 }, { 7, 8 }, { 8, 7 }, { 64, 65 },
+		{ 65, 64 }, { 640, 641 }, { 641, 640 }, { 5, 17 }, { 17, 5 }, { 300, 7 }, { 7, 300 } };
+	const unsigned int count = sizeof(sizes) / sizeof(sizes[0]);
+
+	//a flat image stays flat whatever the filter, in either direction
+	for (unsigned int f = 0; f < 4; ++f) {
+		for (unsigned int s = 0; s < count; ++s) {
+			const unsigned int in = sizes[s][0], out = sizes[s][1];
+			const ppm<> flat = constant_image(in, in == 640 || in == 641 ? 3 : in, 0, 93, 255);
+			ppm<> across(out, flat.height, uninitialized), down(in, out, uninitialized), both(out, out, uninitialized);
+			resample(rgb_view<const unsigned char>(flat.view()), rgb_view<unsigned char>(across.view()), filters[f]);
+			CHECK(all_equal(across.view(0), 0) && all_equal(across.view(1), 93) && all_equal(across.view(2), 255));
+			const ppm<> tall = constant_image(3, in, 0, 93, 255);
+			ppm<> tall_out(3, out, uninitialized);
+			resample(rgb_view<const unsigned char>(tall.view()), rgb_view<unsigned char>(tall_out.view()), filters[f]);
+			CHECK(all_equal(tall_out.view(0), 0) && all_equal(tall_out.view(1), 93) && all_equal(tall_out.view(2), 255));
+			if (in <= 300 && out <= 300) {
+				const ppm<> square = constant_image(in, in, 0, 93, 255);
+				resample(rgb_view<const unsigned char>(square.view()), rgb_view<unsigned char>(both.view()), filters[f]);
+				CHECK(all_equal(both.view(0), 0) && all_equal(both.view(1), 93) && all_equal(both.view(2), 255));
+			}
+
+			ppm<float> flat_float(in, 3, uninitialized), float_out(out, 3, uninitialized);
+			fill(flat_float.view(0), 0.25f);
+			resample(flat_float.view(0), float_out.view(0), filters[f]);
+			bool same = true;
+			for (unsigned int x = 0; x < out; ++x)
+				same = same && std::fabs(float_out.view(0)(x, 1) - 0.25f) < 1e-6f;
+			CHECK(same);
+		}
+	}
+
+	//the same size copies; halving with the box filter averages 2x2 blocks
+	const ppm<> img = random_image(90, 61, 1);
+	ppm<> copied(img.width, img.height, uninitialized);
+	resample(img.view(0), copied.view(0), resample_box);
+	CHECK(max_difference(copied.view(0), img.view(0)) == 0);
+	ppm<> half(45, 30, uninitialized);
+	resample(img.view(1).crop(0, 0, 90, 60), half.view(1), resample_box);
+	bool averaged = true;
+	for (unsigned int y = 0; y < half.height; ++y) {
+		for (unsigned int x = 0; x < half.width; ++x) {
+			const image_view<const unsigned char> p = img.view(1);
+			const int sum = p(2 * x, 2 * y) + p(2 * x + 1, 2 * y) + p(2 * x, 2 * y + 1) + p(2 * x + 1, 2 * y + 1);
+			averaged = averaged && std::abs((int)half.view(1)(x, y) - (sum + 2) / 4) <= 1;
+		}
+	}
+	CHECK(averaged);
+
+	//8-bit planes agree with float ones, and strided planes with dense ones
+	const unsigned int targets[][2] = { { 1, 1 }, { 31, 20 }, { 91, 62 }, { 200, 150 } };
+	for (unsigned int f = 0; f < 4; ++f) {
+		for (unsigned int t = 0; t < 4; ++t) {
+			const unsigned int w = targets[t][0], h = targets[t][1];
+			ppm<float> linear(img.width, img.height, uninitialized), linear_out(w, h, uninitialized);
+			copy(img.view(2), linear.view(2));
+			resample(linear.view(2), linear_out.view(2), filters[f]);
+			ppm<> out(w, h, uninitialized);
+			resample(img.view(2), out.view(2), filters[f]);
+			bool close = true;
+			for (unsigned int y = 0; y < h; ++y) {
+				for (unsigned int x = 0; x < w; ++x) {
+					const float v = std::min(std::max(linear_out.view(2)(x, y), 0.0f), 255.0f);
+					close = close && std::fabs(out.view(2)(x, y) - v) <= 1.0f;
+				}
+			}
+			CHECK(close);
+
+			const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+			ppm<unsigned char, interleaved> packed_out(w, h, uninitialized);
+			resample(rgb_view<const unsigned char>(packed.view()), rgb_view<unsigned char>(packed_out.view()), filters[f]);
+			CHECK(max_difference(packed_out.view(2), out.view(2)) == 0);
+		}
+	}
+
+	//the rows come out the same however they are spread over threads
+	const ppm<> large = random_image(400, 300, 2);
+	for (unsigned int f = 0; f < 4; ++f) {
+		CHECK(same_on_every_thread_count([&]() {
+			ppm<> result(170, 411, uninitialized);
+			resample(rgb_view<const unsigned char>(large.view()), rgb_view<unsigned char>(result.view()), filters[f]);
+			return result;
+		}));
+	}
+}
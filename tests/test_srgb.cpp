@@ -0,0 +1,80 @@
+///
+/// \file test_srgb.cpp
+/// \brief Tests of the sRGB decoding table and the piecewise linear encoding
+///
+
+#include "tests.h"
+#include "srgb.h"
+
+#include <cstring>
+#include <limits>
+
+///This will encode a linear intensity in [0, 1] exactly, as the reference
+static double encode_reference(double x) {
+	return x <= 0.0031308 ? 12.92 * x : 1.055 * std::pow(x, 1.0 / 2.4) - 0.055;
+}
+
+///This will return the float with the given bits
+static float from_bits(uint32_t bits) {
+	float v;
+	std::memcpy(&v, &bits, sizeof(v));
+	return v;
+}
+
+void test_srgb() {
+	//the table decodes every code, and every decoded code encodes back to itself
+	bool decoded = true, round_trip = true;
+	for (unsigned int c = 0; c < 256; ++c) {
+		const double v = c / 255.0;
+		const double exact = v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+		decoded = decoded && std::fabs(srgb_to_linear((unsigned char)c) - exact) <= 1e-7;
+		round_trip = round_trip && linear_to_srgb(srgb_to_linear((unsigned char)c)) == c;
+	}
+	CHECK(decoded);
+	CHECK(round_trip);
+
+	//within each of the 256 buckets of a piece the fit is constant and the curve rises, so the floats at the
+	//two ends of every bucket bound the error over all floats of [2^-13, 1)
+	double worst = 0.0;
+	for (uint32_t bucket = 0; bucket < 104 * 256; ++bucket) {
+		const uint32_t first = ((127u - 13u) << 23) + (bucket << 12);
+		const float ends[2] = { from_bits(first), from_bits(first + 4095) };
+		for (unsigned int e = 0; e < 2; ++e)
+			worst = std::max(worst, std::fabs(linear_to_srgb(ends[e]) - 255.0 * encode_reference(ends[e])));
+	}
+	CHECK(worst <= 0.56);
+
+	//out of range values clamp, a NaN to the bottom
+	CHECK(linear_to_srgb(0.0f) == 0 && linear_to_srgb(-1.0f) == 0 && linear_to_srgb(1e-30f) == 0);
+	CHECK(linear_to_srgb(1.0f) == 255 && linear_to_srgb(7.0f) == 255);
+	CHECK(linear_to_srgb(std::numeric_limits<float>::infinity()) == 255);
+	CHECK(linear_to_srgb(std::numeric_limits<float>::quiet_NaN()) == 0);
+
+	//the planes agree with the scalar calls, 8 at a time or one by one, dense or strided, including 1x1
+	const unsigned int sizes[][2] = { { 1, 1 }, { 7, 3 }, { 8, 2 }, { 37, 19 }, { 256, 40 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const unsigned int width = sizes[s][0], height = sizes[s][1];
+		const ppm<float> values = random_float_image(width, height, 1 + s, -0.2f, 1.2f);
+		ppm<> encoded(width, height, uninitialized);
+		linear_to_srgb(rgb_view<const float>(values.view()), rgb_view<unsigned char>(encoded.view()));
+		ppm<float, interleaved> packed(width, height, uninitialized);
+		for (unsigned int c = 0; c < 3; ++c)
+			copy(values.view(c), packed.view(c));
+		ppm<unsigned char, interleaved> packed_encoded(width, height, uninitialized);
+		linear_to_srgb(rgb_view<const float>(packed.view()), rgb_view<unsigned char>(packed_encoded.view()));
+		bool scalar = true;
+		for (unsigned int c = 0; c < 3; ++c)
+			for (unsigned int y = 0; y < height; ++y)
+				for (unsigned int x = 0; x < width; ++x)
+					scalar = scalar && encoded.view(c)(x, y) == linear_to_srgb(values.view(c)(x, y));
+		CHECK(scalar);
+		CHECK(max_difference(rgb_view<const unsigned char>(packed_encoded.view()),
+			rgb_view<const unsigned char>(encoded.view())) == 0);
+
+		const ppm<> img = random_image(width, height, 10 + s);
+		ppm<float> linear(width, height, uninitialized);
+		srgb_to_linear(rgb_view<const unsigned char>(img.view()), rgb_view<float>(linear.view()));
+		linear_to_srgb(rgb_view<const float>(linear.view()), rgb_view<unsigned char>(encoded.view()));
+		CHECK(max_difference(rgb_view<const unsigned char>(encoded.view()), rgb_view<const unsigned char>(img.view())) == 0);
+	}
+}
@@ -0,0 +1,160 @@
+///
+/// \file test_thread_pool.cpp
+/// \brief Tests of the work-stealing thread pool and parallel_for
+///
+
+#include "tests.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+///This will tell whether every item was visited exactly once
+static bool visited_once(const std::vector<unsigned int> &visits) {
+	for (size_t i = 0; i < visits.size(); ++i)
+		if (visits[i] != 1)
+			return false;
+	return true;
+}
+
+///This will run count tasks on a pool through submit and wait, task i
+///visiting item i
+///
+/// \param pool the pool
+/// \param count the number of tasks
+/// \return true if every task ran exactly once
+///
+static bool run_tasks(thread_pool &pool, unsigned int count) {
+	std::vector<unsigned int> visits(count, 0);
+	std::vector<std::function<void()> > fns;
+	for (unsigned int i = 0; i < count; ++i)
+		fns.push_back([&visits, i]() { visits[i]++; });
+	task_group group;
+	pool.submit(fns, group);
+	pool.wait(group);
+	return visited_once(visits);
+}
+
+///This will call parallel_for over items and throw from the band holding
+///item bad, after the band has visited its items
+///
+/// \param items the number of items
+/// \param bad the item whose band throws
+/// \param visits the visits of each item
+/// \return the message of the exception that came out, empty if none did
+///
+static std::string throw_from_band(unsigned int items, unsigned int bad, std::vector<unsigned int> &visits) {
+	visits.assign(items, 0);
+	try {
+		parallel_for(0, items, 1, [&](unsigned int b, unsigned int e) {
+			for (unsigned int i = b; i < e; ++i)
+				visits[i]++;
+			if (b <= bad && bad < e)
+				throw std::runtime_error("band " + std::to_string(b));
+		});
+	}
+	catch (const std::runtime_error &ex) {
+		return ex.what();
+	}
+	return std::string();
+}
+
+void test_thread_pool() {
+	for (unsigned int t = 0; t < TEST_THREAD_COUNTS; ++t) {
+		with_threads(TEST_THREADS[t], [&]() {
+			//an exception thrown by one band comes out of parallel_for once every band has finished
+			std::vector<unsigned int> visits;
+			const std::string message = throw_from_band(1000, 517, visits);
+			CHECK(message.compare(0, 5, "band ") == 0 && visited_once(visits));
+			//when every band throws, one of the exceptions comes out
+			std::atomic<unsigned int> thrown(0);
+			bool caught = false;
+			try {
+				parallel_for(0, 64, 1, [&](unsigned int, unsigned int) {
+					thrown++;
+					throw std::logic_error("every band");
+				});
+			}
+			catch (const std::logic_error &) {
+				caught = true;
+			}
+			CHECK(caught && thrown > 0);
+			//and the pool still runs work afterwards
+			visits.assign(3000, 0);
+			parallel_for(0, 3000, 7, [&](unsigned int b, unsigned int e) {
+				for (unsigned int i = b; i < e; ++i)
+					visits[i]++;
+			});
+			CHECK(visited_once(visits));
+
+			//nested parallel_for runs every inner band without deadlocking, and an inner exception reaches
+			//the outermost caller
+			visits.assign(64 * 64, 0);
+			parallel_for(0, 64, 1, [&](unsigned int b, unsigned int e) {
+				for (unsigned int i = b; i < e; ++i)
+					parallel_for(0, 64, 1, [&](unsigned int jb, unsigned int je) {
+						for (unsigned int j = jb; j < je; ++j)
+							visits[i * 64 + j]++;
+					});
+			});
+			CHECK(visited_once(visits));
+			caught = false;
+			try {
+				parallel_for(0, 16, 1, [&](unsigned int b, unsigned int e) {
+					for (unsigned int i = b; i < e; ++i)
+						parallel_for(0, 16, 1, [&](unsigned int jb, unsigned int) {
+							if (i == 9 && jb == 0)
+								throw std::runtime_error("inner");
+						});
+				});
+			}
+			catch (const std::runtime_error &ex) {
+				caught = std::string(ex.what()) == "inner";
+			}
+			CHECK(caught);
+		});
+	}
+
+	//resizing and pinning an idle pool restarts its workers, which then run work as before
+	thread_pool pool(3);
+	CHECK(pool.size() == 3 && !pool.is_pinned() && run_tasks(pool, 50));
+	const unsigned int sizes[] = { 1, 2, 5, 5, 3 };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		pool.resize(sizes[s]);
+		CHECK(pool.size() == sizes[s] && run_tasks(pool, 50));
+	}
+	pool.set_pinned(true);
+	CHECK(pool.size() == 3 && pool.is_pinned() && run_tasks(pool, 50));
+	pool.resize(4);
+	CHECK(pool.size() == 4 && pool.is_pinned() && run_tasks(pool, 50));
+	pool.set_pinned(false);
+	CHECK(pool.size() == 4 && !pool.is_pinned() && run_tasks(pool, 50));
+
+	//the first task to start holds its thread until every other task is done, which only happens if the
+	//other thread steals the tasks queued behind it
+	thread_pool pair(2);
+	std::atomic<bool> started(false);
+	std::atomic<unsigned int> done(0);
+	bool waited = false;
+	std::vector<std::function<void()> > fns;
+	for (unsigned int i = 0; i < 8; ++i) {
+		fns.push_back([&]() {
+			if (!started.exchange(true)) {
+				const std::chrono::steady_clock::time_point give_up = std::chrono::steady_clock::now()
+					+ std::chrono::seconds(10);
+				while (done < 7 && std::chrono::steady_clock::now() < give_up)
+					std::this_thread::yield();
+				waited = done == 7;
+			}
+			done++;
+		});
+	}
+	task_group group;
+	pair.submit(fns, group);
+	pair.wait(group);
+	CHECK(waited && done == 8);
+}
@@ -0,0 +1,87 @@
+///
+/// \file test_tiled.cpp
+/// \brief Tests of the tiled and Z-order planes and the blocked transposes
+///
+
+#include "tests.h"
+#include "tiled.h"
+
+///This will check that a plane converts to tiles and back unchanged, that
+///at() finds the same pixels as the view, and that transposing it moves
+///every pixel where a plain transpose does
+///
+/// \param src the plane
+///
+template <unsigned int TILE, typename Order>
+static void check_tiled(const image_view<const unsigned char> &src) {
+	tiled_plane<unsigned char, TILE, Order> tiled;
+	tiled.from_view(src);
+	CHECK(tiled.width == src.width && tiled.height == src.height);
+	bool same = true;
+	for (unsigned int y = 0; y < src.height; ++y)
+		for (unsigned int x = 0; x < src.width; ++x)
+			same = same && tiled.at(x, y) == src(x, y);
+	CHECK(same);
+
+	ppm<> back(src.width, src.height);
+	tiled.to_view(back.view(0));
+	CHECK(max_difference(back.view(0), src) == 0);
+
+	//every pixel is visited by exactly one tile
+	ppm<> visits(src.width, src.height);
+	tiled.for_each_tile([&](unsigned int, unsigned int, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h) {
+		for (unsigned int y = y0; y < y0 + h; ++y)
+			for (unsigned int x = x0; x < x0 + w; ++x)
+				visits.view(0)(x, y)++;
+	});
+	CHECK(all_equal(visits.view(0), 1));
+
+	tiled_plane<unsigned char, TILE, Order> transposed;
+	transpose(tiled, transposed);
+	CHECK(transposed.width == src.height && transposed.height == src.width);
+	same = true;
+	for (unsigned int y = 0; y < src.height; ++y)
+		for (unsigned int x = 0; x < src.width; ++x)
+			same = same && transposed.at(y, x) == src(x, y);
+	CHECK(same);
+}
+
+void test_tiled() {
+	const unsigned int sizes[][2] = { { 1, 1 }, { 8, 8 }, { 13, 7 }, { 64, 64 }, { 131, 70 } };
+	for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		const ppm<> img = random_image(sizes[s][0], sizes[s][1], 10 + s);
+		const image_view<const unsigned char> src = img.view(0);
+		check_tiled<8, row_order>(src);
+		check_tiled<8, morton_order>(src);
+		check_tiled<64, morton_order>(src);
+		check_tiled<12, row_order>(src);
+
+		//row_order tiles seen through views
+		tiled_plane<unsigned char, 8, row_order> tiled;
+		tiled.from_view(src);
+		bool same = true;
+		for (unsigned int ty = 0; ty < tiled.tiles_y; ++ty)
+			for (unsigned int tx = 0; tx < tiled.tiles_x; ++tx)
+				same = same && max_difference(tiled.tile(tx, ty), src.crop(tx * 8, ty * 8, 8, 8)) == 0;
+		CHECK(same);
+
+		//the blocked transpose and rotation of row-major views, also of a strided view
+		ppm<> out(img.height, img.width, uninitialized);
+		transpose_blocked<unsigned char, 16>(src, out.view(1));
+		rotate90_blocked<unsigned char, 16>(img.view(2), out.view(2));
+		ppm<> interleaved_out(img.height, img.width, uninitialized);
+		const ppm<unsigned char, interleaved> packed(rgb_view<const unsigned char>(img.view()), 255);
+		transpose_blocked<unsigned char, 16>(packed.view(0), interleaved_out.view(0));
+		bool transposed = true, rotated = true, strided = true;
+		for (unsigned int y = 0; y < img.height; ++y) {
+			for (unsigned int x = 0; x < img.width; ++x) {
+				transposed = transposed && out.view(1)(y, x) == src(x, y);
+				rotated = rotated && out.view(2)(img.height - 1 - y, x) == img.view(2)(x, y);
+				strided = strided && interleaved_out.view(0)(y, x) == src(x, y);
+			}
+		}
+		CHECK(transposed);
+		CHECK(rotated);
+		CHECK(strided);
+	}
+}
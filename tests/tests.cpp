@@ -0,0 +1,186 @@
+///
+/// \file tests.cpp
+/// \brief Correctness tests of the image kernels
+///
+
+#include "tests.h"
+#include "thread_pool.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+const unsigned int TEST_THREADS[] = { 1, 3, 7 };
+const unsigned int TEST_THREAD_COUNTS = sizeof(TEST_THREADS) / sizeof(TEST_THREADS[0]);
+
+//the checks that failed so far
+static unsigned int failed_checks = 0;
+
+///This will record the outcome of a check, printing it if it failed
+///
+/// \param ok true if the check passed
+/// \param what the condition checked
+/// \param file the source file of the check
+/// \param line the line of the check
+/// \return ok
+///
+bool check_that(bool ok, const char *what, const char *file, int line) {
+	if (!ok) {
+		failed_checks++;
+		std::cout << "Error. " << file << ":" << line << ": check failed: " << what << std::endl;
+	}
+	return ok;
+}
+
+///This will return the next value of a small linear congruential generator
+///
+/// \param state the generator state, advanced
+/// \return 24 random bits
+///
+static unsigned int next_random(unsigned int &state) {
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+///This will create an image of random samples
+///
+/// \param width the width in pixels
+/// \param height the height in pixels
+/// \param seed the seed; the same seed gives the same image
+/// \return the image
+///
+ppm<> random_image(unsigned int width, unsigned int height, unsigned int seed) {
+	ppm<> img(width, height, uninitialized);
+	unsigned int state = seed;
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				img.view(c)(x, y) = (unsigned char)(next_random(state) & 255);
+	return img;
+}
+
+///This will create an image of one color
+///
+/// \param width the width in pixels
+/// \param height the height in pixels
+/// \param r the red sample
+/// \param g the green sample
+/// \param b the blue sample
+/// \return the image
+///
+ppm<> constant_image(unsigned int width, unsigned int height, unsigned char r, unsigned char g, unsigned char b) {
+	ppm<> img(width, height, uninitialized);
+	const unsigned char v[3] = { r, g, b };
+	for (unsigned int c = 0; c < 3; ++c)
+		fill(img.view(c), v[c]);
+	return img;
+}
+
+///This will create an image of random float samples
+///
+/// \param width the width in pixels
+/// \param height the height in pixels
+/// \param seed the seed
+/// \param lo the smallest sample
+/// \param hi the bound above every sample
+/// \return the image
+///
+ppm<float> random_float_image(unsigned int width, unsigned int height, unsigned int seed, float lo, float hi) {
+	ppm<float> img(width, height, uninitialized);
+	unsigned int state = seed;
+	for (unsigned int c = 0; c < 3; ++c)
+		for (unsigned int y = 0; y < height; ++y)
+			for (unsigned int x = 0; x < width; ++x)
+				img.view(c)(x, y) = lo + (hi - lo) * (float)next_random(state) / 16777216.0f;
+	return img;
+}
+
+///This will tell whether every sample of a plane has one value
+///
+/// \param src the plane
+/// \param v the value
+/// \return true if no sample differs from v
+///
+bool all_equal(const image_view<const unsigned char> &src, unsigned char v) {
+	for (unsigned int y = 0; y < src.height; ++y)
+		for (unsigned int x = 0; x < src.width; ++x)
+			if (src(x, y) != v)
+				return false;
+	return true;
+}
+
+///This will run a function with the global pool resized, restoring the
+///pool's size afterwards
+///
+/// \param threads the number of threads, counting the caller
+/// \param fn the function
+///
+void with_threads(unsigned int threads, const std::function<void()> &fn) {
+	thread_pool &pool = thread_pool::global();
+	const unsigned int before = pool.size();
+	pool.resize(threads);
+	fn();
+	pool.resize(before);
+}
+
+//a suite and the name it is run by
+struct test_suite {
+	const char *name;
+	void (*run)();
+};
+
+static const test_suite suites[] = {
+	{ "blur", test_blur },
+	{ "tiled", test_tiled },
+	{ "convolve", test_convolve },
+	{ "fft", test_fft },
+	{ "resample", test_resample },
+	{ "srgb", test_srgb },
+	{ "color", test_color },
+	{ "lut", test_lut },
+	{ "histogram", test_histogram },
+	{ "median", test_median },
+	{ "bilateral", test_bilateral },
+	{ "morphology", test_morphology },
+	{ "gradient", test_gradient },
+	{ "integral", test_integral },
+	{ "palette", test_palette },
+	{ "layers", test_layers },
+	{ "components", test_components },
+	{ "fill", test_fill },
+	{ "thread_pool", test_thread_pool },
+	{ "pixel_buffer", test_pixel_buffer },
+	{ "hdr", test_hdr },
+	{ "ppm", test_ppm },
+};
+
+///This will run the suites named on the command line, or all of them
+///
+/// \param argc the number of arguments
+/// \param argv the arguments: [name ...]
+/// \return 0 if every check passed, 1 otherwise
+///
+int main(int argc, char **argv) {
+	const unsigned int count = sizeof(suites) / sizeof(suites[0]);
+	for (int i = 1; i < argc; ++i) {
+		bool known = false;
+		for (unsigned int s = 0; s < count; ++s)
+			known = known || std::string(argv[i]) == suites[s].name;
+		if (!known) {
+			std::cout << "Error. Unknown test suite \"" << argv[i] << "\"." << std::endl;
+			return 1;
+		}
+	}
+	for (unsigned int s = 0; s < count; ++s) {
+		bool selected = argc < 2;
+		for (int i = 1; i < argc; ++i)
+			selected = selected || std::string(argv[i]) == suites[s].name;
+		if (!selected)
+			continue;
+		const unsigned int before = failed_checks;
+		suites[s].run();
+		std::cout << suites[s].name << ": " << (failed_checks == before ? "ok" : "FAILED") << std::endl;
+	}
+	return failed_checks == 0 ? 0 : 1;
+}
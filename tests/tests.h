@@ -0,0 +1,134 @@
+///
+/// \file tests.h
+/// \brief Correctness tests of the image kernels
+///
+/// Run as "tests [name ...]"; with no names every suite runs.  Each suite
+/// checks its kernels against plain reference code on small images: flat
+/// images, odd and 1x1 sizes, in-place calls where the kernel allows them,
+/// and the same result on one thread and on several.  A failed check prints
+/// where it is, and the program exits with 1 if any check failed.  Timings
+/// live in the benchmarks (see bench.h), not here.
+///
+
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include "image_view.h"
+#include "ppm.h"
+
+//count a failed check and print it with its file and line
+#define CHECK(cond) check_that((cond), #cond, __FILE__, __LINE__)
+
+//record the outcome of a check; true if it passed
+bool check_that(bool ok, const char *what, const char *file, int line);
+
+//an image of samples drawn from a fixed seed, so every run sees the same pixels
+ppm<> random_image(unsigned int width, unsigned int height, unsigned int seed);
+//an image of one color
+ppm<> constant_image(unsigned int width, unsigned int height, unsigned char r, unsigned char g, unsigned char b);
+//a plane of random floats in [lo, hi) from a fixed seed
+ppm<float> random_float_image(unsigned int width, unsigned int height, unsigned int seed, float lo, float hi);
+
+//true if every sample of a plane equals v
+bool all_equal(const image_view<const unsigned char> &src, unsigned char v);
+
+//run fn with the global thread pool resized to threads threads, then restore its size
+void with_threads(unsigned int threads, const std::function<void()> &fn);
+
+//the thread counts the determinism checks compare: 1, then counts that split the rows unevenly
+extern const unsigned int TEST_THREADS[];
+extern const unsigned int TEST_THREAD_COUNTS;
+
+///This will return the largest difference between two planes
+///
+/// \param a the first plane
+/// \param b the second plane, same size as a
+/// \return the largest absolute difference of two samples
+///
+template <typename A, typename B>
+double max_difference(const image_view<A> &a, const image_view<B> &b) {
+	double diff = 0.0;
+	for (unsigned int y = 0; y < a.height; ++y)
+		for (unsigned int x = 0; x < a.width; ++x)
+			diff = std::max(diff, std::fabs((double)a(x, y) - (double)b(x, y)));
+	return diff;
+}
+template <typename A, typename B>
+double max_difference(const rgb_view<A> &a, const rgb_view<B> &b) {
+	double diff = 0.0;
+	for (unsigned int c = 0; c < 3; ++c)
+		diff = std::max(diff, max_difference(a[c], b[c]));
+	return diff;
+}
+
+///This will tell whether two images hold the same pixels
+///
+/// \param a the first image
+/// \param b the second image
+/// \return true if they have the same size and no sample differs
+///
+template <typename T, typename Layout>
+bool same_pixels(const ppm<T, Layout> &a, const ppm<T, Layout> &b) {
+	return a.width == b.width && a.height == b.height && max_difference(a.view(), b.view()) == 0;
+}
+
+///This will run a computation once with the pool at each of TEST_THREADS
+///and compare every later result to the first, so a kernel gives the same
+///however its work is spread over threads
+///
+/// \param run computes and returns the result
+/// \param same tells whether two results are equal
+/// \return true if every result equals the first
+///
+template <typename F, typename E>
+bool same_on_every_thread_count(F run, E same) {
+	std::vector<typename std::decay<decltype(run())>::type> results;
+	for (unsigned int t = 0; t < TEST_THREAD_COUNTS; ++t)
+		with_threads(TEST_THREADS[t], [&]() {
+			results.push_back(run());
+		});
+	bool all_same = true;
+	for (size_t t = 1; t < results.size(); ++t)
+		all_same = all_same && same(results[t], results[0]);
+	return all_same;
+}
+
+///This will run a computation returning an image once with the pool at each
+///of TEST_THREADS and compare the pixels of every later image to the first
+template <typename F>
+bool same_on_every_thread_count(F run) {
+	typedef typename std::decay<decltype(run())>::type image;
+	return same_on_every_thread_count(run, same_pixels<typename image::sample_type, typename image::layout_type>);
+}
+
+//the suites, one per module
+void test_blur();
+void test_tiled();
+void test_convolve();
+void test_fft();
+void test_resample();
+void test_srgb();
+void test_color();
+void test_lut();
+void test_histogram();
+void test_median();
+void test_bilateral();
+void test_morphology();
+void test_gradient();
+void test_integral();
+void test_palette();
+void test_layers();
+void test_components();
+void test_fill();
+void test_thread_pool();
+void test_pixel_buffer();
+void test_hdr();
+void test_ppm();
+
+#endif
@@ -0,0 +1,202 @@
+///
+/// \file thread_pool.cpp
+/// \brief Work-stealing thread pool
+///
+
+#include "thread_pool.h"
+#include "numa.h"
+
+//the pool and queue of the worker running on this thread, if any
+static thread_local thread_pool *current_pool = 0;
+static thread_local unsigned int current_queue = 0;
+
+///This will create a pool that uses threads threads, the thread calling
+///parallel_for included
+///
+/// \param threads the total number of threads, at least 1
+///
+thread_pool::thread_pool(unsigned int threads) : queued(0), stopping(false), pinned(false) {
+	start(threads);
+}
+
+///This will stop and join the workers
+thread_pool::~thread_pool() {
+	stop();
+}
+
+///This will return the pool parallel_for uses.  It starts with one thread
+///per hardware thread and is never destroyed, so kernels can run from
+///static destructors.
+///
+/// \return the global pool
+///
+thread_pool &thread_pool::global() {
+	static thread_pool *pool = new thread_pool(cpu_count());
+	return *pool;
+}
+
+///This will start threads - 1 workers and their queues
+///
+/// \param threads the total number of threads
+///
+void thread_pool::start(unsigned int threads) {
+	threads = threads > 0 ? threads : 1;
+	stopping = false;
+	queued = 0;
+	queues.clear();
+	for (unsigned int i = 0; i < threads; ++i)
+		queues.push_back(std::unique_ptr<task_queue>(new task_queue()));
+	for (unsigned int i = 0; i + 1 < threads; ++i)
+		workers.push_back(std::thread(&thread_pool::worker_loop, this, i));
+}
+
+///This will wake every worker, let it finish and join it
+void thread_pool::stop() {
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+	workers.clear();
+}
+
+///This will change the number of threads.  No parallel_for may be running.
+///
+/// \param threads the total number of threads, counting the caller
+///
+void thread_pool::resize(unsigned int threads) {
+	if (threads == size())
+		return;
+	stop();
+	start(threads);
+}
+
+///This will pin every worker to a CPU of its own, or unpin them.  parallel_for
+///deals consecutive bands to consecutive queues, so pinned workers process
+///the same rows on the same CPU call after call, which is what first touch
+///placement relies on.  The workers are restarted, so no parallel_for may be
+///running.
+///
+/// \param pin true to pin the workers
+///
+void thread_pool::set_pinned(bool pin) {
+	if (pin == pinned)
+		return;
+	const unsigned int threads = size();
+	stop();
+	pinned = pin;
+	start(threads);
+}
+
+///This will take the next task for a thread: the newest task of its own
+///queue, or else the oldest task of another queue
+///
+/// \param home the queue of the calling thread
+/// \param t the task taken
+/// \return true if a task was taken
+///
+bool thread_pool::pop(unsigned int home, task &t) {
+	const unsigned int n = (unsigned int)queues.size();
+	for (unsigned int k = 0; k < n; ++k) {
+		task_queue &q = *queues[(home + k) % n];
+		std::lock_guard<std::mutex> guard(q.lock);
+		if (q.tasks.empty())
+			continue;
+		if (k == 0) {
+			t = q.tasks.back();
+			q.tasks.pop_back();
+		}
+		else {
+			t = q.tasks.front();
+			q.tasks.pop_front();
+		}
+		queued--;
+		return true;
+	}
+	return false;
+}
+
+///This will run a task and mark it done in its group, keeping the first
+///exception it throws for the thread waiting on the group
+///
+/// \param t the task
+///
+void thread_pool::run(task &t) {
+	try {
+		t.fn();
+	}
+	catch (...) {
+		std::lock_guard<std::mutex> guard(t.group->error_lock);
+		if (!t.group->error)
+			t.group->error = std::current_exception();
+	}
+	t.group->remaining--;
+}
+
+///This will run tasks until the pool stops, sleeping while every queue is
+///empty
+///
+/// \param index the queue of this worker
+///
+void thread_pool::worker_loop(unsigned int index) {
+	current_pool = this;
+	current_queue = index;
+	if (pinned)
+		pin_thread_for_band(index, (unsigned int)queues.size());
+	task t;
+	for (;;) {
+		if (pop(index, t)) {
+			run(t);
+			continue;
+		}
+		std::unique_lock<std::mutex> guard(sleep_lock);
+		wake.wait(guard, [this]() { return stopping || queued > 0; });
+		if (stopping)
+			return;
+	}
+}
+
+///This will queue tasks for a group.  Consecutive tasks go to the same
+///queue, so neighboring bands tend to run on the same thread.
+///
+/// \param fns the tasks
+/// \param group the group the tasks belong to
+///
+void thread_pool::submit(std::vector<std::function<void()> > &fns, task_group &group) {
+	const unsigned int n = (unsigned int)fns.size();
+	const unsigned int nq = (unsigned int)queues.size();
+	group.remaining += n;
+	{
+		std::lock_guard<std::mutex> guard(sleep_lock);
+		queued += n;
+	}
+	for (unsigned int i = 0; i < n; ++i) {
+		task t;
+		t.fn.swap(fns[i]);
+		t.group = &group;
+		task_queue &q = *queues[(unsigned int)((unsigned long long)i * nq / n)];
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.tasks.push_back(t);
+	}
+	wake.notify_all();
+}
+
+///This will run queued tasks on the calling thread until every task of
+///the group has finished, then rethrow the first exception a task threw
+///
+/// \param group the group to wait for
+///
+void thread_pool::wait(task_group &group) {
+	const unsigned int home = current_pool == this ? current_queue : (unsigned int)queues.size() - 1;
+	task t;
+	while (group.remaining > 0) {
+		if (pop(home, t))
+			run(t);
+		else
+			std::this_thread::yield();
+	}
+	if (group.error)
+		std::rethrow_exception(group.error);
+}
@@ -0,0 +1,122 @@
+///
+/// \file thread_pool.h
+/// \brief Work-stealing thread pool and parallel_for over row bands
+///
+/// Every image kernel splits its rows (or tiles) into bands with
+/// parallel_for.  Bands are dealt out round robin to per-worker queues; a
+/// worker takes work from the back of its own queue and, when that runs
+/// dry, steals from the front of the others, so uneven bands still keep
+/// every core busy.  The thread calling parallel_for works on bands too
+/// instead of blocking, which also makes nested parallel_for calls safe.
+///
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//a set of tasks the submitting thread waits for
+struct task_group {
+	std::atomic<unsigned int> remaining;
+	std::mutex error_lock;
+	std::exception_ptr error;
+
+	task_group() : remaining(0) {}
+};
+
+class thread_pool {
+	struct task {
+		std::function<void()> fn;
+		task_group *group;
+	};
+	struct task_queue {
+		std::mutex lock;
+		std::deque<task> tasks;
+	};
+
+	//one queue per worker plus one shared by threads outside the pool
+	std::vector<std::unique_ptr<task_queue> > queues;
+	std::vector<std::thread> workers;
+	std::mutex sleep_lock;
+	std::condition_variable wake;
+	std::atomic<unsigned int> queued;
+	bool stopping;
+	bool pinned;
+
+	void start(unsigned int threads);
+	void stop();
+	void worker_loop(unsigned int index);
+	bool pop(unsigned int home, task &t);
+	void run(task &t);
+
+	thread_pool(const thread_pool &);
+	thread_pool &operator=(const thread_pool &);
+
+public:
+	//a pool using threads threads in total, counting the calling thread
+	explicit thread_pool(unsigned int threads);
+	~thread_pool();
+
+	//the pool used by parallel_for, sized to the number of hardware threads
+	static thread_pool &global();
+
+	//number of threads that work on a parallel_for, including the caller
+	unsigned int size() const { return (unsigned int)workers.size() + 1; }
+	//change the number of threads; must not be called while work is running
+	void resize(unsigned int threads);
+	//the most bands parallel_for splits a range into
+	unsigned int max_bands() const { return 4 * size(); }
+	//pin worker i to the CPU of band i of the workers, or let them float; must not be called while work is running
+	void set_pinned(bool pin);
+	bool is_pinned() const { return pinned; }
+
+	//queue tasks, dealing them out over the worker queues
+	void submit(std::vector<std::function<void()> > &fns, task_group &group);
+	//run queued tasks on the calling thread until the group is done
+	void wait(task_group &group);
+};
+
+///This will call fn(b, e) for consecutive bands [b, e) covering
+///[begin, end), spread over the global thread pool.  A band holds at least
+///grain items; there are a few bands per thread so stealing can even out
+///the load.  Exceptions thrown by fn are rethrown here.
+///
+/// \param begin the first item (row, tile, ...)
+/// \param end one past the last item
+/// \param grain the smallest band worth handing to another thread
+/// \param fn the function to call for each band
+///
+template <typename F>
+void parallel_for(unsigned int begin, unsigned int end, unsigned int grain, F fn) {
+	if (end <= begin)
+		return;
+	thread_pool &pool = thread_pool::global();
+	const unsigned int count = end - begin;
+	grain = grain > 0 ? grain : 1;
+	unsigned int bands = (count + grain - 1) / grain;
+	bands = bands < pool.max_bands() ? bands : pool.max_bands();
+	if (bands <= 1 || pool.size() == 1) {
+		fn(begin, end);
+		return;
+	}
+	std::vector<std::function<void()> > fns;
+	fns.reserve(bands);
+	for (unsigned int i = 0; i < bands; ++i) {
+		const unsigned int b = begin + (unsigned int)((unsigned long long)count * i / bands);
+		const unsigned int e = begin + (unsigned int)((unsigned long long)count * (i + 1) / bands);
+		fns.push_back([&fn, b, e]() { fn(b, e); });
+	}
+	task_group group;
+	pool.submit(fns, group);
+	pool.wait(group);
+}
+
+#endif
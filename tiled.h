@@ -0,0 +1,259 @@
+///
+/// \file tiled.h
+/// \brief Tiled and Z-order storage for image planes
+///
+/// Row-major planes make vertical passes, rotations and transposes stride
+/// through memory a full row at a time.  A tiled_plane instead stores the
+/// image as TILE x TILE blocks, each block contiguous, so a 2D neighborhood
+/// stays within a few pages and cache lines.  Inside a tile the pixels are
+/// either row-major (row_order, every tile is an image_view) or Z-order
+/// (morton_order, neighbors in both directions are close in memory).
+///
+/// Edge tiles are stored at full size; the padding is never read.
+///
+/// A tiled plane is not a ppm Layout: every kernel takes row-major
+/// image_views, which a tile order cannot provide, so tiled planes are a
+/// container converted to and from views.  The kernels get the tiling
+/// through transpose_blocked and rotate90_blocked, which walk row-major
+/// views in TILE x TILE blocks (morphology transposes this way).
+///
+
+#ifndef TILED_H
+#define TILED_H
+
+#include <algorithm>
+#include <type_traits>
+
+#include "image_view.h"
+#include "pixel_buffer.h"
+#include "thread_pool.h"
+
+//pixel order inside a tile
+struct row_order {};
+struct morton_order {};
+
+///This will spread the low 16 bits of v to the even bit positions
+///
+/// \param v the value
+/// \return the spread value
+///
+inline unsigned int spread_bits(unsigned int v) {
+	v &= 0xffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+///This will return the Z-order (Morton) index of a position
+///
+/// \param x the column
+/// \param y the row
+/// \return x and y with their bits interleaved, x in the even bits
+///
+inline unsigned int morton_index(unsigned int x, unsigned int y) {
+	return spread_bits(x) | (spread_bits(y) << 1);
+}
+
+template <typename T, unsigned int TILE = 64, typename Order = row_order>
+class tiled_plane {
+	//the Z-order of a TILE x TILE tile only fills it when TILE is a power of two
+	static_assert(!std::is_same<Order, morton_order>::value || (TILE & (TILE - 1)) == 0,
+		"a morton_order tile must be a power of two wide");
+	static_assert(TILE > 0 && TILE <= 65536, "TILE must be between 1 and 65536");
+
+	pixel_buffer<T> data;
+
+	///This will return the offset of a pixel inside its tile
+	static unsigned int in_tile(unsigned int x, unsigned int y, row_order) { return y * TILE + x; }
+	static unsigned int in_tile(unsigned int x, unsigned int y, morton_order) { return morton_index(x, y); }
+
+public:
+	static const unsigned int tile_size = TILE;
+
+	unsigned int width;
+	unsigned int height;
+	//number of tiles across and down
+	unsigned int tiles_x;
+	unsigned int tiles_y;
+
+	tiled_plane() : width(0), height(0), tiles_x(0), tiles_y(0) {}
+	tiled_plane(unsigned int _width, unsigned int _height) { resize(_width, _height); }
+
+	//change the size; the contents are left uninitialized
+	void resize(unsigned int _width, unsigned int _height) {
+		width = _width;
+		height = _height;
+		tiles_x = (width + TILE - 1) / TILE;
+		tiles_y = (height + TILE - 1) / TILE;
+		data.resize((size_t)tiles_x * tiles_y * TILE * TILE);
+	}
+
+	//the first sample of tile (tx, ty)
+	T *tile_data(unsigned int tx, unsigned int ty) { return data.data() + ((size_t)ty * tiles_x + tx) * TILE * TILE; }
+	const T *tile_data(unsigned int tx, unsigned int ty) const { return data.data() + ((size_t)ty * tiles_x + tx) * TILE * TILE; }
+
+	T &at(unsigned int x, unsigned int y) { return tile_data(x / TILE, y / TILE)[in_tile(x % TILE, y % TILE, Order())]; }
+	const T &at(unsigned int x, unsigned int y) const { return tile_data(x / TILE, y / TILE)[in_tile(x % TILE, y % TILE, Order())]; }
+
+	///This will return tile (tx, ty) as a view clipped to the image.  Only
+	///row_order planes have tiles that can be seen through a view.
+	///
+	/// \param tx the tile column
+	/// \param ty the tile row
+	/// \return the view of the tile
+	///
+	image_view<T> tile(unsigned int tx, unsigned int ty) {
+		return image_view<T>(tile_data(tx, ty), std::min(TILE, width - tx * TILE), std::min(TILE, height - ty * TILE), TILE);
+	}
+	image_view<const T> tile(unsigned int tx, unsigned int ty) const {
+		return image_view<const T>(tile_data(tx, ty), std::min(TILE, width - tx * TILE), std::min(TILE, height - ty * TILE), TILE);
+	}
+
+	///This will call fn(tx, ty, x0, y0, w, h) for every tile in storage
+	///order, where (x0, y0) is the top left pixel of the tile and w x h
+	///its size after clipping to the image
+	///
+	/// \param fn the function to call
+	///
+	template <typename F>
+	void for_each_tile(F fn) const {
+		for (unsigned int ty = 0; ty < tiles_y; ++ty)
+			for (unsigned int tx = 0; tx < tiles_x; ++tx)
+				fn(tx, ty, tx * TILE, ty * TILE, std::min(TILE, width - tx * TILE), std::min(TILE, height - ty * TILE));
+	}
+
+	///This will call fn like for_each_tile, with the tiles spread over the
+	///thread pool.  fn must be safe to call for different tiles at once.
+	///
+	/// \param fn the function to call
+	///
+	template <typename F>
+	void parallel_for_each_tile(F fn) const {
+		parallel_for(0, tiles_x * tiles_y, 1, [&](unsigned int t0, unsigned int t1) {
+			for (unsigned int t = t0; t < t1; ++t) {
+				const unsigned int tx = t % tiles_x;
+				const unsigned int ty = t / tiles_x;
+				fn(tx, ty, tx * TILE, ty * TILE, std::min(TILE, width - tx * TILE), std::min(TILE, height - ty * TILE));
+			}
+		});
+	}
+
+	///This will fill the plane from a row-major view of the same size, one
+	///tile at a time so both sides stay cache resident
+	///
+	/// \param src the view to copy from
+	///
+	void from_view(const image_view<const T> &src) {
+		resize(src.width, src.height);
+		parallel_for_each_tile([&](unsigned int tx, unsigned int ty, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h) {
+			T *dst = tile_data(tx, ty);
+			for (unsigned int y = 0; y < h; ++y) {
+				const T *in = &src(x0, y0 + y);
+				for (unsigned int x = 0; x < w; ++x)
+					dst[in_tile(x, y, Order())] = in[(size_t)x * src.step];
+			}
+		});
+	}
+
+	///This will copy the plane into a row-major view of the same size
+	///
+	/// \param dst the view to copy to
+	///
+	void to_view(const image_view<T> &dst) const {
+		parallel_for_each_tile([&](unsigned int tx, unsigned int ty, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h) {
+			const T *src = tile_data(tx, ty);
+			for (unsigned int y = 0; y < h; ++y) {
+				T *out = &dst(x0, y0 + y);
+				for (unsigned int x = 0; x < w; ++x)
+					out[(size_t)x * dst.step] = src[in_tile(x, y, Order())];
+			}
+		});
+	}
+};
+
+///This will transpose a tiled plane.  Tile (tx, ty) of the source becomes
+///tile (ty, tx) of the result and is transposed entirely in cache.
+///
+/// \param src the plane to transpose
+/// \param dst the transposed plane
+///
+template <typename T, unsigned int TILE, typename Order>
+void transpose(const tiled_plane<T, TILE, Order> &src, tiled_plane<T, TILE, Order> &dst) {
+	dst.resize(src.height, src.width);
+	src.parallel_for_each_tile([&](unsigned int, unsigned int, unsigned int x0, unsigned int y0, unsigned int w, unsigned int h) {
+		for (unsigned int y = 0; y < h; ++y)
+			for (unsigned int x = 0; x < w; ++x)
+				dst.at(y0 + y, x0 + x) = src.at(x0 + x, y0 + y);
+	});
+}
+
+///This will transpose a row-major view into another, walking both in
+///TILE x TILE blocks so neither side strides through memory a row at a time
+///
+/// \param src the view to transpose
+/// \param dst the transposed view, src.height wide and src.width high
+///
+template <typename T, unsigned int TILE>
+void transpose_blocked(const image_view<const T> &src, const image_view<T> &dst) {
+	const unsigned int blocks = (src.height + TILE - 1) / TILE;
+	parallel_for(0, blocks, 1, [&](unsigned int b0, unsigned int b1) {
+		for (unsigned int y0 = b0 * TILE; y0 < std::min(src.height, b1 * TILE); y0 += TILE) {
+			for (unsigned int x0 = 0; x0 < src.width; x0 += TILE) {
+				const unsigned int y1 = std::min(src.height, y0 + TILE);
+				const unsigned int x1 = std::min(src.width, x0 + TILE);
+				for (unsigned int x = x0; x < x1; ++x) {
+					T *out = &dst(y0, x);
+					for (unsigned int y = y0; y < y1; ++y)
+						out[(size_t)(y - y0) * dst.step] = src(x, y);
+				}
+			}
+		}
+	});
+}
+
+///This will rotate a row-major view by 90 degrees clockwise, blocked like
+///transpose_blocked
+///
+/// \param src the view to rotate
+/// \param dst the rotated view, src.height wide and src.width high
+///
+template <typename T, unsigned int TILE>
+void rotate90_blocked(const image_view<const T> &src, const image_view<T> &dst) {
+	const unsigned int blocks = (src.height + TILE - 1) / TILE;
+	parallel_for(0, blocks, 1, [&](unsigned int b0, unsigned int b1) {
+		for (unsigned int y0 = b0 * TILE; y0 < std::min(src.height, b1 * TILE); y0 += TILE) {
+			for (unsigned int x0 = 0; x0 < src.width; x0 += TILE) {
+				const unsigned int y1 = std::min(src.height, y0 + TILE);
+				const unsigned int x1 = std::min(src.width, x0 + TILE);
+				for (unsigned int x = x0; x < x1; ++x)
+					for (unsigned int y = y0; y < y1; ++y)
+						dst(src.height - 1 - y, x) = src(x, y);
+			}
+		}
+	});
+}
+
+///The three channels of an RGB image stored as tiled planes
+template <typename T, unsigned int TILE = 64, typename Order = row_order>
+struct tiled_rgb {
+	tiled_plane<T, TILE, Order> planes[3];
+
+	tiled_rgb() {}
+	tiled_rgb(const rgb_view<const T> &src) { from_view(src); }
+
+	unsigned int width() const { return planes[0].width; }
+	unsigned int height() const { return planes[0].height; }
+
+	void from_view(const rgb_view<const T> &src) {
+		for (unsigned int c = 0; c < 3; ++c)
+			planes[c].from_view(src[c]);
+	}
+	void to_view(const rgb_view<T> &dst) const {
+		for (unsigned int c = 0; c < 3; ++c)
+			planes[c].to_view(dst[c]);
+	}
+};
+
+#endif